@@ -0,0 +1,433 @@
+#include "benchmark.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QImage>
+#include <QGLPixelBuffer>
+#include <QGLFramebufferObject>
+
+#include <algorithm>
+#include <vector>
+
+#include "openglrenderer.h"
+#include "clusteredrenderer.h"
+#include "softwarerenderer.h"
+#include "shadermanager.h"
+#include "scene.h"
+#include "mesh.h"
+#include "stagingbuffer.h"
+#include "utils/glutils.h"
+#include "utils/kernels.h"
+#include "utils/timer.h"
+#include "utils/trace.h"
+
+static const char *modeName(RenderMode mode) {
+    switch (mode) {
+    case RENDER_MODE_WIREFRAME: return "wireframe";
+    case RENDER_MODE_PHONG: return "phong";
+    case RENDER_MODE_SHADED_WIREFRAME: return "shaded_wireframe";
+    default: return "default";
+    }
+}
+
+Benchmark::Benchmark(QString filename)
+    : m_filename(filename), m_width(BENCHMARK_WIDTH), m_height(BENCHMARK_HEIGHT),
+      m_frames(BENCHMARK_FRAMES), m_maxLevel(BENCHMARK_LEVELS), m_copies(1), m_lights(0), m_lods(false), m_budget(0), m_software(false),
+      m_pbuffer(0), m_fbo(0)
+{
+}
+
+QString Benchmark::usage() {
+    return "usage: viewer --benchmark <file.obj> [--frames N] [--levels N] [--size WxH] [--copies N] [--lights N] [--lods 0|1] [--budget MS] [--dump DIR] [--trace FILE] [--renderer opengl|software]";
+}
+
+bool Benchmark::parseArguments(QStringList args) {
+    for (int i = 0; i < args.size(); i++) {
+        QString option = args[i];
+        if (!option.startsWith("--") || option == "--benchmark") continue;
+        if (i + 1 >= args.size()) return false;
+
+        QString value = args[++i];
+        bool ok = true;
+        if (option == "--frames") {
+            m_frames = value.toInt(&ok);
+        } else if (option == "--levels") {
+            m_maxLevel = value.toInt(&ok);
+        } else if (option == "--size") {
+            QStringList size = value.split("x");
+            if (size.size() != 2) return false;
+            bool okWidth, okHeight;
+            setFrameSize(size[0].toInt(&okWidth), size[1].toInt(&okHeight));
+            ok = okWidth && okHeight;
+        } else if (option == "--copies") {
+            m_copies = value.toInt(&ok);
+        } else if (option == "--lights") {
+            m_lights = value.toInt(&ok);
+        } else if (option == "--lods") {
+            m_lods = value.toInt(&ok) != 0;
+        } else if (option == "--budget") {
+            m_budget = value.toDouble(&ok);
+        } else if (option == "--dump") {
+            m_dumpDir = value;
+        } else if (option == "--trace") {
+            m_traceFile = value;
+        } else if (option == "--renderer") {
+            if (value != "opengl" && value != "software") return false;
+            m_software = value == "software";
+        } else {
+            return false;
+        }
+
+        if (!ok) return false;
+    }
+
+    //the light rig is only shaded by the clustered renderer
+    if (m_software && m_lights > 0) return false;
+
+    return m_frames > 0 && m_maxLevel >= 0 && m_copies > 0 && m_lights >= 0 && m_budget >= 0 && m_width > 0 && m_height > 0;
+}
+
+void Benchmark::setFrameSize(int width, int height) {
+    m_width = width;
+    m_height = height;
+}
+
+void Benchmark::setNumFrames(int frames) { m_frames = frames; }
+void Benchmark::setMaxLevel(int level) { m_maxLevel = level; }
+void Benchmark::setCopies(int copies) { m_copies = copies; }
+void Benchmark::setLights(int lights) { m_lights = lights; }
+void Benchmark::setLevelsOfDetail(bool enabled) { m_lods = enabled; }
+void Benchmark::setFrameBudget(double ms) { m_budget = ms; }
+void Benchmark::setDumpDirectory(QString dir) { m_dumpDir = dir; }
+void Benchmark::setTraceFile(QString filename) { m_traceFile = filename; }
+void Benchmark::setSoftware(bool software) { m_software = software; }
+
+bool Benchmark::run(QTextStream &out) {
+#ifdef VIEWER_TRACING
+    if (!m_traceFile.isEmpty())
+        Trace::setEnabled(true);
+#else
+    if (!m_traceFile.isEmpty())
+        out << "warning: tracing is not compiled in, rebuild with qmake CONFIG+=tracing" << endl;
+#endif
+
+    //create an offscreen surface and make its context current
+    m_pbuffer = new QGLPixelBuffer(QSize(m_width, m_height), QGLFormat::defaultFormat());
+    if (!m_pbuffer->isValid()) {
+        out << "error: unable to create an offscreen GL surface" << endl;
+        delete m_pbuffer;
+        m_pbuffer = 0;
+        return false;
+    }
+    m_pbuffer->makeCurrent();
+
+    //render into a framebuffer object when supported, otherwise into the pbuffer itself
+    if (QGLFramebufferObject::hasOpenGLFramebufferObjects()) {
+        m_fbo = new QGLFramebufferObject(m_width, m_height, QGLFramebufferObject::Depth);
+        m_fbo->bind();
+    }
+
+    out << "renderer: " << (const char*)glGetString(GL_RENDERER) << endl;
+    out << "version: " << (const char*)glGetString(GL_VERSION) << endl;
+    out << "kernels: " << kernelInstructionSet() << endl;
+    out << "target: " << (m_fbo ? "framebuffer object" : "pbuffer")
+        << " " << m_width << "x" << m_height << endl;
+
+    //the renderers free their GL resources while the context is still there
+    bool rendered = renderMesh(out);
+
+    if (m_fbo) m_fbo->release();
+    m_pbuffer->doneCurrent();
+
+    delete m_fbo;
+    delete m_pbuffer;
+    m_fbo = 0;
+    m_pbuffer = 0;
+    if (!rendered) return false;
+
+#ifdef VIEWER_TRACING
+    if (!m_traceFile.isEmpty()) {
+        Trace::setEnabled(false);
+        if (!Trace::save(m_traceFile)) {
+            out << "error: unable to save trace to " << m_traceFile << endl;
+            return false;
+        }
+        out << "trace: " << m_traceFile << endl;
+    }
+#endif
+
+    return true;
+}
+
+bool Benchmark::renderMesh(QTextStream &out) {
+    //a rig of many lights needs the clustered renderer
+    OpenGLRenderer openGLRenderer;
+    ClusteredRenderer clusteredRenderer;
+    SoftwareRenderer softwareRenderer;
+    OpenGLRenderer &glRenderer = m_lights > 0 ? clusteredRenderer : openGLRenderer;
+    Renderer *renderer = m_software ? (Renderer*)&softwareRenderer : (Renderer*)&glRenderer;
+    renderer->init(m_width, m_height);
+    if (m_software)
+        out << "rasterizer: software " << softwareRenderer.getNumThreads() << " threads" << endl;
+    if (m_lights > 0) {
+        clusteredRenderer.setLightRig(m_lights);
+        out << "lights: " << clusteredRenderer.getNumLights() << " "
+            << (clusteredRenderer.isClustering() ? "clustered" : "unclustered") << endl;
+    }
+
+    //load mesh in the phases of the viewer, which shows a preview before the topology is built
+    Timer timer;
+    ObjData data;
+    MeshPtr mesh;
+    if (Mesh::parseObjFile(m_filename, data)) {
+        Mesh::unitize(data.positions);
+        double parseMs = timer.elapsed();
+
+        //time to the first frame of the preview
+        Scene preview;
+        preview.setMesh(MeshPtr(Mesh::previewFromObjData(data)));
+        renderer->setScene(&preview);
+        renderer->render();
+        glFinish();
+        double previewMs = timer.elapsed();
+
+        //the loader builds the picking hierarchy with the topology
+        mesh = MeshPtr(Mesh::fromObjData(data));
+        if (mesh) {
+            mesh->buildBvh();
+            out << "load: " << m_filename << " " << timer.elapsed() << " ms" << endl;
+            out << "load phases: parse " << parseMs << " ms first_frame " << previewMs
+                << " ms topology " << timer.elapsed() - previewMs << " ms" << endl;
+        }
+    }
+
+    if (!mesh) {
+        out << "error: unable to load " << m_filename << endl;
+        return false;
+    }
+    data = ObjData();
+
+    Scene scene;
+    scene.setMesh(mesh);
+    if (m_copies > 1) {
+        scene.setCopies(m_copies);
+        out << "copies: " << m_copies << endl;
+    }
+    renderer->setScene(&scene);
+
+    //every level is filled through the same staging buffer, as in the upload thread of the viewer
+    StagingBuffer *staging = 0;
+    if (glInitBufferObjects() && glHasBufferCopies() && glHasFences()) staging = new StagingBuffer();
+
+    RenderMode modes[] = {RENDER_MODE_DEFAULT, RENDER_MODE_WIREFRAME, RENDER_MODE_PHONG, RENDER_MODE_SHADED_WIREFRAME};
+    for (uint level = 0; level <= (uint)m_maxLevel; level++) {
+        //levels of detail are built separately so subdividing is timed alone
+        scene.setLevelsOfDetail(false);
+        timer.start();
+        scene.subdivide(level);
+        out << "subdivide: level " << level << " " << timer.elapsed() << " ms" << endl;
+        if (m_lods) {
+            timer.start();
+            scene.setLevelsOfDetail(true);
+            scene.waitForLods();
+            out << "lods: level " << level << " build " << timer.elapsed() << " ms" << endl;
+        }
+        reportBuffers(&scene, staging, out, level);
+
+        for (uint i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+            renderOrbit(renderer, out, level, modes[i]);
+
+        //the software renderer draws every frame at full quality
+        if (m_budget > 0 && !m_software)
+            renderInteractiveOrbit(&glRenderer, out, level);
+        if (m_lods && !m_software)
+            reportLods(&scene, &glRenderer, out, level);
+
+        reportMemory(&scene, out, level);
+    }
+
+    //lights per cluster are what the fragments of Phong shading loop over
+    if (m_lights > 0 && clusteredRenderer.isClustering()) {
+        uint clusters = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+        out << "clusters: " << clusters << " light_indices " << clusteredRenderer.getNumLightIndices()
+            << " per_cluster " << (double)clusteredRenderer.getNumLightIndices() / clusters << endl;
+    }
+
+    //programs are built when first drawn with, from the binary cache of an earlier run when possible
+    if (!m_software) {
+        ShaderManager *shaders = glRenderer.getShaderManager();
+        out << "shaders: compiled " << shaders->getNumCompiled() << " cached " << shaders->getNumCached()
+            << " " << shaders->getBuildMs() << " ms" << endl;
+    }
+
+    delete staging;
+    return true;
+}
+
+void Benchmark::renderOrbit(Renderer *renderer, QTextStream &out, uint level, RenderMode mode) {
+    renderer->setRenderMode(mode);
+
+    //draw one untimed frame so buffer creation is not counted as a frame
+    renderer->render();
+    glFinish();
+    if (!m_dumpDir.isEmpty())
+        dumpFrame(level, mode);
+
+    //orbit the camera once around the mesh
+    Camera camera = renderer->getCamera();
+    vector<double> times;
+    for (int i = 0; i < m_frames; i++) {
+        camera.setAzimuth(360.0 * i / m_frames);
+        renderer->setCamera(camera);
+
+        Timer timer;
+        renderer->render();
+        glFinish();
+        times.push_back(timer.elapsed());
+
+        out << "frame: level " << level << " " << modeName(mode) << " " << i
+            << " " << times.back() << " ms" << endl;
+    }
+
+    //summarize frame times
+    sort(times.begin(), times.end());
+    double total = 0;
+    for (uint i = 0; i < times.size(); i++) total += times[i];
+    out << "summary: level " << level << " " << modeName(mode)
+        << " min " << times.front() << " ms"
+        << " median " << times[times.size()/2] << " ms"
+        << " mean " << total / times.size() << " ms"
+        << " max " << times.back() << " ms" << endl;
+}
+
+void Benchmark::renderInteractiveOrbit(OpenGLRenderer *renderer, QTextStream &out, uint level) {
+    renderer->setRenderMode(RENDER_MODE_DEFAULT);
+    renderer->setFrameBudget(m_budget);
+    renderer->setInteractive(true);
+
+    //the renderer times each frame itself and draws the next one coarser or finer
+    Camera camera = renderer->getCamera();
+    vector<double> times;
+    uint reduction = 0;
+    float resolution = 1;
+    for (int i = 0; i < m_frames; i++) {
+        camera.setAzimuth(360.0 * i / m_frames);
+        renderer->setCamera(camera);
+
+        Timer timer;
+        renderer->render();
+        glFinish();
+        times.push_back(timer.elapsed());
+        reduction = max(reduction, renderer->getReduction());
+        resolution = min(resolution, renderer->getResolutionScale());
+
+        out << "interactive: level " << level << " " << i << " " << times.back() << " ms reduction "
+            << renderer->getReduction() << " resolution " << renderer->getResolutionScale() << endl;
+    }
+
+    //after the drag each frame is a level finer, until full quality
+    renderer->setInteractive(false);
+    uint refining = 0;
+    Timer timer;
+    while (renderer->isRefining()) {
+        renderer->render();
+        glFinish();
+        refining++;
+    }
+    double refineMs = timer.elapsed();
+
+    sort(times.begin(), times.end());
+    out << "summary: level " << level << " interactive budget " << m_budget << " ms"
+        << " median " << times[times.size()/2] << " ms"
+        << " max " << times.back() << " ms"
+        << " over " << (times.end() - upper_bound(times.begin(), times.end(), m_budget))
+        << " max_reduction " << reduction << " min_resolution " << resolution
+        << " refine " << refining << " frames " << refineMs << " ms" << endl;
+}
+
+void Benchmark::reportLods(Scene *scene, OpenGLRenderer *renderer, QTextStream &out, uint level) {
+    //the level drawn is the one chosen for the last frame of the orbit
+    const QList<MeshLod> &lods = scene->getLods(0);
+    for (int i = 0; i < lods.size(); i++) {
+        out << "lod: level " << level << " " << i
+            << " triangles " << lods[i].mesh->numDrawVertices() / 3
+            << " error " << lods[i].error
+            << (renderer->getLodLevel(0) == (uint)i ? " drawn" : "") << endl;
+    }
+}
+
+void Benchmark::reportMemory(Scene *scene, QTextStream &out, uint level) {
+    MemoryUsage usage = scene->memoryUsage();
+    out << "memory: level " << level
+        << " geometry " << usage.geometry
+        << " topology " << usage.topology
+        << " lookup_maps " << usage.lookupMaps
+        << " scratch " << usage.scratch
+        << " cpu_buffers " << usage.cpuBuffers
+        << " gpu_buffers " << usage.gpuBuffers
+        << " picking " << usage.picking
+        << " total " << usage.total() << " bytes" << endl;
+
+    ArenaStats stats = scene->allocationStats();
+    out << "allocations: level " << level
+        << " count " << stats.allocations
+        << " allocated " << stats.bytesAllocated
+        << " reserved " << stats.bytesReserved << " bytes" << endl;
+}
+
+void Benchmark::reportBuffers(Scene *scene, StagingBuffer *staging, QTextStream &out, uint level) {
+    if (!glInitBufferObjects()) {
+        out << "buffers: level " << level << " buffer objects unsupported" << endl;
+        return;
+    }
+
+    //the buffers are deleted again, the frames are drawn from system memory as before
+    Timer timer;
+    size_t bytes = 0;
+    bool mapped = true;
+    for (uint i = 0; i < scene->getNumMeshes() && mapped; i++) {
+        ConstMeshPtr mesh = scene->getDisplayedMesh(i);
+        int size = sizeof(DrawVertex) * mesh->numDrawVertices();
+        QGLBuffer buffer(QGLBuffer::VertexBuffer);
+        buffer.setUsagePattern(QGLBuffer::StaticDraw);
+        if (!buffer.create() || !buffer.bind()) {
+            mapped = false;
+            break;
+        }
+        buffer.allocate(size);
+
+        if (staging && staging->isValid()) {
+            buffer.release();
+            uint n = mesh->numDrawVertices();
+            for (uint begin = 0, end = 0; begin < n && mapped; begin = end) {
+                end = mesh->drawSliceEnd(begin, staging->sliceVertices());
+                mapped = staging->write(mesh.data(), buffer.bufferId(), begin, end);
+            }
+        } else {
+            DrawVertex *vertices = size > 0 ? (DrawVertex*)glMapWriteBuffer(GL_ARRAY_BUFFER, size) : 0;
+            mapped = size == 0 || vertices;
+            if (vertices) {
+                mesh->fillDrawBuffer(vertices);
+                mapped = glUnmapWriteBuffer(GL_ARRAY_BUFFER);
+            }
+            buffer.release();
+        }
+        bytes += size;
+    }
+    glFinish();
+
+    const char *path = staging && staging->isValid() ? "staged_fill " : "mapped_fill ";
+    if (mapped)
+        out << "buffers: level " << level << " " << path << timer.elapsed() << " ms " << bytes << " bytes" << endl;
+    else
+        out << "buffers: level " << level << " mapping unsupported" << endl;
+}
+
+void Benchmark::dumpFrame(uint level, RenderMode mode) {
+    QDir dir(m_dumpDir);
+    if (!dir.exists()) dir.mkpath(".");
+
+    QString name = QString("%1_L%2_%3.png").arg(QFileInfo(m_filename).baseName()).arg(level).arg(modeName(mode));
+    QImage image = m_fbo ? m_fbo->toImage() : m_pbuffer->toImage();
+    image.save(dir.filePath(name));
+}
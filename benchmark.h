@@ -0,0 +1,89 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+
+#include "renderer.h"
+
+class OpenGLRenderer;
+class QGLPixelBuffer;
+class QGLFramebufferObject;
+class StagingBuffer;
+
+#define BENCHMARK_WIDTH 512
+#define BENCHMARK_HEIGHT 512
+#define BENCHMARK_FRAMES 36
+#define BENCHMARK_LEVELS 3
+
+/* Offscreen rendering benchmark. Loads an OBJ file into an offscreen GL surface,
+   orbits the camera around it in every render mode and subdivision level, and
+   reports the time taken by each frame. Works without a GPU on a software GL
+   driver such as Mesa llvmpipe.*/
+class Benchmark {
+    public:
+        Benchmark(QString filename);
+
+        //parses benchmark options from the command line, returns false on bad options
+        bool parseArguments(QStringList args);
+
+        //runs the benchmark and writes the results to out, returns false on failure
+        bool run(QTextStream &out);
+
+        void setFrameSize(int width, int height);
+        void setNumFrames(int frames);
+        void setMaxLevel(int level);
+        void setCopies(int copies);
+        void setLights(int lights);
+        void setLevelsOfDetail(bool enabled);
+        void setFrameBudget(double ms);
+        void setDumpDirectory(QString dir);
+        void setTraceFile(QString filename);
+        void setSoftware(bool software);
+
+        //returns the usage message of the command line options
+        static QString usage();
+
+    private:
+        //loads the mesh and renders every orbit in the current context, returns false if it does not load
+        bool renderMesh(QTextStream &out);
+
+        //renders and times the camera orbit for the current level and render mode
+        void renderOrbit(Renderer *renderer, QTextStream &out, uint level, RenderMode mode);
+
+        //orbits the camera as a drag would, with the renderer keeping frames within the budget, then times the
+        //frames refining back to full quality
+        void renderInteractiveOrbit(OpenGLRenderer *renderer, QTextStream &out, uint level);
+
+        //prints the triangles and error of each level of detail of the first mesh, and the one drawn
+        void reportLods(Scene *scene, OpenGLRenderer *renderer, QTextStream &out, uint level);
+
+        //prints the memory used by the scene at the current level
+        void reportMemory(Scene *scene, QTextStream &out, uint level);
+
+        //times filling the draw buffers of the displayed meshes into buffer objects, as the viewer uploads them
+        //through the staging buffer, or straight into the mapped buffers if staging is 0 or not valid
+        void reportBuffers(Scene *scene, StagingBuffer *staging, QTextStream &out, uint level);
+
+        //saves the current frame to the dump directory
+        void dumpFrame(uint level, RenderMode mode);
+
+        QString m_filename;
+        int m_width;
+        int m_height;
+        int m_frames;
+        int m_maxLevel;
+        int m_copies;
+        int m_lights;   //lights of the rig shaded by the clustered renderer, 0 for the OpenGL renderer
+        bool m_lods;    //draws reduced meshes where their detail is too small to see
+        double m_budget;    //milliseconds of the frames of an interactive orbit, 0 for none
+        QString m_dumpDir;
+        QString m_traceFile;
+        bool m_software;    //draws with the software rasterizer instead of OpenGL
+
+        QGLPixelBuffer *m_pbuffer;
+        QGLFramebufferObject *m_fbo;
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,249 @@
+#include "bufferuploader.h"
+#include "stagingbuffer.h"
+
+#include "utils/glutils.h"
+#include "utils/trace.h"
+
+//bytes written into a buffer object between two checks for a stop request
+#define UPLOAD_SLICE_BYTES (1 << 20)
+
+BufferUploader::BufferUploader(QGLWidget *shareWidget, QObject *parent)
+    : QThread(parent), m_staging(0), m_stop(false)
+{
+    //a context is current in one thread at a time, so it is released here and made current in run
+    m_context = new QGLWidget(0, shareWidget);
+    m_valid = m_context->isValid() && m_context->isSharing();
+    m_context->doneCurrent();
+#if QT_VERSION >= 0x040800
+    m_context->context()->moveToThread(this);
+#endif
+    shareWidget->makeCurrent();
+
+    //the entry points are the same for the whole share group
+    m_valid = m_valid && glInitBufferObjects();
+}
+
+BufferUploader::~BufferUploader() {
+    m_mutex.lock();
+    m_stop = true;
+    m_wake.wakeAll();
+    m_mutex.unlock();
+    wait();
+
+    //the thread released the buffers before it finished
+    for (int i = 0; i < m_uploads.size(); i++)
+        delete m_uploads[i];
+    delete m_context;
+}
+
+bool BufferUploader::isValid() const {
+    return m_valid;
+}
+
+bool BufferUploader::prepare(ConstMeshPtr mesh) {
+    if (mesh->hasGpuBuffers()) return true;
+
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < m_uploads.size(); i++) {
+        Upload *upload = m_uploads[i];
+
+        //a destroyed mesh may have left an upload for the same address
+        if (upload->key != mesh.data() || upload->mesh.isNull()) continue;
+        if (!upload->written) return false;
+
+        //meshes whose buffer could not be created keep drawing from system memory
+        if (upload->failed) return true;
+
+        //the fence signals once the writes of the upload thread were executed
+        if (upload->fence) {
+            if (!glFenceSignaled(upload->fence)) return false;
+            glDeleteFence(upload->fence);
+            upload->fence = 0;
+        }
+
+        GpuBuffers buffers;
+        buffers.vertices = upload->buffer->bufferId();
+        if (upload->edgeBuffer) {
+            buffers.positions = upload->positionBuffer->bufferId();
+            buffers.edges = upload->edgeBuffer->bufferId();
+        }
+        mesh->setGpuBuffers(buffers);
+        upload->switched = true;
+        return true;
+    }
+
+    Upload *upload = new Upload();
+    upload->mesh = mesh;
+    upload->key = mesh.data();
+    upload->buffer = upload->positionBuffer = upload->edgeBuffer = 0;
+    upload->fence = 0;
+    upload->written = false;
+    upload->failed = false;
+    upload->switched = false;
+    m_uploads.append(upload);
+    m_queue.append(upload);
+    m_wake.wakeOne();
+    return false;
+}
+
+bool BufferUploader::hasPendingFences() {
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < m_uploads.size(); i++) {
+        const Upload *upload = m_uploads[i];
+        if (upload->written && !upload->failed && !upload->switched && !upload->mesh.isNull())
+            return true;
+    }
+    return false;
+}
+
+void BufferUploader::run() {
+    m_context->makeCurrent();
+
+    //the staging buffer lives as long as the thread, so every level is written into the same memory
+    if (glHasBufferCopies() && glHasFences()) {
+        m_staging = new StagingBuffer();
+        if (!m_staging->isValid()) {
+            delete m_staging;
+            m_staging = 0;
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    while (!m_stop) {
+        //buffers of destroyed meshes are deleted whenever the thread wakes up
+        for (int i = m_uploads.size() - 1; i >= 0; i--) {
+            Upload *upload = m_uploads[i];
+            if (!upload->mesh.isNull()) continue;
+
+            m_queue.removeAll(upload);
+            m_uploads.removeAt(i);
+            release(upload);
+            delete upload;
+        }
+
+        if (m_queue.isEmpty()) {
+            m_wake.wait(&m_mutex);
+            continue;
+        }
+
+        //keep the mesh alive while its buffers are written
+        Upload *upload = m_queue.takeFirst();
+        ConstMeshPtr mesh = upload->mesh.toStrongRef();
+        if (mesh.isNull()) continue;
+
+        locker.unlock();
+        bool written = this->upload(upload, mesh);
+        mesh.clear();
+        locker.relock();
+        if (m_stop) break;
+
+        upload->written = true;
+        upload->failed = !written;
+
+        locker.unlock();
+        emit uploaded();
+        locker.relock();
+    }
+
+    for (int i = 0; i < m_uploads.size(); i++)
+        release(m_uploads[i]);
+    locker.unlock();
+
+    delete m_staging;
+    m_staging = 0;
+
+    m_context->doneCurrent();
+}
+
+bool BufferUploader::upload(Upload *upload, ConstMeshPtr mesh) {
+    TRACE_SCOPE("BufferUploader::upload");
+
+    int bytes = sizeof(DrawVertex) * mesh->numDrawVertices();
+    upload->buffer = createBuffer(QGLBuffer::VertexBuffer, bytes);
+    if (!upload->buffer) return false;
+
+    //without a staging buffer the threads filling the buffer write its storage directly
+    DrawVertex *mapped = !m_staging && bytes > 0 ? (DrawVertex*)glMapWriteBuffer(GL_ARRAY_BUFFER, bytes) : 0;
+    if (m_staging) {
+        //slices are filled into the staging buffer and copied into the new buffer on the GPU
+        upload->buffer->release();
+        uint n = mesh->numDrawVertices();
+        for (uint begin = 0, end = 0; begin < n && !isStopping(); begin = end) {
+            end = mesh->drawSliceEnd(begin, m_staging->sliceVertices());
+            if (!m_staging->write(mesh.data(), upload->buffer->bufferId(), begin, end)) return false;
+        }
+    } else if (mapped) {
+        mesh->fillDrawBuffer(mapped);
+        bool kept = glUnmapWriteBuffer(GL_ARRAY_BUFFER);
+        upload->buffer->release();
+        if (!kept) return false;
+    } else {
+        //write a temporary copy in slices, so a stop request does not wait for a whole level
+        vector<DrawVertex> vertices(mesh->numDrawVertices());
+        if (!vertices.empty()) mesh->fillDrawBuffer(&vertices[0]);
+        const char *data = (const char*)(vertices.empty() ? 0 : &vertices[0]);
+        for (int offset = 0; offset < bytes && !isStopping(); offset += UPLOAD_SLICE_BYTES)
+            upload->buffer->write(offset, data + offset, qMin(UPLOAD_SLICE_BYTES, bytes - offset));
+        upload->buffer->release();
+    }
+
+    //the edges index the positions of the mesh, which are copied as they are
+    if (mesh->hasEdges() && !isStopping()) {
+        upload->positionBuffer = createBuffer(QGLBuffer::VertexBuffer, 0);
+        if (!upload->positionBuffer) return false;
+        upload->positionBuffer->allocate(mesh->getPositions(), sizeof(Vector3f) * mesh->numPositions());
+        upload->positionBuffer->release();
+
+        int edgeBytes = sizeof(uint) * mesh->numEdgeIndices();
+        upload->edgeBuffer = createBuffer(QGLBuffer::IndexBuffer, edgeBytes);
+        if (!upload->edgeBuffer) return false;
+        uint *indices = (uint*)glMapWriteBuffer(GL_ELEMENT_ARRAY_BUFFER, edgeBytes);
+        if (indices) {
+            mesh->fillEdgeIndices(indices);
+            bool kept = glUnmapWriteBuffer(GL_ELEMENT_ARRAY_BUFFER);
+            upload->edgeBuffer->release();
+            if (!kept) return false;
+        } else {
+            vector<uint> edges(mesh->numEdgeIndices());
+            mesh->fillEdgeIndices(&edges[0]);
+            upload->edgeBuffer->write(0, &edges[0], edgeBytes);
+            upload->edgeBuffer->release();
+        }
+    }
+
+    //without fences the render thread cannot tell when the writes are done, so wait for them here
+    upload->fence = glInsertFence();
+    if (upload->fence)
+        glFlush();
+    else
+        glFinish();
+    return true;
+}
+
+QGLBuffer *BufferUploader::createBuffer(QGLBuffer::Type type, int bytes) {
+    QGLBuffer *buffer = new QGLBuffer(type);
+    buffer->setUsagePattern(QGLBuffer::StaticDraw);
+    if (!buffer->create() || !buffer->bind()) {
+        delete buffer;
+        return 0;
+    }
+    if (bytes > 0) buffer->allocate(bytes);
+    return buffer;
+}
+
+bool BufferUploader::isStopping() {
+    QMutexLocker locker(&m_mutex);
+    return m_stop;
+}
+
+void BufferUploader::release(Upload *upload) {
+    delete upload->buffer;
+    delete upload->positionBuffer;
+    delete upload->edgeBuffer;
+    upload->buffer = upload->positionBuffer = upload->edgeBuffer = 0;
+
+    if (upload->fence) {
+        glDeleteFence(upload->fence);
+        upload->fence = 0;
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef BUFFERUPLOADER_H
+#define BUFFERUPLOADER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QGLWidget>
+#include <QGLBuffer>
+
+#include "mesh.h"
+
+class StagingBuffer;
+
+/* Fills the draw buffers of meshes into buffer objects in a thread of its
+   own, so building and uploading the buffers of a new subdivision level does
+   not stall the frames drawn meanwhile. The thread owns a hidden widget whose
+   context shares its objects with the view. The vertices are filled in slices
+   into a staging buffer the thread keeps, and copied from it on the GPU, so
+   no copy is kept in system memory and no fresh memory is faulted in for each
+   level; drivers without buffer copies get the vertices written straight into
+   the mapped buffer, and drivers that cannot map buffers a temporary copy
+   written in bounded slices. The edge indices are written into mapped
+   buffers. A fence is inserted after the writes, and the render thread only
+   switches a mesh to its buffers once the fence has signaled. Buffers of
+   meshes that were destroyed are deleted by the thread.*/
+class BufferUploader : public QThread {
+    Q_OBJECT
+
+    public:
+        //creates the upload context sharing with a widget, call with the context of the widget current
+        //leaves that context current again
+        BufferUploader(QGLWidget *shareWidget, QObject *parent = 0);
+        ~BufferUploader();
+
+        //returns false if no context sharing with the widget could be created
+        bool isValid() const;
+
+        //returns true once the mesh can be drawn, from buffer objects, or from its arrays if they
+        //could not be uploaded; starts uploading the buffers of a new mesh
+        //call from the render thread with its context current
+        bool prepare(ConstMeshPtr mesh);
+
+        //returns true while written buffers wait for their fence, which no signal reports
+        bool hasPendingFences();
+
+    signals:
+        //emitted from the upload thread after the buffers of a mesh were written
+        void uploaded();
+
+    protected:
+        void run();
+
+    private:
+        struct Upload {
+            QWeakPointer<const Mesh> mesh;
+            const Mesh *key;    //only compared, the mesh may be gone
+            QGLBuffer *buffer;          //draw buffer
+            QGLBuffer *positionBuffer;  //positions and vertex indices of the edges, 0 for meshes without edges
+            QGLBuffer *edgeBuffer;
+            void *fence;
+            bool written;
+            bool failed;
+            bool switched;
+        };
+
+        //fills the draw buffer and edges of a mesh into new buffer objects, returns false if they cannot be created
+        bool upload(Upload *upload, ConstMeshPtr mesh);
+
+        //returns a new bound buffer object of the given size, or 0 if it cannot be created
+        static QGLBuffer *createBuffer(QGLBuffer::Type type, int bytes);
+
+        bool isStopping();
+
+        //deletes the buffer object and fence of an upload, call with the upload context current
+        static void release(Upload *upload);
+
+        QGLWidget *m_context;
+        bool m_valid;
+
+        //owned by the upload thread, 0 if the context cannot copy between buffers
+        StagingBuffer *m_staging;
+
+        //uploads are queued by the render thread and taken in order by the upload thread
+        QMutex m_mutex;
+        QWaitCondition m_wake;
+        QList<Upload*> m_uploads;
+        QList<Upload*> m_queue;
+        bool m_stop;
+};
+
+#endif // BUFFERUPLOADER_H
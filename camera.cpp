@@ -8,11 +8,7 @@ Camera::Camera() {
     azimuth = 0;
     zenith = 90;
 
-    Vector3f origin;
-    origin.x = 0;
-    origin.y = 0;
-    origin.z = 0;
-    origin.w = 0;
+    origin.zero();
 
     minRadial = DEFAULT_MIN_RADIAL;
     maxRadial = DEFAULT_MAX_RADIAL;
@@ -26,13 +22,17 @@ Camera::Camera(int radial, int azimuth, int zenith) {
 
 Vector3f Camera::toCartesian() {
     Vector3f p;
-    p.z = radial*sin(RAD(zenith))*cos(RAD(azimuth));
-    p.x = radial*sin(RAD(zenith))*sin(RAD(azimuth));
-    p.y = radial*cos(RAD(zenith));
+    p.z() = radial*sin(RAD(zenith))*cos(RAD(azimuth));
+    p.x() = radial*sin(RAD(zenith))*sin(RAD(azimuth));
+    p.y() = radial*cos(RAD(zenith));
 
     return p;
 }
 
+Matrix4f Camera::getViewMatrix() {
+    return lookAtMatrix(toCartesian(), origin, Vector3f(0, 1, 0));
+}
+
 //getters
 float Camera::getRadial() { return radial; }
 float Camera::getAzimuth() { return azimuth; }
@@ -14,6 +14,9 @@ class Camera {
         Camera(int radial, int azimuth, int zenith);
         Vector3f toCartesian();
 
+        //returns the viewing matrix looking from the camera at its origin
+        Matrix4f getViewMatrix();
+
         //getters
         float getRadial();
         float getAzimuth();
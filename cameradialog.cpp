@@ -12,6 +12,10 @@ CameraDialog::CameraDialog(Renderer *renderer, QWidget *parent=0)
     max->setValidator(doubleValidator);
 }
 
+void CameraDialog::setRenderer(Renderer *renderer) {
+    this->renderer = renderer;
+}
+
 void CameraDialog::connectControls() {
     connect(theta, SIGNAL(valueChanged(int)), SLOT(updateCamera()));
     connect(phi, SIGNAL(valueChanged(int)), SLOT(updateCamera()));
@@ -55,9 +59,9 @@ void CameraDialog::updateCamera() {
     camera.setRadial( rho->value() );
 
     Vector3f o;
-    o.x = ox->value() / 100.0 * ORIGIN_MAX_X;
-    o.y = oy->value() / 100.0 * ORIGIN_MAX_Y;
-    o.z = oz->value() / 100.0 * ORIGIN_MAX_Z;
+    o.x() = ox->value() / 100.0 * ORIGIN_MAX_X;
+    o.y() = oy->value() / 100.0 * ORIGIN_MAX_Y;
+    o.z() = oz->value() / 100.0 * ORIGIN_MAX_Z;
 
     camera.setOrigin(o);
 
@@ -79,9 +83,9 @@ void CameraDialog::exec() {
     rho->setValue(camera.getRadial());
 
     Vector3f o = camera.getOrigin();
-    ox->setValue( (int)(o.x / ORIGIN_MAX_X * 100) );
-    oy->setValue( (int)(o.y / ORIGIN_MAX_Y * 100) );
-    oz->setValue( (int)(o.z / ORIGIN_MAX_Z * 100) );
+    ox->setValue( (int)(o.x() / ORIGIN_MAX_X * 100) );
+    oy->setValue( (int)(o.y() / ORIGIN_MAX_Y * 100) );
+    oz->setValue( (int)(o.z() / ORIGIN_MAX_Z * 100) );
 
     min->setText( QString::number(camera.getMinRadial()) );
     max->setText( QString::number(camera.getMaxRadial()) );
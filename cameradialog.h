@@ -15,6 +15,9 @@ class CameraDialog : public QDialog, public Ui_cameraDialog {
     public:
         CameraDialog(Renderer *renderer, QWidget *parent);
 
+        //edits the camera of another renderer from the next time the dialog opens
+        void setRenderer(Renderer *renderer);
+
     signals:
         void cameraUpdated();
 
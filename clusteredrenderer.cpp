@@ -0,0 +1,307 @@
+#include "clusteredrenderer.h"
+#include "shadermanager.h"
+#include "utils/glutils.h"
+#include "utils/kernels.h"
+#include "utils/trace.h"
+
+#include <math.h>
+
+//texture units of the light, cluster and light index textures, unit 0 is left to the rest of the viewer
+#define LIGHT_TEXTURE_UNIT 1
+
+//the lights of a rig lie on two shells around the origin and fade out within their range
+#define RIG_INNER_RADIUS 1.0f
+#define RIG_OUTER_RADIUS 1.4f
+#define RIG_LIGHT_RANGE 0.8f
+#define RIG_GOLDEN_ANGLE 2.39996323f
+
+//returns a new float texture that is sampled without filtering
+static GLuint createFloatTexture() {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+ClusteredRenderer::ClusteredRenderer() : rigLights(MAX_GL_LIGHTS) {
+    clustering = false;
+    clusterRevision = 0;
+    lightTexture = clusterTexture = indexTexture = 0;
+    indexTextureRows = 0;
+    numLightIndices = 0;
+}
+
+ClusteredRenderer::~ClusteredRenderer() {
+    //the textures go with the context if it is gone already
+    if (QGLContext::currentContext() && lightTexture) {
+        GLuint textures[3] = {lightTexture, clusterTexture, indexTexture};
+        glDeleteTextures(3, textures);
+    }
+}
+
+void ClusteredRenderer::init(int width, int height) {
+    OpenGLRenderer::init(width, height);
+    if (!clusterDefines.isEmpty()) return;
+
+    //the shader works out the clusters with the same grid and planes as the assignment
+    clusterDefines << QString("CLUSTER_TILES_X %1.0").arg(CLUSTER_TILES_X)
+                   << QString("CLUSTER_TILES_Y %1.0").arg(CLUSTER_TILES_Y)
+                   << QString("CLUSTER_SLICES %1.0").arg(CLUSTER_SLICES)
+                   << QString("MAX_CLUSTERED_LIGHTS %1.0").arg(MAX_CLUSTERED_LIGHTS)
+                   << QString("MAX_CLUSTER_LIGHTS %1").arg(MAX_CLUSTER_LIGHTS)
+                   << "NEAR_PLANE " + QString::number(NEAR_PLANE, 'f', 1)
+                   << "FAR_PLANE " + QString::number(FAR_PLANE, 'f', 1);
+
+    clustering = glInitFloatTextures();
+    if (!clustering) return;
+
+    lightTexture = createFloatTexture();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_FORMAT, MAX_CLUSTERED_LIGHTS, 4, 0, GL_RGBA, GL_FLOAT, 0);
+    clusterTexture = createFloatTexture();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA32F_FORMAT, CLUSTER_TILES_X * CLUSTER_TILES_Y, CLUSTER_SLICES,
+                 0, GL_LUMINANCE_ALPHA, GL_FLOAT, 0);
+    indexTexture = createFloatTexture();
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void ClusteredRenderer::resize(int width, int height) {
+    OpenGLRenderer::resize(width, height);
+
+    //the clusters follow the projection
+    lightRevision++;
+}
+
+QGLShaderProgram *ClusteredRenderer::shadingProgram(bool instanced) const {
+    QGLShaderProgram *shaders = renderMode == RENDER_MODE_PHONG ? clusteredProgram(instanced) : 0;
+    return shaders ? shaders : OpenGLRenderer::shadingProgram(instanced);
+}
+
+QGLShaderProgram *ClusteredRenderer::clusteredProgram(bool instanced) const {
+    if (!clustering) return 0;
+
+    //the vertex shaders of phong shading pass on the eye space positions the clusters are found from
+    return shaderManager->program(instanced ? "phong_instanced.vsh" : "phong.vsh", "clustered.fsh", clusterDefines);
+}
+
+void ClusteredRenderer::updateLightUniforms(QGLShaderProgram *shaders) {
+    if (shaders != clusteredProgram(false) && shaders != clusteredProgram(true)) {
+        OpenGLRenderer::updateLightUniforms(shaders);
+        return;
+    }
+
+    updateClusters();
+
+    //the bindings of the texture units are shared with the rest of the viewer, so they are made for every draw
+    GLuint textures[3] = {lightTexture, clusterTexture, indexTexture};
+    for (uint i = 0; i < 3; i++) {
+        glSelectTextureUnit(LIGHT_TEXTURE_UNIT + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+    }
+    glSelectTextureUnit(0);
+
+    //the tiles divide the pixels drawn, which are fewer than the view while the resolution is scaled
+    shaders->setUniformValue("tileSize", (GLfloat)drawWidth / CLUSTER_TILES_X, (GLfloat)drawHeight / CLUSTER_TILES_Y);
+
+    if (lightRevisions.value(shaders) == lightRevision) return;
+    lightRevisions[shaders] = lightRevision;
+
+    shaders->setUniformValue("lightTexture", (GLint)LIGHT_TEXTURE_UNIT);
+    shaders->setUniformValue("clusterTexture", (GLint)(LIGHT_TEXTURE_UNIT + 1));
+    shaders->setUniformValue("indexTexture", (GLint)(LIGHT_TEXTURE_UNIT + 2));
+    shaders->setUniformValue("indexTextureSize", (GLfloat)INDEX_TEXTURE_WIDTH, (GLfloat)indexTextureRows);
+}
+
+void ClusteredRenderer::updateClusters() {
+    if (clusterRevision == lightRevision) return;
+    clusterRevision = lightRevision;
+    TRACE_SCOPE("ClusteredRenderer::updateClusters");
+
+    //parameters of the lights in rows of the light texture: position, ambient color and range, diffuse, specular
+    uint n = rigLights.size();
+    vector<float> parameters(16 * n);
+    vector<Vector3f> positions(n);
+    for (uint i = 0; i < n; i++) {
+        const Light &light = rigLights[i];
+        const Color *colors[3] = {&light.ambient, &light.diffuse, &light.specular};
+        for (uint k = 0; k < 4; k++) parameters[4*i + k] = light.pos[k];
+        for (uint j = 0; j < 3; j++) {
+            float *c = &parameters[4 * ((j + 1) * n + i)];
+            c[0] = colors[j]->r; c[1] = colors[j]->g; c[2] = colors[j]->b; c[3] = colors[j]->a;
+        }
+        parameters[4 * (n + i) + 3] = light.range;
+        positions[i] = Vector3f(light.pos[0], light.pos[1], light.pos[2]);
+    }
+    glBindTexture(GL_TEXTURE_2D, lightTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, n, 4, GL_RGBA, GL_FLOAT, &parameters[0]);
+
+    //signed distances of the lights to the planes between the tiles, which pass through the eye
+    //the planes of the x tiles come first, the positive side is towards the larger tiles
+    vector<float> tileDistances((CLUSTER_TILES_X + CLUSTER_TILES_Y + 2) * n);
+    for (uint k = 0; k <= CLUSTER_TILES_X; k++) {
+        float a = (2.0f * k / CLUSTER_TILES_X - 1) / projection[0][0];
+        float length = sqrtf(1 + a*a);
+        batchPlaneDistances(&positions[0], n, Vector4f(1 / length, 0, a / length, 0), &tileDistances[k * n]);
+    }
+    for (uint k = 0; k <= CLUSTER_TILES_Y; k++) {
+        float a = (2.0f * k / CLUSTER_TILES_Y - 1) / projection[1][1];
+        float length = sqrtf(1 + a*a);
+        batchPlaneDistances(&positions[0], n, Vector4f(0, 1 / length, a / length, 0),
+                            &tileDistances[(CLUSTER_TILES_X + 1 + k) * n]);
+    }
+
+    //count the lights of each cluster, then store the lights at the offsets of the clusters
+    //a cluster with more than MAX_CLUSTER_LIGHTS lights keeps the first ones
+    const uint numClusters = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+    vector<uint> ranges(6 * n), counts(numClusters, 0);
+    vector<bool> reaches(n);
+    for (uint i = 0; i < n; i++) {
+        const uint *r = &ranges[6*i];
+        reaches[i] = clusterRange(i, tileDistances, &ranges[6*i]);
+        if (!reaches[i]) continue;
+
+        for (uint z = r[4]; z <= r[5]; z++)
+            for (uint y = r[2]; y <= r[3]; y++)
+                for (uint x = r[0]; x <= r[1]; x++) {
+                    uint &count = counts[(z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x];
+                    if (count < MAX_CLUSTER_LIGHTS) count++;
+                }
+    }
+
+    vector<float> clusters(2 * numClusters);
+    vector<uint> offsets(numClusters + 1, 0);
+    for (uint c = 0; c < numClusters; c++) {
+        offsets[c + 1] = offsets[c] + counts[c];
+        clusters[2*c] = offsets[c];
+        clusters[2*c + 1] = counts[c];
+    }
+    numLightIndices = offsets[numClusters];
+
+    uint rows = qMax(1u, (numLightIndices + INDEX_TEXTURE_WIDTH - 1) / INDEX_TEXTURE_WIDTH);
+    vector<float> indices(rows * INDEX_TEXTURE_WIDTH, 0);
+    for (uint i = 0; i < n; i++) {
+        if (!reaches[i]) continue;
+
+        const uint *r = &ranges[6*i];
+        for (uint z = r[4]; z <= r[5]; z++)
+            for (uint y = r[2]; y <= r[3]; y++)
+                for (uint x = r[0]; x <= r[1]; x++) {
+                    uint c = (z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+                    if (offsets[c] < offsets[c + 1]) indices[offsets[c]++] = i;
+                }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, clusterTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CLUSTER_TILES_X * CLUSTER_TILES_Y, CLUSTER_SLICES,
+                    GL_LUMINANCE_ALPHA, GL_FLOAT, &clusters[0]);
+
+    //the index texture only grows, so its size stays the same as long as the lights do
+    glBindTexture(GL_TEXTURE_2D, indexTexture);
+    if (rows > indexTextureRows) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE32F_FORMAT, INDEX_TEXTURE_WIDTH, rows, 0, GL_LUMINANCE, GL_FLOAT, &indices[0]);
+        indexTextureRows = rows;
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, INDEX_TEXTURE_WIDTH, rows, GL_LUMINANCE, GL_FLOAT, &indices[0]);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool ClusteredRenderer::clusterRange(uint light, const vector<float> &tileDistances, uint range[6]) const {
+    const Light &l = rigLights[light];
+    if (!l.isEnabled) return false;
+
+    range[0] = range[2] = range[4] = 0;
+    range[1] = CLUSTER_TILES_X - 1;
+    range[3] = CLUSTER_TILES_Y - 1;
+    range[5] = CLUSTER_SLICES - 1;
+
+    //directional lights and lights without a range reach every cluster
+    float r = l.range;
+    if (l.pos[3] == 0 || r <= 0) return true;
+
+    float depth = -l.pos[2];
+    if (depth + r < NEAR_PLANE || depth - r > FAR_PLANE) return false;
+    range[4] = sliceOf(qMax(depth - r, NEAR_PLANE));
+    range[5] = sliceOf(qMin(depth + r, FAR_PLANE));
+
+    //the planes between the tiles meet at the eye, so they do not bound a light around it
+    if (depth - r <= 0) return true;
+
+    //a light reaches a tile if it is within its range of the positive side of the lower plane
+    //and of the negative side of the upper one
+    uint n = rigLights.size();
+    const uint tiles[2] = {CLUSTER_TILES_X, CLUSTER_TILES_Y};
+    const float *distances = &tileDistances[light];
+    for (uint axis = 0; axis < 2; axis++) {
+        int first = -1, last = -1;
+        for (uint k = 0; k < tiles[axis]; k++) {
+            if (distances[k * n] > -r && distances[(k + 1) * n] < r) {
+                if (first < 0) first = k;
+                last = k;
+            }
+        }
+        if (first < 0) return false;
+
+        range[2*axis] = first;
+        range[2*axis + 1] = last;
+        distances += (CLUSTER_TILES_X + 1) * n;
+    }
+    return true;
+}
+
+uint ClusteredRenderer::sliceOf(float depth) const {
+    int slice = (int)floorf(logf(depth / NEAR_PLANE) * CLUSTER_SLICES / logf(FAR_PLANE / NEAR_PLANE));
+    return qBound(0, slice, CLUSTER_SLICES - 1);
+}
+
+void ClusteredRenderer::setLight(int i, Light light) {
+    if (i < 0 || i >= (int)rigLights.size()) return;
+    rigLights[i] = light;
+
+    //the first lights also light the fixed-function render modes
+    if (i < MAX_GL_LIGHTS)
+        OpenGLRenderer::setLight(i, light);
+    else
+        lightRevision++;
+}
+
+void ClusteredRenderer::setLights(Light *lights, int n) {
+    n = MIN(n, MAX_CLUSTERED_LIGHTS);
+    rigLights.resize(MAX(n, MAX_GL_LIGHTS));
+    for (int i = 0; i < n; i++) setLight(i, lights[i]);
+    lightRevision++;
+}
+
+void ClusteredRenderer::setLightRig(int n) {
+    n = qBound(0, n, MAX_CLUSTERED_LIGHTS - MAX_GL_LIGHTS);
+    rigLights.resize(MAX_GL_LIGHTS + n);
+
+    //spread the lights evenly over the shells along a spiral
+    Matrix4f view = camera.getViewMatrix();
+    for (int i = 0; i < n; i++) {
+        float z = 1 - (2*i + 1.0f) / n;
+        float radius = sqrtf(1 - z*z) * (i % 2 ? RIG_INNER_RADIUS : RIG_OUTER_RADIUS);
+        float angle = i * RIG_GOLDEN_ANGLE;
+        Vector4f p(cosf(angle) * radius, sinf(angle) * radius, z * (i % 2 ? RIG_INNER_RADIUS : RIG_OUTER_RADIUS), 1);
+
+        Vector3f color = randColor3f(i + 1);
+        Light light;
+        light.diffuse.r = color[0]; light.diffuse.g = color[1]; light.diffuse.b = color[2]; light.diffuse.a = 1;
+        light.specular = light.diffuse;
+        light.ambient.a = 1;
+        light.pos = view * p;
+        light.range = RIG_LIGHT_RANGE;
+        light.isEnabled = true;
+        rigLights[MAX_GL_LIGHTS + i] = light;
+    }
+
+    lightRevision++;
+}
+
+bool ClusteredRenderer::isClustering() const { return clustering; }
+uint ClusteredRenderer::getNumLightIndices() const { return numLightIndices; }
+int ClusteredRenderer::getNumLights() { return rigLights.size(); }
+Light ClusteredRenderer::getLight(int i) { return rigLights[i]; }
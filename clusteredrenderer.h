@@ -0,0 +1,82 @@
+#ifndef CLUSTEREDRENDERER_H
+#define CLUSTEREDRENDERER_H
+
+#include "openglrenderer.h"
+
+//the view frustum is divided into screen tiles and depth slices, which are spaced exponentially
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 16
+#define CLUSTER_SLICES 24
+
+//lights the light texture has room for, and lights a cluster can hold, defined in clustered.fsh by the renderer
+#define MAX_CLUSTERED_LIGHTS 1024
+#define MAX_CLUSTER_LIGHTS 256
+
+//texels in a row of the light index texture
+#define INDEX_TEXTURE_WIDTH 2048
+
+/* Renderer for rigs of many lights. Phong shading looks up the lights of a
+   fragment in a grid of clusters that divides the view frustum, so each
+   fragment only loops over the lights that reach its cluster. The lights are
+   assigned to the clusters on the CPU whenever they or the projection change:
+   the distances of the lights to the planes between the tiles are computed
+   by the batch kernels, and a light is added to every cluster within its
+   range. The light parameters, the clusters and the light indices are kept
+   in float textures. The other render modes draw like the OpenGL renderer,
+   with the first MAX_GL_LIGHTS lights. Positions of lights are given in eye
+   space as for the OpenGL renderer.*/
+class ClusteredRenderer : public OpenGLRenderer {
+    public:
+        ClusteredRenderer();
+        ~ClusteredRenderer();
+
+        void init(int width, int height);
+        void resize(int width, int height);
+
+        void setLights(Light *lights, int n);
+        void setLight(int i, Light light);
+        int getNumLights();
+        Light getLight(int i);
+
+        //keeps the first MAX_GL_LIGHTS lights and adds n colored point lights of limited range
+        //on a shell around the origin of the scene, placed with the current camera
+        void setLightRig(int n);
+
+        //returns false if the context cannot sample float textures, Phong shading then uses the first lights only
+        bool isClustering() const;
+
+        //returns the number of light indices over all clusters from the last assignment
+        uint getNumLightIndices() const;
+
+    protected:
+        QGLShaderProgram *shadingProgram(bool instanced) const;
+        void updateLightUniforms(QGLShaderProgram *shaders);
+
+    private:
+        //assigns the lights to the clusters they reach and uploads the textures, if the lights changed
+        void updateClusters();
+
+        //finds the clusters a light reaches, returns false if it reaches none
+        bool clusterRange(uint light, const vector<float> &tileDistances, uint range[6]) const;
+
+        //returns the depth slice of a distance in front of the camera
+        uint sliceOf(float depth) const;
+
+        //returns the program of clustered Phong shading, 0 if the context cannot use it
+        QGLShaderProgram *clusteredProgram(bool instanced) const;
+
+        vector<Light> rigLights;
+
+        bool clustering;
+        QStringList clusterDefines;
+
+        //the clusters are rebuilt when the light revision differs from the one they were built for
+        uint clusterRevision;
+        GLuint lightTexture;
+        GLuint clusterTexture;
+        GLuint indexTexture;
+        uint indexTextureRows;
+        uint numLightIndices;
+};
+
+#endif // CLUSTEREDRENDERER_H
@@ -1,26 +1,60 @@
 
 #include <QDebug>
+#include <QStringList>
 #include <math.h>
 #include "glwidget.h"
+#include "utils/trace.h"
 
 #include <GL/glut.h>
 
+//milliseconds between repaints while uploaded buffers wait for their fence
+#define FENCE_POLL_INTERVAL 5
+
+//milliseconds between repaints while levels of detail are reduced in the background
+#define LOD_POLL_INTERVAL 50
+
+//milliseconds after the last wheel step that zooming counts as ended
+#define WHEEL_IDLE_INTERVAL 200
+
+//formats a number of bytes in the largest fitting unit
+static QString formatBytes(size_t bytes) {
+    if (bytes >= 1024*1024)
+        return QString("%1 MB").arg(bytes / (1024.0*1024.0), 0, 'f', 2);
+    if (bytes >= 1024)
+        return QString("%1 KB").arg(bytes / 1024.0, 0, 'f', 1);
+    return QString("%1 B").arg(bytes);
+}
+
 GLWidget::GLWidget(Renderer *renderer, QWidget* parent)
-    : QGLWidget(parent), m_renderer(renderer), m_renderMode(RENDER_MODE_DEFAULT),
-      m_moveCamera(false), m_zoomCamera(false), m_showAxis(false), m_showInfo(false),
-      m_phongShaders(0)
+    : QGLWidget(parent), m_renderer(renderer), m_uploader(0),
+      m_moveCamera(false), m_zoomCamera(false), m_showAxis(false), m_showInfo(false), m_hovering(false)
 {
+    //receive mouse moves without a pressed button for hovering
+    setMouseTracking(true);
+
+    m_wheelTimer = new QTimer(this);
+    m_wheelTimer->setSingleShot(true);
+    m_wheelTimer->setInterval(WHEEL_IDLE_INTERVAL);
+    connect(m_wheelTimer, SIGNAL(timeout()), this, SLOT(endInteraction()));
 }
 
 void GLWidget::initializeGL() {
-    if (m_renderer)
-        m_renderer->init(width(), height());
+    //repaint whenever the buffers of a mesh were written, without a shared context meshes draw from system memory
+    if (!m_uploader) {
+        m_uploader = new BufferUploader(this, this);
+        if (m_uploader->isValid()) {
+            connect(m_uploader, SIGNAL(uploaded()), this, SLOT(update()));
+            m_uploader->start();
+        } else {
+            delete m_uploader;
+            m_uploader = 0;
+        }
+    }
 
-    //create shaders for phong shading
-    m_phongShaders = new QGLShaderProgram(context(), this);
-    m_phongShaders->addShaderFromSourceFile(QGLShader::Vertex, "phong.vsh");
-    m_phongShaders->addShaderFromSourceFile(QGLShader::Fragment, "phong.fsh");
-    m_phongShaders->link();
+    if (m_renderer) {
+        m_renderer->init(width(), height());
+        m_renderer->setUploader(m_uploader);
+    }
 }
 
 void GLWidget::resizeGL(int width, int height) {
@@ -29,28 +63,22 @@ void GLWidget::resizeGL(int width, int height) {
 }
 
 void GLWidget::paintGL() {
-    //set current render mode options
-    switch(m_renderMode) {
-    case RENDER_MODE_WIREFRAME:
-        glDisable(GL_LIGHTING);
-        m_phongShaders->release();
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        break;
-    case RENDER_MODE_PHONG:
-        glEnable(GL_LIGHTING);
-        m_phongShaders->bind();
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        break;
-    default:
-        glEnable(GL_LIGHTING);
-        m_phongShaders->release();
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        break;
-    }
+    TRACE_SCOPE("GLWidget::paintGL");
 
     if (m_renderer)
         m_renderer->render();
-    m_phongShaders->release();
+
+    //no signal reports a fence completing, so look again shortly while one is pending
+    if (m_uploader && m_uploader->hasPendingFences())
+        QTimer::singleShot(FENCE_POLL_INTERVAL, this, SLOT(update()));
+
+    //the full meshes are drawn until their levels of detail are ready, which nothing signals either
+    if (m_renderer && m_renderer->getScene() && m_renderer->getScene()->isBuildingLods())
+        QTimer::singleShot(LOD_POLL_INTERVAL, this, SLOT(update()));
+
+    //after the camera stopped, each frame is a level finer than the one before
+    if (m_renderer && m_renderer->isRefining())
+        QTimer::singleShot(0, this, SLOT(update()));
 
     //draw axis
     if (m_showAxis) {
@@ -78,8 +106,34 @@ void GLWidget::paintGL() {
         Camera camera = m_renderer->getCamera();
         Vector3f p = camera.toCartesian();
 
-        QString info = QString("Camera: (%1, %2, %3)").arg(p.x, 0, 'f', 2).arg(p.y, 0, 'f', 2).arg(p.z, 0, 'f', 2);
+        QString info = QString("Camera: (%1, %2, %3)").arg(p.x(), 0, 'f', 2).arg(p.y(), 0, 'f', 2).arg(p.z(), 0, 'f', 2);
         renderText(5,13,info);
+
+        //frames of a moving camera may be drawn at fewer pixels and stretched
+        float scale = m_renderer->getResolutionScale();
+        renderText(width() - 150, 13, QString("Resolution: %1% (%2x%3)").arg(qRound(100 * scale))
+                   .arg(qRound(width() * scale)).arg(qRound(height() * scale)));
+
+        //show memory used by the scene
+        Scene *scene = m_renderer->getScene();
+        if (scene) {
+            MemoryUsage usage = scene->memoryUsage();
+            QStringList lines;
+            lines << QString("Memory: %1").arg(formatBytes(usage.total()))
+                  << QString("  geometry: %1").arg(formatBytes(usage.geometry))
+                  << QString("  topology: %1").arg(formatBytes(usage.topology))
+                  << QString("  lookup maps: %1").arg(formatBytes(usage.lookupMaps))
+                  << QString("  subdivision scratch: %1").arg(formatBytes(usage.scratch))
+                  << QString("  CPU buffers: %1").arg(formatBytes(usage.cpuBuffers))
+                  << QString("  GPU buffers: %1").arg(formatBytes(usage.gpuBuffers))
+                  << QString("  picking: %1").arg(formatBytes(usage.picking))
+                  << QString("Objects: %1 in %2 batches").arg(scene->getNumObjects()).arg(scene->getBatches().size());
+            if (m_hovering)
+                lines << QString("Hover: object %1 face %2 vertex %3").arg(m_hover.object).arg(m_hover.hit.face).arg(m_hover.hit.vertex);
+
+            for (int i = 0; i < lines.size(); i++)
+                renderText(5, 28 + 15*i, lines[i]);
+        }
     }
 }
 
@@ -90,11 +144,17 @@ void GLWidget::mousePressEvent(QMouseEvent *event) {
     if (event->buttons() & Qt::RightButton)
         m_zoomCamera = true;
 
+    if (m_renderer && (m_moveCamera || m_zoomCamera))
+        m_renderer->setInteractive(true);
+
     m_lastPos = event->pos();
 }
 
 void GLWidget::mouseMoveEvent(QMouseEvent *event) {
-    if (!(m_moveCamera || m_zoomCamera)) return;
+    if (!(m_moveCamera || m_zoomCamera)) {
+        hover(event->pos());
+        return;
+    }
 
     Camera camera = m_renderer->getCamera();
 
@@ -118,8 +178,47 @@ void GLWidget::mouseMoveEvent(QMouseEvent *event) {
 }
 
 void GLWidget::mouseReleaseEvent(QMouseEvent *) {
+    bool moved = m_moveCamera || m_zoomCamera;
     m_moveCamera = false;
     m_zoomCamera = false;
+
+    if (moved && !m_wheelTimer->isActive())
+        endInteraction();
+}
+
+void GLWidget::endInteraction() {
+    //a drag still going on ends with its release
+    if (!m_renderer || m_moveCamera || m_zoomCamera) return;
+    m_renderer->setInteractive(false);
+    update();
+}
+
+void GLWidget::leaveEvent(QEvent *) {
+    if (!m_hovering || !m_renderer) return;
+
+    m_hovering = false;
+    m_renderer->clearHighlight();
+    repaint();
+}
+
+void GLWidget::hover(const QPoint &pos) {
+    if (!m_renderer) return;
+
+    ScenePick pick;
+    bool hit = m_renderer->pick(pos.x(), pos.y(), pick);
+
+    //repaint only when the highlighted face or vertex changes
+    if (hit == m_hovering && (!hit || (pick.mesh == m_hover.mesh && pick.object == m_hover.object
+                                       && pick.hit.face == m_hover.hit.face && pick.hit.vertex == m_hover.hit.vertex)))
+        return;
+
+    m_hovering = hit;
+    m_hover = pick;
+    if (hit)
+        m_renderer->setHighlight(pick);
+    else
+        m_renderer->clearHighlight();
+    repaint();
 }
 
 void GLWidget::wheelEvent(QWheelEvent *event) {
@@ -127,15 +226,28 @@ void GLWidget::wheelEvent(QWheelEvent *event) {
     Camera camera = m_renderer->getCamera();
     camera.setRadial(camera.getRadial() - event->delta() * 0.002);
     m_renderer->setCamera(camera);
+    m_renderer->setInteractive(true);
+    m_wheelTimer->start();
 
     repaint();
 }
 
 void GLWidget::setRenderMode(RenderMode renderMode) {
-    m_renderMode = renderMode;
+    if (m_renderer)
+        m_renderer->setRenderMode(renderMode);
 }
 
-void GLWidget::setRenderer(Renderer *renderer) { m_renderer = renderer; }
+void GLWidget::setRenderer(Renderer *renderer) {
+    m_renderer = renderer;
+    if (!m_renderer) return;
+
+    //a renderer switched to once the context exists sets up its state in it
+    if (isValid()) {
+        makeCurrent();
+        m_renderer->init(width(), height());
+    }
+    m_renderer->setUploader(m_uploader);
+}
 Renderer *GLWidget::getRenderer() { return m_renderer; }
 
 void GLWidget::setShowAxis(bool showAxis) { m_showAxis = showAxis; }
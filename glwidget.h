@@ -4,20 +4,13 @@
 #include <QGLWidget>
 #include <QTimer>
 #include <QMouseEvent>
-#include <QGLShaderProgram>
 
 #include "camera.h"
 #include "types.h"
 #include "light.h"
 
 #include "renderer.h"
-
-typedef enum RenderMode {
-    RENDER_MODE_DEFAULT,
-    RENDER_MODE_WIREFRAME,
-    RENDER_MODE_PHONG
-} RenderMode;
-
+#include "bufferuploader.h"
 
 /*Widget to display graphics and animation*/
 class GLWidget : public QGLWidget {
@@ -36,6 +29,7 @@ class GLWidget : public QGLWidget {
         void mouseMoveEvent(QMouseEvent *event);
         void mouseReleaseEvent(QMouseEvent *event);
         void wheelEvent(QWheelEvent *event);
+        void leaveEvent(QEvent *event);
 
         void setRenderer(Renderer *renderer);
         Renderer *getRenderer();
@@ -48,18 +42,31 @@ class GLWidget : public QGLWidget {
 
         void setRenderMode(RenderMode renderMode);
 
+    private slots:
+        //the camera stopped moving, the following frames refine to full quality
+        void endInteraction();
+
     private:
+        //highlights the face under the cursor
+        void hover(const QPoint &pos);
+
         Renderer *m_renderer;
-        RenderMode m_renderMode;
+
+        //uploads meshes in a context sharing with this one, created with the context
+        BufferUploader *m_uploader;
 
         bool m_moveCamera;
         bool m_zoomCamera;
         QPoint m_lastPos;
 
+        //the wheel has no release, so zooming ends once it has been still for a while
+        QTimer *m_wheelTimer;
+
         bool m_showAxis;
         bool m_showInfo;
 
-        QGLShaderProgram *m_phongShaders;
+        bool m_hovering;
+        ScenePick m_hover;
 };
 
 #endif // GLWIDGET_H
@@ -13,11 +13,10 @@ Light::Light() {
     specular.g = 0;
     specular.b = 0;
 
-    pos.x = 0;
-    pos.y = 0;
-    pos.z = 0;
+    pos = Vector4f(0, 0, 0, 0);
 
     cutoff = 0;
+    range = 0;
 
     isEnabled = false;
 }
@@ -26,7 +25,9 @@ Light::Light(Color a, Color d, Color s, Vector3f p) {
     ambient = a;
     diffuse = d;
     specular = s;
-    pos = p;
+    pos = Vector4f(p.x(), p.y(), p.z(), 0);
+    cutoff = 0;
+    range = 0;
 
     isEnabled = true;
 }
@@ -49,10 +50,9 @@ Light::Light(float ar, float ag, float ab, float aa, float dr, float dg, float d
     specular.b = sb;
     specular.a = sa;
 
-    pos.x = x;
-    pos.y = y;
-    pos.z = z;
-    pos.w = 1;
+    pos = Vector4f(x, y, z, 1);
+    cutoff = 0;
+    range = 0;
 
     isEnabled = true;
 }
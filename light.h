@@ -13,9 +13,10 @@ class Light {
         Color ambient;
         Color diffuse;
         Color specular;
-        Vector3f pos;
+        Vector4f pos;   //w is 0 for directional and 1 for positional lights
 
         float cutoff;
+        float range;    //distance at which a positional light fades out, 0 if it reaches everywhere
 
         bool isEnabled;
         bool isDirectional;
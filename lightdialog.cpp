@@ -35,6 +35,10 @@ LightDialog::LightDialog(Renderer *renderer, QWidget *parent) : QDialog(parent)
     connectControls();
 }
 
+void LightDialog::setRenderer(Renderer *renderer) {
+    this->renderer = renderer;
+}
+
 void LightDialog::connectControls() {
     connect(lightSpinBox, SIGNAL(valueChanged(int)), SLOT(saveLight()));
     connect(lightSpinBox, SIGNAL(valueChanged(int)), SLOT(lightChanged(int)));
@@ -95,18 +99,18 @@ void LightDialog::lightChanged(int i) {
     Color a = light.ambient;
     Color d = light.diffuse;
     Color s = light.specular;
-    Vector3f p = light.pos;
+    Vector4f p = light.pos;
 
     ar->setValue(int(a.r*100)); ag->setValue(int(a.g*100)); ab->setValue(int(a.b*100));
     dr->setValue(int(d.r*100)); dg->setValue(int(d.g*100)); db->setValue(int(d.b*100));
     sr->setValue(int(s.r*100)); sg->setValue(int(s.g*100)); sb->setValue(int(s.b*100));
 
-    px->setValue( int(p.x / LIGHT_MAX_X * 100) );
-    py->setValue( int(p.y / LIGHT_MAX_Y * 100) );
-    pz->setValue( int(p.z / LIGHT_MAX_Z * 100) );
-    //px->setText(QString::number(p.x)); py->setText(QString::number(p.y)); pz->setText(QString::number(p.z));
+    px->setValue( int(p.x() / LIGHT_MAX_X * 100) );
+    py->setValue( int(p.y() / LIGHT_MAX_Y * 100) );
+    pz->setValue( int(p.z() / LIGHT_MAX_Z * 100) );
+    //px->setText(QString::number(p.x())); py->setText(QString::number(p.y())); pz->setText(QString::number(p.z()));
 
-    typeComboBox->setCurrentIndex((int)p.w);
+    typeComboBox->setCurrentIndex((int)p.w());
 
     connectControls();
 }
@@ -133,12 +137,13 @@ void LightDialog::saveLight() {
     s.a = 1.0;
 
     Vector3f p;
-    p.x = px->value() / 100.0 * LIGHT_MAX_X;
-    p.y = py->value() / 100.0 * LIGHT_MAX_Y;
-    p.z = pz->value() / 100.0 * LIGHT_MAX_Z;
+    p.x() = px->value() / 100.0 * LIGHT_MAX_X;
+    p.y() = py->value() / 100.0 * LIGHT_MAX_Y;
+    p.z() = pz->value() / 100.0 * LIGHT_MAX_Z;
 
     Light light(a,d,s,p);
     light.isEnabled = lightEnable->isChecked();
+    light.range = renderer->getLight(currLight).range;
 
     renderer->setLight(currLight, light);
 
@@ -146,15 +151,18 @@ void LightDialog::saveLight() {
 }
 
 void LightDialog::exec() {
+    //renderers with a light rig have more lights than the fixed-function pipeline
+    oldLights.resize(renderer->getNumLights());
     for (int i = 0; i < renderer->getNumLights(); i++) {
         oldLights[i] = renderer->getLight(i);
     }
+    lightSpinBox->setRange(0, renderer->getNumLights() - 1);
 
     lightChanged(currLight);
     QDialog::exec();
 }
 
 void LightDialog::reject() {
-    renderer->setLights(oldLights,renderer->getNumLights());
+    renderer->setLights(&oldLights[0],oldLights.size());
     QDialog::reject();
 }
@@ -18,6 +18,9 @@ class LightDialog : public QDialog, public Ui_lightDialog {
     public:
         LightDialog(Renderer* renderer, QWidget *parent);
 
+        //edits the lights of another renderer from the next time the dialog opens
+        void setRenderer(Renderer *renderer);
+
     signals:
         void lightUpdated();
 
@@ -33,7 +36,7 @@ class LightDialog : public QDialog, public Ui_lightDialog {
         void connectControls();
         void disconnectControls();
 
-        Light oldLights[NUM_LIGHTS];
+        vector<Light> oldLights;
         Renderer *renderer;
         int currLight;
 };
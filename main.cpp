@@ -1,9 +1,50 @@
 #include <QtGui/QApplication>
 #include "mainwindow.h"
+#include "benchmark.h"
+#include "mathbenchmark.h"
+
+//runs the offscreen benchmark given by the command line arguments
+static int runBenchmark(QStringList args) {
+    QTextStream out(stdout);
+
+    int idx = args.indexOf("--benchmark");
+    if (idx + 1 >= args.size()) {
+        out << Benchmark::usage() << endl;
+        return 1;
+    }
+
+    Benchmark benchmark(args[idx + 1]);
+    args.removeAt(idx + 1);
+    if (!benchmark.parseArguments(args.mid(1))) {
+        out << Benchmark::usage() << endl;
+        return 1;
+    }
+
+    return benchmark.run(out) ? 0 : 1;
+}
+
+//runs the math library checks and micro-benchmarks
+static int runMathBenchmark(QStringList args) {
+    QTextStream out(stdout);
+
+    MathBenchmark benchmark;
+    if (!benchmark.parseArguments(args.mid(1))) {
+        out << MathBenchmark::usage() << endl;
+        return 1;
+    }
+
+    return benchmark.run(out) ? 0 : 1;
+}
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    if (a.arguments().contains("--benchmark"))
+        return runBenchmark(a.arguments());
+    if (a.arguments().contains("--benchmark-math"))
+        return runMathBenchmark(a.arguments());
+
     MainWindow w;
     w.show();
     return a.exec();
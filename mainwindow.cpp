@@ -2,17 +2,22 @@
 
 #include <QDebug>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QInputDialog>
 #include <QMessageBox>
+#include <QSignalMapper>
 
 #include "lightdialog.h"
+#include "utils/trace.h"
 
 MainWindow::MainWindow(QWidget* parent)
-    : QMainWindow(parent), scene(0), mesh(0) {
+    : QMainWindow(parent), scene(0), progressDialog(0) {
     //initialize main window attributes
     resize(WIDTH,HEIGHT);
     setWindowTitle("viewer");
 
-    openGLRenderer = new OpenGLRenderer();
+    openGLRenderer = new ClusteredRenderer();
+    softwareRenderer = new SoftwareRenderer();
     scene = new Scene();
 
     //create glWidget
@@ -30,13 +35,18 @@ MainWindow::MainWindow(QWidget* parent)
     connect(cameraDialog, SIGNAL(accepted()), glWidget, SLOT(repaint()));
     connect(cameraDialog, SIGNAL(cameraUpdated()), glWidget, SLOT(repaint()));
 
+    meshLoader = new MeshLoader(this);
+    connect(meshLoader, SIGNAL(progressChanged(int)), SLOT(updateLoadProgress(int)));
+    connect(meshLoader, SIGNAL(previewReady(MeshPtr)), SLOT(showPreview(MeshPtr)));
+    connect(meshLoader, SIGNAL(loaded(MeshPtr)), SLOT(showLoadedMesh(MeshPtr)));
+    connect(meshLoader, SIGNAL(failed(QString)), SLOT(loadFailed(QString)));
+    connect(meshLoader, SIGNAL(cancelled()), SLOT(loadCancelled()));
+
     createMenus();
 }
 
 MainWindow::~MainWindow() {
     delete scene;
-
-    if (mesh) delete mesh;
 }
 
 void MainWindow::createMenus() {
@@ -49,6 +59,22 @@ void MainWindow::createMenus() {
         this->connect(openAct, SIGNAL(triggered()), SLOT(open()));
         fileMenu->addAction(openAct);
 
+#ifdef VIEWER_TRACING
+        fileMenu->addSeparator();
+
+        //tracing actions
+        QAction *traceAct = new QAction("&Record Trace", this);
+        traceAct->setStatusTip("Record a trace of loading, subdivision and drawing");
+        traceAct->setCheckable(true);
+        this->connect(traceAct, SIGNAL(triggered()), SLOT(toggleTracing()));
+        fileMenu->addAction(traceAct);
+
+        QAction *saveTraceAct = new QAction("&Save Trace", this);
+        saveTraceAct->setStatusTip("Save the recorded trace as Chrome trace JSON");
+        this->connect(saveTraceAct, SIGNAL(triggered()), SLOT(saveTrace()));
+        fileMenu->addAction(saveTraceAct);
+#endif
+
         fileMenu->addSeparator();
 
         //exit action
@@ -74,6 +100,12 @@ void MainWindow::createMenus() {
         this->connect(editLightAct, SIGNAL(triggered()), SLOT(editLights()));
         editMenu->addAction(editLightAct);
 
+        //edit light rig action
+        QAction *editLightRigAct = new QAction("Light &Rig", this);
+        editLightRigAct->setStatusTip("Add point lights around the scene, shaded in Phong mode");
+        this->connect(editLightRigAct, SIGNAL(triggered()), SLOT(editLightRig()));
+        editMenu->addAction(editLightRigAct);
+
 
     QMenu *viewMenu = menuBar()->addMenu("&Show");
         //view coordinates action
@@ -119,6 +151,37 @@ void MainWindow::createMenus() {
         this->connect(renderPhongAct, SIGNAL(triggered()), SLOT(renderPhong()));
         renderMenu->addAction(renderPhongAct);
 
+        //render shaded wireframe action
+        QAction *renderShadedWireAct = new QAction("&Shaded Wireframe", this);
+        renderShadedWireAct->setStatusTip("Shaded Wireframe");
+        renderShadedWireAct->setShortcut(QKeySequence("Shift+Ctrl+S"));
+        this->connect(renderShadedWireAct, SIGNAL(triggered()), SLOT(renderShadedWireframe()));
+        renderMenu->addAction(renderShadedWireAct);
+
+        renderMenu->addSeparator();
+
+        //levels of detail action
+        QAction *lodAct = new QAction("&Levels of Detail", this);
+        lodAct->setStatusTip("Draw reduced meshes where their detail is too small to see");
+        lodAct->setCheckable(true);
+        this->connect(lodAct, SIGNAL(toggled(bool)), SLOT(setLevelsOfDetail(bool)));
+        renderMenu->addAction(lodAct);
+
+        //frame budget action
+        QAction *frameBudgetAct = new QAction("Frame &Budget", this);
+        frameBudgetAct->setStatusTip("Milliseconds a frame may take while the camera moves, coarser meshes are drawn to keep to it");
+        this->connect(frameBudgetAct, SIGNAL(triggered()), SLOT(editFrameBudget()));
+        renderMenu->addAction(frameBudgetAct);
+
+        renderMenu->addSeparator();
+
+        //software rasterizer action
+        QAction *softwareAct = new QAction("Software &Rasterizer", this);
+        softwareAct->setStatusTip("Draw the scene on the CPU with the multithreaded tile rasterizer");
+        softwareAct->setCheckable(true);
+        this->connect(softwareAct, SIGNAL(toggled(bool)), SLOT(setSoftwareRasterizer(bool)));
+        renderMenu->addAction(softwareAct);
+
     //subdivision steps
     QMenu *subdivideMenu = menuBar()->addMenu("&Subdivide");
     for (uint i = 0; i < 5; i++) {
@@ -126,6 +189,18 @@ void MainWindow::createMenus() {
         this->connect(subdivideAct, SIGNAL(triggered(uint)), SLOT(subdivide(uint)));
         subdivideMenu->addAction(subdivideAct);
     }
+
+    //copies of the mesh laid out in a grid, drawn as instances
+    QMenu *copiesMenu = menuBar()->addMenu("&Copies");
+    QSignalMapper *copiesMapper = new QSignalMapper(this);
+    this->connect(copiesMapper, SIGNAL(mapped(int)), SLOT(setCopies(int)));
+    int copies[] = {1, 16, 256, 1024};
+    for (uint i = 0; i < 4; i++) {
+        QAction *copiesAct = new QAction(QString("%1").arg(copies[i]), this);
+        copiesMapper->connect(copiesAct, SIGNAL(triggered()), SLOT(map()));
+        copiesMapper->setMapping(copiesAct, copies[i]);
+        copiesMenu->addAction(copiesAct);
+    }
 }
 
 
@@ -134,24 +209,67 @@ void MainWindow::open() {
     QString fileName = QFileDialog::getOpenFileName(this, "Load OBJ File", "", "OBJ Files (*.obj);;All files (*.*)");
     if (fileName == "") return;
 
-    //load mesh
-    Mesh *newMesh = Mesh::fromObjFile(fileName);
+    //cancelling a load that is still running puts back the mesh shown before it
+    if (meshLoader->isLoading())
+        meshLoader->cancel();
+    previousMesh = scene->getMesh();
+
+    //load mesh in the background, the progress dialog is shown if it takes a while
+    progressDialog = new QProgressDialog(QString("Loading %1").arg(QFileInfo(fileName).fileName()), "Cancel", 0, 100, this);
+    progressDialog->setWindowTitle("Open OBJ");
+    progressDialog->setMinimumDuration(500);
+    connect(progressDialog, SIGNAL(canceled()), meshLoader, SLOT(cancel()));
+
+    meshLoader->load(fileName);
+}
+
+void MainWindow::updateLoadProgress(int percent) {
+    if (progressDialog)
+        progressDialog->setValue(percent);
+}
+
+void MainWindow::showPreview(MeshPtr preview) {
+    //show the faces while the topology of the mesh is built
+    scene->setMesh(preview);
+    glWidget->getRenderer()->setScene(scene);
+    glWidget->repaint();
+}
+
+void MainWindow::showLoadedMesh(MeshPtr mesh) {
+    //the loader already scaled the mesh to the unit box
+    scene->setMesh(mesh);
+    glWidget->getRenderer()->setScene(scene);
+    finishLoading(false);
+}
+
+void MainWindow::loadFailed(QString) {
+    finishLoading(true);
 
-    if (newMesh) {
-        //update current mesh if mesh was loaded successfully
-        if (mesh) delete mesh;
-        mesh = newMesh;
+    //display error if mesh fails to load
+    QMessageBox msgBox;
+    msgBox.setIcon(QMessageBox::Warning);
+    msgBox.setText("Error opening file. Please ensure that the file is a valid OBJ mesh.");
+    msgBox.exec();
+}
 
-        mesh->unitize();
-        scene->setMesh(mesh);
+void MainWindow::loadCancelled() {
+    finishLoading(true);
+}
+
+void MainWindow::finishLoading(bool restore) {
+    if (progressDialog) {
+        progressDialog->disconnect(meshLoader);
+        progressDialog->deleteLater();
+        progressDialog = 0;
+    }
+
+    //only a preview can be showing in place of the previous mesh
+    MeshPtr mesh = scene->getMesh();
+    if (restore && mesh && mesh->isPreview()) {
+        scene->setMesh(previousMesh);
         glWidget->getRenderer()->setScene(scene);
-    } else {
-        //display error if mesh fails to load
-        QMessageBox msgBox;
-        msgBox.setIcon(QMessageBox::Warning);
-        msgBox.setText("Error opening file. Please ensure that the file is a quad mesh.");
-        msgBox.exec();
     }
+    previousMesh.clear();
 
     glWidget->repaint();
 }
@@ -160,6 +278,27 @@ void MainWindow::editLights() {
     lightDialog->exec();
 }
 
+void MainWindow::editLightRig() {
+    //the rig is placed around the scene as seen from the current camera
+    int rig = openGLRenderer->getNumLights() - MAX_GL_LIGHTS;
+    bool ok;
+    rig = QInputDialog::getInt(this, "Light Rig", "Point lights:", rig, 0, MAX_CLUSTERED_LIGHTS - MAX_GL_LIGHTS, 1, &ok);
+    if (!ok) return;
+
+    openGLRenderer->setLightRig(rig);
+    glWidget->repaint();
+}
+
+void MainWindow::editFrameBudget() {
+    //0 draws every frame at full quality
+    bool ok;
+    int budget = QInputDialog::getInt(this, "Frame Budget", "Milliseconds while moving (0 for full quality):",
+                                      (int)openGLRenderer->getFrameBudget(), 0, 1000, 1, &ok);
+    if (!ok) return;
+
+    openGLRenderer->setFrameBudget(budget);
+}
+
 void MainWindow::editCamera() {
     cameraDialog->exec();
 }
@@ -184,6 +323,11 @@ void MainWindow::renderPhong() {
     glWidget->repaint();
 }
 
+void MainWindow::renderShadedWireframe() {
+    glWidget->setRenderMode(RENDER_MODE_SHADED_WIREFRAME);
+    glWidget->repaint();
+}
+
 void MainWindow::showInfo() {
     glWidget->setShowInfo( !glWidget->getShowInfo() );
     glWidget->repaint();
@@ -201,3 +345,56 @@ void MainWindow::subdivide(uint steps) {
         scene->subdivide(steps);
     glWidget->repaint();
 }
+
+void MainWindow::setCopies(int copies) {
+    if (scene)
+        scene->setCopies(copies);
+    glWidget->repaint();
+}
+
+void MainWindow::setLevelsOfDetail(bool enabled) {
+    if (scene)
+        scene->setLevelsOfDetail(enabled);
+    glWidget->repaint();
+}
+
+void MainWindow::setSoftwareRasterizer(bool enabled) {
+    Renderer *previous = glWidget->getRenderer();
+    Renderer *renderer = enabled ? (Renderer*)softwareRenderer : (Renderer*)openGLRenderer;
+    if (renderer == previous) return;
+
+    //the renderer taken over shows what the other one did, init reset its first light
+    glWidget->setRenderer(renderer);
+    renderer->setCamera(previous->getCamera());
+    for (int i = 0; i < MAX_GL_LIGHTS; i++)
+        renderer->setLight(i, previous->getLight(i));
+    renderer->setRenderMode(previous->getRenderMode());
+    renderer->setScene(previous->getScene());
+
+    lightDialog->setRenderer(renderer);
+    cameraDialog->setRenderer(renderer);
+    glWidget->repaint();
+}
+
+void MainWindow::toggleTracing() {
+#ifdef VIEWER_TRACING
+    //start a fresh trace every time recording is switched on
+    if (!Trace::isEnabled())
+        Trace::clear();
+    Trace::setEnabled(!Trace::isEnabled());
+#endif
+}
+
+void MainWindow::saveTrace() {
+#ifdef VIEWER_TRACING
+    QString fileName = QFileDialog::getSaveFileName(this, "Save Trace", "trace.json", "JSON Files (*.json)");
+    if (fileName == "") return;
+
+    if (!Trace::save(fileName)) {
+        QMessageBox msgBox;
+        msgBox.setIcon(QMessageBox::Warning);
+        msgBox.setText("Error saving trace.");
+        msgBox.exec();
+    }
+#endif
+}
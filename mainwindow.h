@@ -5,14 +5,17 @@
 #include <QMenu>
 #include <QMenuBar>
 #include <QAction>
+#include <QProgressDialog>
 
 #include "glwidget.h"
 #include "lightdialog.h"
 #include "cameradialog.h"
 
-#include "openglrenderer.h"
+#include "clusteredrenderer.h"
+#include "softwarerenderer.h"
 #include "scene.h"
 #include "mesh.h"
+#include "meshloader.h"
 
 #define WIDTH 600
 #define HEIGHT 600
@@ -50,25 +53,48 @@ class MainWindow : public QMainWindow {
     protected slots:
         void open();
         void editLights();
+        void editLightRig();
+        void editFrameBudget();
         void editCamera();
         void showAxis();
         void renderDefault();
         void renderWireframe();
         void renderPhong();
+        void renderShadedWireframe();
         void showInfo();
         void toggleFullscreen();
         void subdivide(uint steps);
+        void setCopies(int copies);
+        void setLevelsOfDetail(bool enabled);
+        void setSoftwareRasterizer(bool enabled);
+        void toggleTracing();
+        void saveTrace();
+
+        //results of the mesh loader
+        void updateLoadProgress(int percent);
+        void showPreview(MeshPtr preview);
+        void showLoadedMesh(MeshPtr mesh);
+        void loadFailed(QString filename);
+        void loadCancelled();
 
     private:
         void createMenus();
 
+        //closes the progress dialog and puts back the mesh shown before loading
+        void finishLoading(bool restore);
+
         GLWidget* glWidget;         //main display widget
         LightDialog *lightDialog;
         CameraDialog *cameraDialog;
 
-        OpenGLRenderer *openGLRenderer;
+        ClusteredRenderer *openGLRenderer;
+        SoftwareRenderer *softwareRenderer;
         Scene *scene;
-        Mesh *mesh;
+
+        //loads meshes in the background, the previous mesh is kept until the new one replaces it
+        MeshLoader *meshLoader;
+        QProgressDialog *progressDialog;
+        MeshPtr previousMesh;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,1287 @@
+#include "mathbenchmark.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "types.h"
+#include "utils/bvh.h"
+#include "utils/decimator.h"
+#include "utils/delaunay.h"
+#include "utils/kernels.h"
+#include "utils/pointutils.h"
+#include "utils/rasterizer.h"
+#include "utils/timer.h"
+
+using namespace std;
+
+//keeps benchmark results alive so the compiler cannot discard the loops
+static volatile double sink;
+
+//plain float vector used as the reference implementation
+struct RefVector3 {
+    float x;
+    float y;
+    float z;
+};
+
+static inline RefVector3 refVector3(float x, float y, float z) {
+    RefVector3 v = {x, y, z};
+    return v;
+}
+
+static inline RefVector3 refAdd(const RefVector3 &a, const RefVector3 &b) {
+    return refVector3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+static inline RefVector3 refSub(const RefVector3 &a, const RefVector3 &b) {
+    return refVector3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline RefVector3 refScale(const RefVector3 &a, float s) {
+    return refVector3(a.x * s, a.y * s, a.z * s);
+}
+
+static inline float refDot(const RefVector3 &a, const RefVector3 &b) {
+    return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+
+static inline RefVector3 refCross(const RefVector3 &a, const RefVector3 &b) {
+    return refVector3(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+}
+
+static inline double refMagnitude(const RefVector3 &a) {
+    return sqrt(refDot(a, a));
+}
+
+//closed form determinant of a 3x3 matrix
+static inline double refDet3(const float m[3][3]) {
+    return m[0][0] * ((double)m[1][1]*m[2][2] - (double)m[1][2]*m[2][1])
+         - m[0][1] * ((double)m[1][0]*m[2][2] - (double)m[1][2]*m[2][0])
+         + m[0][2] * ((double)m[1][0]*m[2][1] - (double)m[1][1]*m[2][0]);
+}
+
+//closed form determinant of a 4x4 matrix using the 2x2 minors of the top and bottom rows
+static inline double refDet4(const float m[4][4]) {
+    double s0 = (double)m[0][0]*m[1][1] - (double)m[1][0]*m[0][1];
+    double s1 = (double)m[0][0]*m[1][2] - (double)m[1][0]*m[0][2];
+    double s2 = (double)m[0][0]*m[1][3] - (double)m[1][0]*m[0][3];
+    double s3 = (double)m[0][1]*m[1][2] - (double)m[1][1]*m[0][2];
+    double s4 = (double)m[0][1]*m[1][3] - (double)m[1][1]*m[0][3];
+    double s5 = (double)m[0][2]*m[1][3] - (double)m[1][2]*m[0][3];
+
+    double c5 = (double)m[2][2]*m[3][3] - (double)m[3][2]*m[2][3];
+    double c4 = (double)m[2][1]*m[3][3] - (double)m[3][1]*m[2][3];
+    double c3 = (double)m[2][1]*m[3][2] - (double)m[3][1]*m[2][2];
+    double c2 = (double)m[2][0]*m[3][3] - (double)m[3][0]*m[2][3];
+    double c1 = (double)m[2][0]*m[3][2] - (double)m[3][0]*m[2][2];
+    double c0 = (double)m[2][0]*m[3][1] - (double)m[3][0]*m[2][1];
+
+    return s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+}
+
+//returns a pseudo-random float in [-1,1]
+static float randFloat() {
+    return 2.0f * rand() / RAND_MAX - 1.0f;
+}
+
+//returns true if a and b are equal within a relative tolerance
+static bool nearlyEqual(double a, double b, double eps = 1E-4) {
+    return fabs(a - b) <= eps * MAX(1.0, MAX(fabs(a), fabs(b)));
+}
+
+static bool nearlyEqual(Vector3f a, const RefVector3 &b) {
+    return nearlyEqual(a[0], b.x) && nearlyEqual(a[1], b.y) && nearlyEqual(a[2], b.z);
+}
+
+MathBenchmark::MathBenchmark()
+    : m_iterations(MATH_BENCHMARK_ITERATIONS), m_delaunayPoints(MATH_BENCHMARK_DELAUNAY_POINTS), m_failures(0)
+{
+}
+
+QString MathBenchmark::usage() {
+    return "usage: viewer --benchmark-math [--iterations N] [--points N]";
+}
+
+bool MathBenchmark::parseArguments(QStringList args) {
+    for (int i = 0; i < args.size(); i++) {
+        QString option = args[i];
+        if (!option.startsWith("--") || option == "--benchmark-math") continue;
+        if (i + 1 >= args.size()) return false;
+
+        bool ok = false;
+        if (option == "--iterations")
+            m_iterations = args[++i].toInt(&ok);
+        else if (option == "--points")
+            m_delaunayPoints = args[++i].toInt(&ok);
+        if (!ok) return false;
+    }
+
+    return m_iterations > 0 && m_delaunayPoints >= 3;
+}
+
+bool MathBenchmark::run(QTextStream &out) {
+    m_failures = 0;
+    runChecks(out);
+    runKernelChecks(out);
+    runDelaunayChecks(out);
+    runBvhChecks(out);
+    runDecimatorChecks(out);
+    runRasterizerChecks(out);
+    runBenchmarks(out);
+    runKernelBenchmarks(out);
+    runDelaunayBenchmarks(out);
+    runBvhBenchmarks(out);
+    runDecimatorBenchmarks(out);
+    runRasterizerBenchmarks(out);
+
+    out << "checks: " << (m_failures == 0 ? "all passed" : "FAILED")
+        << " (" << m_failures << " failures)" << endl;
+    return m_failures == 0;
+}
+
+void MathBenchmark::check(QTextStream &out, const char *name, bool passed) {
+    out << "check: " << name << " " << (passed ? "ok" : "FAILED") << endl;
+    if (!passed) m_failures++;
+}
+
+void MathBenchmark::report(QTextStream &out, const char *name, double templateMs, double referenceMs, uint ops) {
+    out << "bench: " << name
+        << " template " << templateMs * 1E6 / ops << " ns/op"
+        << " reference " << referenceMs * 1E6 / ops << " ns/op"
+        << " ratio " << templateMs / referenceMs << endl;
+}
+
+void MathBenchmark::reportKernel(QTextStream &out, const char *name, const char *isa, double ms, double scalarMs, uint ops) {
+    out << "bench: kernel " << name << " " << isa << " " << ms * 1E6 / ops << " ns/op"
+        << " scalar " << scalarMs * 1E6 / ops << " ns/op"
+        << " ratio " << ms / scalarMs << endl;
+}
+
+//instruction sets of the batch kernels, the ones the CPU does not support are skipped
+static const char *s_instructionSets[] = {"scalar", "sse", "avx2"};
+#define NUM_INSTRUCTION_SETS 3
+
+void MathBenchmark::runChecks(QTextStream &out) {
+    srand(1);
+
+    //construction and copy
+    Vector3f zero;
+    check(out, "vector default construction is zero", zero[0] == 0 && zero[1] == 0 && zero[2] == 0);
+
+    Vector4f v(1, 2, 3, 4);
+    check(out, "vector construction", v[0] == 1 && v[1] == 2 && v[2] == 3 && v[3] == 4);
+    check(out, "vector named elements", v.x() == 1 && v.y() == 2 && v.z() == 3 && v.w() == 4);
+
+    Vector4f copy(v);
+    Vector4f assigned;
+    assigned = v;
+    check(out, "vector copy", copy == v && assigned == v);
+
+    copy.x() = 10;
+    check(out, "vector copy is independent", copy[0] == 10 && v[0] == 1);
+
+    check(out, "vector layout", sizeof(Vector3f) == 3*sizeof(float) && sizeof(Vector4f) == 4*sizeof(float)
+          && sizeof(Vector3d) == 3*sizeof(double));
+    check(out, "matrix layout", sizeof(Matrix4f) == 16*sizeof(float));
+
+    //arithmetic, dot, cross and magnitude against the reference
+    bool add = true, sub = true, scale = true, div = true;
+    bool dot = true, cross = true, magnitude = true, unit = true;
+    for (uint i = 0; i < 1000; i++) {
+        float a0 = randFloat(), a1 = randFloat(), a2 = randFloat();
+        float b0 = randFloat(), b1 = randFloat(), b2 = randFloat();
+        float s = randFloat() + 2.0f;
+
+        Vector3f a(a0, a1, a2), b(b0, b1, b2);
+        RefVector3 ra = refVector3(a0, a1, a2), rb = refVector3(b0, b1, b2);
+
+        add = add && nearlyEqual(a + b, refAdd(ra, rb));
+        sub = sub && nearlyEqual(a - b, refSub(ra, rb));
+        scale = scale && nearlyEqual(a * s, refScale(ra, s));
+        div = div && nearlyEqual(a / s, refScale(ra, 1.0f / s));
+        dot = dot && nearlyEqual(a.dot(b), refDot(ra, rb));
+        cross = cross && nearlyEqual(a.cross(b), refCross(ra, rb));
+        magnitude = magnitude && nearlyEqual(a.magnitude(), refMagnitude(ra));
+        unit = unit && nearlyEqual(a.unit().magnitude(), 1.0);
+    }
+    check(out, "vector addition", add);
+    check(out, "vector subtraction", sub);
+    check(out, "vector scalar multiplication", scale);
+    check(out, "vector scalar division", div);
+    check(out, "vector dot product", dot);
+    check(out, "vector cross product", cross);
+    check(out, "vector magnitude", magnitude);
+    check(out, "vector unit", unit);
+
+    //ordering used by the point lookup map
+    check(out, "vector lexicographic order", Vector3f(0, 1, 2) < Vector3f(0, 2, 0) && !(Vector3f(1, 0, 0) < Vector3f(0, 5, 5)));
+
+    //matrix addition
+    Matrix3f A, B;
+    for (uint i = 0; i < 3; i++) {
+        for (uint j = 0; j < 3; j++) {
+            A[i][j] = i*3 + j;
+            B[i][j] = 1;
+        }
+    }
+    Matrix3f C = A + B;
+    bool matrixAdd = true;
+    for (uint i = 0; i < 3; i++)
+        for (uint j = 0; j < 3; j++)
+            matrixAdd = matrixAdd && C[i][j] == i*3 + j + 1;
+    check(out, "matrix addition", matrixAdd);
+
+    //determinants against the closed form
+    bool det2 = true, det3 = true, det4 = true;
+    for (uint n = 0; n < 1000; n++) {
+        Matrix<float,2,2> M2;
+        Matrix3f M3;
+        Matrix4f M4;
+        float m3[3][3], m4[4][4];
+        for (uint i = 0; i < 4; i++) {
+            for (uint j = 0; j < 4; j++) {
+                m4[i][j] = M4[i][j] = randFloat();
+                if (i < 3 && j < 3) m3[i][j] = M3[i][j] = m4[i][j];
+                if (i < 2 && j < 2) M2[i][j] = m4[i][j];
+            }
+        }
+
+        det2 = det2 && nearlyEqual(M2.det(), (double)m4[0][0]*m4[1][1] - (double)m4[0][1]*m4[1][0]);
+        det3 = det3 && nearlyEqual(M3.det(), refDet3(m3));
+        det4 = det4 && nearlyEqual(M4.det(), refDet4(m4));
+    }
+    check(out, "matrix 2x2 determinant", det2);
+    check(out, "matrix 3x3 determinant", det3);
+    check(out, "matrix 4x4 determinant", det4);
+
+    Matrix4f I = Matrix4f::identity();
+    check(out, "matrix identity determinant", I.det() == 1);
+
+    //rows of non-square matrices
+    Matrix<float,2,3> R;
+    for (uint i = 0; i < 2; i++)
+        for (uint j = 0; j < 3; j++)
+            R[i][j] = i*3 + j;
+    check(out, "matrix non-square rows", R.ptr()[4] == 4 && R.transpose()[2][1] == 5);
+
+    //multiply, transpose and inverse of 4x4 matrices
+    bool multiply = true, transpose = true, inverse = true;
+    for (uint n = 0; n < 100; n++) {
+        Matrix4f A4, B4;
+        for (uint i = 0; i < 4; i++) {
+            for (uint j = 0; j < 4; j++) {
+                A4[i][j] = randFloat();
+                B4[i][j] = randFloat();
+            }
+        }
+
+        Matrix4f P = A4 * B4, T = A4.transpose(), AI = A4 * A4.inverse();
+        for (uint i = 0; i < 4; i++) {
+            for (uint j = 0; j < 4; j++) {
+                double p = 0;
+                for (uint k = 0; k < 4; k++) p += A4[i][k] * B4[k][j];
+                multiply = multiply && nearlyEqual(P[i][j], p);
+                transpose = transpose && T[i][j] == A4[j][i];
+                inverse = inverse && nearlyEqual(AI[i][j], i == j ? 1 : 0, 1E-3);
+            }
+        }
+    }
+    check(out, "matrix 4x4 multiply", multiply);
+    check(out, "matrix 4x4 transpose", transpose);
+    check(out, "matrix 4x4 inverse", inverse);
+    check(out, "matrix singular inverse is zero", Matrix4f().inverse().det() == 0);
+
+    //camera matrices: the frustum maps the near plane corners to the clip cube corners
+    //and lookAt maps the eye to the origin and the center onto the -z axis
+    Matrix4f F = frustumMatrix(-1, 1, -2, 2, 1, 100);
+    Vector4f corner = F * Vector4f(1, 2, -1, 1);
+    Vector4f far = F * Vector4f(0, 0, -100, 1);
+    check(out, "frustum matrix", nearlyEqual(corner[0] / corner[3], 1) && nearlyEqual(corner[1] / corner[3], 1)
+                                && nearlyEqual(corner[2] / corner[3], -1) && nearlyEqual(far[2] / far[3], 1));
+
+    Matrix4f V = lookAtMatrix(Vector3f(1, 2, 3), Vector3f(0, 0, 0), Vector3f(0, 1, 0));
+    Vector4f eye = V * Vector4f(1, 2, 3, 1);
+    Vector4f center = V * Vector4f(0, 0, 0, 1);
+    check(out, "lookAt matrix", nearlyEqual(Vector3f(eye[0], eye[1], eye[2]).magnitude(), 0)
+                                && nearlyEqual(center[0], 0) && nearlyEqual(center[1], 0)
+                                && nearlyEqual(center[2], -sqrt(14.0)));
+
+    //geometric predicates built on the templates
+    Vector2f a(0, 0), b(1, 0), c(0, 1);
+    check(out, "inCircle inside", inCircle(a, b, c, Vector2f(0.2f, 0.2f)));
+    check(out, "inCircle outside", !inCircle(a, b, c, Vector2f(2, 2)));
+    check(out, "inTriangle inside", inTriangle(a, b, c, Vector2f(0.2f, 0.2f)));
+    check(out, "inTriangle outside", !inTriangle(a, b, c, Vector2f(1, 1)));
+    check(out, "pointLineTest", pointLineTest(a, b, c) == -1 && pointLineTest(a, c, b) == 1
+                                && pointLineTest(a, b, Vector2f(2, 0)) == 0);
+
+    //ear clipping of a concave polygon in both windings must cover its area with triangles of its winding
+    Vector2f polygon[] = {Vector2f(0, 0), Vector2f(4, 0), Vector2f(4, 4), Vector2f(2, 1), Vector2f(0, 4), Vector2f(1, 2)};
+    bool earClipping = true;
+    for (uint k = 0; k < 2; k++) {
+        vector<uint> triangles;
+        triangulatePolygon(polygon, 6, triangles);
+
+        double area = 0;
+        for (uint i = 0; i < triangles.size(); i += 3) {
+            double o = orient2d(polygon[triangles[i]], polygon[triangles[i+1]], polygon[triangles[i+2]]);
+            earClipping = earClipping && (k == 0 ? o > 0 : o < 0);
+            area += fabs(o) / 2;
+        }
+        earClipping = earClipping && triangles.size() == 12 && area == 8;
+
+        reverse(polygon, polygon + 6);
+    }
+    check(out, "triangulatePolygon concave", earClipping);
+}
+
+void MathBenchmark::runDelaunayChecks(QTextStream &out) {
+    srand(5);
+
+    //points on the line y = x are exactly colinear, a one ulp step off it must give the right sign
+    bool colinear = true, offLine = true;
+    for (uint i = 0; i < 1000; i++) {
+        float s = fabs(randFloat()) * 1E6f, t = fabs(randFloat()) * 1E6f, u = fabs(randFloat()) * 1E6f;
+        Vector2f a(s, s), b(t, t), c(u, u);
+        colinear = colinear && orient2d(a, b, c) == 0;
+
+        if (s == t) continue;
+        Vector2f above(u, nextafterf(u, 2E6f)), below(u, nextafterf(u, -1));
+        double sign = s < t ? 1 : -1;
+        offLine = offLine && orient2d(a, b, above) * sign > 0 && orient2d(a, b, below) * sign < 0;
+    }
+    check(out, "orient2d colinear", colinear);
+    check(out, "orient2d near colinear", offLine);
+
+    //the corners of a square far from the origin are cocircular, moving one by an ulp must give the right sign
+    bool cocircular = true, offCircle = true;
+    for (uint i = 0; i < 1000; i++) {
+        float x = floorf(randFloat() * 1E6f), y = floorf(randFloat() * 1E6f);
+        float r = floorf(fabs(randFloat()) * 1000) + 1;
+        Vector2f a(x + r, y), b(x, y + r), c(x - r, y), d(x, y - r);
+        cocircular = cocircular && incircle(a, b, c, d) == 0;
+
+        Vector2f inside(x, nextafterf(y - r, y)), outside(x, nextafterf(y - r, y - 2*r));
+        offCircle = offCircle && incircle(a, b, c, inside) > 0 && incircle(a, b, c, outside) < 0;
+    }
+    check(out, "incircle cocircular", cocircular);
+    check(out, "incircle near cocircular", offCircle);
+
+    uint u, v;
+    unhash(::hash(100000, 70000), u, v);
+    check(out, "edge key of large indices", u == 70000 && v == 100000 && ::hash(0, 65536) != ::hash(1, 0));
+
+    //random points in general position
+    uint n = 10000;
+    vector<Vector2f> points(n);
+    for (uint i = 0; i < n; i++) points[i] = Vector2f(randFloat(), randFloat());
+
+    Delaunay delaunay;
+    bool ok = delaunay.triangulate(points);
+    const vector<uint> &triangles = delaunay.getTriangles();
+    bool ccw = true;
+    for (uint i = 0; i < triangles.size(); i += 3)
+        ccw = ccw && orient2d(points[triangles[i]], points[triangles[i+1]], points[triangles[i+2]]) > 0;
+
+    //a triangulation of n points with h on the hull has 2n - 2 - h triangles and 3n - 3 - h edges
+    uint h = 2*n - 2 - delaunay.getNumTriangles();
+    check(out, "delaunay random points", ok && delaunay.isDelaunay() && ccw
+                                         && delaunay.getEdges().size() == 3*n - 3 - h && h < 100);
+
+    //a grid is full of cocircular points, with one point repeated
+    points.clear();
+    for (uint i = 0; i < 100; i++)
+        for (uint j = 0; j < 100; j++)
+            points.push_back(Vector2f(i, j));
+    points.push_back(Vector2f(50, 50));
+
+    ok = delaunay.triangulate(points);
+    check(out, "delaunay grid", ok && delaunay.isDelaunay() && delaunay.getNumDuplicates() == 1
+                                && delaunay.getNumTriangles() == 2*99*99);
+
+    //colinear points span no triangle
+    points.clear();
+    for (uint i = 0; i < 10; i++) points.push_back(Vector2f(i, 2*i));
+    check(out, "delaunay colinear points", !delaunay.triangulate(points));
+}
+
+//returns the closest triangle hit by a ray by testing all of them, or -1 on a miss
+static int refIntersect(const vector<Vector3f> &positions, const vector<uint> &triangles,
+                        const Vector3f &origin, const Vector3f &direction, double &t) {
+    int closest = -1;
+    t = 1E30;
+    for (uint i = 0; i < triangles.size() / 3; i++) {
+        Vector3f a = positions[triangles[3*i]];
+        Vector3f e1 = positions[triangles[3*i + 1]] - a, e2 = positions[triangles[3*i + 2]] - a;
+        Vector3f p = direction.cross(e2), s = origin - a, q = s.cross(e1);
+        double det = e1.dot(p);
+        if (fabs(det) < 1E-12) continue;
+
+        double u = s.dot(p) / det, v = direction.dot(q) / det, d = e2.dot(q) / det;
+        if (u >= 0 && v >= 0 && u + v <= 1 && d > 0 && d < t) {
+            t = d;
+            closest = i;
+        }
+    }
+    return closest;
+}
+
+void MathBenchmark::runBvhChecks(QTextStream &out) {
+    srand(7);
+
+    //a soup of small random triangles
+    uint n = 2000;
+    vector<Vector3f> positions(3*n);
+    vector<uint> triangles(3*n);
+    for (uint i = 0; i < n; i++) {
+        Vector3f center(randFloat(), randFloat(), randFloat());
+        for (uint j = 0; j < 3; j++) {
+            positions[3*i + j] = center + Vector3f(randFloat(), randFloat(), randFloat()) * 0.1f;
+            triangles[3*i + j] = 3*i + j;
+        }
+    }
+
+    Bvh bvh;
+    bvh.build(&positions[0], &triangles[0], n);
+
+    //rays from outside the unit box through random points inside it
+    bool same = true;
+    uint hits = 0;
+    for (uint i = 0; i < 1000; i++) {
+        Vector3f origin = Vector3f(randFloat(), randFloat(), randFloat()).unit() * 3.0f;
+        Vector3f direction = Vector3f(randFloat(), randFloat(), randFloat()) - origin;
+
+        double refT;
+        int refTriangle = refIntersect(positions, triangles, origin, direction, refT);
+        float t;
+        uint triangle;
+        bool hit = bvh.intersect(&positions[0], origin, direction, 1E30f, t, triangle);
+
+        same = same && hit == (refTriangle >= 0) && (!hit || ((int)triangle == refTriangle && nearlyEqual(t, refT)));
+        hits += hit;
+    }
+    check(out, "bvh closest hit", same && hits > 100);
+
+    //moving the triangles and refitting must give the same hits as moving the rays
+    vector<Vector3f> moved(positions.size());
+    Vector3f offset(1, 2, 3);
+    for (uint i = 0; i < positions.size(); i++) moved[i] = positions[i] + offset;
+    bvh.refit(&moved[0]);
+
+    same = true;
+    for (uint i = 0; i < 1000; i++) {
+        Vector3f origin = Vector3f(randFloat(), randFloat(), randFloat()).unit() * 3.0f;
+        Vector3f direction = Vector3f(randFloat(), randFloat(), randFloat()) - origin;
+
+        double refT;
+        int refTriangle = refIntersect(positions, triangles, origin, direction, refT);
+        float t;
+        uint triangle;
+        bool hit = bvh.intersect(&moved[0], origin + offset, direction, 1E30f, t, triangle);
+
+        same = same && hit == (refTriangle >= 0) && (!hit || ((int)triangle == refTriangle && nearlyEqual(t, refT, 1E-3)));
+    }
+    check(out, "bvh refit", same);
+}
+
+//builds a torus of side x side points around the z axis, with radii 1 and 0.4
+static void makeTorus(uint side, vector<Vector3f> &positions, vector<uint> &triangles) {
+    positions.resize(side * side);
+    for (uint i = 0; i < side; i++)
+        for (uint j = 0; j < side; j++) {
+            float a = 2 * M_PI * i / side, b = 2 * M_PI * j / side;
+            positions[i*side + j] = Vector3f((1 + 0.4f*cosf(b)) * cosf(a), (1 + 0.4f*cosf(b)) * sinf(a), 0.4f*sinf(b));
+        }
+
+    triangles.clear();
+    triangles.reserve(6 * side * side);
+    for (uint i = 0; i < side; i++)
+        for (uint j = 0; j < side; j++) {
+            uint a = i*side + j, b = (i + 1) % side * side + j, c = (i + 1) % side * side + (j + 1) % side;
+            uint d = i*side + (j + 1) % side;
+            uint quad[6] = {a, b, c, a, c, d};
+            triangles.insert(triangles.end(), quad, quad + 6);
+        }
+}
+
+//returns true if every edge of the triangles is shared by exactly two of them and none is degenerate
+static bool isClosedManifold(const vector<uint> &triangles) {
+    vector<unsigned long long> edges;
+    for (uint i = 0; i < triangles.size(); i += 3)
+        for (uint j = 0; j < 3; j++) {
+            unsigned long long a = triangles[i + j], b = triangles[i + (j+1) % 3];
+            if (a == b) return false;
+            edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+        }
+    sort(edges.begin(), edges.end());
+    for (uint i = 0; i < edges.size(); i += 2)
+        if (i + 1 >= edges.size() || edges[i] != edges[i + 1] || (i + 2 < edges.size() && edges[i + 2] == edges[i]))
+            return false;
+    return true;
+}
+
+//returns the largest distance of the points from the surface of the torus built by makeTorus
+static double torusDistance(const vector<Vector3f> &positions) {
+    double distance = 0;
+    for (uint i = 0; i < positions.size(); i++) {
+        const Vector3f &p = positions[i];
+        double r = sqrt((double)p[0]*p[0] + (double)p[1]*p[1]) - 1;
+        distance = max(distance, fabs(sqrt(r*r + (double)p[2]*p[2]) - 0.4));
+    }
+    return distance;
+}
+
+void MathBenchmark::runDecimatorChecks(QTextStream &out) {
+    vector<Vector3f> positions;
+    vector<uint> triangles;
+    makeTorus(100, positions, triangles);
+    uint n = triangles.size() / 3;
+
+    //the reduced torus must stay closed, and its error must be of the size of its distance from the torus
+    Decimator decimator;
+    decimator.setNumThreads(1);
+    decimator.decimate(&positions[0], positions.size(), &triangles[0], n, n / 16);
+    double distance = torusDistance(decimator.getPositions());
+    check(out, "decimate torus", decimator.getNumTriangles() == n / 16 && isClosedManifold(decimator.getTriangles())
+                                 && distance <= 2 * decimator.getError() && decimator.getError() < 0.02f);
+
+    //slabs reduced in parallel must leave the same kind of surface
+    makeTorus(200, positions, triangles);
+    n = triangles.size() / 3;
+    decimator.setNumThreads(4);
+    decimator.decimate(&positions[0], positions.size(), &triangles[0], n, n / 4);
+    distance = torusDistance(decimator.getPositions());
+    check(out, "decimate torus in slabs", decimator.getNumPartitions() == 4 && decimator.getNumTriangles() == n / 4
+                                          && isClosedManifold(decimator.getTriangles())
+                                          && distance <= 2 * decimator.getError());
+
+    //the boundary of an open grid must not move
+    uint side = 50;
+    positions.clear();
+    triangles.clear();
+    for (uint i = 0; i < side; i++)
+        for (uint j = 0; j < side; j++)
+            positions.push_back(Vector3f(i, j, 0.1f * sinf(0.3f*i) * cosf(0.3f*j)));
+    for (uint i = 0; i + 1 < side; i++)
+        for (uint j = 0; j + 1 < side; j++) {
+            uint a = i*side + j, b = a + side, c = b + 1, d = a + 1;
+            uint quad[6] = {a, b, c, a, c, d};
+            triangles.insert(triangles.end(), quad, quad + 6);
+        }
+    n = triangles.size() / 3;
+    decimator.setNumThreads(1);
+    decimator.decimate(&positions[0], positions.size(), &triangles[0], n, n / 8);
+    uint corners = 0, edgePoints = 0;
+    const vector<Vector3f> &reduced = decimator.getPositions();
+    for (uint i = 0; i < reduced.size(); i++) {
+        bool onX = reduced[i][0] == 0 || reduced[i][0] == side - 1;
+        bool onY = reduced[i][1] == 0 || reduced[i][1] == side - 1;
+        corners += onX && onY;
+        edgePoints += onX || onY;
+    }
+    check(out, "decimate keeps boundary", corners == 4 && edgePoints == 4 * (side - 1) && decimator.getNumTriangles() <= n / 8);
+}
+
+//a vertex of triangles drawn by the rasterizer, laid out like the draw buffers of meshes
+struct RasterVertex {
+    Vector3f position;
+    Vector3f normal;
+    unsigned char edgeFlag;
+};
+
+//adds a triangle facing +z, with its corners in the given order
+static void addRasterTriangle(vector<RasterVertex> &vertices, const Vector3f &a, const Vector3f &b, const Vector3f &c,
+                              bool edges = true)
+{
+    const Vector3f *corners[3] = {&a, &b, &c};
+    for (uint i = 0; i < 3; i++) {
+        RasterVertex v;
+        v.position = *corners[i];
+        v.normal = Vector3f(0, 0, 1);
+        v.edgeFlag = edges;
+        vertices.push_back(v);
+    }
+}
+
+//draws one frame of the triangles, seen from the origin down -z with a 90 degree square view
+static void rasterizeFrame(Rasterizer &rasterizer, const vector<RasterVertex> &vertices, const Matrix4f &modelView,
+                           RasterShading shading)
+{
+    vector<RasterLight> lights(1);
+    lights[0].position = Vector4f(0, 0, 1, 0);
+    lights[0].ambient = Vector3f(0.5f, 0.5f, 0.5f);
+    lights[0].diffuse = Vector3f(1, 1, 1);
+    lights[0].specular = Vector3f(1, 1, 1);
+
+    rasterizer.setProjection(frustumMatrix(-1, 1, -1, 1, 1, 100));
+    rasterizer.setLights(lights);
+    rasterizer.setShading(shading);
+    rasterizer.begin();
+    rasterizer.addTriangles(&vertices[0].position, &vertices[0].normal, &vertices[0].edgeFlag, sizeof(RasterVertex),
+                            vertices.size(), &modelView, 1);
+    rasterizer.end();
+}
+
+//returns the red channel of a pixel of the last frame
+static uint redAt(const Rasterizer &rasterizer, int x, int y) {
+    return ((const unsigned char*)&rasterizer.getPixels()[y * rasterizer.getWidth() + x])[0];
+}
+
+//builds the triangles of a torus as a mesh draw buffer, every edge a face edge
+static void makeRasterTorus(uint side, vector<RasterVertex> &vertices) {
+    vector<Vector3f> positions;
+    vector<uint> triangles;
+    makeTorus(side, positions, triangles);
+
+    vertices.resize(triangles.size());
+    for (uint i = 0; i < triangles.size(); i++) {
+        const Vector3f &p = positions[triangles[i]];
+        Vector3f ring(p[0], p[1], 0);
+        ring = ring * (float)(1 / ring.magnitude());
+        vertices[i].position = p;
+        vertices[i].normal = (p - ring).unit();
+        vertices[i].edgeFlag = 1;
+    }
+}
+
+void MathBenchmark::runRasterizerChecks(QTextStream &out) {
+    srand(5);
+    Rasterizer rasterizer;
+    rasterizer.resize(200, 150);
+
+    //a jittered grid of triangles wound either way, larger than the view, must leave no pixel uncovered
+    uint side = 24;
+    vector<Vector3f> grid((side + 1) * (side + 1));
+    for (uint i = 0; i <= side; i++)
+        for (uint j = 0; j <= side; j++) {
+            bool inner = i > 0 && j > 0 && i < side && j < side;
+            float jitter = inner ? 0.4f : 0;
+            grid[i*(side + 1) + j] = Vector3f(-8 + 16.0f * (j + jitter * randFloat()) / side,
+                                              -8 + 16.0f * (i + jitter * randFloat()) / side, -5);
+        }
+    vector<RasterVertex> vertices;
+    for (uint i = 0; i < side; i++)
+        for (uint j = 0; j < side; j++) {
+            const Vector3f &a = grid[i*(side + 1) + j], &b = grid[i*(side + 1) + j + 1];
+            const Vector3f &c = grid[(i + 1)*(side + 1) + j + 1], &d = grid[(i + 1)*(side + 1) + j];
+            if ((i + j) % 2) {
+                addRasterTriangle(vertices, a, b, c);
+                addRasterTriangle(vertices, a, d, c);
+            } else {
+                addRasterTriangle(vertices, a, b, d);
+                addRasterTriangle(vertices, b, c, d);
+            }
+        }
+    rasterizeFrame(rasterizer, vertices, Matrix4f::identity(), RASTER_DIFFUSE);
+    bool covered = true;
+    for (int i = 0; i < rasterizer.getWidth() * rasterizer.getHeight(); i++)
+        covered = covered && rasterizer.getPixels()[i] != 0;
+    check(out, "rasterize without gaps", covered);
+
+    //the nearer of two overlapping squares must show whichever is drawn first, the farther one faces away
+    bool nearer = true;
+    for (uint order = 0; order < 2; order++) {
+        vector<RasterVertex> squares;
+        for (uint k = 0; k < 2; k++) {
+            float z = (k == order) ? -3 : -4;
+            addRasterTriangle(squares, Vector3f(-2, -2, z), Vector3f(2, -2, z), Vector3f(2, 2, z));
+            addRasterTriangle(squares, Vector3f(-2, -2, z), Vector3f(2, 2, z), Vector3f(-2, 2, z));
+            if (z < -3)
+                for (uint i = squares.size() - 6; i < squares.size(); i++) squares[i].normal = Vector3f(0, 0, -1);
+        }
+        rasterizeFrame(rasterizer, squares, Matrix4f::identity(), RASTER_DIFFUSE);
+        nearer = nearer && redAt(rasterizer, 100, 75) > 200;
+    }
+    check(out, "rasterize depth order", nearer);
+
+    //a floor reaching behind the eye and far to the sides is clipped, covering the view below the horizon only
+    vector<RasterVertex> floor;
+    addRasterTriangle(floor, Vector3f(-1000, -1, 10), Vector3f(1000, -1, 10), Vector3f(1000, -1, -90));
+    addRasterTriangle(floor, Vector3f(-1000, -1, 10), Vector3f(1000, -1, -90), Vector3f(-1000, -1, -90));
+    for (uint i = 0; i < floor.size(); i++) floor[i].normal = Vector3f(0, 1, 0);
+    rasterizeFrame(rasterizer, floor, Matrix4f::identity(), RASTER_DIFFUSE);
+    check(out, "rasterize clipped", redAt(rasterizer, 0, 0) != 0 && redAt(rasterizer, 199, 70) != 0
+                                    && redAt(rasterizer, 100, 80) == 0 && redAt(rasterizer, 0, 149) == 0);
+
+    //edges alone show the sides of a square split along its diagonal, not the diagonal
+    vector<RasterVertex> square;
+    addRasterTriangle(square, Vector3f(-2, -2, -4), Vector3f(2, -2, -4), Vector3f(2, 2, -4));
+    addRasterTriangle(square, Vector3f(-2, -2, -4), Vector3f(2, 2, -4), Vector3f(-2, 2, -4));
+    square[2].edgeFlag = square[3].edgeFlag = 0;
+    rasterizeFrame(rasterizer, square, Matrix4f::identity(), RASTER_EDGES);
+    check(out, "rasterize face edges", redAt(rasterizer, 70, 100) == 0 && redAt(rasterizer, 100, 75) == 0
+                                       && redAt(rasterizer, 100, 38) == 255 && redAt(rasterizer, 50, 75) == 255);
+
+    //threads claim tiles in any order, the frame must come out the same
+    vector<RasterVertex> torus;
+    makeRasterTorus(100, torus);
+    Matrix4f modelView = lookAtMatrix(Vector3f(0, -2.5f, 1.5f), Vector3f(0, 0, 0), Vector3f(0, 0, 1));
+    rasterizer.resize(301, 257);
+    vector<uint> frames[2];
+    int threads[] = {1, 4};
+    RasterShading modes[] = {RASTER_PHONG, RASTER_DIFFUSE_EDGES};
+    bool same = true;
+    for (uint m = 0; m < 2; m++) {
+        for (uint k = 0; k < 2; k++) {
+            rasterizer.setNumThreads(threads[k]);
+            rasterizeFrame(rasterizer, torus, modelView, modes[m]);
+            frames[k].assign(rasterizer.getPixels(), rasterizer.getPixels() + rasterizer.getWidth() * rasterizer.getHeight());
+        }
+        same = same && frames[0] == frames[1] && redAt(rasterizer, 150, 128) == 0 && redAt(rasterizer, 150, 90) != 0;
+    }
+    check(out, "rasterize threads agree", same);
+}
+
+void MathBenchmark::runBenchmarks(QTextStream &out) {
+    srand(2);
+
+    //random input data shared by the template and reference loops
+    uint n = MATH_BENCHMARK_SIZE;
+    vector<float> data(n * 3);
+    for (uint i = 0; i < data.size(); i++) data[i] = randFloat();
+
+    vector<Vector3f> A, B;
+    vector<RefVector3> refA, refB;
+    for (uint i = 0; i < n; i++) {
+        uint j = (i * 7 + 3) % n;
+        A.push_back(Vector3f(data[i*3], data[i*3+1], data[i*3+2]));
+        B.push_back(Vector3f(data[j*3], data[j*3+1], data[j*3+2]));
+        refA.push_back(refVector3(data[i*3], data[i*3+1], data[i*3+2]));
+        refB.push_back(refVector3(data[j*3], data[j*3+1], data[j*3+2]));
+    }
+
+    uint ops = n * m_iterations;
+    Timer timer;
+    double templateMs, referenceMs;
+
+    //construction and copy
+    {
+        double sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++) {
+            for (uint i = 0; i < n; i++) {
+                Vector3f v(data[i*3], data[i*3+1], data[i*3+2]);
+                Vector3f w = v;
+                sum += w[1];
+            }
+        }
+        templateMs = timer.elapsed();
+        sink = sum;
+
+        sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++) {
+            for (uint i = 0; i < n; i++) {
+                RefVector3 v = refVector3(data[i*3], data[i*3+1], data[i*3+2]);
+                RefVector3 w = v;
+                sum += w.y;
+            }
+        }
+        referenceMs = timer.elapsed();
+        sink = sum;
+        report(out, "construct+copy", templateMs, referenceMs, ops);
+    }
+
+    //arithmetic
+    {
+        vector<Vector3f> C(n);
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < n; i++)
+                C[i] = (A[i] + B[i] - C[i]) * 0.5f;
+        templateMs = timer.elapsed();
+        sink = C[n/2][0];
+
+        vector<RefVector3> refC(n, refVector3(0, 0, 0));
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < n; i++)
+                refC[i] = refScale(refSub(refAdd(refA[i], refB[i]), refC[i]), 0.5f);
+        referenceMs = timer.elapsed();
+        sink = refC[n/2].x;
+        report(out, "add+sub+scale", templateMs, referenceMs, ops);
+    }
+
+    //dot product
+    {
+        double sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < n; i++)
+                sum += A[i].dot(B[i]);
+        templateMs = timer.elapsed();
+        sink = sum;
+
+        sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < n; i++)
+                sum += refDot(refA[i], refB[i]);
+        referenceMs = timer.elapsed();
+        sink = sum;
+        report(out, "dot", templateMs, referenceMs, ops);
+    }
+
+    //cross product
+    {
+        double sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < n; i++)
+                sum += A[i].cross(B[i])[2];
+        templateMs = timer.elapsed();
+        sink = sum;
+
+        sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < n; i++)
+                sum += refCross(refA[i], refB[i]).z;
+        referenceMs = timer.elapsed();
+        sink = sum;
+        report(out, "cross", templateMs, referenceMs, ops);
+    }
+
+    //magnitude
+    {
+        double sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < n; i++)
+                sum += A[i].magnitude();
+        templateMs = timer.elapsed();
+        sink = sum;
+
+        sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < n; i++)
+                sum += refMagnitude(refA[i]);
+        referenceMs = timer.elapsed();
+        sink = sum;
+        report(out, "magnitude", templateMs, referenceMs, ops);
+    }
+
+    //determinants, using fewer matrices since each one consumes 16 floats
+    uint numMatrices = n / 16;
+    ops = numMatrices * m_iterations;
+    {
+        vector<Matrix3f> M(numMatrices);
+        vector<float> m(numMatrices * 9);
+        for (uint k = 0; k < numMatrices; k++) {
+            for (uint i = 0; i < 3; i++) {
+                for (uint j = 0; j < 3; j++) {
+                    M[k][i][j] = data[k*9 + i*3 + j];
+                    m[k*9 + i*3 + j] = data[k*9 + i*3 + j];
+                }
+            }
+        }
+
+        double sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < numMatrices; i++)
+                sum += M[i].det();
+        templateMs = timer.elapsed();
+        sink = sum;
+
+        sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < numMatrices; i++)
+                sum += refDet3((const float (*)[3])&m[i*9]);
+        referenceMs = timer.elapsed();
+        sink = sum;
+        report(out, "det 3x3", templateMs, referenceMs, ops);
+    }
+
+    {
+        vector<Matrix4f> M(numMatrices);
+        vector<float> m(numMatrices * 16);
+        for (uint k = 0; k < numMatrices; k++) {
+            for (uint i = 0; i < 4; i++) {
+                for (uint j = 0; j < 4; j++) {
+                    M[k][i][j] = data[k*16 + i*4 + j];
+                    m[k*16 + i*4 + j] = data[k*16 + i*4 + j];
+                }
+            }
+        }
+
+        double sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < numMatrices; i++)
+                sum += M[i].det();
+        templateMs = timer.elapsed();
+        sink = sum;
+
+        sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i < numMatrices; i++)
+                sum += refDet4((const float (*)[4])&m[i*16]);
+        referenceMs = timer.elapsed();
+        sink = sum;
+        report(out, "det 4x4", templateMs, referenceMs, ops);
+    }
+
+    //4x4 multiply against a plain loop
+    {
+        vector<Matrix4f> M(numMatrices);
+        vector<float> m(numMatrices * 16);
+        for (uint k = 0; k < numMatrices; k++) {
+            for (uint i = 0; i < 4; i++) {
+                for (uint j = 0; j < 4; j++) {
+                    M[k][i][j] = data[k*16 + i*4 + j];
+                    m[k*16 + i*4 + j] = data[k*16 + i*4 + j];
+                }
+            }
+        }
+
+        double sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++) {
+            for (uint i = 0; i + 1 < numMatrices; i++) {
+                Matrix4f P = M[i] * M[i+1];
+                for (uint j = 0; j < 16; j++) sum += P.ptr()[j];
+            }
+        }
+        templateMs = timer.elapsed();
+        sink = sum;
+
+        sum = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++) {
+            for (uint i = 0; i + 1 < numMatrices; i++) {
+                const float *a = &m[i*16], *b = &m[(i+1)*16];
+                float P[16];
+                for (uint r = 0; r < 4; r++)
+                    for (uint c = 0; c < 4; c++)
+                        P[r*4 + c] = a[r*4]*b[c] + a[r*4+1]*b[4+c] + a[r*4+2]*b[8+c] + a[r*4+3]*b[12+c];
+                for (uint j = 0; j < 16; j++) sum += P[j];
+            }
+        }
+        referenceMs = timer.elapsed();
+        sink = sum;
+        report(out, "multiply 4x4", templateMs, referenceMs, (numMatrices - 1) * m_iterations);
+    }
+
+    //inCircle against the closed form 4x4 determinant of the lifted points
+    ops = (n - 3) * m_iterations;
+    {
+        vector<Vector2f> P(n);
+        for (uint i = 0; i < n; i++) P[i] = Vector2f(data[i*3], data[i*3+1]);
+
+        uint inside = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++)
+            for (uint i = 0; i + 3 < n; i++)
+                inside += inCircle(P[i], P[i+1], P[i+2], P[i+3]);
+        templateMs = timer.elapsed();
+        sink = inside;
+
+        inside = 0;
+        timer.start();
+        for (int k = 0; k < m_iterations; k++) {
+            for (uint i = 0; i + 3 < n; i++) {
+                float m[4][4];
+                for (uint j = 0; j < 4; j++) {
+                    const Vector2f &v = P[i+j];
+                    m[j][0] = v[0];
+                    m[j][1] = v[1];
+                    m[j][2] = v[0]*v[0] + v[1]*v[1];
+                    m[j][3] = 1;
+                }
+                inside += refDet4(m) > 0;
+            }
+        }
+        referenceMs = timer.elapsed();
+        sink = inside;
+        report(out, "inCircle", templateMs, referenceMs, ops);
+    }
+}
+
+void MathBenchmark::runKernelChecks(QTextStream &out) {
+    srand(3);
+    QString selected = kernelInstructionSet();
+    out << "kernels: " << selected << endl;
+
+    //an odd number of points so the SIMD kernels also handle leftover elements
+    uint n = 1003;
+    vector<Vector3f> points(n);
+    for (uint i = 0; i < n; i++)
+        points[i] = Vector3f(randFloat(), randFloat(), randFloat()) * 10;
+    points[n/2].zero();
+
+    //gather each point with its two neighbours
+    vector<uint> indices, offsets;
+    vector<float> weights;
+    for (uint i = 0; i < n; i++) {
+        offsets.push_back(indices.size());
+        for (uint j = 0; j < i % 4; j++)
+            indices.push_back((i + j*7) % n);
+        weights.push_back(randFloat());
+    }
+    offsets.push_back(indices.size());
+
+    Matrix4f M;
+    for (uint i = 0; i < 3; i++)
+        for (uint j = 0; j < 4; j++)
+            M[i][j] = randFloat();
+    M[3][3] = 1;
+
+    for (uint k = 0; k < NUM_INSTRUCTION_SETS; k++) {
+        const char *isa = s_instructionSets[k];
+        if (!setKernelInstructionSet(isa)) continue;
+        QString prefix = QString("kernel %1 ").arg(isa);
+
+        //bounds
+        Vector3f minPos, maxPos, refMin = points[0], refMax = points[0];
+        for (uint i = 0; i < n; i++) {
+            for (uint j = 0; j < 3; j++) {
+                refMin[j] = MIN(refMin[j], points[i][j]);
+                refMax[j] = MAX(refMax[j], points[i][j]);
+            }
+        }
+        batchBounds(&points[0], n, minPos, maxPos);
+        check(out, (prefix + "bounds").toAscii().constData(), minPos == refMin && maxPos == refMax);
+
+        //translate and scale
+        vector<Vector3f> result(points);
+        Vector3f offset(1, -2, 3);
+        batchTranslateScale(&result[0], n, offset, 0.5f);
+        bool translateScale = true;
+        for (uint i = 0; i < n; i++)
+            translateScale = translateScale && nearlyEqual((result[i] - (points[i] + offset)*0.5f).magnitude(), 0);
+        check(out, (prefix + "translate scale").toAscii().constData(), translateScale);
+
+        //normalize
+        result = points;
+        batchNormalize(&result[0], n);
+        bool normalize = result[n/2] == Vector3f();
+        for (uint i = 0; i < n; i++)
+            if (i != n/2) normalize = normalize && nearlyEqual((result[i] - points[i].unit()).magnitude(), 0);
+        check(out, (prefix + "normalize").toAscii().constData(), normalize);
+
+        //weighted gather sum
+        result.assign(n, Vector3f(1, 1, 1));
+        batchGatherSum(&result[0], &points[0], &indices[0], &offsets[0], n, &weights[0]);
+        bool gather = true;
+        for (uint i = 0; i < n; i++) {
+            Vector3f sum;
+            for (uint j = offsets[i]; j < offsets[i+1]; j++) sum = sum + points[indices[j]];
+            gather = gather && nearlyEqual((result[i] - (sum*weights[i] + Vector3f(1, 1, 1))).magnitude(), 0);
+        }
+        check(out, (prefix + "gather sum").toAscii().constData(), gather);
+
+        //affine transform
+        batchTransform(&result[0], &points[0], n, M);
+        bool transform = true;
+        for (uint i = 0; i < n; i++) {
+            for (uint j = 0; j < 3; j++) {
+                double p = M[j][0]*points[i][0] + M[j][1]*points[i][1] + M[j][2]*points[i][2] + M[j][3];
+                transform = transform && nearlyEqual(result[i][j], p);
+            }
+        }
+        check(out, (prefix + "transform").toAscii().constData(), transform);
+
+        //plane distances
+        Vector4f plane(0.6f, -0.8f, 0, 2);
+        vector<float> distances(n);
+        batchPlaneDistances(&points[0], n, plane, &distances[0]);
+        bool planeDistances = true;
+        for (uint i = 0; i < n; i++) {
+            double d = plane[0]*points[i][0] + plane[1]*points[i][1] + plane[2]*points[i][2] + plane[3];
+            planeDistances = planeDistances && nearlyEqual(distances[i], d);
+        }
+        check(out, (prefix + "plane distances").toAscii().constData(), planeDistances);
+    }
+
+    setKernelInstructionSet(selected.toAscii().constData());
+}
+
+void MathBenchmark::runKernelBenchmarks(QTextStream &out) {
+    srand(4);
+    QString selected = kernelInstructionSet();
+
+    uint n = MATH_BENCHMARK_SIZE * 16;
+    vector<Vector3f> points(n), result(n);
+    for (uint i = 0; i < n; i++)
+        points[i] = Vector3f(randFloat(), randFloat(), randFloat());
+
+    //gather 4 scattered points into each point, like face points in subdivision
+    vector<uint> indices(4*n), offsets(n + 1);
+    vector<float> weights(n, 0.25f);
+    for (uint i = 0; i < n; i++) {
+        for (uint j = 0; j < 4; j++) indices[4*i + j] = (i*13 + j*n/4) % n;
+        offsets[i] = 4*i;
+    }
+    offsets[n] = 4*n;
+
+    Matrix4f M;
+    for (uint i = 0; i < 4; i++) M[i][i] = 1;
+    M[0][3] = 0.5f;
+
+    vector<float> distances(n);
+    Vector4f plane(0.6f, -0.8f, 0, 2);
+
+    const char *names[] = {"bounds", "translate scale", "normalize", "gather sum", "transform", "plane distances"};
+    double scalarMs[6] = {0, 0, 0, 0, 0, 0};
+    uint ops = n * m_iterations;
+
+    for (uint k = 0; k < NUM_INSTRUCTION_SETS; k++) {
+        const char *isa = s_instructionSets[k];
+        if (!setKernelInstructionSet(isa)) continue;
+
+        for (uint kernel = 0; kernel < 6; kernel++) {
+            Vector3f minPos, maxPos;
+            result = points;
+            Timer timer;
+            for (int it = 0; it < m_iterations; it++) {
+                switch (kernel) {
+                case 0: batchBounds(&points[0], n, minPos, maxPos); sink = minPos[0]; break;
+                case 1: batchTranslateScale(&result[0], n, Vector3f(1, 1, 1), 0.5f); break;
+                case 2: batchNormalize(&result[0], n); break;
+                case 3: batchGatherSum(&result[0], &points[0], &indices[0], &offsets[0], n, &weights[0]); break;
+                case 4: batchTransform(&result[0], &points[0], n, M); break;
+                default: batchPlaneDistances(&points[0], n, plane, &distances[0]); result[n/2][0] = distances[n/2]; break;
+                }
+            }
+            double ms = timer.elapsed();
+            sink = result[n/2][0];
+
+            if (k == 0) scalarMs[kernel] = ms;
+            reportKernel(out, names[kernel], isa, ms, scalarMs[kernel], ops);
+        }
+    }
+
+    setKernelInstructionSet(selected.toAscii().constData());
+}
+
+void MathBenchmark::runDelaunayBenchmarks(QTextStream &out) {
+    srand(6);
+
+    uint n = m_delaunayPoints;
+    vector<Vector2f> points(n);
+    for (uint i = 0; i < n; i++) points[i] = Vector2f(randFloat(), randFloat());
+
+    //one thread, then one per core to sort the points
+    int threads[] = {1, 0};
+    for (uint k = 0; k < 2; k++) {
+        Delaunay delaunay;
+        delaunay.setNumThreads(threads[k]);
+
+        Timer timer;
+        delaunay.triangulate(points);
+        double ms = timer.elapsed();
+
+        out << "bench: delaunay " << n << " points "
+            << (threads[k] == 0 ? QString("all cores") : QString("1 thread")) << " "
+            << ms << " ms " << ms * 1E6 / n << " ns/point "
+            << delaunay.getNumTriangles() << " triangles" << endl;
+    }
+}
+
+void MathBenchmark::runBvhBenchmarks(QTextStream &out) {
+    srand(8);
+
+    //a bumpy height field over the unit square
+    uint side = MATH_BENCHMARK_BVH_GRID;
+    vector<Vector3f> positions(side * side);
+    for (uint i = 0; i < side; i++)
+        for (uint j = 0; j < side; j++) {
+            float x = (float)i / (side - 1), y = (float)j / (side - 1);
+            positions[i*side + j] = Vector3f(x, y, 0.05f * sinf(40*x) * cosf(40*y));
+        }
+
+    vector<uint> triangles;
+    triangles.reserve(6 * (side - 1) * (side - 1));
+    for (uint i = 0; i + 1 < side; i++)
+        for (uint j = 0; j + 1 < side; j++) {
+            uint a = i*side + j, b = a + side, c = b + 1, d = a + 1;
+            uint quad[6] = {a, b, c, a, c, d};
+            triangles.insert(triangles.end(), quad, quad + 6);
+        }
+    uint n = triangles.size() / 3;
+
+    Bvh bvh;
+    Timer timer;
+    bvh.build(&positions[0], &triangles[0], n);
+    double buildMs = timer.elapsed();
+
+    //rays from a camera above the field towards random points on it
+    uint rays = MATH_BENCHMARK_BVH_RAYS;
+    vector<Vector3f> directions(rays);
+    Vector3f origin(0.5f, -0.5f, 2);
+    for (uint i = 0; i < rays; i++)
+        directions[i] = Vector3f(fabs(randFloat()), fabs(randFloat()), 0) - origin;
+
+    uint hits = 0;
+    timer.start();
+    for (uint i = 0; i < rays; i++) {
+        float t;
+        uint triangle;
+        hits += bvh.intersect(&positions[0], origin, directions[i], 1E30f, t, triangle);
+    }
+    double queryMs = timer.elapsed();
+
+    timer.start();
+    bvh.refit(&positions[0]);
+    double refitMs = timer.elapsed();
+
+    out << "bench: bvh " << n << " triangles build " << buildMs << " ms refit " << refitMs << " ms "
+        << bvh.getNumNodes() << " nodes " << bvh.memoryUsage() / (1024*1024) << " MB" << endl;
+    out << "bench: bvh query " << queryMs * 1E3 / rays << " us/ray " << hits << "/" << rays << " hits" << endl;
+}
+
+void MathBenchmark::runDecimatorBenchmarks(QTextStream &out) {
+    vector<Vector3f> positions;
+    vector<uint> triangles;
+    makeTorus(MATH_BENCHMARK_DECIMATE_GRID, positions, triangles);
+    uint n = triangles.size() / 3;
+
+    //reduced to a quarter, as each level of detail is from the one before
+    int threads[] = {1, 0};
+    for (uint k = 0; k < 2; k++) {
+        Decimator decimator;
+        decimator.setNumThreads(threads[k]);
+
+        Timer timer;
+        decimator.decimate(&positions[0], positions.size(), &triangles[0], n, n / 4);
+        double ms = timer.elapsed();
+
+        out << "bench: decimate " << n << " triangles to " << decimator.getNumTriangles() << " "
+            << (threads[k] == 0 ? QString("all cores") : QString("1 thread")) << " "
+            << ms << " ms " << decimator.getNumPartitions() << " slabs error " << decimator.getError() << endl;
+    }
+}
+
+void MathBenchmark::runRasterizerBenchmarks(QTextStream &out) {
+    vector<RasterVertex> torus;
+    makeRasterTorus(MATH_BENCHMARK_DECIMATE_GRID, torus);
+    Matrix4f modelView = lookAtMatrix(Vector3f(0, -2.5f, 1.5f), Vector3f(0, 0, 0), Vector3f(0, 0, 1));
+
+    //the first frame of each sizes the buffers of the chunks, the second is timed
+    int threads[] = {1, 0};
+    RasterShading modes[] = {RASTER_DIFFUSE, RASTER_PHONG};
+    const char *modeNames[] = {"diffuse", "phong"};
+    for (uint m = 0; m < 2; m++) {
+        for (uint k = 0; k < 2; k++) {
+            Rasterizer rasterizer;
+            rasterizer.setNumThreads(threads[k]);
+            rasterizer.resize(MATH_BENCHMARK_RASTER_SIZE, MATH_BENCHMARK_RASTER_SIZE);
+            rasterizeFrame(rasterizer, torus, modelView, modes[m]);
+
+            Timer timer;
+            rasterizeFrame(rasterizer, torus, modelView, modes[m]);
+            double ms = timer.elapsed();
+
+            out << "bench: rasterize " << torus.size() / 3 << " triangles " << modeNames[m] << " "
+                << MATH_BENCHMARK_RASTER_SIZE << "x" << MATH_BENCHMARK_RASTER_SIZE << " "
+                << (threads[k] == 0 ? QString("all cores") : QString("1 thread")) << " " << ms << " ms setup "
+                << rasterizer.getSetupMs() << " ms tiles " << rasterizer.getTileMs() << " ms "
+                << rasterizer.getNumTriangles() << " drawn" << endl;
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef MATHBENCHMARK_H
+#define MATHBENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+
+#define MATH_BENCHMARK_ITERATIONS 200
+#define MATH_BENCHMARK_SIZE 4096
+#define MATH_BENCHMARK_DELAUNAY_POINTS 1000000
+#define MATH_BENCHMARK_BVH_GRID 708     //a height field of 708x708 points has a million triangles
+#define MATH_BENCHMARK_BVH_RAYS 100000
+#define MATH_BENCHMARK_DECIMATE_GRID 500    //a torus of 500x500 points has half a million triangles
+#define MATH_BENCHMARK_RASTER_SIZE 1024
+
+/* Correctness checks and micro-benchmarks for the Vector and Matrix templates.
+   Every operation is checked and timed against a plain float reference
+   implementation, so a change to the math library can be judged by its numbers.
+   The batch kernels of every instruction set the CPU supports are checked and
+   timed against their scalar implementation. The robust predicates are checked
+   on degenerate input and a Delaunay triangulation of random points is checked
+   and timed with one thread and with one thread per core. Ray queries of the
+   bounding volume hierarchy are checked against testing every triangle,
+   decimated surfaces are checked to stay closed and within their error, and
+   the software rasterizer is checked to leave no gaps between triangles and to
+   draw the same frame with any number of threads.*/
+class MathBenchmark {
+    public:
+        MathBenchmark();
+
+        //parses benchmark options from the command line, returns false on bad options
+        bool parseArguments(QStringList args);
+
+        //runs the checks and benchmarks, returns false if any check fails
+        bool run(QTextStream &out);
+
+        //returns the usage message of the command line options
+        static QString usage();
+
+    private:
+        //runs the correctness checks
+        void runChecks(QTextStream &out);
+
+        //runs the timed benchmarks
+        void runBenchmarks(QTextStream &out);
+
+        //runs the checks and benchmarks of the batch kernels
+        void runKernelChecks(QTextStream &out);
+        void runKernelBenchmarks(QTextStream &out);
+
+        //runs the checks and benchmarks of the Delaunay triangulation
+        void runDelaunayChecks(QTextStream &out);
+        void runDelaunayBenchmarks(QTextStream &out);
+
+        //runs the checks and benchmarks of the bounding volume hierarchy
+        void runBvhChecks(QTextStream &out);
+        void runBvhBenchmarks(QTextStream &out);
+
+        //runs the checks and benchmarks of the quadric error decimation
+        void runDecimatorChecks(QTextStream &out);
+        void runDecimatorBenchmarks(QTextStream &out);
+
+        //runs the checks and benchmarks of the software rasterizer
+        void runRasterizerChecks(QTextStream &out);
+        void runRasterizerBenchmarks(QTextStream &out);
+
+        //records the result of a check
+        void check(QTextStream &out, const char *name, bool passed);
+
+        //prints the time per operation of the templates and the reference implementation
+        void report(QTextStream &out, const char *name, double templateMs, double referenceMs, uint ops);
+
+        //prints the time per element of a kernel and its scalar implementation
+        void reportKernel(QTextStream &out, const char *name, const char *isa, double ms, double scalarMs, uint ops);
+
+        int m_iterations;
+        int m_delaunayPoints;
+        uint m_failures;
+};
+
+#endif // MATHBENCHMARK_H
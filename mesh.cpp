@@ -1,5 +1,24 @@
 #include "mesh.h"
 #include <QFile>
+#include <QThread>
+#include <QtConcurrentRun>
+#include <float.h>
+#include <stddef.h>
+
+#include "utils/decimator.h"
+#include "utils/glutils.h"
+#include "utils/kernels.h"
+#include "utils/pointutils.h"
+#include "utils/trace.h"
+
+#define NO_NORMAL 0xFFFFFFFF
+
+//number of lines parsed and faces added between two progress reports
+#define PROGRESS_LINES 16384
+#define PROGRESS_FACES 16384
+
+//fewest faces worth a thread of their own when filling the draw buffer
+#define FILL_CHUNK_FACES 4096
 
 int uintCompare (const void *a, const void *b) {
     uint v1 = *(uint*)a;
@@ -9,286 +28,771 @@ int uintCompare (const void *a, const void *b) {
     return 0;
 }
 
+MemoryUsage::MemoryUsage()
+    : geometry(0), topology(0), lookupMaps(0), scratch(0), cpuBuffers(0), gpuBuffers(0), picking(0)
+{
+}
+
+size_t MemoryUsage::total() const {
+    return geometry + topology + lookupMaps + scratch + cpuBuffers + gpuBuffers + picking;
+}
+
+MemoryUsage &MemoryUsage::operator+=(const MemoryUsage &m) {
+    geometry += m.geometry;
+    topology += m.topology;
+    lookupMaps += m.lookupMaps;
+    scratch += m.scratch;
+    cpuBuffers += m.cpuBuffers;
+    gpuBuffers += m.gpuBuffers;
+    picking += m.picking;
+    return *this;
+}
+
+//returns the bytes allocated by a vector
+template <typename T>
+static size_t vectorBytes(const vector<T> &v) {
+    return v.capacity() * sizeof(T);
+}
+
+GpuBuffers::GpuBuffers() : vertices(0), positions(0), edges(0) {}
+
+//sets the barycentric coordinates of the 3 vertices of a triangle from their edge flags
+//the edge opposite corner c starts at corner c+1, and is hidden by giving corner c's coordinate to all corners
+static void setBarycentric(DrawVertex *triangle) {
+    for (uint j = 0; j < 3; j++)
+        for (uint c = 0; c < 3; c++)
+            triangle[j].barycentric[c] = (c == j || !triangle[(c+1) % 3].edgeFlag) ? 255 : 0;
+}
+
 Mesh::Mesh()
-    : m_vertexBuffer(0), m_normalBuffer(0), m_cached(false), m_numVertices(0)
+    : m_drawBuffer(0), m_cached(false), m_numVertices(0), m_bvh(0), m_preview(false),
+      m_arena(new Arena()), m_buildArena(new Arena()), m_faceOffsets(1, 0),
+      m_pointIdxMap(less<Vector3f>(), PointIndexMap::allocator_type(m_buildArena)),
+      m_edgeIdxMap(less<Edge>(), EdgeIndexMap::allocator_type(m_buildArena))
 {
 }
 
 Mesh::~Mesh() {
-    if (m_vertexBuffer)
-        free(m_vertexBuffer);
+    if (m_drawBuffer)
+        free(m_drawBuffer);
+
+    delete m_bvh;
 
-    if (m_normalBuffer)
-        free(m_normalBuffer);
+    //destroy everything allocated from the arenas before freeing them
+    m_vertices.clear();
+    m_pointIdxMap.clear();
+    m_edgeIdxMap.clear();
+
+    delete m_arena;
+    delete m_buildArena;
+}
+
+#ifdef Q_COMPILER_RVALUE_REFS
+Mesh::Mesh(Mesh &&mesh)
+    : m_drawBuffer(0), m_cached(false), m_numVertices(0), m_bvh(0), m_preview(false),
+      m_arena(new Arena()), m_buildArena(new Arena()), m_faceOffsets(1, 0),
+      m_pointIdxMap(less<Vector3f>(), PointIndexMap::allocator_type(m_buildArena)),
+      m_edgeIdxMap(less<Edge>(), EdgeIndexMap::allocator_type(m_buildArena))
+{
+    swap(mesh);
+}
+
+Mesh &Mesh::operator=(Mesh &&mesh) {
+    swap(mesh);
+    return *this;
+}
+#endif
+
+void Mesh::swap(Mesh &mesh) {
+    std::swap(m_drawBuffer, mesh.m_drawBuffer);
+    std::swap(m_cached, mesh.m_cached);
+    std::swap(m_numVertices, mesh.m_numVertices);
+    m_edgeIndices.swap(mesh.m_edgeIndices);
+    std::swap(m_gpuBuffers, mesh.m_gpuBuffers);
+    std::swap(m_bvh, mesh.m_bvh);
+    std::swap(m_preview, mesh.m_preview);
+
+    std::swap(m_arena, mesh.m_arena);
+    std::swap(m_buildArena, mesh.m_buildArena);
+    std::swap(m_releasedStats, mesh.m_releasedStats);
+
+    m_positions.swap(mesh.m_positions);
+    m_normals.swap(mesh.m_normals);
+    m_vertices.swap(mesh.m_vertices);
+    m_edges.swap(mesh.m_edges);
+    m_faceOffsets.swap(mesh.m_faceOffsets);
+    m_cornerVertices.swap(mesh.m_cornerVertices);
+    m_cornerEdges.swap(mesh.m_cornerEdges);
+    m_cornerNormals.swap(mesh.m_cornerNormals);
+
+    m_facePoints.swap(mesh.m_facePoints);
+    m_edgePoints.swap(mesh.m_edgePoints);
+    m_vertexPoints.swap(mesh.m_vertexPoints);
+
+    m_facePointNormals.swap(mesh.m_facePointNormals);
+    m_edgePointNormals.swap(mesh.m_edgePointNormals);
+    m_vertexPointNormals.swap(mesh.m_vertexPointNormals);
+
+    m_pointIdxMap.swap(mesh.m_pointIdxMap);
+    m_edgeIdxMap.swap(mesh.m_edgeIdxMap);
 }
 
 void Mesh::unitize() {
+    unitize(m_positions);
+
+    //the faces keep their triangles, so only the bounds of the picking hierarchy change
+    if (m_bvh)
+        m_bvh->refit(&m_positions[0]);
+}
+
+void Mesh::unitize(vector<Vector3f> &positions) {
+    if (positions.empty()) return;
+
     //find bounding box of mesh
     Vector3f minPos, maxPos;
-    for (uint i = 0; i < m_vertices.size(); i++) {
-        Vector3f &pos = m_vertices[i].pos;
-        for (uint j = 0; j < 3; j++) {
-            minPos[j] = min(minPos[j],pos[j]);
-            maxPos[j] = max(maxPos[j],pos[j]);
-        }
-    }
+    batchBounds(&positions[0], positions.size(), minPos, maxPos);
 
     //calculate scaling factor and offset from origin
     float scale = min(maxPos[0] - minPos[0], maxPos[1] - minPos[1]);
     scale = min(scale, maxPos[2] - minPos[2]);
+
+    //flat meshes, such as a single polygon, are scaled by their largest extent instead
+    if (scale <= 0)
+        scale = max(max(maxPos[0] - minPos[0], maxPos[1] - minPos[1]), maxPos[2] - minPos[2]);
+    if (scale <= 0) scale = 1;
     Vector3f center = (minPos + maxPos)/2.0;
 
-    //scale and translate all vertices in mesh
-    for (uint i = 0; i < m_vertices.size(); i++) {
-       Vector3f &pos = m_vertices[i].pos;
-       for (uint j = 0; j < 3; j++) {
-           pos[j] = pos[j] - center[j]; //translate so center is at origin
-           pos[j] = pos[j] / scale;     //scale to unit bounding box
-       }
+    //translate so center is at origin and scale to unit bounding box
+    batchTranslateScale(&positions[0], positions.size(), center * -1.0f, 1.0f / scale);
+}
+
+//skips spaces and tabs
+static const char *skipSpace(const char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    return s;
+}
+
+//returns true if nothing but whitespace is left on the line
+static bool atLineEnd(const char *s) {
+    s = skipSpace(s);
+    return *s == 0 || *s == '\n' || *s == '\r';
+}
+
+//parses a decimal number at s in the C locale and moves s past it, returns false if there is none
+static bool parseFloat(const char *&s, float &value) {
+    const char *p = skipSpace(s);
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') p++;
+
+    //keep up to 19 significant digits, which fit in the mantissa
+    unsigned long long mantissa = 0;
+    int exponent = 0, digits = 0;
+    bool any = false;
+    for (; *p >= '0' && *p <= '9'; p++, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (*p == '.') {
+        for (p++; *p >= '0' && *p <= '9'; p++, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+        }
+    }
+    if (!any) return false;
+
+    if (*p == 'e' || *p == 'E') {
+        const char *e = p + 1;
+        bool negativeExp = *e == '-';
+        if (*e == '-' || *e == '+') e++;
+        if (*e >= '0' && *e <= '9') {
+            int exp = 0;
+            for (; *e >= '0' && *e <= '9'; e++)
+                if (exp < 1000) exp = exp * 10 + (*e - '0');
+            exponent += negativeExp ? -exp : exp;
+            p = e;
+        }
     }
+
+    //powers of 10 up to 1e22 are exact, so a single multiply or divide rounds correctly
+    double v = mantissa;
+    if (exponent < 0) {
+        for (; exponent < -22; exponent += 22) v /= 1E22;
+        v /= pow(10.0, -exponent);
+    } else if (exponent > 0) {
+        for (; exponent > 22; exponent -= 22) v *= 1E22;
+        v *= pow(10.0, exponent);
+    }
+
+    value = negative ? -v : v;
+    s = p;
+    return true;
 }
 
-/* parse a line in the form of "<type> <x> <y> <z>" to a coordinate*/
-bool parseCoordinate(QString line, Vector3f& coord) {
-    line = line.simplified();
+//parses an integer at s and moves s past it, returns false if there is none
+static bool parseInt(const char *&s, int &value) {
+    const char *p = s;
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') p++;
+    if (*p < '0' || *p > '9') return false;
 
-    QStringList tokens = line.split(" ", QString::SkipEmptyParts);
-    if (tokens.size() != 4)
+    value = 0;
+    for (; *p >= '0' && *p <= '9'; p++)
+        value = value * 10 + (*p - '0');
+    if (negative) value = -value;
+
+    s = p;
+    return true;
+}
+
+//converts a 1-based OBJ index, or a negative one relative to the end, to an index into count elements
+static bool resolveIndex(int index, uint count, uint &result) {
+    if (index > 0)
+        result = index - 1;
+    else if (index < 0 && (uint)-index <= count)
+        result = count + index;
+    else
         return false;
+    return true;
+}
+
+/* parse a line in the form of "<type> <x> <y> <z>" to a coordinate,
+   further values such as a w coordinate or vertex color are ignored*/
+bool parseCoordinate(const char *line, Vector3f& coord) {
+    //skip the type
+    while (*line && *line != ' ' && *line != '\t') line++;
 
-    QStringListIterator it(tokens);
-    it.next();
     for (uint i = 0; i < 3; i++) {
-        bool ok = false;
-        coord[i] = it.next().toFloat(&ok);
-        if (!ok) return false;
+        if (!parseFloat(line, coord[i]))
+            return false;
     }
 
     return true;
 }
 
-/* parse a line in the form of "<f> <v1/t1/n1> <v2/t2/n2> <v3/t3/n3> <v4/t4/n4>"
-   into a face. The texture and normal indices are optional */
-bool parseFace(QString line, uint *vertices, uint *normals, bool &hasNormals) {
-    line = line.simplified();
+/* parse a line in the form of "<f> <v1/t1/n1> <v2/t2/n2> ... <vn/tn/nn>" with
+   at least 3 vertices and append the 0-based vertex and normal indices of the face,
+   or NO_NORMAL if it has none.
+   The texture and normal indices are optional, but either all or no vertices have
+   normals. numPositions and numNormals are the number read so far, which negative
+   indices count back from*/
+bool parseFace(const char *line, uint numPositions, uint numNormals,
+               vector<uint> &vertices, vector<uint> &normals)
+{
+    uint first = vertices.size();
+    uint withNormals = 0;
 
-    //ensure that the face is a quad
-    QStringList tokens = line.split(" ", QString::SkipEmptyParts);
-    if (tokens.size() != 5)
-        return false;
+    line++;
+    while (!atLineEnd(line)) {
+        line = skipSpace(line);
 
-    hasNormals = false;
-    QStringListIterator it(tokens);
-    it.next();
-    for (uint i = 0; i < 4; i++) {
         //parse the token into its vertex, texture, and normal indices
-        QString vertexStr = it.next();
-        QStringList vertexTokens = vertexStr.split("/");
-
-        //check if data is properly formatted
-        bool validVertex = vertexTokens.size() > 0 && vertexTokens.size() <= 3;
-        bool validNormals = !hasNormals || vertexTokens.size() == 3; //has normals --> 3 vertex tokens
-        if (!validVertex || !validNormals)
+        int index;
+        uint v, n = NO_NORMAL;
+        if (!parseInt(line, index) || !resolveIndex(index, numPositions, v))
             return false;
 
-        //add vertex index
-        bool ok = false;
-        QStringListIterator vertexIt(vertexTokens);
-        vertices[i] = vertexIt.next().toInt(&ok) - 1;
+        if (*line == '/') {
+            //since we ignore texture indices, we can skip the second index
+            line++;
+            if (*line != '/' && !parseInt(line, index))
+                return false;
 
-        //since we ignore texture indices, we can skip the second token
-        if (vertexTokens.size() == 3) {
-            hasNormals = true;
-            vertexIt.next();
-            normals[i] = vertexIt.next().toInt(&ok) - 1;
+            if (*line == '/') {
+                line++;
+                if (!parseInt(line, index) || !resolveIndex(index, numNormals, n))
+                    return false;
+                withNormals++;
+            }
         }
 
-        if (!ok) return false;
+        //check that the token ended
+        if (*line != ' ' && *line != '\t' && !atLineEnd(line))
+            return false;
+
+        vertices.push_back(v);
+        normals.push_back(n);
     }
 
-    return true;
+    uint numVertices = vertices.size() - first;
+    return numVertices >= 3 && (withNormals == 0 || withNormals == numVertices);
+}
+
+//reads the next line of any length into line as a null terminated string
+//returns false at the end of the file
+static bool readLine(QFile &file, vector<char> &line) {
+    if (line.size() < 256)
+        line.resize(256);
+
+    uint length = 0;
+    for (;;) {
+        qint64 n = file.readLine(&line[length], line.size() - length);
+        if (n <= 0)
+            return length > 0;
+
+        length += n;
+        if (line[length - 1] == '\n' || length + 1 < line.size())
+            return true;
+
+        //the line did not fit in the buffer
+        line.resize(2 * line.size());
+    }
 }
 
 Mesh *Mesh::fromObjFile(QString filename) {
+    TRACE_SCOPE("Mesh::fromObjFile");
+
+    ObjData data;
+    if (!parseObjFile(filename, data))
+        return 0;
+
+    Mesh *M = fromObjData(data);
+    if (M) M->buildBvh();
+    return M;
+}
+
+bool Mesh::parseObjFile(QString filename, ObjData &data, ProgressMonitor *monitor) {
+    TRACE_SCOPE("Mesh::parseObjFile");
+
     QFile file(filename);
     if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-        return 0;
+        return false;
+    qint64 fileSize = file.size();
 
-    Mesh *M = new Mesh();
-    vector<Vector3f> normals;
+    //faces can refer to vertices further on in the file, so they are only collected
+    //in the single pass over the file and added to the mesh once all vertices are known
+    data.positions.clear();
+    data.normals.clear();
+    data.faceOffsets.assign(1, 0);
+    data.faceVertices.clear();
+    data.faceNormals.clear();
 
-    //first pass to add all vertices and normals to mesh
-    while (!file.atEnd()) {
-        QByteArray lineBytes = file.readLine();
+    vector<char> lineBuffer;
+    for (uint lines = 1; readLine(file, lineBuffer); lines++) {
+        const char *line = &lineBuffer[0];
 
-        if (lineBytes.at(0) == 'v' && lineBytes.at(1) == 'n') {
+        if (line[0] == 'v' && line[1] == 'n') {
             // parse normal if line starts with 'vn'
             Vector3f normal;
-
-            if (!parseCoordinate(QString(lineBytes), normal)) {
-                delete M;
+            if (!parseCoordinate(line, normal))
                 return false;
-            }
 
-            normals.push_back(normal);
-        } else if (lineBytes.at(0) == 'v' && lineBytes.at(1) == ' ') {
+            data.normals.push_back(normal);
+        } else if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
             // parse vertex if line starts with just 'v'
-            Vertex V;
-            if (!parseCoordinate(QString(lineBytes), V.pos)) {
-                delete M;
+            Vector3f pos;
+            if (!parseCoordinate(line, pos))
                 return false;
-            }
-            M->m_vertices.push_back(V);
+
+            data.positions.push_back(pos);
+        } else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+            if (!parseFace(line, data.positions.size(), data.normals.size(), data.faceVertices, data.faceNormals))
+                return false;
+
+            data.faceOffsets.push_back(data.faceVertices.size());
         }
+
+        if (monitor && lines % PROGRESS_LINES == 0 && !monitor->progress((float)file.pos() / fileSize))
+            return false;
     }
 
-    //second pass to add faces to the mesh
-    file.reset();
-    while (!file.atEnd()) {
-        QByteArray lineBytes = file.readLine();
-        if (lineBytes.at(0) == 'f') {
-            uint V[4];
-            uint N[4];
-            bool hasNormals;
+    return true;
+}
+
+Mesh *Mesh::fromObjData(const ObjData &data, ProgressMonitor *monitor) {
+    TRACE_SCOPE("Mesh::fromObjData");
 
-            if (!parseFace(QString(lineBytes), V, N, hasNormals)) {
+    Mesh *M = new Mesh();
+    M->m_positions = data.positions;
+
+    //add the faces to the mesh
+    uint numVertices = M->m_positions.size();
+    M->m_normals.resize(numVertices);
+    M->m_vertices.resize(numVertices, Vertex(M->m_arena));
+
+    uint numFaces = data.faceOffsets.size() - 1;
+    M->m_faceOffsets.reserve(numFaces + 1);
+    M->m_cornerVertices.reserve(data.faceVertices.size());
+    M->m_cornerEdges.reserve(data.faceVertices.size());
+    M->m_cornerNormals.reserve(data.faceVertices.size());
+
+    vector<Vector3f> cornerNormals;
+    for (uint i = 0; i < numFaces; i++) {
+        uint begin = data.faceOffsets[i];
+        uint n = data.faceOffsets[i+1] - begin;
+
+        for (uint j = begin; j < begin + n; j++) {
+            if (data.faceVertices[j] >= numVertices) {
                 delete M;
-                return false;
+                return 0;
             }
+        }
 
-            if (hasNormals) {
-                //use normals if they are provided
-                Vector3f faceNormals[4];
-                for (uint i = 0; i < 4; i++) {
-                    if (N[i] < normals.size())
-                        faceNormals[i] = normals[N[i]];
-                }
-                M->addFace(V[0],V[1],V[2],V[3], faceNormals);
-            } else {
-                //interpolate normals if they are not provided
-                M->addFace(V[0],V[1],V[2],V[3]);
+        bool added;
+        if (data.faceNormals[begin] != NO_NORMAL) {
+            //use normals if they are provided
+            cornerNormals.assign(n, Vector3f());
+            for (uint j = 0; j < n; j++) {
+                if (data.faceNormals[begin + j] < data.normals.size())
+                    cornerNormals[j] = data.normals[data.faceNormals[begin + j]];
             }
+            added = M->addFace(&data.faceVertices[begin], n, &cornerNormals[0]);
+        } else {
+            //interpolate normals if they are not provided
+            added = M->addFace(&data.faceVertices[begin], n);
+        }
+
+        //the topology cannot hold faces that repeat a vertex or an edge shared by more than two faces
+        if (!added) {
+            delete M;
+            return 0;
+        }
+
+        if (monitor && i % PROGRESS_FACES == 0 && !monitor->progress((float)i / numFaces)) {
+            delete M;
+            return 0;
+        }
+    }
+
+    M->finalize();
+
+    TRACE_COUNTER("vertices", M->m_vertices.size());
+    TRACE_COUNTER("faces", M->numFaces());
+    return M;
+}
+
+Mesh *Mesh::previewFromObjData(const ObjData &data) {
+    TRACE_SCOPE("Mesh::previewFromObjData");
+
+    //count the triangles of the faces whose vertices all exist
+    uint numPositions = data.positions.size();
+    uint numFaces = data.faceOffsets.size() - 1;
+    uint numVertices = 0;
+    for (uint i = 0; i < numFaces; i++) {
+        bool valid = true;
+        for (uint j = data.faceOffsets[i]; j < data.faceOffsets[i+1]; j++)
+            valid = valid && data.faceVertices[j] < numPositions;
+        if (valid) numVertices += 3 * (data.faceOffsets[i+1] - data.faceOffsets[i] - 2);
+    }
+
+    Mesh *M = new Mesh();
+    M->m_preview = true;
+    M->m_numVertices = numVertices;
+    M->m_drawBuffer = (DrawVertex*)malloc(sizeof(DrawVertex)*numVertices);
+    M->m_cached = true;
+
+    //fan every face from its first corner, with the flat Newell normal of the face
+    uint idx = 0;
+    for (uint i = 0; i < numFaces; i++) {
+        uint begin = data.faceOffsets[i];
+        uint n = data.faceOffsets[i+1] - begin;
+        const uint *corners = &data.faceVertices[begin];
+
+        bool valid = true;
+        for (uint j = 0; j < n; j++)
+            valid = valid && corners[j] < numPositions;
+        if (!valid) continue;
+
+        Vector3f normal;
+        for (uint j = 0; j < n; j++) {
+            const Vector3f &a = data.positions[corners[j]];
+            const Vector3f &b = data.positions[corners[(j+1) % n]];
+            normal = normal + Vector3f((a[1] - b[1]) * (a[2] + b[2]),
+                                       (a[2] - b[2]) * (a[0] + b[0]),
+                                       (a[0] - b[0]) * (a[1] + b[1]));
+        }
+        normal = normal.unit();
+
+        for (uint j = 1; j + 1 < n; j++) {
+            uint fan[3] = {0, j, j + 1};
+            DrawVertex *triangle = M->m_drawBuffer + idx;
+            for (uint k = 0; k < 3; k++) {
+                DrawVertex &vertex = M->m_drawBuffer[idx++];
+                vertex.position = data.positions[corners[fan[k]]];
+                vertex.normal = normal;
+
+                //the edge from a corner is a face edge if it goes to the next corner of the face
+                vertex.edgeFlag = fan[(k+1) % 3] == (fan[k] + 1) % n;
+            }
+            setBarycentric(triangle);
         }
     }
 
     return M;
 }
 
-Mesh Mesh::subdivide() {
+Mesh *Mesh::subdivide() {
+    TRACE_SCOPE("Mesh::subdivide");
+
     //calculate new points in subdivided mesh
     calculatePoints();
 
-    Mesh M;
+    Mesh *M = new Mesh();
+
+    //each face of n vertices will become n quads in the new mesh
+    uint numCorners = m_cornerVertices.size();
+    M->m_faceOffsets.reserve(numCorners + 1);
+    M->m_cornerVertices.reserve(4*numCorners);
+    M->m_cornerEdges.reserve(4*numCorners);
+    M->m_cornerNormals.reserve(4*numCorners);
 
-    //each face will become 4 faces in the new mesh
-    for (uint i = 0; i < m_faces.size(); i++) {
-        Face &f = m_faces[i];
+    for (uint i = 0; i < numFaces(); i++) {
+        uint begin = m_faceOffsets[i];
+        uint n = faceSize(i);
         Vector3f V[4];
         Vector3f N[4];
 
         //calculate the vertices of the new faces
         V[0] = m_facePoints[i];
         N[0] = m_facePointNormals[i];
-        for (uint j = 0; j < 4; j++) {
-            V[1] = m_edgePoints[f.edges[j]];
-            V[2] = m_vertexPoints[f.vertices[(j+1)%4]];
-            V[3] = m_edgePoints[f.edges[(j+1)%4]];
+        for (uint j = 0; j < n; j++) {
+            uint c = begin + j;
+            uint next = begin + (j+1)%n;
+
+            V[1] = m_edgePoints[m_cornerEdges[c]];
+            V[2] = m_vertexPoints[m_cornerVertices[next]];
+            V[3] = m_edgePoints[m_cornerEdges[next]];
 
-            N[1] = m_edgePointNormals[f.edges[j]];
-            N[2] = m_vertexPointNormals[f.vertices[(j+1)%4]];
-            N[3] = m_edgePointNormals[f.edges[(j+1)%4]];
+            N[1] = m_edgePointNormals[m_cornerEdges[c]];
+            N[2] = m_vertexPointNormals[m_cornerVertices[next]];
+            N[3] = m_edgePointNormals[m_cornerEdges[next]];
 
-            M.addFace(V[0],V[1],V[2],V[3],N);
+            M->addFace(V, 4, N);
         }
     }
 
+    //the new points are copied into M, so neither mesh needs build data anymore
+    clearPoints();
+    M->finalize();
+
+    //the level is shown next, picking it must not wait for its hierarchy
+    M->buildBvh();
+
+    TRACE_COUNTER("vertices", M->m_vertices.size());
+    TRACE_COUNTER("faces", M->numFaces());
     return M;
 }
 
-void Mesh::calculatePoints() {
-    //face points
-    for (uint i = 0; i < m_faces.size(); i++) {
-        //interpolate face point coordinate from all vertices of face
-        const uint *V = m_faces[i].vertices;
-        Vector3f p(0,0,0);
-        for (uint j = 0; j < 4; j++) p = p + m_vertices[V[j]].pos;
-        m_facePoints.push_back(p / 4.0);
+//returns the first element of a vector, or null if it is empty
+template <typename T>
+static T *arrayOf(vector<T> &v) {
+    return v.empty() ? 0 : &v[0];
+}
 
-        //interpolate face point normal from normals of all vertices of face
-        Vector3f n;
-        for (uint j = 0; j < 4; j++) n = n + m_faces[j].normals[j];
-        m_facePointNormals.push_back(n / 4.0);
+void Mesh::calculatePoints() {
+    TRACE_SCOPE("Mesh::calculatePoints");
+
+    uint numFaces = this->numFaces();
+    uint numEdges = m_edges.size();
+    uint numVertices = m_vertices.size();
+
+    //there is one point per face, edge and vertex, the gathers below add up their terms
+    clearPoints();
+    m_facePoints.resize(numFaces);
+    m_facePointNormals.resize(numFaces);
+    m_edgePoints.resize(numEdges);
+    m_edgePointNormals.resize(numEdges);
+    m_vertexPoints.resize(numVertices);
+    m_vertexPointNormals.assign(m_normals.begin(), m_normals.end());
+
+    //indices[offsets[i]] to indices[offsets[i+1]-1] are gathered into point i
+    vector<uint> indices;
+    vector<uint> offsets;
+    vector<float> weights;
+
+    //face points: average of the coordinates and normals of all vertices of face
+    //the corners of the faces are already in the layout of the gather
+    weights.resize(numFaces);
+    for (uint i = 0; i < numFaces; i++)
+        weights[i] = 1.0f / faceSize(i);
+    batchGatherSum(arrayOf(m_facePoints), arrayOf(m_positions), arrayOf(m_cornerVertices), arrayOf(m_faceOffsets), numFaces, arrayOf(weights));
+    batchGatherSum(arrayOf(m_facePointNormals), arrayOf(m_normals), arrayOf(m_cornerVertices), arrayOf(m_faceOffsets), numFaces, arrayOf(weights));
+
+    //edge points: average of the two vertices and adjacent face points
+    indices.resize(2*numEdges);
+    offsets.resize(numEdges + 1);
+    weights.resize(numEdges);
+    for (uint i = 0; i < numEdges; i++) {
+        indices[2*i] = m_edges[i].vertices[0];
+        indices[2*i + 1] = m_edges[i].vertices[1];
+        offsets[i] = 2*i;
+        weights[i] = 1.0f / (2 + m_edges[i].numFaces);
+    }
+    offsets[numEdges] = indices.size();
+    batchGatherSum(arrayOf(m_edgePoints), arrayOf(m_positions), arrayOf(indices), arrayOf(offsets), numEdges, arrayOf(weights));
+    batchGatherSum(arrayOf(m_edgePointNormals), arrayOf(m_normals), arrayOf(indices), arrayOf(offsets), numEdges, arrayOf(weights));
+
+    indices.clear();
+    for (uint i = 0; i < numEdges; i++) {
+        offsets[i] = indices.size();
+        for (uint j = 0; j < m_edges[i].numFaces; j++)
+            indices.push_back(m_edges[i].faces[j]);
+    }
+    offsets[numEdges] = indices.size();
+    batchGatherSum(arrayOf(m_edgePoints), arrayOf(m_facePoints), arrayOf(indices), arrayOf(offsets), numEdges, arrayOf(weights));
+    batchGatherSum(arrayOf(m_edgePointNormals), arrayOf(m_facePointNormals), arrayOf(indices), arrayOf(offsets), numEdges, arrayOf(weights));
+
+    //vertex points: (f + 2r + (n-3)p)/n, where f is the average adjacent face point,
+    //r the average adjacent edge midpoint and p the vertex itself
+    //extraordinary points keep their position
+    offsets.resize(numVertices + 1);
+    weights.resize(numVertices);
+
+    //f/n = (sum of adjacent face points)/n^2
+    indices.clear();
+    for (uint i = 0; i < numVertices; i++) {
+        const IndexList &E = m_vertices[i].edges;
+        const IndexList &F = m_vertices[i].faces;
+        float n = E.size();
+        bool regular = E.size() > 0 && E.size() == F.size();
+
+        offsets[i] = indices.size();
+        if (regular) indices.insert(indices.end(), F.begin(), F.end());
+        weights[i] = regular ? 1.0f / (n*n) : 0;
+    }
+    offsets[numVertices] = indices.size();
+    batchGatherSum(arrayOf(m_vertexPoints), arrayOf(m_facePoints), arrayOf(indices), arrayOf(offsets), numVertices, arrayOf(weights));
+
+    //2r/n = (sum of both vertices of adjacent edges)/n^2
+    indices.clear();
+    for (uint i = 0; i < numVertices; i++) {
+        offsets[i] = indices.size();
+        if (weights[i] == 0) continue;
+
+        const IndexList &E = m_vertices[i].edges;
+        for (uint j = 0; j < E.size(); j++) {
+            indices.push_back(m_edges[E[j]].vertices[0]);
+            indices.push_back(m_edges[E[j]].vertices[1]);
+        }
     }
+    offsets[numVertices] = indices.size();
+    batchGatherSum(arrayOf(m_vertexPoints), arrayOf(m_positions), arrayOf(indices), arrayOf(offsets), numVertices, arrayOf(weights));
+
+    //(n-3)p/n, or p for extraordinary points
+    indices.resize(numVertices);
+    for (uint i = 0; i < numVertices; i++) {
+        float n = m_vertices[i].edges.size();
+        indices[i] = i;
+        offsets[i] = i;
+        weights[i] = weights[i] == 0 ? 1 : (n - 3) / n;
+    }
+    offsets[numVertices] = numVertices;
+    batchGatherSum(arrayOf(m_vertexPoints), arrayOf(m_positions), arrayOf(indices), arrayOf(offsets), numVertices, arrayOf(weights));
+}
 
-    //edge points
-    for (uint i = 0; i < m_edges.size(); i++) {
-        const uint *V = m_edges[i].vertices;
-        const uint *F = m_edges[i].faces;
+void Mesh::clearPoints() {
+    //swap with empty vectors to release their memory
+    vector<Vector3f>().swap(m_facePoints);
+    vector<Vector3f>().swap(m_edgePoints);
+    vector<Vector3f>().swap(m_vertexPoints);
 
-        //interpolate edge point coordinate from adjacent face points and two vertices
-        Vector3f p(0,0,0);
-        for (uint j = 0; j < 2; j++) p = p + m_vertices[V[j]].pos;
-        for (uint j = 0; j < m_edges[i].numFaces; j++) p = p + m_facePoints[F[j]];
-        m_edgePoints.push_back(p / (2 + m_edges[i].numFaces));
+    vector<Vector3f>().swap(m_facePointNormals);
+    vector<Vector3f>().swap(m_edgePointNormals);
+    vector<Vector3f>().swap(m_vertexPointNormals);
+}
 
-        //interpolate edge point normal from normals of adjacent face points and two vertices
-        Vector3f n;
-        for (uint j = 0; j < 2; j++) n = n + m_vertices[V[j]].normal;
-        for (uint j = 0; j < m_edges[i].numFaces; j++) p = p + m_facePointNormals[F[j]];
-        m_edgePointNormals.push_back(n / (2 + m_edges[i].numFaces));
-    }
+void Mesh::finalize() {
+    TRACE_SCOPE("Mesh::finalize");
 
-    //vertex points
-    for (uint i = 0; i < m_vertices.size(); i++) {
-        vector<uint> &E = m_vertices[i].edges;
-        vector<uint> &F = m_vertices[i].faces;
-        uint n = E.size();
-
-        //extrodinary point
-        if (E.size() != F.size()) {
-            m_vertexPoints.push_back(m_vertices[i].pos);
-            continue;
-        }
-        //Q_ASSERT(F.size() == n);
+    //lookup maps are only used to find existing primitives while adding faces
+    m_pointIdxMap.clear();
+    m_edgeIdxMap.clear();
+    m_buildArena->release();
 
-        Vector3f p = m_vertices[i].pos;
+    clearPoints();
 
-        // f = average face point of all adjacent faces
-        Vector3f f(0,0,0);
-        for (uint j = 0; j < n; j++) f = f + m_facePoints[F[j]];
-        f = f / n;
+    //vertex normals are summed while faces are added
+    batchNormalize(arrayOf(m_normals), m_normals.size());
 
-        //r = average coordinate of all adjacent edge midpoints
-        Vector3f r(0,0,0);
-        for (uint j = 0; j < n; j++) {
-            uint v1 = m_edges[E[j]].vertices[0];
-            uint v2 = m_edges[E[j]].vertices[1];
-            r = r + (m_vertices[v1].pos + m_vertices[v2].pos)/2.0;
-        }
-        r = r / n;
+    //copy the vertices into a fresh arena so their adjacency lists are packed
+    //without the holes left behind by lists that grew while faces were added
+    Arena *arena = new Arena();
+    vector<Vertex> vertices;
+    vertices.reserve(m_vertices.size());
+    for (uint i = 0; i < m_vertices.size(); i++) {
+        const Vertex &v = m_vertices[i];
+        vertices.push_back(Vertex(arena));
 
-        m_vertexPoints.push_back((f + r*2 + p*(n-3))/n);
-        m_vertexPointNormals.push_back(m_vertices[i].normal);
+        Vertex &packed = vertices.back();
+        packed.edges.assign(v.edges.begin(), v.edges.end());
+        packed.faces.assign(v.faces.begin(), v.faces.end());
     }
+    m_vertices.swap(vertices);
+    vertices.clear();
+
+    ArenaStats stats = m_arena->stats();
+    stats.bytesReserved = 0;
+    m_releasedStats += stats;
+    delete m_arena;
+    m_arena = arena;
+
+    //copy the remaining arrays to release unused capacity
+    vector<Vector3f>(m_positions).swap(m_positions);
+    vector<Vector3f>(m_normals).swap(m_normals);
+    vector<Edge>(m_edges).swap(m_edges);
+    vector<uint>(m_faceOffsets).swap(m_faceOffsets);
+    vector<uint>(m_cornerVertices).swap(m_cornerVertices);
+    vector<uint>(m_cornerEdges).swap(m_cornerEdges);
+    vector<Vector3f>(m_cornerNormals).swap(m_cornerNormals);
+
+    TRACE_COUNTER("arena allocations", allocationStats().allocations);
+    TRACE_COUNTER("arena bytes reserved", allocationStats().bytesReserved);
 }
 
+bool Mesh::isPreview() const {
+    return m_preview;
+}
 
-void Mesh::addFace(Vector3f v1, Vector3f v2, Vector3f v3, Vector3f v4, const Vector3f *normals) {
-    addFace(indexOf(v1), indexOf(v2), indexOf(v3), indexOf(v4), normals);
+uint Mesh::numFaces() const {
+    return m_faceOffsets.size() - 1;
 }
 
-void Mesh::addFace(uint v1, uint v2, uint v3, uint v4, const Vector3f *normals) {
-    Face f;
-    uint V[] = {v1,v2,v3,v4};
-    uint idx = m_faces.size();
+uint Mesh::faceSize(uint face) const {
+    return m_faceOffsets[face + 1] - m_faceOffsets[face];
+}
+
+bool Mesh::addFace(const Vector3f *positions, uint n, const Vector3f *normals) {
+    uint V[4];
+    vector<uint> manyV;
+    uint *indices = V;
+    if (n > 4) {
+        manyV.resize(n);
+        indices = &manyV[0];
+    }
+
+    for (uint i = 0; i < n; i++)
+        indices[i] = indexOf(positions[i]);
+    return addFace(indices, n, normals);
+}
+
+bool Mesh::addFace(const uint *V, uint n, const Vector3f *normals) {
+    uint idx = numFaces();
+
+    //an edge holds two faces, so faces that repeat a vertex or meet a full edge are left out
+    for (uint i = 0; i < n; i++) {
+        for (uint j = i + 1; j < n; j++)
+            if (V[i] == V[j]) return false;
+
+        Edge e;
+        e.vertices[0] = V[i];
+        e.vertices[1] = V[(i+1)%n];
+        EdgeIndexMap::const_iterator it = m_edgeIdxMap.find(e);
+        if (it != m_edgeIdxMap.end() && m_edges[it->second].numFaces >= 2) return false;
+    }
 
     //deal with each vertex of the face
-    for (uint i = 0; i < 4; i++) {
-        f.vertices[i] = V[i];
-        f.edges[i] = indexOf(V[i],V[(i+1)%4]);
+    for (uint i = 0; i < n; i++) {
+        uint edge = indexOf(V[i],V[(i+1)%n]);
+        m_cornerVertices.push_back(V[i]);
+        m_cornerEdges.push_back(edge);
 
-        Edge &e = m_edges[f.edges[i]];
-        Q_ASSERT(e.numFaces < 2);
+        Edge &e = m_edges[edge];
         e.faces[e.numFaces++] = idx;
         m_vertices[V[i]].faces.push_back(idx);
     }
@@ -296,43 +800,48 @@ void Mesh::addFace(uint v1, uint v2, uint v3, uint v4, const Vector3f *normals)
     //deal with face normals
     if (USE_OBJ_NORMALS && normals) {
        //if vertex normals of face exist, just use those
-        for (uint i = 0; i < 4; i++) {
-            f.normals[i] = normals[i];
-
-            //update cumulative moving average of vertex normal
-            Vector3f &vertexNormal = m_vertices[f.vertices[i]].normal;
-            float k = m_vertices[f.vertices[i]].faces.size();
-            Q_ASSERT(k > 0);
-            vertexNormal = (vertexNormal*(k-1) + normals[i])/k;
-            vertexNormal = vertexNormal / vertexNormal.magnitude();
+        for (uint i = 0; i < n; i++) {
+            m_cornerNormals.push_back(normals[i]);
+
+            //sum vertex normal, it is normalized when the mesh is finalized
+            Vector3f &vertexNormal = m_normals[V[i]];
+            vertexNormal = vertexNormal + normals[i];
         }
     } else {
-        //calculate normals if they do not exist
-        Vector3f a = m_vertices[f.vertices[0]].pos - m_vertices[f.vertices[1]].pos;
-        Vector3f b = m_vertices[f.vertices[1]].pos - m_vertices[f.vertices[2]].pos;
-        Vector3f n = a.cross(b);
-        n = n / n.magnitude();
-        for (uint i = 0; i < 4; i++) {
-            f.normals[i] = n;
-
-            //update cumulative moving average of vertex normal
-            Vector3f &vertexNormal = m_vertices[f.vertices[i]].normal;
-            float k = m_vertices[f.vertices[i]].faces.size();
-            Q_ASSERT(k > 0);
-            vertexNormal = (vertexNormal*(k-1) + n)/k;
-            vertexNormal = vertexNormal / vertexNormal.magnitude();
+        //calculate normals if they do not exist, using Newell's method
+        //so that concave and non-planar faces get their average normal
+        Vector3f N;
+        for (uint i = 0; i < n; i++) {
+            const Vector3f &a = m_positions[V[i]];
+            const Vector3f &b = m_positions[V[(i+1)%n]];
+            N[0] += (a[1] - b[1]) * (a[2] + b[2]);
+            N[1] += (a[2] - b[2]) * (a[0] + b[0]);
+            N[2] += (a[0] - b[0]) * (a[1] + b[1]);
+        }
+
+        //faces without area keep a zero normal, as batchNormalize leaves zero vectors
+        float magnitude = N.magnitude();
+        if (magnitude > 0) N = N / magnitude;
+
+        for (uint i = 0; i < n; i++) {
+            m_cornerNormals.push_back(N);
+
+            //sum vertex normal, it is normalized when the mesh is finalized
+            Vector3f &vertexNormal = m_normals[V[i]];
+            vertexNormal = vertexNormal + N;
         }
     }
 
-    m_faces.push_back(f);
+    m_faceOffsets.push_back(m_cornerVertices.size());
+    return true;
 }
 
 uint Mesh::indexOf(Vector3f p) {
     //add new vertex with position p to the mesh if it does not exist
     if (m_pointIdxMap.count(p) == 0) {
-        Vertex v;
-        v.pos = p;
-        m_vertices.push_back(v);
+        m_positions.push_back(p);
+        m_normals.push_back(Vector3f());
+        m_vertices.push_back(Vertex(m_arena));
         m_pointIdxMap[p] = m_vertices.size() - 1;
     }
 
@@ -357,58 +866,389 @@ uint Mesh::indexOf(uint v1, uint v2) {
     return m_edgeIdxMap[e];
 }
 
-const float *Mesh::getVertexBuffer(uint &numVertices) {
+uint Mesh::numDrawVertices() const {
+    //a face of n vertices becomes n-2 triangles, previews only know their buffer
+    if (m_preview) return m_numVertices;
+    return 3 * (m_cornerVertices.size() - 2*numFaces());
+}
+
+const DrawVertex *Mesh::getDrawBuffer(uint &numVertices) const {
+    QMutexLocker locker(&m_bufferMutex);
     if (!m_cached)
         createBuffers();
 
     numVertices = m_numVertices;
-    return m_vertexBuffer;
+    return m_drawBuffer;
 }
 
-const float *Mesh::getNormalBuffer(uint &numVertices) {
-    if (!m_cached)
-        createBuffers();
+void Mesh::setGpuBuffers(const GpuBuffers &buffers) const {
+    m_gpuBuffers = buffers;
+}
 
-    numVertices = m_numVertices;
-    return m_normalBuffer;
+bool Mesh::hasGpuBuffers() const {
+    return m_gpuBuffers.vertices != 0;
 }
 
 
-void Mesh::createBuffers() {
-    //create and fill buffers with vertex and normal coordinates
-    m_numVertices = m_faces.size()*4;
-    m_vertexBuffer = (float*)malloc(3*sizeof(float)*m_numVertices);
-    m_normalBuffer = (float*)malloc(3*sizeof(float)*m_numVertices);
-    uint idx = 0;
-    for (uint i = 0; i < m_faces.size(); i++) {
-        Face &f = m_faces[i];
-        for (uint j = 0; j < 4; j++) {
-            Vector3f &v = m_vertices[f.vertices[j]].pos;
-            Vector3f &n = f.normals[j];
+void Mesh::triangulateFace(uint face, vector<uint> &corners, vector<Vector2f> &projected) const {
+    uint begin = m_faceOffsets[face];
+    uint n = faceSize(face);
+    corners.clear();
 
-            for (uint k = 0; k < 3; k++) {
-                m_vertexBuffer[idx] = v[k];
-                m_normalBuffer[idx] = n[k];
-                idx++;
-            }
-        }
+    if (n == 3) {
+        corners.push_back(0);
+        corners.push_back(1);
+        corners.push_back(2);
+        return;
     }
 
+    //project the face onto the plane of the axes its normal is most orthogonal to
+    const Vector3f &N = m_cornerNormals[begin];
+    uint axis = fabs(N[0]) > fabs(N[1]) ? 0 : 1;
+    if (fabs(N[2]) > fabs(N[axis])) axis = 2;
+    uint u = (axis + 1) % 3, v = (axis + 2) % 3;
+
+    projected.resize(n);
+    for (uint j = 0; j < n; j++) {
+        const Vector3f &p = m_positions[m_cornerVertices[begin + j]];
+        projected[j] = Vector2f(p[u], p[v]);
+    }
+    triangulatePolygon(&projected[0], n, corners);
+}
+
+uint Mesh::faceOfTriangle(uint triangle) const {
+    //a face of n corners has n-2 triangles, so the triangles of face i start at m_faceOffsets[i] - 2i
+    uint low = 0, high = numFaces();
+    while (high - low > 1) {
+        uint middle = (low + high) / 2;
+        if (m_faceOffsets[middle] - 2*middle <= triangle)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+void Mesh::createBuffers() const {
+    TRACE_SCOPE("Mesh::createBuffers");
+
+    m_numVertices = numDrawVertices();
+    m_drawBuffer = (DrawVertex*)malloc(sizeof(DrawVertex)*m_numVertices);
+    fillDrawBuffer(m_drawBuffer);
     m_cached = true;
 }
 
-void Mesh::glDraw() {
-    //get vertex and normal buffers
+void Mesh::fillDrawBuffer(DrawVertex *vertices) const {
+    fillDrawBuffer(vertices, 0, numDrawVertices());
+}
+
+uint Mesh::firstDrawVertex(uint face) const {
+    return 3 * (m_faceOffsets[face] - 2*face);
+}
+
+uint Mesh::drawSliceEnd(uint begin, uint maxVertices) const {
+    uint n = numDrawVertices();
+    if (maxVertices >= n - begin) return n;
+
+    //previews have no faces, any whole triangle ends a slice
+    if (m_preview) return begin + qMax(3u, maxVertices - maxVertices % 3);
+
+    //the faces before the one holding the first vertex past the slice fit in it
+    uint first = faceOfTriangle(begin / 3);
+    uint end = faceOfTriangle((begin + maxVertices) / 3);
+    return firstDrawVertex(qMax(end, first + 1));
+}
+
+void Mesh::fillDrawBuffer(DrawVertex *vertices, uint begin, uint end) const {
+    TRACE_SCOPE("Mesh::fillDrawBuffer");
+    if (end <= begin) return;
+
+    //previews are made with their draw buffer
+    if (m_preview) {
+        memcpy(vertices, m_drawBuffer + begin, sizeof(DrawVertex)*(end - begin));
+        return;
+    }
+
+    //every face knows where its vertices start, so chunks of faces are filled independently
+    uint firstFace = faceOfTriangle(begin / 3);
+    uint n = (end == numDrawVertices() ? numFaces() : faceOfTriangle(end / 3)) - firstFace;
+    uint threads = qMax(QThread::idealThreadCount(), 1);
+    uint chunks = qMax(1u, qMin(threads, n / FILL_CHUNK_FACES));
+    uint chunkSize = (n + chunks - 1) / chunks;
+
+    vector<QFuture<void> > futures;
+    for (uint c = 0; c < chunks; c++) {
+        uint first = firstFace + c * chunkSize;
+        uint last = qMin(firstFace + n, first + chunkSize);
+        if (c + 1 < chunks)
+            futures.push_back(QtConcurrent::run(this, &Mesh::fillFaces, vertices, begin, first, last));
+        else
+            fillFaces(vertices, begin, first, last);
+    }
+    for (uint i = 0; i < futures.size(); i++) futures[i].waitForFinished();
+}
+
+void Mesh::fillFaces(DrawVertex *vertices, uint offset, uint begin, uint end) const {
+    vector<uint> corners;
+    vector<Vector2f> projected;
+    for (uint i = begin; i < end; i++) {
+        uint first = m_faceOffsets[i];
+        uint n = faceSize(i);
+        triangulateFace(i, corners, projected);
+
+        //the fields are written in order, so writes to mapped memory combine into whole lines
+        DrawVertex *out = vertices + firstDrawVertex(i) - offset;
+        for (uint j = 0; j < corners.size(); j++) {
+            uint corner = first + corners[j];
+            out[j].position = m_positions[m_cornerVertices[corner]];
+            out[j].normal = m_cornerNormals[corner];
+
+            //triangles keep the winding of the face, so the triangle edge from a corner
+            //is an edge of the face if it goes to the next corner of the face
+            uint next = corners[j - j%3 + (j+1)%3];
+            out[j].edgeFlag = next == (corners[j] + 1) % n;
+            if (j % 3 == 2) setBarycentric(out + j - 2);
+        }
+    }
+}
+
+uint Mesh::numPositions() const { return m_positions.size(); }
+const Vector3f *Mesh::getPositions() const { return m_positions.empty() ? 0 : &m_positions[0]; }
+uint Mesh::numEdgeIndices() const { return 2 * m_edges.size(); }
+bool Mesh::hasEdges() const { return !m_edges.empty(); }
+
+void Mesh::fillEdgeIndices(uint *indices) const {
+    TRACE_SCOPE("Mesh::fillEdgeIndices");
+    for (uint i = 0; i < m_edges.size(); i++) {
+        indices[2*i] = m_edges[i].vertices[0];
+        indices[2*i + 1] = m_edges[i].vertices[1];
+    }
+}
+
+void Mesh::glDraw(MeshPrimitives primitives) const {
+    uint count = glEnableArrays(primitives);
+    glDrawPrimitives(primitives, count, 0);
+    glDisableArrays(primitives);
+}
+
+void Mesh::glDrawCopies(const float *transforms, uint copies, MeshPrimitives primitives) const {
+    //the arrays are set up once for all copies
+    uint count = glEnableArrays(primitives);
+    for (uint i = 0; i < copies; i++) {
+        glPushMatrix();
+        glMultMatrixf(transforms + 16*i);
+        glDrawPrimitives(primitives, count, 0);
+        glPopMatrix();
+    }
+    glDisableArrays(primitives);
+}
+
+void Mesh::glDrawInstanced(uint instances, MeshPrimitives primitives) const {
+    uint count = glEnableArrays(primitives);
+    glDrawPrimitives(primitives, count, instances);
+    glDisableArrays(primitives);
+}
+
+void Mesh::glDrawPrimitives(MeshPrimitives primitives, uint count, uint instances) const {
+    if (count == 0) return;
+
+    if (primitives == MESH_EDGES) {
+        //the element array buffer stays bound while drawing, so the indices are an offset into it
+        const uint *indices = m_gpuBuffers.edges ? 0 : &m_edgeIndices[0];
+        if (instances > 0)
+            glDrawIndexedInstances(GL_LINES, count, GL_UNSIGNED_INT, indices, instances);
+        else
+            glDrawElements(GL_LINES, count, GL_UNSIGNED_INT, indices);
+        return;
+    }
+
+    if (instances > 0)
+        glDrawInstances(GL_TRIANGLES, 0, count, instances);
+    else
+        glDrawArrays(GL_TRIANGLES, 0, count);
+}
+
+uint Mesh::glEnableArrays(MeshPrimitives primitives) const {
+    //pointers are offsets into the buffer bound when they are set, and keep that buffer after it is unbound
+    if (primitives == MESH_EDGES) {
+        if (!hasEdges()) return 0;
+
+        glEnableClientState(GL_VERTEX_ARRAY);
+        if (m_gpuBuffers.edges) {
+            glBindArrayBuffer(m_gpuBuffers.positions);
+            glVertexPointer(3, GL_FLOAT, 0, 0);
+            glBindArrayBuffer(0);
+            glBindElementBuffer(m_gpuBuffers.edges);
+        } else {
+            QMutexLocker locker(&m_bufferMutex);
+            if (m_edgeIndices.empty()) {
+                m_edgeIndices.resize(numEdgeIndices());
+                fillEdgeIndices(&m_edgeIndices[0]);
+            }
+            glVertexPointer(3, GL_FLOAT, 0, getPositions());
+        }
+        return numEdgeIndices();
+    }
+
     uint numVertices;
-    const float *vertexBuffer = getVertexBuffer(numVertices);
-    const float *normalBuffer = getNormalBuffer(numVertices);
+    const char *base;
+    if (hasGpuBuffers()) {
+        numVertices = numDrawVertices();
+        base = 0;
+        glBindArrayBuffer(m_gpuBuffers.vertices);
+    } else {
+        base = (const char*)getDrawBuffer(numVertices);
+    }
 
-    //draw arrays using openGL
+    //point openGL to the interleaved arrays
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
-        if (vertexBuffer) glVertexPointer(3, GL_FLOAT, 0, vertexBuffer);
-        if (normalBuffer) glNormalPointer(GL_FLOAT, 0, normalBuffer);
-        glDrawArrays(GL_QUADS, 0, numVertices);
+    glEnableClientState(GL_EDGE_FLAG_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(DrawVertex), base + offsetof(DrawVertex, position));
+    glNormalPointer(GL_FLOAT, sizeof(DrawVertex), base + offsetof(DrawVertex, normal));
+    glEdgeFlagPointer(sizeof(DrawVertex), base + offsetof(DrawVertex, edgeFlag));
+
+    if (primitives == MESH_WIRED_TRIANGLES) {
+        glAttribPointer(BARYCENTRIC_ATTRIBUTE, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DrawVertex),
+                        base + offsetof(DrawVertex, barycentric));
+        glEnableAttribArray(BARYCENTRIC_ATTRIBUTE);
+    }
+
+    if (hasGpuBuffers()) glBindArrayBuffer(0);
+    return numVertices;
+}
+
+void Mesh::glDisableArrays(MeshPrimitives primitives) const {
     glDisableClientState(GL_VERTEX_ARRAY);
     glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_EDGE_FLAG_ARRAY);
+
+    if (primitives == MESH_WIRED_TRIANGLES)
+        glDisableAttribArray(BARYCENTRIC_ATTRIBUTE);
+    if (primitives == MESH_EDGES && m_gpuBuffers.edges)
+        glBindElementBuffer(0);
+}
+
+void Mesh::getTriangles(vector<uint> &triangles) const {
+    triangles.clear();
+    triangles.reserve(3 * (m_cornerVertices.size() - 2*numFaces()));
+    vector<uint> corners;
+    vector<Vector2f> projected;
+    for (uint i = 0; i < numFaces(); i++) {
+        triangulateFace(i, corners, projected);
+        for (uint j = 0; j < corners.size(); j++)
+            triangles.push_back(m_cornerVertices[m_faceOffsets[i] + corners[j]]);
+    }
+}
+
+Mesh *Mesh::decimate(uint targetTriangles, float &error) const {
+    TRACE_SCOPE("Mesh::decimate");
+
+    vector<uint> triangles;
+    getTriangles(triangles);
+    Decimator decimator;
+    decimator.decimate(m_positions.empty() ? 0 : &m_positions[0], m_positions.size(),
+                       triangles.empty() ? 0 : &triangles[0], triangles.size() / 3, targetTriangles);
+    error = decimator.getError();
+
+    //the reduced triangles become the faces of a new mesh, whose normals are interpolated again
+    ObjData data;
+    data.positions = decimator.getPositions();
+    data.faceVertices = decimator.getTriangles();
+    data.faceNormals.assign(data.faceVertices.size(), NO_NORMAL);
+    data.faceOffsets.resize(decimator.getNumTriangles() + 1);
+    for (uint i = 0; i < data.faceOffsets.size(); i++)
+        data.faceOffsets[i] = 3 * i;
+    return fromObjData(data);
+}
+
+const Vector3f &Mesh::getPosition(uint vertex) const {
+    return m_positions[vertex];
+}
+
+void Mesh::buildBvh() const {
+    if (m_bvh || m_positions.empty()) return;
+    TRACE_SCOPE("Mesh::buildBvh");
+
+    //build over the triangles of the faces in face order, as they are drawn
+    vector<uint> triangles;
+    getTriangles(triangles);
+
+    m_bvh = new Bvh();
+    m_bvh->build(&m_positions[0], triangles.empty() ? 0 : &triangles[0], triangles.size() / 3);
+}
+
+bool Mesh::pick(const Vector3f &origin, const Vector3f &direction, float maxT, MeshHit &hit) const {
+    if (m_positions.empty()) return false;
+    buildBvh();
+
+    uint triangle;
+    if (!m_bvh->intersect(&m_positions[0], origin, direction, maxT, hit.t, triangle))
+        return false;
+
+    //find the corner of the face nearest to the hit point
+    hit.face = faceOfTriangle(triangle);
+    Vector3f p = origin + direction * hit.t;
+    float nearest = FLT_MAX;
+    hit.vertex = m_cornerVertices[m_faceOffsets[hit.face]];
+    for (uint j = m_faceOffsets[hit.face]; j < m_faceOffsets[hit.face + 1]; j++) {
+        float d = (m_positions[m_cornerVertices[j]] - p).magnitude();
+        if (d < nearest) {
+            nearest = d;
+            hit.vertex = m_cornerVertices[j];
+        }
+    }
+
+    return true;
+}
+
+void Mesh::glDrawFace(uint face) const {
+    vector<uint> corners;
+    vector<Vector2f> projected;
+    triangulateFace(face, corners, projected);
+
+    glBegin(GL_TRIANGLES);
+    for (uint j = 0; j < corners.size(); j++) {
+        uint corner = m_faceOffsets[face] + corners[j];
+        glNormal3fv(m_cornerNormals[corner].ptr());
+        glVertex3fv(m_positions[m_cornerVertices[corner]].ptr());
+    }
+    glEnd();
+}
+
+MemoryUsage Mesh::memoryUsage() const {
+    MemoryUsage usage;
+
+    usage.geometry = sizeof(Mesh) + vectorBytes(m_positions) + vectorBytes(m_normals)
+                   + vectorBytes(m_vertices) + vectorBytes(m_edges) + vectorBytes(m_faceOffsets)
+                   + vectorBytes(m_cornerVertices) + vectorBytes(m_cornerEdges) + vectorBytes(m_cornerNormals);
+
+    //adjacency lists and lookup map nodes live in the arenas
+    usage.topology = m_arena->stats().bytesReserved;
+    usage.lookupMaps = m_buildArena->stats().bytesReserved;
+
+    usage.scratch = vectorBytes(m_facePoints) + vectorBytes(m_edgePoints) + vectorBytes(m_vertexPoints)
+                  + vectorBytes(m_facePointNormals) + vectorBytes(m_edgePointNormals) + vectorBytes(m_vertexPointNormals);
+
+    //meshes drawn from a buffer object only keep a draw buffer in system memory if it was needed before
+    if (m_cached)
+        usage.cpuBuffers = sizeof(DrawVertex) * m_numVertices;
+    usage.cpuBuffers += vectorBytes(m_edgeIndices);
+    if (hasGpuBuffers()) {
+        usage.gpuBuffers = sizeof(DrawVertex) * numDrawVertices();
+        if (m_gpuBuffers.edges)
+            usage.gpuBuffers += sizeof(Vector3f) * numPositions() + sizeof(uint) * numEdgeIndices();
+    }
+
+    if (m_bvh)
+        usage.picking = m_bvh->memoryUsage();
+
+    return usage;
+}
+
+ArenaStats Mesh::allocationStats() const {
+    ArenaStats stats = m_releasedStats;
+    stats += m_arena->stats();
+    stats += m_buildArena->stats();
+    return stats;
 }
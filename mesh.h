@@ -2,28 +2,39 @@
 #define MESH_H
 
 #include "types.h"
+#include "utils/arena.h"
+#include "utils/bvh.h"
 #include <QGLWidget>
+#include <QMutex>
+#include <QSharedPointer>
 
 #include <map>
 #include <vector>
 
 #define USE_OBJ_NORMALS 0   //uses normals in OBJ file
 
+//generic attribute location of the barycentric coordinates of wired triangles
+//some drivers alias generic attributes with the built-in ones, 6 is not shared with any
+#define BARYCENTRIC_ATTRIBUTE 6
+
 using namespace std;
 
 struct Vertex;
 struct Edge;
-struct Face;
 
 typedef struct Vertex Vertex;
 typedef struct Edge Edge;
-typedef struct Face Face;
 
+//list of primitive indices allocated from the arena of a mesh
+typedef vector<uint, ArenaAllocator<uint> > IndexList;
+
+//adjacency of a vertex, its position and normal are kept in the position and normal arrays of the mesh
 struct Vertex {
-    Vector3f pos;
-    vector<uint> edges;
-    vector<uint> faces;
-    Vector3f normal;
+    IndexList edges;
+    IndexList faces;
+
+    Vertex(Arena *arena = 0)
+        : edges(ArenaAllocator<uint>(arena)), faces(ArenaAllocator<uint>(arena)) {}
 };
 
 //compares two unsigned integers for sorting
@@ -53,51 +64,206 @@ struct Edge {
     }
 };
 
-struct Face {
-    uint vertices[4];
-    uint edges[4];
-    Vector3f normals[4];
+//bytes of memory used by a mesh in each category
+struct MemoryUsage {
+    size_t geometry;    //vertices, edges and faces
+    size_t topology;    //per-vertex adjacency lists
+    size_t lookupMaps;  //maps of primitives to their index used while building the mesh
+    size_t scratch;     //points and normals calculated for subdivision
+    size_t cpuBuffers;  //draw buffers in system memory
+    size_t gpuBuffers;  //buffer objects in GPU memory
+    size_t picking;     //bounding volume hierarchy for ray picking
 
-    //less than comparison for map
-    bool operator<(const Face &f) const {
-        uint V1[4] = {vertices[0], vertices[1], vertices[2], vertices[3]};
-        uint V2[4] = {f.vertices[0], f.vertices[1], f.vertices[2], f.vertices[3]};
+    MemoryUsage();
 
-        qsort(V1, 4, sizeof(uint), uintCompare);
-        qsort(V2, 4, sizeof(uint), uintCompare);
+    //returns the sum of all categories
+    size_t total() const;
 
-        for (uint i = 0; i < 4; i++) {
-            if (V1[i] == V2[i]) continue;
-            return V1[i] < V2[i];
-        }
+    MemoryUsage &operator+=(const MemoryUsage &m);
+};
 
-        return false;
-    }
+//a vertex of the triangulated faces in the interleaved draw buffer
+//the edge flag marks triangle edges that are face edges, so wireframes do not show the triangulation
+//barycentric coordinates are 0 or 255, edges that are not face edges get 255 at all three corners
+//so no fragment of the triangle is close to them; they fill what would be padding otherwise
+struct DrawVertex {
+    Vector3f position;
+    Vector3f normal;
+    GLboolean edgeFlag;
+    GLubyte barycentric[3];
+};
+
+//what a mesh draws
+enum MeshPrimitives {
+    MESH_TRIANGLES,         //the triangulated faces
+    MESH_EDGES,             //every edge once as a line, meshes without edges draw nothing
+    MESH_WIRED_TRIANGLES    //the triangulated faces with barycentric coordinates in BARYCENTRIC_ATTRIBUTE
 };
 
+//names of the buffer objects a mesh draws from once uploaded, 0 if there is none
+struct GpuBuffers {
+    GLuint vertices;    //draw buffer filled by fillDrawBuffer
+    GLuint positions;   //vertex positions, for the edges
+    GLuint edges;       //element array filled by fillEdgeIndices
+
+    GpuBuffers();
+};
+
+//a face hit by a ray, and the vertex of the face nearest to the hit point
+struct MeshHit {
+    uint face;
+    uint vertex;
+    float t;    //ray parameter of the hit point
+};
+
+//receives the progress of a long operation, which it can cancel
+class ProgressMonitor {
+public:
+    virtual ~ProgressMonitor() {}
+
+    //called with the fraction of the operation that is done, returns false to cancel it
+    virtual bool progress(float fraction) = 0;
+};
+
+//contents of an OBJ file before its faces are added to a mesh
+//the corners of face i are [faceOffsets[i], faceOffsets[i+1]) in faceVertices and faceNormals
+struct ObjData {
+    vector<Vector3f> positions;
+    vector<Vector3f> normals;
+    vector<uint> faceOffsets;
+    vector<uint> faceVertices;
+    vector<uint> faceNormals;
+};
+
+//lookup maps of geometric primitives to their index, allocated from the build arena of a mesh
+typedef map<Vector3f, uint, less<Vector3f>, ArenaAllocator<pair<const Vector3f, uint> > > PointIndexMap;
+typedef map<Edge, uint, less<Edge>, ArenaAllocator<pair<const Edge, uint> > > EdgeIndexMap;
+
+/* A polygon mesh, whose faces can have any number of vertices. Meshes are not
+   copyable since they own their draw buffers; they are passed around as shared
+   handles (MeshPtr) and only modified while being built. Once finalized, a mesh
+   is shared read-only (ConstMeshPtr).*/
 class Mesh {
 public:
     Mesh();
     ~Mesh();
 
+#ifdef Q_COMPILER_RVALUE_REFS
+    Mesh(Mesh &&mesh);
+    Mesh &operator=(Mesh &&mesh);
+#endif
+
+    // exchanges the contents of two meshes without copying them
+    void swap(Mesh &mesh);
+
     static Mesh *fromObjFile(QString filename);
 
-    const float *getVertexBuffer(uint &numVertices);
-    const float *getNormalBuffer(uint &numVertices);
-    void glDraw();
+    // parses an OBJ file, returns false if it cannot be read or parsed, or the monitor cancels
+    static bool parseObjFile(QString filename, ObjData &data, ProgressMonitor *monitor = 0);
+
+    // builds a mesh and its topology from a parsed file
+    // returns 0 if a face refers to a missing vertex, repeats a vertex, or would be the third face
+    // of an edge, or if the monitor cancels
+    static Mesh *fromObjData(const ObjData &data, ProgressMonitor *monitor = 0);
+
+    // returns a mesh that can only be drawn, its faces are fanned into triangles with flat normals
+    // it has no topology, so it cannot be subdivided or picked
+    static Mesh *previewFromObjData(const ObjData &data);
+
+    // returns true for meshes made by previewFromObjData
+    bool isPreview() const;
+
+    // returns the number of vertices of the triangulated faces
+    uint numDrawVertices() const;
+
+    // fills numDrawVertices() vertices of the triangulated faces, splitting the faces among threads
+    // the target may be mapped GPU memory, every vertex is written once and never read
+    void fillDrawBuffer(DrawVertex *vertices) const;
+
+    // returns the end of the slice of whole faces starting at draw vertex begin, which must start a face
+    // the slice has at most maxVertices vertices, unless its first face alone has more
+    uint drawSliceEnd(uint begin, uint maxVertices) const;
+
+    // fills the vertices [begin, end) of a slice, the first at vertices[0]
+    void fillDrawBuffer(DrawVertex *vertices, uint begin, uint end) const;
+
+    // returns the draw buffer in system memory, created on first use by whichever thread asks for it first
+    const DrawVertex *getDrawBuffer(uint &numVertices) const;
+
+    // returns the number of positions, and the vertex indices of the edges, 2 per edge
+    // previews have no edges
+    uint numPositions() const;
+    const Vector3f *getPositions() const;
+    uint numEdgeIndices() const;
+    bool hasEdges() const;
+    void fillEdgeIndices(uint *indices) const;
+
+    // makes the mesh draw from buffer objects instead of system memory
+    // the buffers are owned by the caller and must outlive the mesh, or be replaced before they are deleted
+    void setGpuBuffers(const GpuBuffers &buffers) const;
+    bool hasGpuBuffers() const;
+
+    // wired triangles need glInitInstancing to have succeeded for the current context
+    void glDraw(MeshPrimitives primitives = MESH_TRIANGLES) const;
+
+    // draws copies of the mesh, each with a column-major model transform multiplied onto the current matrix
+    void glDrawCopies(const float *transforms, uint copies, MeshPrimitives primitives = MESH_TRIANGLES) const;
+
+    // draws instances of the mesh in one call, the bound shaders place each instance
+    // only valid when glInitInstancing succeeded for the current context
+    void glDrawInstanced(uint instances, MeshPrimitives primitives = MESH_TRIANGLES) const;
 
     // scales mesh down to a unit bounding box
     void unitize();
 
-    // returns the mesh after one step of Catmull-Clark subdivision
-    Mesh subdivide();
+    // scales positions down to a unit bounding box as unitize does
+    static void unitize(vector<Vector3f> &positions);
+
+    // returns a new mesh after one step of Catmull-Clark subdivision
+    Mesh *subdivide();
+
+    // returns a new mesh of at most targetTriangles triangles, reduced by collapsing the edges of least
+    // quadric error; error is set to how far the reduced surface strays from this one, in its units
+    Mesh *decimate(uint targetTriangles, float &error) const;
+
+    // returns the memory used by the mesh
+    MemoryUsage memoryUsage() const;
+
+    // returns the statistics of all allocations made from the arenas of the mesh
+    ArenaStats allocationStats() const;
+
+    // releases data only needed while building the mesh and packs the remaining arrays
+    // no faces can be added to the mesh afterwards
+    void finalize();
+
+    // returns the number of faces and the number of vertices of a face
+    uint numFaces() const;
+    uint faceSize(uint face) const;
+
+    // returns the position of a vertex
+    const Vector3f &getPosition(uint vertex) const;
+
+    // returns the vertex indices of the triangulated faces, 3 per triangle, in face order as they are drawn
+    void getTriangles(vector<uint> &triangles) const;
+
+    // builds the hierarchy of the faces that picking queries, if it is not built yet
+    // levels that can be displayed build it with the level, so the first pick does not stall the view
+    void buildBvh() const;
+
+    // finds the closest face hit by the ray origin + t*direction with 0 < t < maxT
+    // the hierarchy is built on the first query if it was not built with the mesh
+    bool pick(const Vector3f &origin, const Vector3f &direction, float maxT, MeshHit &hit) const;
+
+    // draws the triangles of one face
+    void glDrawFace(uint face) const;
 
 protected:
-    // adds a face of 4 new vertices
-    void addFace(Vector3f v1, Vector3f v2, Vector3f v3, Vector3f v4, const Vector3f *normals = 0);
+    // adds a face of n vertices in the given positions, adding the vertices that do not exist
+    // returns false without adding it if it repeats a vertex or one of its edges already has two faces
+    bool addFace(const Vector3f *positions, uint n, const Vector3f *normals = 0);
 
-    // adds a face of 4 existing vertices
-    void addFace(uint v1, uint v2, uint v3, uint v4, const Vector3f *normals = 0);
+    // adds a face of n existing vertices, returns false as above
+    bool addFace(const uint *vertices, uint n, const Vector3f *normals = 0);
 
     // returns the index of vertex in position p, and adds it to mesh if it does not exist
     uint indexOf(Vector3f p);
@@ -105,23 +271,73 @@ protected:
     // returns the index of an edge (2 vertices in mesh), and adds it to mesh if it does not exist
     uint indexOf(uint v1, uint v2);
 
-    // initializes and fills the vertex and normal buffers
-    void createBuffers();
+    // enables the arrays of the primitives, returns the number of vertices or indices to draw
+    uint glEnableArrays(MeshPrimitives primitives) const;
+    void glDisableArrays(MeshPrimitives primitives) const;
+
+    // draws the enabled primitives, as instances unless instances is 0
+    void glDrawPrimitives(MeshPrimitives primitives, uint count, uint instances) const;
+
+    // sets the corners of the n-2 triangles of a face, as corner numbers of the face
+    void triangulateFace(uint face, vector<uint> &corners, vector<Vector2f> &projected) const;
+
+    // returns the face of a triangle of the triangulated faces
+    uint faceOfTriangle(uint triangle) const;
+
+    // returns the first draw vertex of a face, the vertices of face i start at 3*(m_faceOffsets[i] - 2i)
+    uint firstDrawVertex(uint face) const;
+
+    // fills the vertices of faces [begin, end), vertices holds the draw vertices from offset on
+    void fillFaces(DrawVertex *vertices, uint offset, uint begin, uint end) const;
+
+    // allocates and fills the draw buffer in system memory
+    void createBuffers() const;
 
     // calculates face, egde, and vertex points
     void calculatePoints();
 
+    // releases the points calculated for subdivision
+    void clearPoints();
+
 protected:
-    //vertex and normal data
-    float *m_vertexBuffer;
-    float *m_normalBuffer;
-    bool m_cached;
-    uint m_numVertices;
+    //interleaved vertex data, created on first draw from system memory
+    mutable DrawVertex *m_drawBuffer;
+    mutable bool m_cached;
+    mutable uint m_numVertices;
+    mutable QMutex m_bufferMutex;
+
+    //vertex indices of the edges, created on first draw of the edges from system memory
+    mutable vector<uint> m_edgeIndices;
+
+    //buffer objects drawn instead of system memory once set
+    mutable GpuBuffers m_gpuBuffers;
+
+    //hierarchy over the triangulated faces for picking, created with displayed levels or on first query
+    mutable Bvh *m_bvh;
+
+    //preview meshes only have draw buffers
+    bool m_preview;
+
+    //arenas for the adjacency lists of vertices and the lookup maps
+    //the build arena is released in one shot when the mesh is finalized
+    Arena *m_arena;
+    Arena *m_buildArena;
+    ArenaStats m_releasedStats;
 
     //geometric primitives of mesh
+    //vertex positions and normals are contiguous arrays so batch kernels can process them
+    vector<Vector3f> m_positions;
+    vector<Vector3f> m_normals;
     vector<Vertex> m_vertices;
     vector<Edge> m_edges;
-    vector<Face> m_faces;
+
+    //faces of any number of vertices in compressed rows: the corners of face i are
+    //[m_faceOffsets[i], m_faceOffsets[i+1]) in the vertex, edge and normal arrays of the corners
+    //the edge of a corner goes from its vertex to the vertex of the next corner
+    vector<uint> m_faceOffsets;
+    vector<uint> m_cornerVertices;
+    vector<uint> m_cornerEdges;
+    vector<Vector3f> m_cornerNormals;
 
     //vertices computed in subdivision
     vector<Vector3f> m_facePoints;
@@ -134,9 +350,14 @@ protected:
     vector<Vector3f> m_vertexPointNormals;
 
     //lookup maps of geometric primitives to their index
-    map<Vector3f, uint> m_pointIdxMap;
-    map<Edge, uint> m_edgeIdxMap;
-    map<Face, uint> m_faceIdxMap;
+    PointIndexMap m_pointIdxMap;
+    EdgeIndexMap m_edgeIdxMap;
+
+private:
+    Q_DISABLE_COPY(Mesh)
 };
 
+typedef QSharedPointer<Mesh> MeshPtr;
+typedef QSharedPointer<const Mesh> ConstMeshPtr;
+
 #endif // MESH_H
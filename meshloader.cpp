@@ -0,0 +1,124 @@
+#include "meshloader.h"
+
+#include <QtConcurrentRun>
+
+#include "utils/trace.h"
+
+//share of the progress bar taken by parsing, the rest is taken by building the topology
+#define PARSE_PERCENT 40
+
+//reports the progress of one phase of a load to the loader, and cancels the
+//phase once a newer load started or the load was cancelled
+class LoadMonitor : public ProgressMonitor {
+public:
+    LoadMonitor(MeshLoader *loader, const QAtomicInt *current, uint generation, int first, int last)
+        : m_loader(loader), m_current(current), m_generation(generation),
+          m_first(first), m_last(last), m_percent(-1) {}
+
+    bool progress(float fraction) {
+        if ((uint)(int)*m_current != m_generation) return false;
+
+        //only post whole percent steps
+        int percent = m_first + (int)(fraction * (m_last - m_first));
+        if (percent != m_percent) {
+            m_percent = percent;
+            QMetaObject::invokeMethod(m_loader, "deliverProgress", Qt::QueuedConnection,
+                                      Q_ARG(int, percent), Q_ARG(uint, m_generation));
+        }
+        return true;
+    }
+
+private:
+    MeshLoader *m_loader;
+    const QAtomicInt *m_current;
+    uint m_generation;
+    int m_first;
+    int m_last;
+    int m_percent;
+};
+
+MeshLoader::MeshLoader(QObject *parent)
+    : QObject(parent), m_generation(0), m_loading(false)
+{
+    qRegisterMetaType<MeshPtr>("MeshPtr");
+}
+
+MeshLoader::~MeshLoader() {
+    cancel();
+    m_future.waitForFinished();
+}
+
+void MeshLoader::load(QString filename) {
+    //a running worker notices the new generation at its next progress report and stops
+    uint generation = m_generation.fetchAndAddOrdered(1) + 1;
+    m_loading = true;
+    m_future = QtConcurrent::run(this, &MeshLoader::run, filename, generation);
+}
+
+bool MeshLoader::isLoading() const {
+    return m_loading;
+}
+
+void MeshLoader::cancel() {
+    m_generation.fetchAndAddOrdered(1);
+    if (!m_loading) return;
+
+    m_loading = false;
+    emit cancelled();
+}
+
+void MeshLoader::run(QString filename, uint generation) {
+    TRACE_SCOPE("MeshLoader::run");
+
+    ObjData data;
+    LoadMonitor parseMonitor(this, &m_generation, generation, 0, PARSE_PERCENT);
+    if (!Mesh::parseObjFile(filename, data, &parseMonitor)) {
+        QMetaObject::invokeMethod(this, "deliverFailure", Qt::QueuedConnection,
+                                  Q_ARG(QString, filename), Q_ARG(uint, generation));
+        return;
+    }
+
+    //the preview only needs the raw positions, so it can be shown while the topology is built
+    Mesh::unitize(data.positions);
+    MeshPtr preview(Mesh::previewFromObjData(data));
+    QMetaObject::invokeMethod(this, "deliverPreview", Qt::QueuedConnection,
+                              Q_ARG(MeshPtr, preview), Q_ARG(uint, generation));
+
+    LoadMonitor buildMonitor(this, &m_generation, generation, PARSE_PERCENT, 100);
+    MeshPtr mesh(Mesh::fromObjData(data, &buildMonitor));
+    if (!mesh) {
+        QMetaObject::invokeMethod(this, "deliverFailure", Qt::QueuedConnection,
+                                  Q_ARG(QString, filename), Q_ARG(uint, generation));
+        return;
+    }
+
+    //the hierarchy for picking is built here, not on the first hover in the view
+    mesh->buildBvh();
+
+    QMetaObject::invokeMethod(this, "deliverMesh", Qt::QueuedConnection,
+                              Q_ARG(MeshPtr, mesh), Q_ARG(uint, generation));
+}
+
+void MeshLoader::deliverProgress(int percent, uint generation) {
+    if (generation == (uint)(int)m_generation)
+        emit progressChanged(percent);
+}
+
+void MeshLoader::deliverPreview(MeshPtr preview, uint generation) {
+    if (generation == (uint)(int)m_generation)
+        emit previewReady(preview);
+}
+
+void MeshLoader::deliverMesh(MeshPtr mesh, uint generation) {
+    if (generation != (uint)(int)m_generation) return;
+
+    m_loading = false;
+    emit loaded(mesh);
+}
+
+void MeshLoader::deliverFailure(QString filename, uint generation) {
+    if (generation != (uint)(int)m_generation) return;
+
+    m_loading = false;
+    emit failed(filename);
+}
@@ -0,0 +1,59 @@
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include <QObject>
+#include <QFuture>
+#include <QAtomicInt>
+#include <QMetaType>
+
+#include "mesh.h"
+
+Q_DECLARE_METATYPE(MeshPtr)
+
+/* Loads OBJ files in a worker thread. As soon as a file is parsed, a preview
+   of its faces is delivered, and the topology of the full mesh is built while
+   the preview is shown. Both meshes are scaled to the unit box as
+   Mesh::unitize does. Only the results of the latest load are delivered;
+   starting a new load cancels the current one.*/
+class MeshLoader : public QObject {
+    Q_OBJECT
+
+    public:
+        MeshLoader(QObject *parent = 0);
+        ~MeshLoader();
+
+        //starts loading a file in the background
+        void load(QString filename);
+
+        //returns true from the start of a load until its mesh is delivered, or it fails or is cancelled
+        bool isLoading() const;
+
+    public slots:
+        //cancels the current load, the worker stops at its next progress report
+        void cancel();
+
+    signals:
+        void progressChanged(int percent);
+        void previewReady(MeshPtr preview);
+        void loaded(MeshPtr mesh);
+        void failed(QString filename);
+        void cancelled();
+
+    private slots:
+        //called in the thread of the loader with the results of the worker
+        //results of loads that were cancelled or replaced are dropped
+        void deliverProgress(int percent, uint generation);
+        void deliverPreview(MeshPtr preview, uint generation);
+        void deliverMesh(MeshPtr mesh, uint generation);
+        void deliverFailure(QString filename, uint generation);
+
+    private:
+        //parses the file and builds the preview and the mesh, runs in the worker thread
+        void run(QString filename, uint generation);
+
+        QFuture<void> m_future;
+        QAtomicInt m_generation;    //incremented by every load and cancel
+        bool m_loading;
+};
+
+#endif // MESHLOADER_H
@@ -1,23 +1,82 @@
 #include "openglrenderer.h"
+#include "bufferuploader.h"
+#include "shadermanager.h"
+#include "utils/glutils.h"
+#include "utils/timer.h"
+#include "utils/trace.h"
 #include <QDebug>
+#include <QGLFramebufferObject>
+#include <float.h>
+#include <math.h>
 #include <stdio.h>
 
+//color of the edges drawn over shaded faces
+#define WIRE_COLOR 0.1f, 0.1f, 0.1f
+
+//largest error of a level of detail on screen, in pixels
+//a coarser level is only taken once its error is this many times below, so levels do not flip at one distance
+#define LOD_PIXEL_ERROR 1.0f
+#define LOD_HYSTERESIS 1.5f
+
+//each coarser level has about this many times fewer triangles, a slow frame drops as many levels as it needs by this
+//a finer level not drawn yet in an interaction is only tried once a frame is this many times below the budget
+#define INTERACTIVE_LEVEL_RATIO 4
+#define INTERACTIVE_REFINE_MARGIN 2.5
+
+//the resolution drops to no less than this fraction of the width and height before the meshes are reduced
+//it aims for this fraction of the budget, in steps that keep it from following every jitter of the frame time
+#define RESOLUTION_MIN_SCALE 0.5f
+#define RESOLUTION_HEADROOM 0.8
+#define RESOLUTION_STEP 0.05f
+
 OpenGLRenderer::OpenGLRenderer() {
     scene = 0;
+    renderMode = RENDER_MODE_DEFAULT;
+    shaderManager = 0;
+    lightRevision = 1;
+    fixedLightRevision = 0;
+    instancing = false;
+    instancedShaders = 0;
+    instanceBuffer = 0;
+    instanceRevision = 0;
+    highlight = false;
+    uploader = 0;
+    width = height = 0;
+    interactive = false;
+    frameBudget = INTERACTIVE_FRAME_BUDGET;
+    reduction = 0;
+    maxReduction = 0;
+    resolutionScaling = false;
+    resolutionScale = 1;
+    scaledTarget = 0;
+    viewFramebuffer = 0;
+    context = 0;
     /*showAxis = false;
     showInfo = false;*/
 }
 
-OpenGLRenderer::~OpenGLRenderer() {}
+OpenGLRenderer::~OpenGLRenderer() {
+    //the buffers, target and programs belong to the context of init, which has to be current to free them
+    if (context && QGLContext::currentContext() != context)
+        context->makeCurrent();
+
+    if (instanceBuffer) delete instanceBuffer;
+    if (scaledTarget) delete scaledTarget;
+    if (shaderManager) delete shaderManager;
+}
 
 void OpenGLRenderer::init(int width, int height) {
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
     glViewport(0, 0, width, height);
+    this->width = width;
+    this->height = height;
+    context = const_cast<QGLContext*>(QGLContext::currentContext());
 
     float w = width > height ? 2 : (float)width/height * 2;
     float h = height > width ? 2 : (float)height/width * 2;
-    glFrustum(-w/2,w/2,-h/2,h/2,1,100);
+    projection = frustumMatrix(-w/2,w/2,-h/2,h/2,NEAR_PLANE,FAR_PLANE);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrix(projection);
 
     glMatrixMode(GL_MODELVIEW);
     glClearColor(0,0,0,0);
@@ -28,77 +87,531 @@ void OpenGLRenderer::init(int width, int height) {
 
     Light light(0.5f, 0.5f, 0.5f, 1.0f, 0.8f, 0.8f, 1.0, 1.0f, 1.0f, 0.6f, 0.6f, 1.0f, 10.0f, 10.0f, 10.0f);
     setLight(0,light);
+
+    //programs are built in the context that is current during init, the first time they are drawn with
+    if (!shaderManager) {
+        shaderManager = new ShaderManager();
+        shaderManager->bindAttribute("instanceTransform", INSTANCE_ATTRIBUTE);
+        shaderManager->bindAttribute("cornerBarycentric", BARYCENTRIC_ATTRIBUTE);
+        shaderDefines << QString("MAX_LIGHTS %1").arg(MAX_GL_LIGHTS);
+
+        //the instanced fixed-function emulation is needed to draw every mode instanced
+        instanceBuffer = new QGLBuffer(QGLBuffer::VertexBuffer);
+        instanceBuffer->setUsagePattern(QGLBuffer::DynamicDraw);
+        instancing = glInitInstancing() && instanceBuffer->create();
+        if (instancing) instancedShaders = shaderManager->program("instanced.vsh", "instanced.fsh", shaderDefines);
+        instancing = instancedShaders != 0;
+
+        resolutionScaling = QGLFramebufferObject::hasOpenGLFramebufferObjects() && glInitFramebufferBlit();
+    }
 }
 
 void OpenGLRenderer::resize(int width, int height) {
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
     glViewport(0, 0, width, height);
+    this->width = width;
+    this->height = height;
 
     float w = width > height ? 2 : (float)width/height * 2;
     float h = height > width ? 2 : (float)height/width * 2;
-    glFrustum(-w/2,w/2,-h/2,h/2,1,100);
+    projection = frustumMatrix(-w/2,w/2,-h/2,h/2,NEAR_PLANE,FAR_PLANE);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrix(projection);
 
     glMatrixMode(GL_MODELVIEW);
     glClearColor(0,0,0,0);
 }
 
 void OpenGLRenderer::render() {
+    Timer timer;
+    bool scaled = bindScaledTarget();
+
+    //set current render mode options
+    switch(renderMode) {
+    case RENDER_MODE_WIREFRAME:
+        glDisable(GL_LIGHTING);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        break;
+    default:
+        glEnable(GL_LIGHTING);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        break;
+    }
+
+    QGLShaderProgram *shading = shadingProgram(false);
+    if (shading) {
+        shading->bind();
+        updateLightUniforms(shading);
+    }
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glLoadIdentity();
 
     glColor3f(1,1,1);
 
-    //get camera
-    Vector3f p = camera.toCartesian();
-    Vector3f o = camera.getOrigin();
+    updateFixedLights();
 
-    gluLookAt(p.x, p.y, p.z, o.x, o.y, o.z, 0, 1, 0);
+    //look from the camera
+    glLoadMatrix(camera.getViewMatrix());
 
     if (scene) {
-        scene->glDraw();
+        vector<DrawBatch> batches = uploadedBatches();
+        if (renderMode == RENDER_MODE_WIREFRAME) {
+            drawBatches(batches, true);
+        } else if (renderMode == RENDER_MODE_SHADED_WIREFRAME && !wireProgram()) {
+            //push the faces back so the edges drawn over them win the depth test
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(1, 1);
+            drawBatches(batches, false);
+            glDisable(GL_POLYGON_OFFSET_FILL);
+
+            glDisable(GL_LIGHTING);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+            glColor3f(WIRE_COLOR);
+            drawBatches(batches, true);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            glColor3f(1,1,1);
+        } else {
+            drawBatches(batches, false);
+        }
+    }
+
+    if (shading) shading->release();
+
+    if (highlight)
+        drawHighlight();
+
+    if (scaled)
+        drawScaledTarget();
+
+    //frames are timed to the end of drawing while the camera moves, so the next one fits the budget
+    //once it stops, the full resolution is back at once and the meshes a level a frame
+    if (interactive && frameBudget > 0) {
+        glFinish();
+        updateReduction(timer.elapsed());
+    } else if (!interactive) {
+        resolutionScale = 1;
+        if (reduction > 0) reduction--;
     }
 }
 
-void OpenGLRenderer::setLight(int i, Light light) {
-    if (i >= MAX_GL_LIGHTS) return;
+bool OpenGLRenderer::bindScaledTarget() {
+    drawWidth = width;
+    drawHeight = height;
+    if (!resolutionScaling || resolutionScale >= 1 || width <= 0 || height <= 0) return false;
 
-    GLenum lightTable[MAX_GL_LIGHTS] = {GL_LIGHT0, GL_LIGHT1, GL_LIGHT2, GL_LIGHT3, GL_LIGHT4, GL_LIGHT5, GL_LIGHT6, GL_LIGHT7};
-    lights[i] = light;
+    viewFramebuffer = glDrawFramebuffer();
+    if (scaledTarget && scaledTarget->size() != QSize(width, height)) {
+        delete scaledTarget;
+        scaledTarget = 0;
+    }
+    if (!scaledTarget) {
+        scaledTarget = new QGLFramebufferObject(width, height, QGLFramebufferObject::Depth);
+        if (!scaledTarget->isValid()) {
+            delete scaledTarget;
+            scaledTarget = 0;
+            resolutionScaling = false;
+            glBindDrawFramebuffer(viewFramebuffer);
+            return false;
+        }
+    }
+
+    drawWidth = qMax(1, qRound(width * resolutionScale));
+    drawHeight = qMax(1, qRound(height * resolutionScale));
+    glBindDrawFramebuffer(scaledTarget->handle());
+    glViewport(0, 0, drawWidth, drawHeight);
+    return true;
+}
+
+void OpenGLRenderer::drawScaledTarget() {
+    glBindDrawFramebuffer(viewFramebuffer);
+    glViewport(0, 0, width, height);
+    glBlitScaled(scaledTarget->handle(), drawWidth, drawHeight, width, height);
+
+    //the depth of the view is left from the last full frame, overlays drawn after this one must not test against it
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void OpenGLRenderer::drawHighlight() {
+    //the highlight only applies to the level it was picked at
+    if (!scene || highlightPick.object >= scene->getNumObjects()) return;
+    const SceneObject &object = scene->getObject(highlightPick.object);
+    if (scene->getDisplayedMesh(object.mesh) != highlightPick.mesh) return;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_POLYGON_BIT | GL_CURRENT_BIT | GL_POINT_BIT);
+    glDisable(GL_LIGHTING);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    //pull the face in front of itself so it wins the depth test
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(-1, -1);
+
+    glPushMatrix();
+    glMultMatrixf(object.transform.transpose().ptr());
+
+    glColor3f(1.0f, 0.8f, 0.0f);
+    highlightPick.mesh->glDrawFace(highlightPick.hit.face);
+
+    //draw the vertex on top of everything
+    glDisable(GL_DEPTH_TEST);
+    glPointSize(6);
+    glColor3f(1.0f, 0.2f, 0.0f);
+    glBegin(GL_POINTS);
+        glVertex3fv(highlightPick.mesh->getPosition(highlightPick.hit.vertex).ptr());
+    glEnd();
+
+    glPopMatrix();
+    glPopAttrib();
+}
+
+bool OpenGLRenderer::pick(int x, int y, ScenePick &pick) {
+    if (!scene || width <= 0 || height <= 0) return false;
+
+    //unproject the pixel center on the near and far planes
+    Matrix4f inverse = (projection * camera.getViewMatrix()).inverse();
+    float nx = 2 * (x + 0.5f) / width - 1;
+    float ny = 1 - 2 * (y + 0.5f) / height;
+    Vector4f nearPoint = inverse * Vector4f(nx, ny, -1, 1);
+    Vector4f farPoint = inverse * Vector4f(nx, ny, 1, 1);
+
+    Vector3f origin(nearPoint[0] / nearPoint[3], nearPoint[1] / nearPoint[3], nearPoint[2] / nearPoint[3]);
+    Vector3f end(farPoint[0] / farPoint[3], farPoint[1] / farPoint[3], farPoint[2] / farPoint[3]);
+
+    //the ray reaches the far plane at t = 1
+    return scene->pick(origin, end - origin, 1, pick);
+}
+
+void OpenGLRenderer::setHighlight(const ScenePick &pick) {
+    highlight = true;
+    highlightPick = pick;
+}
+
+void OpenGLRenderer::clearHighlight() {
+    highlight = false;
+    highlightPick = ScenePick();
+}
+
+QGLShaderProgram *OpenGLRenderer::shadingProgram(bool instanced) const {
+    if (renderMode != RENDER_MODE_PHONG) return 0;
+    return shaderManager->program(instanced ? "phong_instanced.vsh" : "phong.vsh", "phong.fsh", shaderDefines);
+}
+
+QGLShaderProgram *OpenGLRenderer::wireProgram() const {
+    if (!instancing) return 0;
+    return shaderManager->program("instanced.vsh", "wire.fsh", shaderDefines);
+}
+
+ShaderManager *OpenGLRenderer::getShaderManager() {
+    return shaderManager;
+}
+
+vector<DrawBatch> OpenGLRenderer::uploadedBatches() {
+    vector<DrawBatch> batches = scene->getBatches();
+    selectLods(batches);
+    reduceBatches(batches);
+    if (!uploader) return batches;
+
+    //keep drawing the previous level until the buffers of a new one are complete
+    shownMeshes.resize(scene->getNumMeshes());
+    vector<DrawBatch> uploaded;
+    for (uint i = 0; i < batches.size(); i++) {
+        DrawBatch batch = batches[i];
+        ConstMeshPtr &shown = shownMeshes[batch.meshIndex];
+        if (uploader->prepare(batch.mesh))
+            shown = batch.mesh;
+        else if (shown)
+            batch.mesh = shown;
+        else
+            continue;
+        uploaded.push_back(batch);
+    }
+    return uploaded;
+}
+
+void OpenGLRenderer::selectLods(vector<DrawBatch> &batches) {
+    if (!scene->hasLevelsOfDetail()) {
+        lodLevels.clear();
+        return;
+    }
+
+    //pixels covered by a unit of length at distance 1, from the vertical scale of the projection
+    float pixelsPerUnit = projection[1][1] * height / 2;
+    Vector3f eye = camera.toCartesian();
+    const vector<float> &transforms = scene->getInstanceTransforms();
+    lodLevels.resize(scene->getNumMeshes(), 0);
+
+    for (uint i = 0; i < batches.size(); i++) {
+        DrawBatch &batch = batches[i];
+        const QList<MeshLod> &lods = scene->getLods(batch.meshIndex);
+
+        //the nearest copy decides for all, for one copy at the origin its distance is the radial distance of the camera
+        //the transforms are column-major, the translation is the last column and the scale the length of the first
+        float nearest = FLT_MAX;
+        float scale = 1;
+        for (uint j = 0; j < batch.numInstances; j++) {
+            const float *m = &transforms[16 * (batch.firstInstance + j)];
+            float s = Vector3f(m[0], m[1], m[2]).magnitude();
+            float d = (Vector3f(m[12], m[13], m[14]) - eye).magnitude() - s * lods.first().radius;
+            if (d < nearest) {
+                nearest = d;
+                scale = s;
+            }
+        }
+        float pixels = pixelsPerUnit * scale / qMax(nearest, NEAR_PLANE);
+
+        //refine while the error shows, coarsen only with a margin below the threshold
+        uint &level = lodLevels[batch.meshIndex];
+        level = qMin(level, (uint)lods.size() - 1);
+        while (level > 0 && lods[level].error * pixels > LOD_PIXEL_ERROR)
+            level--;
+        while (level + 1 < (uint)lods.size() && lods[level + 1].error * pixels * LOD_HYSTERESIS <= LOD_PIXEL_ERROR)
+            level++;
+        batch.mesh = lods[level].mesh;
+    }
+}
+
+uint OpenGLRenderer::getLodLevel(uint mesh) const {
+    return mesh < lodLevels.size() ? lodLevels[mesh] : 0;
+}
+
+void OpenGLRenderer::reduceBatches(vector<DrawBatch> &batches) {
+    maxReduction = 0;
+    for (uint i = 0; i < batches.size(); i++) {
+        DrawBatch &batch = batches[i];
+        const QList<MeshLod> &lods = scene->getLods(batch.meshIndex);
+
+        //the subdivision levels below are coarser versions too, though of a smoother shape
+        uint coarser;
+        if (lods.size() > 1) {
+            uint level = getLodLevel(batch.meshIndex);
+            coarser = lods.size() - 1 - level;
+            batch.mesh = lods[level + qMin(reduction, coarser)].mesh;
+        } else {
+            coarser = scene->getSubdivisionSteps();
+            batch.mesh = scene->getLevel(batch.meshIndex, coarser - qMin(reduction, coarser));
+        }
+        maxReduction = qMax(maxReduction, coarser);
+    }
+}
+
+void OpenGLRenderer::updateReduction(double ms) {
+    if (reductionMs.size() <= reduction)
+        reductionMs.resize(reduction + 1, 0);
+    reductionMs[reduction] = ms;
+
+    //fewer pixels first, then coarser meshes, and back in the opposite order
+    if (ms > frameBudget && resolutionScaling && resolutionScale > RESOLUTION_MIN_SCALE) {
+        resolutionScale = qMax(RESOLUTION_MIN_SCALE, qMin(scaledResolution(ms), resolutionScale - RESOLUTION_STEP));
+    } else if (ms > frameBudget) {
+        uint steps = (uint)ceil(log(ms / frameBudget) / log((double)INTERACTIVE_LEVEL_RATIO));
+        reduction = qMin(reduction + qMax(steps, 1u), maxReduction);
+    } else if (reduction > 0) {
+        //refine if the finer level fitted before, a level that was too slow is not tried again in this interaction
+        double finer = reductionMs[reduction - 1];
+        if (finer > 0 ? finer <= frameBudget : ms * INTERACTIVE_REFINE_MARGIN <= frameBudget)
+            reduction--;
+    } else if (resolutionScale < 1) {
+        resolutionScale = qMin(1.0f, qMax(scaledResolution(ms), resolutionScale));
+    }
+}
+
+float OpenGLRenderer::scaledResolution(double ms) const {
+    //the time of the pixels goes with their number, the square of the scale
+    float scale = resolutionScale * sqrt(frameBudget * RESOLUTION_HEADROOM / ms);
+    return floor(scale / RESOLUTION_STEP + 1E-3f) * RESOLUTION_STEP;
+}
+
+void OpenGLRenderer::setInteractive(bool interactive) {
+    //the times of the last interaction no longer hold for where the camera is now
+    if (interactive && !this->interactive)
+        reductionMs.clear();
+    this->interactive = interactive;
+}
+
+bool OpenGLRenderer::isRefining() {
+    return !interactive && (reduction > 0 || resolutionScale < 1);
+}
+
+float OpenGLRenderer::getResolutionScale() {
+    return resolutionScale;
+}
+
+void OpenGLRenderer::setFrameBudget(double ms) { frameBudget = ms; }
+double OpenGLRenderer::getFrameBudget() const { return frameBudget; }
+uint OpenGLRenderer::getReduction() const { return reduction; }
+
+//returns what to draw of a mesh, meshes without edges draw their faces in line polygon mode instead
+static MeshPrimitives drawnPrimitives(const ConstMeshPtr &mesh, bool edges, bool wired) {
+    if (edges) return mesh->hasEdges() ? MESH_EDGES : MESH_TRIANGLES;
+    return wired ? MESH_WIRED_TRIANGLES : MESH_TRIANGLES;
+}
+
+void OpenGLRenderer::drawBatches(const vector<DrawBatch> &batches, bool edges) {
+    if (instancing) {
+        drawInstanced(batches, edges);
+        return;
+    }
 
-    //get light colors
-    Color a = lights[i].ambient;
-    Color d = lights[i].diffuse;
-    Color s = lights[i].specular;
-    Vector3f p = lights[i].pos;
+    //line polygon mode is only needed for the meshes drawn without edges, it does not affect lines
+    const vector<float> &transforms = scene->getInstanceTransforms();
+    for (uint i = 0; i < batches.size(); i++) {
+        MeshPrimitives primitives = drawnPrimitives(batches[i].mesh, edges, false);
+        batches[i].mesh->glDrawCopies(&transforms[16 * batches[i].firstInstance], batches[i].numInstances, primitives);
+    }
+}
+
+void OpenGLRenderer::drawInstanced(const vector<DrawBatch> &batches, bool edges) {
+    TRACE_SCOPE("OpenGLRenderer::drawInstanced");
 
-    //set up color and position buffers
-    float ambient[4] = {a.r,a.g,a.b,a.a};
-    float diffuse[4] = {d.r,d.g,d.b,d.a};
-    float specular[4] = {s.r,s.g,s.b,s.a};
-    float pos[4] = {p.x,p.y,p.z,p.w};
+    QGLShaderProgram *wire = !edges && renderMode == RENDER_MODE_SHADED_WIREFRAME ? wireProgram() : 0;
+    QGLShaderProgram *shading = edges ? 0 : shadingProgram(true);
+    bool wired = wire != 0;
+    QGLShaderProgram *shaders = instancedShaders;
+    if (wired)
+        shaders = wire;
+    else if (shading)
+        shaders = shading;
+    shaders->bind();
 
-    glLightfv(lightTable[i], GL_AMBIENT, ambient);
-    glLightfv(lightTable[i], GL_DIFFUSE, diffuse);
-    glLightfv(lightTable[i], GL_SPECULAR, specular);
+    //fixed-function emulation lights the enabled lights, except for edges
+    updateLightUniforms(shaders);
+    if (shaders == instancedShaders || wired)
+        shaders->setUniformValue("lighting", (GLint)!edges);
+    if (wired)
+        shaders->setUniformValue("wireColor", WIRE_COLOR, 1.0f);
+
+    //upload the transforms only when objects were added or removed
+    const vector<float> &transforms = scene->getInstanceTransforms();
+    instanceBuffer->bind();
+    if (instanceRevision != scene->getRevision()) {
+        instanceBuffer->allocate(transforms.empty() ? 0 : &transforms[0], transforms.size() * sizeof(float));
+        instanceRevision = scene->getRevision();
+    }
 
+    //a 4x4 transform takes the 4 consecutive attribute locations of its columns
+    //meshes drawn from buffer objects unbind the instance buffer, so it is bound again for every batch
+    int location = INSTANCE_ATTRIBUTE;
+    for (uint i = 0; i < batches.size(); i++) {
+        const DrawBatch &batch = batches[i];
+        instanceBuffer->bind();
+        for (int j = 0; j < 4; j++) {
+            int offset = (16 * batch.firstInstance + 4 * j) * sizeof(float);
+            shaders->setAttributeBuffer(location + j, GL_FLOAT, offset, 4, 16 * sizeof(float));
+            shaders->enableAttributeArray(location + j);
+            glAttribDivisor(location + j, 1);
+        }
+
+        batch.mesh->glDrawInstanced(batch.numInstances, drawnPrimitives(batch.mesh, edges, wired));
+    }
+
+    for (int j = 0; j < 4; j++) {
+        glAttribDivisor(location + j, 0);
+        shaders->disableAttributeArray(location + j);
+    }
+    instanceBuffer->release();
+    shaders->release();
+}
+
+void OpenGLRenderer::updateFixedLights() {
+    if (fixedLightRevision == lightRevision) return;
+    fixedLightRevision = lightRevision;
+
+    GLenum lightTable[MAX_GL_LIGHTS] = {GL_LIGHT0, GL_LIGHT1, GL_LIGHT2, GL_LIGHT3, GL_LIGHT4, GL_LIGHT5, GL_LIGHT6, GL_LIGHT7};
+
+    //positions are given with the identity modelview, so they stay fixed to the camera
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
-    glLightfv(lightTable[i], GL_POSITION, pos);
 
-    if (lights[i].isEnabled)
-        glEnable(lightTable[i]);
-    else
-        glDisable(lightTable[i]);
+    for (int i = 0; i < MAX_GL_LIGHTS; i++) {
+        //get light colors
+        Color a = lights[i].ambient;
+        Color d = lights[i].diffuse;
+        Color s = lights[i].specular;
+
+        //set up color and position buffers
+        float ambient[4] = {a.r,a.g,a.b,a.a};
+        float diffuse[4] = {d.r,d.g,d.b,d.a};
+        float specular[4] = {s.r,s.g,s.b,s.a};
+
+        glLightfv(lightTable[i], GL_AMBIENT, ambient);
+        glLightfv(lightTable[i], GL_DIFFUSE, diffuse);
+        glLightfv(lightTable[i], GL_SPECULAR, specular);
+        glLightfv(lightTable[i], GL_POSITION, lights[i].pos.ptr());
+
+        if (lights[i].isEnabled)
+            glEnable(lightTable[i]);
+        else
+            glDisable(lightTable[i]);
+    }
+}
+
+void OpenGLRenderer::updateLightUniforms(QGLShaderProgram *shaders) {
+    if (lightRevisions.value(shaders) == lightRevision) return;
+    lightRevisions[shaders] = lightRevision;
+
+    //the fixed-function emulation reads the lights from the OpenGL state
+    if (shaders == instancedShaders || shaders == wireProgram()) {
+        GLint enabled[MAX_GL_LIGHTS];
+        for (int i = 0; i < MAX_GL_LIGHTS; i++) enabled[i] = lights[i].isEnabled;
+        shaders->setUniformValueArray("lightEnabled", enabled, MAX_GL_LIGHTS);
+        return;
+    }
+
+    //pack the enabled lights, so the shader loops over them only
+    GLfloat position[4 * MAX_GL_LIGHTS], ambient[4 * MAX_GL_LIGHTS];
+    GLfloat diffuse[4 * MAX_GL_LIGHTS], specular[4 * MAX_GL_LIGHTS];
+    int n = 0;
+    for (int i = 0; i < MAX_GL_LIGHTS; i++) {
+        const Light &light = lights[i];
+        if (!light.isEnabled) continue;
+
+        const Color *colors[3] = {&light.ambient, &light.diffuse, &light.specular};
+        GLfloat *arrays[3] = {ambient, diffuse, specular};
+        for (int j = 0; j < 3; j++) {
+            GLfloat *c = arrays[j] + 4*n;
+            c[0] = colors[j]->r; c[1] = colors[j]->g; c[2] = colors[j]->b; c[3] = colors[j]->a;
+        }
+        for (int k = 0; k < 4; k++) position[4*n + k] = light.pos[k];
+        n++;
+    }
+
+    shaders->setUniformValue("numLights", (GLint)n);
+    if (n == 0) return;
+    shaders->setUniformValueArray("lightPosition", position, n, 4);
+    shaders->setUniformValueArray("lightAmbient", ambient, n, 4);
+    shaders->setUniformValueArray("lightDiffuse", diffuse, n, 4);
+    shaders->setUniformValueArray("lightSpecular", specular, n, 4);
+}
+
+void OpenGLRenderer::setLight(int i, Light light) {
+    if (i < 0 || i >= MAX_GL_LIGHTS) return;
+
+    //given to OpenGL with the next frame, when the context is current
+    lights[i] = light;
+    lightRevision++;
 }
 
 void OpenGLRenderer::setLights(Light *lights, int n) {
-    for (int i = 0; i < MAX(MAX_GL_LIGHTS,n); i++) setLight(i, lights[i]);
+    for (int i = 0; i < MIN(MAX_GL_LIGHTS,n); i++) setLight(i, lights[i]);
 }
 
 void OpenGLRenderer::setCamera(Camera camera) { this->camera = camera; }
-void OpenGLRenderer::setScene(Scene *scene) { this->scene = scene; }
+void OpenGLRenderer::setScene(Scene *scene) {
+    this->scene = scene;
+    instanceRevision = 0;
+    highlight = false;
+    shownMeshes.clear();
+    lodLevels.clear();
+    reduction = 0;
+    resolutionScale = 1;
+}
+void OpenGLRenderer::setUploader(BufferUploader *uploader) {
+    this->uploader = uploader;
+    shownMeshes.clear();
+}
+void OpenGLRenderer::setRenderMode(RenderMode renderMode) { this->renderMode = renderMode; }
 
 Camera OpenGLRenderer::getCamera() { return camera; }
+Scene *OpenGLRenderer::getScene() { return scene; }
+RenderMode OpenGLRenderer::getRenderMode() { return renderMode; }
 int OpenGLRenderer::getNumLights() { return MAX_GL_LIGHTS; }
 Light OpenGLRenderer::getLight(int i) { return lights[i]; }
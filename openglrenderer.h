@@ -2,11 +2,30 @@
 #define OPENGLRENDERER_H
 
 #include <GL/gl.h>
+#include <QGLShaderProgram>
+#include <QGLBuffer>
+#include <QHash>
+#include <QStringList>
 
 #include "renderer.h"
 
 #define MAX_GL_LIGHTS 8
 
+//distances of the near and far clipping planes
+#define NEAR_PLANE 1.0f
+#define FAR_PLANE 100.0f
+
+//first of the 4 attribute locations of the instance transform
+//some drivers alias generic attributes with the built-in ones, 12 to 15 share texture coordinates 4 to 7
+#define INSTANCE_ATTRIBUTE 12
+
+//milliseconds a frame may take while the camera is moved, 0 always draws full quality
+#define INTERACTIVE_FRAME_BUDGET 8.0
+
+class ShaderManager;
+class QGLFramebufferObject;
+class QGLContext;
+
 class OpenGLRenderer : public Renderer {
     public:
         OpenGLRenderer();
@@ -20,16 +39,141 @@ class OpenGLRenderer : public Renderer {
         void setLight(int i, Light light);
         void setCamera(Camera camera);
         void setScene(Scene *scene);
+        void setRenderMode(RenderMode renderMode);
 
         Camera getCamera();
+        Scene *getScene();
+        RenderMode getRenderMode();
         int getNumLights();
         Light getLight(int i);
 
-    private:
+        bool pick(int x, int y, ScenePick &pick);
+        void setHighlight(const ScenePick &pick);
+        void clearHighlight();
+
+        void setUploader(BufferUploader *uploader);
+
+        void setInteractive(bool interactive);
+        bool isRefining();
+        float getResolutionScale();
+
+        //sets the milliseconds a frame may take while interactive, 0 always draws full quality
+        void setFrameBudget(double ms);
+        double getFrameBudget() const;
+
+        //returns how many levels coarser than full quality the meshes were drawn last
+        uint getReduction() const;
+
+        //returns the manager the programs are built by, 0 before init
+        ShaderManager *getShaderManager();
+
+        //returns the level of detail a mesh of the scene was drawn at last, 0 for its displayed level
+        uint getLodLevel(uint mesh) const;
+
+    protected:
+        //returns the program that shades the faces in the current render mode, 0 for the fixed-function pipeline
+        virtual QGLShaderProgram *shadingProgram(bool instanced) const;
+
+        //returns the program blending edges over the fixed-function emulation, 0 if shaded wireframes take two passes
+        QGLShaderProgram *wireProgram() const;
+
+        //gives changed lights to the fixed-function pipeline, with the eye space positions they are given in
+        void updateFixedLights();
+
+        //gives changed lights to a bound program, as uniform arrays or as the enabled fixed-function lights
+        virtual void updateLightUniforms(QGLShaderProgram *shaders);
+
+        //draws the highlighted face and vertex over the scene
+        void drawHighlight();
+
+        //returns the batches of the scene at their levels of detail whose meshes are uploaded
+        //a mesh still uploading is replaced by the level of it drawn before, or left out
+        vector<DrawBatch> uploadedBatches();
+
+        //replaces the meshes of the batches by the coarsest levels of detail whose error is too small to see
+        void selectLods(vector<DrawBatch> &batches);
+
+        //replaces the meshes of the batches by ones the current reduction coarser, from their levels of detail
+        //if they have any, otherwise from the subdivision levels below the displayed one
+        void reduceBatches(vector<DrawBatch> &batches);
+
+        //chooses the resolution and reduction of the next frame from the time of the last one
+        void updateReduction(double ms);
+
+        //returns the resolution scale that would make a frame of the given time fit the budget, in whole steps
+        float scaledResolution(double ms) const;
+
+        //binds the scaled target for drawing the frame if the resolution is scaled, returns false if it is not
+        bool bindScaledTarget();
+
+        //stretches the frame drawn into the scaled target over the view
+        void drawScaledTarget();
+
+        //draws the batches for the current render mode, their edges only if edges is set
+        void drawBatches(const vector<DrawBatch> &batches, bool edges);
+
+        //draws every batch with one instanced call
+        void drawInstanced(const vector<DrawBatch> &batches, bool edges);
+
         Light lights[MAX_GL_LIGHTS];
+
+        //lights are only given to OpenGL and the programs again after they changed
+        //a program keeps its uniforms, so each remembers the revision it was given
+        uint lightRevision;
+        uint fixedLightRevision;
+        QHash<QGLShaderProgram*, uint> lightRevisions;
         Camera camera;
+        Matrix4f projection;
+        int width;
+        int height;
+
+        //pixels the scene is drawn at, fewer than the view while the resolution is scaled
+        int drawWidth;
+        int drawHeight;
 
         Scene *scene;
+        RenderMode renderMode;
+
+        //programs are fetched from the manager when drawn with, the defines specialize them for the renderer
+        ShaderManager *shaderManager;
+        QStringList shaderDefines;
+
+        //instanced drawing, used when the context supports it and the shaders link
+        //the instance buffer holds the transforms of the scene revision it was filled for
+        bool instancing;
+        QGLShaderProgram *instancedShaders;
+        QGLBuffer *instanceBuffer;
+        uint instanceRevision;
+
+        bool highlight;
+        ScenePick highlightPick;
+
+        //shownMeshes[i] is the level of mesh i of the scene drawn last
+        BufferUploader *uploader;
+        vector<ConstMeshPtr> shownMeshes;
+
+        //lodLevels[i] is the level of detail chosen for mesh i, kept between frames for the hysteresis
+        vector<uint> lodLevels;
+
+        //while interactive, frames are timed and drawn reduction levels coarser to stay within frameBudget
+        //reductionMs[i] is the time of the last frame drawn at reduction i, 0 if none was drawn this interaction
+        //afterwards the reduction steps back by one level a frame
+        bool interactive;
+        double frameBudget;
+        uint reduction;
+        uint maxReduction;
+        vector<double> reductionMs;
+
+        //the resolution is scaled before the meshes are reduced, fill rate limits software drivers most
+        //a scaled frame is drawn into the corner of a target the size of the view, so scaling never reallocates it
+        //viewFramebuffer is the framebuffer that was bound when the frame started, which it is stretched over
+        bool resolutionScaling;
+        float resolutionScale;
+        QGLFramebufferObject *scaledTarget;
+        GLuint viewFramebuffer;
+
+        //the context of init, which the GL resources are freed in
+        QGLContext *context;
 };
 
 #endif // OPENGLRENDERER_H
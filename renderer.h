@@ -7,6 +7,15 @@
 
 #include "scene.h"
 
+class BufferUploader;
+
+typedef enum RenderMode {
+    RENDER_MODE_DEFAULT,
+    RENDER_MODE_WIREFRAME,
+    RENDER_MODE_PHONG,
+    RENDER_MODE_SHADED_WIREFRAME
+} RenderMode;
+
 class Renderer {
     public:
         virtual ~Renderer() {}
@@ -20,15 +29,38 @@ class Renderer {
         virtual void setCamera(Camera camera) = 0;
 
         virtual void setScene(Scene *scene) = 0;
+        virtual void setRenderMode(RenderMode renderMode) = 0;
        /* virtual void setShowAxis(bool showAxis) = 0;
         virtual void setShowInfo(bool showInfo) = 0;*/
 
         virtual Camera getCamera() = 0;
+        virtual Scene *getScene() = 0;
+        virtual RenderMode getRenderMode() = 0;
         /*virtual bool getShowAxis() = 0;
         virtual bool getShowInfo() = 0;*/
 
         virtual int getNumLights() = 0;
         virtual Light getLight(int i) = 0;
+
+        //finds the object, face and vertex of the scene under a pixel of the view
+        virtual bool pick(int x, int y, ScenePick &pick) = 0;
+
+        //highlights a picked face and vertex in the following frames
+        virtual void setHighlight(const ScenePick &pick) = 0;
+        virtual void clearHighlight() = 0;
+
+        //uploads the meshes of the scene to GPU memory in the background, 0 draws them from system memory
+        virtual void setUploader(BufferUploader *uploader) = 0;
+
+        //draws coarser meshes while the camera is moved, to keep frames within a time budget
+        //once the interaction ends, the following frames refine back to full quality
+        virtual void setInteractive(bool interactive) = 0;
+
+        //returns true while frames after an interaction are still drawn below full quality
+        virtual bool isRefining() = 0;
+
+        //returns the fraction of the width and height of the view the last frame was drawn at before it was stretched
+        virtual float getResolutionScale() = 0;
 };
 
 
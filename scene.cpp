@@ -1,34 +1,356 @@
 #include "scene.h"
+#include "utils/trace.h"
 
-Scene::Scene(): m_mesh(0), m_subdivisionSteps(0) {}
+#include <QtConcurrentRun>
+#include <math.h>
 
-void Scene::setMesh(Mesh *mesh) {
-    m_mesh = mesh;
-    m_subdividedMesh = *m_mesh;
+//each level of detail has a quarter of the triangles of the one before, down to a few hundred
+#define LOD_REDUCTION 4
+#define LOD_MIN_TRIANGLES 256
+#define MAX_LODS 6
+
+//reductions that keep more than this fraction of the triangles end the chain, the surface is as coarse as it gets
+#define LOD_MAX_KEPT 0.9f
+
+Scene::Scene(): m_subdivisionSteps(0), m_lodsEnabled(false), m_revision(1), m_batchesDirty(true) {}
+
+void Scene::setMesh(MeshPtr mesh) {
+    m_meshes.clear();
+    m_lodChains.clear();
+    m_lods.clear();
+    m_objects.clear();
+    m_subdivisionSteps = 0;
+    m_revision++;
+    m_batchesDirty = true;
+
+    if (mesh)
+        addObject(addMesh(mesh), Matrix4f::identity());
+}
+
+MeshPtr Scene::getMesh() {
+    return m_meshes.isEmpty() ? MeshPtr() : m_meshes.first().first();
+}
+
+ConstMeshPtr Scene::getDisplayedMesh() const {
+    if (m_meshes.isEmpty()) return ConstMeshPtr();
+    return getDisplayedMesh(0);
+}
+
+ConstMeshPtr Scene::getDisplayedMesh(uint mesh) const {
+    return getLevel(mesh, m_subdivisionSteps);
+}
+
+ConstMeshPtr Scene::getLevel(uint mesh, uint steps) const {
+    const QList<MeshPtr> &levels = m_meshes[mesh];
+    return levels[qMin((int)steps, levels.size() - 1)];
+}
+
+uint Scene::addMesh(MeshPtr mesh) {
+    QList<MeshPtr> levels;
+    levels.append(mesh);
+    m_meshes.append(levels);
+
+    //bring the new mesh to the level of the others
+    if (m_subdivisionSteps > 0)
+        subdivide(m_subdivisionSteps);
+    else
+        updateLods();
+
+    return m_meshes.size() - 1;
 }
 
-Mesh *Scene::getMesh() {
-    return m_mesh;
+uint Scene::addObject(uint mesh, const Matrix4f &transform) {
+    SceneObject object;
+    object.mesh = mesh;
+    object.transform = transform;
+    object.inverse = transform.inverse();
+    m_objects.push_back(object);
+
+    m_revision++;
+    m_batchesDirty = true;
+    return m_objects.size() - 1;
+}
+
+void Scene::clearObjects() {
+    m_objects.clear();
+    m_revision++;
+    m_batchesDirty = true;
+}
+
+void Scene::setCopies(uint copies) {
+    if (m_meshes.isEmpty()) return;
+    clearObjects();
+
+    //scale the unit sized copies down so the whole grid stays about as large as one copy
+    uint side = (uint)ceil(sqrt((double)copies));
+    float scale = 1.0f / side;
+    float spacing = 1.5f * scale;
+    float offset = -spacing * (side - 1) / 2;
+
+    for (uint i = 0; i < copies; i++) {
+        Matrix4f transform = Matrix4f::identity();
+        transform[0][0] = transform[1][1] = transform[2][2] = scale;
+        transform[0][3] = offset + spacing * (i % side);
+        transform[1][3] = offset + spacing * (i / side);
+        addObject(0, transform);
+    }
+}
+
+uint Scene::getNumMeshes() const { return m_meshes.size(); }
+uint Scene::getNumObjects() const { return m_objects.size(); }
+const SceneObject &Scene::getObject(uint object) const { return m_objects[object]; }
+uint Scene::getRevision() const { return m_revision; }
+
+const vector<DrawBatch> &Scene::getBatches() const {
+    updateBatches();
+    return m_batches;
+}
+
+const vector<float> &Scene::getInstanceTransforms() const {
+    updateBatches();
+    return m_instanceTransforms;
+}
+
+void Scene::updateBatches() const {
+    if (!m_batchesDirty) return;
+    TRACE_SCOPE("Scene::updateBatches");
+
+    //count the objects of each mesh to find where the transforms of each batch start
+    vector<uint> firstInstance(m_meshes.size() + 1, 0);
+    for (uint i = 0; i < m_objects.size(); i++)
+        firstInstance[m_objects[i].mesh + 1]++;
+    for (uint i = 0; i < (uint)m_meshes.size(); i++)
+        firstInstance[i + 1] += firstInstance[i];
+
+    m_batches.clear();
+    for (uint i = 0; i < (uint)m_meshes.size(); i++) {
+        if (firstInstance[i + 1] == firstInstance[i]) continue;
+
+        DrawBatch batch;
+        batch.mesh = getDisplayedMesh(i);
+        batch.meshIndex = i;
+        batch.firstInstance = firstInstance[i];
+        batch.numInstances = firstInstance[i + 1] - firstInstance[i];
+        m_batches.push_back(batch);
+    }
+
+    //OpenGL expects the elements of the transforms in column-major order
+    m_instanceTransforms.resize(16 * m_objects.size());
+    for (uint i = 0; i < m_objects.size(); i++) {
+        Matrix4f columns = m_objects[i].transform.transpose();
+        const float *src = columns.ptr();
+        float *dst = &m_instanceTransforms[16 * firstInstance[m_objects[i].mesh]++];
+        for (uint j = 0; j < 16; j++) dst[j] = src[j];
+    }
+
+    m_batchesDirty = false;
+}
+
+bool Scene::pick(const Vector3f &origin, const Vector3f &direction, float maxT, ScenePick &pick) const {
+    TRACE_SCOPE("Scene::pick");
+
+    //the ray parameter is the same in every space, so hits of different objects compare directly
+    bool found = false;
+    for (uint i = 0; i < m_objects.size(); i++) {
+        const SceneObject &object = m_objects[i];
+        Vector4f o = object.inverse * Vector4f(origin[0], origin[1], origin[2], 1);
+        Vector4f d = object.inverse * Vector4f(direction[0], direction[1], direction[2], 0);
+
+        ConstMeshPtr mesh = getDisplayedMesh(object.mesh);
+        MeshHit hit;
+        if (mesh->pick(Vector3f(o[0], o[1], o[2]), Vector3f(d[0], d[1], d[2]), maxT, hit)) {
+            maxT = hit.t;
+            pick.object = i;
+            pick.mesh = mesh;
+            pick.hit = hit;
+            found = true;
+        }
+    }
+
+    return found;
 }
 
 void Scene::glDraw() {
-    if (m_mesh) {
-        if (m_subdivisionSteps > 0)
-            m_subdividedMesh.glDraw();
-        else
-            m_mesh->glDraw();
+    const vector<DrawBatch> &batches = getBatches();
+    for (uint i = 0; i < batches.size(); i++) {
+        const DrawBatch &batch = batches[i];
+        batch.mesh->glDrawCopies(&m_instanceTransforms[16 * batch.firstInstance], batch.numInstances);
     }
 }
 
 void Scene::subdivide(uint steps) {
-    //determine actual number of steps needed to subdivide
-    if (m_subdivisionSteps == steps) return;
-    if (m_subdivisionSteps > steps) {
-        m_subdivisionSteps = 0;
-        m_subdividedMesh = *m_mesh;
+    TRACE_SCOPE("Scene::subdivide");
+
+    //subdivide the finest level of each mesh until the requested level exists
+    //previews have no topology and are shown at every level
+    for (int i = 0; i < m_meshes.size(); i++) {
+        QList<MeshPtr> &levels = m_meshes[i];
+        if (levels.first()->isPreview()) continue;
+        while ((uint)levels.size() <= steps) {
+            levels.append(MeshPtr(levels.last()->subdivide()));
+        }
+    }
+
+    m_subdivisionSteps = steps;
+    m_batchesDirty = true;
+    updateLods();
+}
+
+uint Scene::getSubdivisionSteps() const {
+    return m_subdivisionSteps;
+}
+
+void Scene::setLevelsOfDetail(bool enabled) {
+    if (m_lodsEnabled == enabled) return;
+    m_lodsEnabled = enabled;
+
+    //chains built before are kept, so switching back on only builds the levels that have none
+    updateLods();
+}
+
+bool Scene::hasLevelsOfDetail() const {
+    return m_lodsEnabled;
+}
+
+const QList<MeshLod> &Scene::getLods(uint mesh) const {
+    collectLods();
+    return m_lods[mesh];
+}
+
+//returns the displayed mesh as the first level of detail of its chain
+//the copies of a mesh are measured by a sphere around their origin
+static MeshLod fullLod(const ConstMeshPtr &displayed) {
+    MeshLod lod;
+    lod.mesh = displayed;
+    lod.error = 0;
+    lod.radius = 0;
+    const Vector3f *positions = displayed->getPositions();
+    for (uint j = 0; j < displayed->numPositions(); j++)
+        lod.radius = qMax(lod.radius, (float)positions[j].magnitude());
+    return lod;
+}
+
+//reduces a displayed mesh into its chain of levels of detail, run in the background
+static QList<MeshLod> buildLodChain(ConstMeshPtr displayed) {
+    TRACE_SCOPE("Scene::buildLodChain");
+
+    QList<MeshLod> lods;
+    MeshLod lod = fullLod(displayed);
+    lods.append(lod);
+
+    //reduce each level from the one before, their errors add up
+    uint triangles = displayed->numDrawVertices() / 3;
+    while (lods.size() < MAX_LODS && triangles / LOD_REDUCTION >= LOD_MIN_TRIANGLES) {
+        float error;
+        MeshLod coarser = lod;
+        coarser.mesh = ConstMeshPtr(lod.mesh->decimate(triangles / LOD_REDUCTION, error));
+        uint reduced = coarser.mesh->numDrawVertices() / 3;
+        if (reduced > LOD_MAX_KEPT * triangles) break;
+
+        coarser.error = lod.error + error;
+        lods.append(coarser);
+        lod = coarser;
+        triangles = reduced;
     }
+    return lods;
+}
+
+void Scene::updateLods() {
+    while (m_lodChains.size() < m_meshes.size())
+        m_lodChains.append(QMap<uint, LodChain>());
+
+    //previews have no topology to reduce
+    if (m_lodsEnabled) {
+        for (int i = 0; i < m_meshes.size(); i++) {
+            uint level = qMin((int)m_subdivisionSteps, m_meshes[i].size() - 1);
+            ConstMeshPtr displayed = m_meshes[i][level];
+            if (displayed->isPreview() || m_lodChains[i].contains(level)) continue;
+            m_lodChains[i][level] = QtConcurrent::run(buildLodChain, displayed);
+        }
+    }
+
+    collectLods();
+}
+
+void Scene::collectLods() const {
+    while (m_lods.size() < m_meshes.size())
+        m_lods.append(QList<MeshLod>());
+
+    for (int i = 0; i < m_meshes.size(); i++) {
+        uint level = qMin((int)m_subdivisionSteps, m_meshes[i].size() - 1);
+        ConstMeshPtr displayed = m_meshes[i][level];
+        QList<MeshLod> &lods = m_lods[i];
+
+        //the chain replaces the displayed mesh alone once it is built
+        if (m_lodsEnabled && i < m_lodChains.size() && m_lodChains[i].contains(level)) {
+            LodChain chain = m_lodChains[i].value(level);
+            if (chain.isFinished()) {
+                if (lods.size() <= 1 || lods.first().mesh != displayed)
+                    lods = chain.result();
+                continue;
+            }
+        }
+
+        if (lods.size() != 1 || lods.first().mesh != displayed) {
+            lods.clear();
+            lods.append(fullLod(displayed));
+        }
+    }
+}
+
+bool Scene::isBuildingLods() const {
+    if (!m_lodsEnabled) return false;
+    for (int i = 0; i < m_lodChains.size(); i++) {
+        uint level = qMin((int)m_subdivisionSteps, m_meshes[i].size() - 1);
+        if (m_lodChains[i].contains(level) && !m_lodChains[i].value(level).isFinished())
+            return true;
+    }
+    return false;
+}
+
+void Scene::waitForLods() {
+    for (int i = 0; i < m_lodChains.size() && m_lodsEnabled; i++) {
+        uint level = qMin((int)m_subdivisionSteps, m_meshes[i].size() - 1);
+        if (m_lodChains[i].contains(level))
+            m_lodChains[i][level].waitForFinished();
+    }
+    collectLods();
+}
+
+MemoryUsage Scene::memoryUsage() const {
+    MemoryUsage usage;
+    for (int i = 0; i < m_meshes.size(); i++)
+        for (int j = 0; j < m_meshes[i].size(); j++)
+            usage += m_meshes[i][j]->memoryUsage();
+
+    //the first level of detail of a chain is the displayed mesh, chains still being built are not counted yet
+    for (int i = 0; i < m_lodChains.size(); i++) {
+        for (QMap<uint, LodChain>::const_iterator chain = m_lodChains[i].begin(); chain != m_lodChains[i].end(); ++chain) {
+            if (!chain->isFinished()) continue;
+            QList<MeshLod> lods = chain->result();
+            for (int j = 1; j < lods.size(); j++)
+                usage += lods[j].mesh->memoryUsage();
+        }
+    }
+
+    //objects only add their transforms, however many share a mesh
+    usage.geometry += m_objects.capacity() * sizeof(SceneObject) + m_batches.capacity() * sizeof(DrawBatch);
+    usage.cpuBuffers += m_instanceTransforms.capacity() * sizeof(float);
+    return usage;
+}
 
-    for (; m_subdivisionSteps < steps; m_subdivisionSteps++) {
-        m_subdividedMesh = m_subdividedMesh.subdivide();
+ArenaStats Scene::allocationStats() const {
+    ArenaStats stats;
+    for (int i = 0; i < m_meshes.size(); i++)
+        for (int j = 0; j < m_meshes[i].size(); j++)
+            stats += m_meshes[i][j]->allocationStats();
+    for (int i = 0; i < m_lodChains.size(); i++) {
+        for (QMap<uint, LodChain>::const_iterator chain = m_lodChains[i].begin(); chain != m_lodChains[i].end(); ++chain) {
+            if (!chain->isFinished()) continue;
+            QList<MeshLod> lods = chain->result();
+            for (int j = 1; j < lods.size(); j++)
+                stats += lods[j].mesh->allocationStats();
+        }
     }
+    return stats;
 }
@@ -1,24 +1,155 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <QFuture>
+#include <QList>
+#include <QMap>
+
 #include "mesh.h"
+#include "utils/matrix.h"
+
+//a copy of a mesh of the scene placed by its model transform
+struct SceneObject {
+    uint mesh;
+    Matrix4f transform;
+    Matrix4f inverse;   //brings rays into the space of the mesh for picking
+};
+
+//an object hit by a ray, with the face and vertex of its displayed mesh
+struct ScenePick {
+    uint object;
+    ConstMeshPtr mesh;
+    MeshHit hit;
+};
+
+//objects of one mesh that are drawn together, their transforms are
+//[firstInstance, firstInstance+numInstances) in the instance transforms of the scene
+struct DrawBatch {
+    ConstMeshPtr mesh;
+    uint meshIndex;     //index of the mesh in the scene, the same at every level
+    uint firstInstance;
+    uint numInstances;
+};
+
+//a version of a displayed mesh for drawing it from further away
+struct MeshLod {
+    ConstMeshPtr mesh;
+    float error;    //estimated distance of its surface from the displayed mesh, in the units of the mesh
+    float radius;   //radius of the sphere around the origin of the mesh that contains it
+};
 
+//levels of detail of a displayed mesh, being reduced in the background until the future finishes
+typedef QFuture<QList<MeshLod> > LodChain;
+
+/* Objects of the scene reference shared meshes, so copies of a mesh cost a
+   transform each rather than a copy of its geometry. Every mesh keeps its own
+   subdivision levels. For drawing, the objects are grouped into one batch per
+   mesh, which the renderer draws with a single instanced call. With levels
+   of detail on, the displayed level of every mesh is reduced into a chain of
+   coarser meshes, a quarter of the triangles each, that the renderer can draw
+   instead when their error is too small to see. The chains are reduced in
+   the background and kept for every subdivision level they were built at;
+   until the chain of a level is ready, only its full mesh is drawn.*/
 class Scene {
 public:
     Scene();
-    void setMesh(Mesh *mesh);
-    Mesh *getMesh();
 
-    // draw the scene
+    // replaces the scene with one object of the given mesh
+    void setMesh(MeshPtr mesh);
+
+    // returns the original of the first mesh
+    MeshPtr getMesh();
+
+    // returns the first mesh, or the given mesh, at the current subdivision level
+    ConstMeshPtr getDisplayedMesh() const;
+    ConstMeshPtr getDisplayedMesh(uint mesh) const;
+
+    // adds a mesh without any objects, returns its index
+    uint addMesh(MeshPtr mesh);
+
+    // adds an object of a mesh added before, returns its index
+    uint addObject(uint mesh, const Matrix4f &transform);
+
+    // removes all objects, but keeps the meshes
+    void clearObjects();
+
+    // replaces the objects with copies of the first mesh laid out in a square grid
+    void setCopies(uint copies);
+
+    uint getNumMeshes() const;
+    uint getNumObjects() const;
+    const SceneObject &getObject(uint object) const;
+
+    // returns the objects grouped by mesh, and the column-major transforms of the batches
+    const vector<DrawBatch> &getBatches() const;
+    const vector<float> &getInstanceTransforms() const;
+
+    // returns a number that changes whenever objects are added or removed
+    uint getRevision() const;
+
+    // finds the closest object hit by the ray origin + t*direction with 0 < t < maxT
+    bool pick(const Vector3f &origin, const Vector3f &direction, float maxT, ScenePick &pick) const;
+
+    // draw the scene, one object at a time
     void glDraw();
 
-    // subdivide the original mesh of the scene by a given number of steps
+    // subdivide the original meshes of the scene by a given number of steps
     void subdivide(uint steps);
+    uint getSubdivisionSteps() const;
+
+    // returns a mesh after the given subdivision steps, or its finest level computed if there are fewer
+    ConstMeshPtr getLevel(uint mesh, uint steps) const;
+
+    // builds levels of detail for the displayed level of each mesh in the background, now and whenever it changes
+    void setLevelsOfDetail(bool enabled);
+    bool hasLevelsOfDetail() const;
+
+    // returns the levels of detail of a mesh from the displayed mesh, whose error is 0, to the coarsest
+    // without levels of detail, or while they are being built, only the displayed mesh is returned
+    const QList<MeshLod> &getLods(uint mesh) const;
+
+    // returns true while the levels of detail of a displayed mesh are being built
+    bool isBuildingLods() const;
+
+    // waits until the levels of detail of the displayed meshes are built
+    void waitForLods();
+
+    // returns the memory used by the original and subdivided meshes and the objects
+    MemoryUsage memoryUsage() const;
+
+    // returns the allocation statistics of the original and subdivided meshes
+    ArenaStats allocationStats() const;
 
 protected:
-    Mesh *m_mesh;
-    Mesh m_subdividedMesh;
+    // groups the objects by mesh, if they changed since the last call
+    void updateBatches() const;
+
+    // starts building the levels of detail of the displayed levels that have none yet
+    void updateLods();
+
+    // takes the levels of detail of the displayed levels that were built since the last call
+    void collectLods() const;
+
+    //m_meshes[i][j] is mesh i after j subdivision steps
+    //levels are kept so stepping back down does not recompute them
+    QList<QList<MeshPtr> > m_meshes;
     uint m_subdivisionSteps;
+
+    //m_lodChains[i][j] is the chain of levels of detail of mesh i after j subdivision steps, reduced in the background
+    //chains are kept when the level or the setting changes, so they are only built once
+    QList<QMap<uint, LodChain> > m_lodChains;
+    bool m_lodsEnabled;
+
+    //m_lods[i] are the levels of detail of the displayed level of mesh i, the displayed mesh alone until its chain is built
+    mutable QList<QList<MeshLod> > m_lods;
+
+    vector<SceneObject> m_objects;
+    uint m_revision;
+
+    //batches are rebuilt on demand after objects are added or the level changes
+    mutable vector<DrawBatch> m_batches;
+    mutable vector<float> m_instanceTransforms;
+    mutable bool m_batchesDirty;
 };
 
 #endif // SCENE_H
@@ -0,0 +1,138 @@
+#include "shadermanager.h"
+#include "utils/glutils.h"
+#include "utils/timer.h"
+#include "utils/trace.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFile>
+
+ShaderManager::ShaderManager() : m_compiled(0), m_cached(0), m_buildMs(0) {
+    //a binary only loads into the driver that saved it
+    m_driver = QByteArray((const char*)glGetString(GL_VENDOR)) + "\n"
+               + QByteArray((const char*)glGetString(GL_RENDERER)) + "\n"
+               + QByteArray((const char*)glGetString(GL_VERSION));
+
+    m_cacheDir = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+    if (!m_cacheDir.isEmpty()) m_cacheDir += "/shaders";
+    m_binaries = !m_cacheDir.isEmpty() && glInitProgramBinaries();
+}
+
+ShaderManager::~ShaderManager() {
+    QList<QGLShaderProgram*> programs = m_programs.values();
+    for (int i = 0; i < programs.size(); i++)
+        delete programs[i];
+}
+
+void ShaderManager::bindAttribute(const QString &name, int location) {
+    m_attributes.append(qMakePair(name, location));
+}
+
+QGLShaderProgram *ShaderManager::program(const QString &vertex, const QString &fragment, const QStringList &defines) {
+    QString name = vertex + " " + fragment;
+    if (!defines.isEmpty()) name += " (" + defines.join(", ") + ")";
+    if (m_programs.contains(name)) return m_programs.value(name);
+
+    TRACE_SCOPE("ShaderManager::program");
+    Timer timer;
+
+    QGLShaderProgram *program = 0;
+    QByteArray vertexSource = source(vertex, defines);
+    QByteArray fragmentSource = source(fragment, defines);
+    if (vertexSource.isEmpty() || fragmentSource.isEmpty()) {
+        qWarning() << "shaders:" << name << "not found in the resources";
+    } else {
+        //the key covers everything the binary depends on
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(m_driver);
+        hash.addData(vertexSource);
+        hash.addData(fragmentSource);
+        for (int i = 0; i < m_attributes.size(); i++)
+            hash.addData(m_attributes[i].first.toAscii() + " " + QByteArray::number(m_attributes[i].second) + "\n");
+        QString path = m_cacheDir + "/" + hash.result().toHex() + ".bin";
+
+        program = load(path);
+        if (program)
+            m_cached++;
+        else
+            program = compile(vertexSource, fragmentSource, name, path);
+    }
+
+    m_programs.insert(name, program);
+    m_buildMs += timer.elapsed();
+    return program;
+}
+
+QByteArray ShaderManager::source(const QString &file, const QStringList &defines) {
+    QFile shader(":/shaders/" + file);
+    if (!shader.open(QIODevice::ReadOnly)) return QByteArray();
+
+    QByteArray text;
+    for (int i = 0; i < defines.size(); i++)
+        text += "#define " + defines[i].toAscii() + "\n";
+    return text + shader.readAll();
+}
+
+QGLShaderProgram *ShaderManager::compile(const QByteArray &vertex, const QByteArray &fragment, const QString &name,
+                                         const QString &path)
+{
+    QGLShaderProgram *program = new QGLShaderProgram(QGLContext::currentContext());
+    bool built = program->addShaderFromSourceCode(QGLShader::Vertex, vertex)
+                 && program->addShaderFromSourceCode(QGLShader::Fragment, fragment);
+
+    for (int i = 0; i < m_attributes.size(); i++)
+        program->bindAttributeLocation(m_attributes[i].first, m_attributes[i].second);
+    if (built && m_binaries)
+        glRetrievableProgram(program->programId());
+
+    if (!built || !program->link()) {
+        qWarning() << "shaders:" << name << "failed to build:" << program->log();
+        delete program;
+        return 0;
+    }
+
+    m_compiled++;
+    save(program, path);
+    return program;
+}
+
+QGLShaderProgram *ShaderManager::load(const QString &path) {
+    if (!m_binaries) return 0;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return 0;
+    QDataStream in(&file);
+    quint32 format;
+    QByteArray binary;
+    in >> format >> binary;
+    if (in.status() != QDataStream::Ok) return 0;
+
+    //a program without shaders counts as linked once it holds a binary the driver accepted
+    //binaries that no longer load are replaced after compiling
+    QGLShaderProgram *program = new QGLShaderProgram(QGLContext::currentContext());
+    if (!glLoadProgramBinary(program->programId(), binary, format) || !program->link()) {
+        delete program;
+        return 0;
+    }
+    return program;
+}
+
+void ShaderManager::save(QGLShaderProgram *program, const QString &path) {
+    QByteArray binary;
+    GLenum format;
+    if (!m_binaries || !glGetProgramBinaryData(program->programId(), binary, format)) return;
+
+    //a failed write only costs compiling again on the next run
+    QDir().mkpath(m_cacheDir);
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return;
+    QDataStream out(&file);
+    out << (quint32)format << binary;
+}
+
+uint ShaderManager::getNumCompiled() const { return m_compiled; }
+uint ShaderManager::getNumCached() const { return m_cached; }
+double ShaderManager::getBuildMs() const { return m_buildMs; }
@@ -0,0 +1,60 @@
+#ifndef SHADERMANAGER_H
+#define SHADERMANAGER_H
+
+#include <QGLShaderProgram>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QStringList>
+
+/* Builds the shader programs of a context on first use and keeps them for the
+   lifetime of the manager. The sources are read from the resources of the
+   viewer (:/shaders), so they are found whatever the working directory is. A
+   program is specialized by #defines put in front of its sources, which
+   replace the defaults of the shaders. Linked programs are saved as binaries
+   in a cache on disk, keyed by the driver and the sources, and later runs load
+   them from there instead of compiling when the driver supports it.*/
+class ShaderManager {
+    public:
+        //create with the context of the programs current
+        ShaderManager();
+        ~ShaderManager();
+
+        //binds an attribute to a location in every program built from now on
+        void bindAttribute(const QString &name, int location);
+
+        //returns the program of a vertex and a fragment shader with the given defines, such as "MAX_LIGHTS 8"
+        //returns 0 if it does not build, which is reported once
+        QGLShaderProgram *program(const QString &vertex, const QString &fragment,
+                                  const QStringList &defines = QStringList());
+
+        //returns the number of programs compiled and loaded from the cache, and the time taken by both
+        uint getNumCompiled() const;
+        uint getNumCached() const;
+        double getBuildMs() const;
+
+    private:
+        //returns the source of a shader with the defines in front, or an empty array if it cannot be read
+        static QByteArray source(const QString &file, const QStringList &defines);
+
+        //links a program from sources, or from the binary cached at path, and caches a new binary
+        QGLShaderProgram *compile(const QByteArray &vertex, const QByteArray &fragment, const QString &name,
+                                  const QString &path);
+        QGLShaderProgram *load(const QString &path);
+        void save(QGLShaderProgram *program, const QString &path);
+
+        //programs by vertex shader, fragment shader and defines, 0 for the ones that did not build
+        QHash<QString, QGLShaderProgram*> m_programs;
+        QList<QPair<QString, int> > m_attributes;
+
+        //binaries are only cached if the driver can save them and there is a cache directory
+        bool m_binaries;
+        QString m_cacheDir;
+        QByteArray m_driver;
+
+        uint m_compiled;
+        uint m_cached;
+        double m_buildMs;
+};
+
+#endif // SHADERMANAGER_H
@@ -0,0 +1,198 @@
+#include "softwarerenderer.h"
+#include "openglrenderer.h"
+#include "utils/glutils.h"
+#include "utils/trace.h"
+
+SoftwareRenderer::SoftwareRenderer() {
+    scene = 0;
+    renderMode = RENDER_MODE_DEFAULT;
+    highlight = false;
+    width = height = 0;
+}
+
+void SoftwareRenderer::init(int width, int height) {
+    resize(width, height);
+
+    Light light(0.5f, 0.5f, 0.5f, 1.0f, 0.8f, 0.8f, 1.0, 1.0f, 1.0f, 0.6f, 0.6f, 1.0f, 10.0f, 10.0f, 10.0f);
+    setLight(0,light);
+}
+
+void SoftwareRenderer::resize(int width, int height) {
+    glViewport(0, 0, width, height);
+    this->width = width;
+    this->height = height;
+
+    //the projection of the OpenGL renderer, so both draw the same frame
+    float w = width > height ? 2 : (float)width/height * 2;
+    float h = height > width ? 2 : (float)height/width * 2;
+    projection = frustumMatrix(-w/2,w/2,-h/2,h/2,NEAR_PLANE,FAR_PLANE);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrix(projection);
+    glMatrixMode(GL_MODELVIEW);
+
+    rasterizer.resize(width, height);
+    rasterizer.setProjection(projection);
+}
+
+void SoftwareRenderer::render() {
+    TRACE_SCOPE("SoftwareRenderer::render");
+
+    //the lights are given in eye space, as to the fixed-function pipeline
+    vector<RasterLight> enabled;
+    for (int i = 0; i < RASTER_MAX_LIGHTS; i++) {
+        const Light &l = lights[i];
+        if (!l.isEnabled) continue;
+
+        RasterLight light;
+        light.position = l.pos;
+        light.ambient = Vector3f(l.ambient.r, l.ambient.g, l.ambient.b);
+        light.diffuse = Vector3f(l.diffuse.r, l.diffuse.g, l.diffuse.b);
+        light.specular = Vector3f(l.specular.r, l.specular.g, l.specular.b);
+        enabled.push_back(light);
+    }
+    rasterizer.setLights(enabled);
+
+    switch (renderMode) {
+    case RENDER_MODE_WIREFRAME: rasterizer.setShading(RASTER_EDGES); break;
+    case RENDER_MODE_PHONG: rasterizer.setShading(RASTER_PHONG); break;
+    case RENDER_MODE_SHADED_WIREFRAME: rasterizer.setShading(RASTER_DIFFUSE_EDGES); break;
+    default: rasterizer.setShading(RASTER_DIFFUSE); break;
+    }
+
+    //every copy of a batch is the draw buffer of its mesh under its own model-view matrix
+    Matrix4f view = camera.getViewMatrix();
+    rasterizer.begin();
+    if (scene) {
+        const vector<DrawBatch> &batches = scene->getBatches();
+        const vector<float> &transforms = scene->getInstanceTransforms();
+        vector<Matrix4f> modelViews;
+        for (uint i = 0; i < batches.size(); i++) {
+            const DrawBatch &batch = batches[i];
+            modelViews.resize(batch.numInstances);
+            for (uint j = 0; j < batch.numInstances; j++) {
+                //the transforms are column-major
+                Matrix4f columns;
+                const float *src = &transforms[16 * (batch.firstInstance + j)];
+                for (uint k = 0; k < 16; k++) columns.ptr()[k] = src[k];
+                modelViews[j] = view * columns.transpose();
+            }
+
+            uint numVertices;
+            const DrawVertex *vertices = batch.mesh->getDrawBuffer(numVertices);
+            if (numVertices == 0) continue;
+            rasterizer.addTriangles(&vertices->position, &vertices->normal, &vertices->edgeFlag, sizeof(DrawVertex),
+                                    numVertices, &modelViews[0], batch.numInstances);
+        }
+    }
+    rasterizer.end();
+
+    //copy the frame into the view, past the matrices and tests of the pipeline
+    glPushAttrib(GL_ENABLE_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_LIGHTING);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glRasterPos2f(-1, -1);
+    if (width > 0 && height > 0)
+        glDrawPixels(width, height, GL_RGBA, GL_UNSIGNED_BYTE, rasterizer.getPixels());
+    glPopAttrib();
+
+    //overlays are drawn over the frame with the matrices of the scene, there is no depth to test them against
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrix(projection);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrix(view);
+
+    if (highlight)
+        drawHighlight();
+}
+
+void SoftwareRenderer::drawHighlight() {
+    //the highlight only applies to the level it was picked at
+    if (!scene || highlightPick.object >= scene->getNumObjects()) return;
+    const SceneObject &object = scene->getObject(highlightPick.object);
+    if (scene->getDisplayedMesh(object.mesh) != highlightPick.mesh) return;
+
+    //the picked face is the nearest under the cursor, so it is drawn over the frame whole
+    glPushAttrib(GL_ENABLE_BIT | GL_POLYGON_BIT | GL_CURRENT_BIT | GL_POINT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    glPushMatrix();
+    glMultMatrixf(object.transform.transpose().ptr());
+
+    glColor3f(1.0f, 0.8f, 0.0f);
+    highlightPick.mesh->glDrawFace(highlightPick.hit.face);
+
+    glPointSize(6);
+    glColor3f(1.0f, 0.2f, 0.0f);
+    glBegin(GL_POINTS);
+        glVertex3fv(highlightPick.mesh->getPosition(highlightPick.hit.vertex).ptr());
+    glEnd();
+
+    glPopMatrix();
+    glPopAttrib();
+}
+
+bool SoftwareRenderer::pick(int x, int y, ScenePick &pick) {
+    if (!scene || width <= 0 || height <= 0) return false;
+
+    //unproject the pixel center on the near and far planes
+    Matrix4f inverse = (projection * camera.getViewMatrix()).inverse();
+    float nx = 2 * (x + 0.5f) / width - 1;
+    float ny = 1 - 2 * (y + 0.5f) / height;
+    Vector4f nearPoint = inverse * Vector4f(nx, ny, -1, 1);
+    Vector4f farPoint = inverse * Vector4f(nx, ny, 1, 1);
+
+    Vector3f origin(nearPoint[0] / nearPoint[3], nearPoint[1] / nearPoint[3], nearPoint[2] / nearPoint[3]);
+    Vector3f end(farPoint[0] / farPoint[3], farPoint[1] / farPoint[3], farPoint[2] / farPoint[3]);
+
+    //the ray reaches the far plane at t = 1
+    return scene->pick(origin, end - origin, 1, pick);
+}
+
+void SoftwareRenderer::setHighlight(const ScenePick &pick) {
+    highlight = true;
+    highlightPick = pick;
+}
+
+void SoftwareRenderer::clearHighlight() {
+    highlight = false;
+    highlightPick = ScenePick();
+}
+
+void SoftwareRenderer::setLight(int i, Light light) {
+    if (i < 0 || i >= RASTER_MAX_LIGHTS) return;
+    lights[i] = light;
+}
+
+void SoftwareRenderer::setLights(Light *lights, int n) {
+    for (int i = 0; i < MIN(RASTER_MAX_LIGHTS,n); i++) setLight(i, lights[i]);
+}
+
+void SoftwareRenderer::setCamera(Camera camera) { this->camera = camera; }
+void SoftwareRenderer::setScene(Scene *scene) {
+    this->scene = scene;
+    highlight = false;
+}
+void SoftwareRenderer::setRenderMode(RenderMode renderMode) { this->renderMode = renderMode; }
+void SoftwareRenderer::setUploader(BufferUploader *) {}
+
+void SoftwareRenderer::setInteractive(bool) {}
+bool SoftwareRenderer::isRefining() { return false; }
+float SoftwareRenderer::getResolutionScale() { return 1; }
+
+void SoftwareRenderer::setNumThreads(int threads) { rasterizer.setNumThreads(threads); }
+uint SoftwareRenderer::getNumThreads() const { return rasterizer.getNumThreads(); }
+const Rasterizer &SoftwareRenderer::getRasterizer() const { return rasterizer; }
+
+Camera SoftwareRenderer::getCamera() { return camera; }
+Scene *SoftwareRenderer::getScene() { return scene; }
+RenderMode SoftwareRenderer::getRenderMode() { return renderMode; }
+int SoftwareRenderer::getNumLights() { return RASTER_MAX_LIGHTS; }
+Light SoftwareRenderer::getLight(int i) { return lights[i]; }
@@ -0,0 +1,72 @@
+#ifndef SOFTWARERENDERER_H
+#define SOFTWARERENDERER_H
+
+#include "renderer.h"
+#include "utils/rasterizer.h"
+
+/* Renderer that draws the scene on the CPU with the tile rasterizer, on
+   every core, and copies the finished frame into the view. It shades like
+   the OpenGL renderer in each render mode, with the same projection and
+   lights given in eye space, so the two can be compared frame by frame and
+   switched between in the viewer. The highlight and the overlays of the
+   widget are still drawn by OpenGL over the frame. Meshes are always drawn
+   at full quality from their draw buffers in system memory.*/
+class SoftwareRenderer : public Renderer {
+    public:
+        SoftwareRenderer();
+
+        void init(int width, int height);
+        void resize(int width, int height);
+        void render();
+
+        void setLights(Light *lights, int n);
+        void setLight(int i, Light light);
+        void setCamera(Camera camera);
+        void setScene(Scene *scene);
+        void setRenderMode(RenderMode renderMode);
+
+        Camera getCamera();
+        Scene *getScene();
+        RenderMode getRenderMode();
+        int getNumLights();
+        Light getLight(int i);
+
+        bool pick(int x, int y, ScenePick &pick);
+        void setHighlight(const ScenePick &pick);
+        void clearHighlight();
+
+        //meshes are never uploaded, the uploader is ignored
+        void setUploader(BufferUploader *uploader);
+
+        //frames are not reduced while the camera moves
+        void setInteractive(bool interactive);
+        bool isRefining();
+        float getResolutionScale();
+
+        //sets the number of threads drawing the frames, 0 uses one per core
+        void setNumThreads(int threads);
+        uint getNumThreads() const;
+
+        //returns the rasterizer, with the counts and times of the last frame
+        const Rasterizer &getRasterizer() const;
+
+    private:
+        //draws the highlighted face and vertex over the frame
+        void drawHighlight();
+
+        Rasterizer rasterizer;
+
+        Light lights[RASTER_MAX_LIGHTS];
+        Camera camera;
+        Matrix4f projection;
+        int width;
+        int height;
+
+        Scene *scene;
+        RenderMode renderMode;
+
+        bool highlight;
+        ScenePick highlightPick;
+};
+
+#endif // SOFTWARERENDERER_H
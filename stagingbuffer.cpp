@@ -0,0 +1,76 @@
+#include "stagingbuffer.h"
+
+#include "utils/glutils.h"
+#include "utils/trace.h"
+
+//bytes of each half, a slice is filled by all threads while the GPU copies the other half
+#define STAGING_HALF_BYTES (8 << 20)
+
+StagingBuffer::StagingBuffer()
+    : m_buffer(QGLBuffer::VertexBuffer), m_halfBytes(STAGING_HALF_BYTES), m_half(0)
+{
+    m_fences[0] = m_fences[1] = 0;
+
+    //the contents are written once and read once by the copy
+    m_buffer.setUsagePattern(QGLBuffer::StreamCopy);
+    if (m_buffer.create() && m_buffer.bind()) {
+        m_buffer.allocate(2 * m_halfBytes);
+        m_buffer.release();
+    }
+}
+
+StagingBuffer::~StagingBuffer() {
+    for (uint i = 0; i < 2; i++) {
+        if (m_fences[i]) glDeleteFence(m_fences[i]);
+    }
+    m_buffer.destroy();
+}
+
+bool StagingBuffer::isValid() const {
+    return m_buffer.bufferId() != 0;
+}
+
+uint StagingBuffer::sliceVertices() const {
+    return m_halfBytes / sizeof(DrawVertex);
+}
+
+bool StagingBuffer::write(const Mesh *mesh, GLuint target, uint begin, uint end) {
+    TRACE_SCOPE("StagingBuffer::write");
+
+    //a face with more vertices than a slice grows both halves, once both are free
+    int bytes = sizeof(DrawVertex) * (end - begin);
+    if (bytes > m_halfBytes) {
+        wait(0);
+        wait(1);
+        m_halfBytes = bytes;
+        m_buffer.bind();
+        m_buffer.allocate(2 * m_halfBytes);
+        m_buffer.release();
+    }
+
+    //the half is reused once the GPU has read it, so the mapping need not wait for anything else
+    wait(m_half);
+    int offset = m_half * m_halfBytes;
+    m_buffer.bind();
+    DrawVertex *vertices = (DrawVertex*)glMapUnsynchronizedBuffer(GL_ARRAY_BUFFER, offset, bytes);
+    if (!vertices) {
+        m_buffer.release();
+        return false;
+    }
+    mesh->fillDrawBuffer(vertices, begin, end);
+    bool kept = glUnmapWriteBuffer(GL_ARRAY_BUFFER);
+    m_buffer.release();
+    if (!kept) return false;
+
+    glCopyBufferData(m_buffer.bufferId(), offset, target, sizeof(DrawVertex) * begin, bytes);
+    m_fences[m_half] = glInsertFence();
+    m_half = 1 - m_half;
+    return true;
+}
+
+void StagingBuffer::wait(uint half) {
+    if (!m_fences[half]) return;
+    glWaitFence(m_fences[half]);
+    glDeleteFence(m_fences[half]);
+    m_fences[half] = 0;
+}
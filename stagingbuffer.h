@@ -0,0 +1,40 @@
+#ifndef STAGINGBUFFER_H
+#define STAGINGBUFFER_H
+
+#include <QGLBuffer>
+
+#include "mesh.h"
+
+/* A buffer object that draw buffers are filled into in slices, each slice
+   then copied on the GPU into the buffer object the mesh is drawn from. The
+   two halves are written in turn, mapped unsynchronized once the copy out of
+   the half has completed, so the same memory is written by every upload and
+   its pages are faulted in once, instead of the driver handing out fresh
+   pages for every level. All calls need the same context current, from
+   creation to deletion, and glHasBufferCopies and glHasFences to be true.*/
+class StagingBuffer {
+    public:
+        StagingBuffer();
+        ~StagingBuffer();
+
+        //returns false if the buffer object could not be created
+        bool isValid() const;
+
+        //returns the number of vertices a slice should hold
+        uint sliceVertices() const;
+
+        //fills the vertices [begin, end) of the draw buffer of a mesh, as given by Mesh::drawSliceEnd,
+        //into a buffer object at the same offset, returns false if the contents were lost
+        bool write(const Mesh *mesh, GLuint target, uint begin, uint end);
+
+    private:
+        //waits for the copies out of a half to complete
+        void wait(uint half);
+
+        QGLBuffer m_buffer;
+        int m_halfBytes;
+        uint m_half;            //half the next slice is written to
+        void *m_fences[2];      //inserted after the copy out of each half, 0 once waited for
+};
+
+#endif // STAGINGBUFFER_H
@@ -0,0 +1,87 @@
+#include "arena.h"
+
+Arena::Arena()
+    : m_next(0), m_remaining(0), m_largeBytes(0)
+{
+    for (size_t i = 0; i < ARENA_NUM_CLASSES; i++)
+        m_freeLists[i] = 0;
+}
+
+Arena::~Arena() {
+    release();
+}
+
+void Arena::newBlock() {
+    char *block = (char*)malloc(ARENA_BLOCK_SIZE);
+    if (!block) throw std::bad_alloc();
+
+    m_blocks.push_back(block);
+    m_next = block;
+    m_remaining = ARENA_BLOCK_SIZE;
+}
+
+void *Arena::allocate(size_t bytes) {
+    m_stats.allocations++;
+    m_stats.bytesAllocated += bytes;
+
+    //large allocations go directly to the system
+    if (bytes > ARENA_MAX_SMALL) {
+        void *p = malloc(bytes);
+        if (!p) throw std::bad_alloc();
+        m_largeBytes += bytes;
+        return p;
+    }
+
+    //reuse a freed allocation of the same size class if there is one
+    size_t sizeClass = (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT;
+    if (sizeClass == 0) sizeClass = 1;
+    if (m_freeLists[sizeClass]) {
+        void *p = m_freeLists[sizeClass];
+        m_freeLists[sizeClass] = *(void**)p;
+        return p;
+    }
+
+    //otherwise take it from the current block
+    size_t size = sizeClass * ARENA_ALIGNMENT;
+    if (m_remaining < size)
+        newBlock();
+
+    void *p = m_next;
+    m_next += size;
+    m_remaining -= size;
+    return p;
+}
+
+void Arena::deallocate(void *p, size_t bytes) {
+    if (!p) return;
+
+    if (bytes > ARENA_MAX_SMALL) {
+        free(p);
+        m_largeBytes -= bytes;
+        return;
+    }
+
+    //push onto the free list of its size class
+    size_t sizeClass = (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT;
+    if (sizeClass == 0) sizeClass = 1;
+    *(void**)p = m_freeLists[sizeClass];
+    m_freeLists[sizeClass] = p;
+}
+
+void Arena::release() {
+    for (size_t i = 0; i < m_blocks.size(); i++)
+        free(m_blocks[i]);
+    std::vector<char*>().swap(m_blocks);
+
+    for (size_t i = 0; i < ARENA_NUM_CLASSES; i++)
+        m_freeLists[i] = 0;
+
+    m_next = 0;
+    m_remaining = 0;
+}
+
+ArenaStats Arena::stats() const {
+    ArenaStats stats = m_stats;
+    stats.bytesReserved = m_blocks.size() * ARENA_BLOCK_SIZE + m_largeBytes;
+    return stats;
+}
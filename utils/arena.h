@@ -0,0 +1,131 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
+
+#define ARENA_BLOCK_SIZE (64*1024)  //bytes reserved at a time from the system
+#define ARENA_ALIGNMENT 16          //alignment and size granularity of small allocations
+#define ARENA_MAX_SMALL 256         //larger allocations bypass the arena blocks
+#define ARENA_NUM_CLASSES (ARENA_MAX_SMALL / ARENA_ALIGNMENT + 1)
+
+//allocation statistics of an arena
+struct ArenaStats {
+    size_t allocations;     //number of allocations made
+    size_t bytesAllocated;  //total bytes requested by all allocations
+    size_t bytesReserved;   //bytes currently held from the system
+
+    ArenaStats() : allocations(0), bytesAllocated(0), bytesReserved(0) {}
+
+    ArenaStats &operator+=(const ArenaStats &s) {
+        allocations += s.allocations;
+        bytesAllocated += s.bytesAllocated;
+        bytesReserved += s.bytesReserved;
+        return *this;
+    }
+};
+
+/* A pool allocator for the many small allocations made while building a mesh.
+   Small allocations are carved out of large blocks and recycled through free
+   lists of their size class, so nothing is returned to the system until the
+   arena is released or destroyed, which frees all blocks in one shot.*/
+class Arena {
+public:
+    Arena();
+    ~Arena();
+
+    //returns memory for the given number of bytes
+    void *allocate(size_t bytes);
+
+    //returns memory from allocate to the arena for reuse
+    void deallocate(void *p, size_t bytes);
+
+    //frees all blocks, memory allocated from the arena must no longer be used
+    void release();
+
+    ArenaStats stats() const;
+
+private:
+    //noncopyable
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+
+    //reserves a new block for small allocations
+    void newBlock();
+
+    std::vector<char*> m_blocks;
+    char *m_next;           //next free byte in the current block
+    size_t m_remaining;     //free bytes left in the current block
+
+    void *m_freeLists[ARENA_NUM_CLASSES];
+
+    size_t m_largeBytes;    //bytes of live allocations larger than ARENA_MAX_SMALL
+    ArenaStats m_stats;
+};
+
+//an STL allocator that allocates from an arena, or from the heap if it has no arena
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+#if __cplusplus >= 201103L
+    //containers exchange their arenas along with their elements
+    typedef std::true_type propagate_on_container_swap;
+#endif
+
+    ArenaAllocator(Arena *arena = 0) : m_arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &a) : m_arena(a.arena()) {}
+
+    pointer allocate(size_type n, const void * = 0) {
+        if (m_arena)
+            return static_cast<pointer>(m_arena->allocate(n * sizeof(T)));
+        return static_cast<pointer>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(pointer p, size_type n) {
+        if (m_arena)
+            m_arena->deallocate(p, n * sizeof(T));
+        else
+            ::operator delete(p);
+    }
+
+    void construct(pointer p, const T &value) { new (p) T(value); }
+    void destroy(pointer p) { p->~T(); }
+
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+    size_type max_size() const { return size_t(-1) / sizeof(T); }
+
+    Arena *arena() const { return m_arena; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &a) const { return m_arena == a.arena(); }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &a) const { return m_arena != a.arena(); }
+
+private:
+    Arena *m_arena;
+};
+
+#endif // ARENA_H
@@ -0,0 +1,297 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#define BVH_BINS 16
+#define BVH_LEAF_SIZE 4         //nodes this small are never split
+#define BVH_MAX_LEAF_SIZE 16    //nodes larger than this are split even if it does not pay off
+#define BVH_MAX_DEPTH 63        //keeps the traversal stack below BVH_STACK_SIZE
+#define BVH_STACK_SIZE 64
+#define BVH_TRAVERSAL_COST 1.0f //cost of visiting a node relative to intersecting a triangle
+
+//returns half of the surface area of a box
+static float halfArea(const float *min, const float *max) {
+    float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+    return dx*dy + dy*dz + dz*dx;
+}
+
+//grows box [min, max] to contain box [bmin, bmax]
+static void growBox(float *min, float *max, const float *bmin, const float *bmax) {
+    for (uint k = 0; k < 3; k++) {
+        if (bmin[k] < min[k]) min[k] = bmin[k];
+        if (bmax[k] > max[k]) max[k] = bmax[k];
+    }
+}
+
+static void emptyBox(float *min, float *max) {
+    for (uint k = 0; k < 3; k++) {
+        min[k] = FLT_MAX;
+        max[k] = -FLT_MAX;
+    }
+}
+
+//returns the bin of a centroid along an axis
+struct BinOf {
+    const Vector3f *centroids;
+    uint axis;
+    float min, scale;
+
+    uint operator()(uint triangle) const {
+        int bin = (int)((centroids[triangle][axis] - min) * scale);
+        return bin < 0 ? 0 : (bin >= BVH_BINS ? BVH_BINS - 1 : bin);
+    }
+};
+
+//true for triangles whose centroid is in a bin left of the split
+struct LeftOfSplit {
+    BinOf binOf;
+    uint split;
+
+    bool operator()(uint triangle) const { return binOf(triangle) < split; }
+};
+
+Bvh::Bvh() {}
+
+void Bvh::build(const Vector3f *positions, const uint *triangles, uint numTriangles) {
+    m_nodes.clear();
+    m_triangles.clear();
+    m_order.resize(numTriangles);
+    if (numTriangles == 0) return;
+
+    //bounds and centroids of the triangles
+    vector<Vector3f> centroids(numTriangles);
+    vector<float> bounds(6 * numTriangles);
+    for (uint i = 0; i < numTriangles; i++) {
+        float *min = &bounds[6*i], *max = min + 3;
+        emptyBox(min, max);
+        for (uint j = 0; j < 3; j++) {
+            const float *p = positions[triangles[3*i + j]].ptr();
+            growBox(min, max, p, p);
+        }
+        centroids[i] = Vector3f(min[0] + max[0], min[1] + max[1], min[2] + max[2]) * 0.5f;
+        m_order[i] = i;
+    }
+
+    //a binary tree with at least one triangle per leaf has fewer than 2n nodes
+    m_nodes.reserve(2 * numTriangles);
+    buildNode(0, numTriangles, 0, centroids, bounds);
+    vector<Node>(m_nodes).swap(m_nodes);
+
+    //store the vertices of the triangles in leaf order
+    m_triangles.resize(3 * numTriangles);
+    for (uint i = 0; i < numTriangles; i++)
+        for (uint j = 0; j < 3; j++)
+            m_triangles[3*i + j] = triangles[3*m_order[i] + j];
+}
+
+uint Bvh::buildNode(uint begin, uint end, uint depth, const vector<Vector3f> &centroids, const vector<float> &bounds) {
+    uint index = m_nodes.size();
+    m_nodes.push_back(Node());
+
+    Node node;
+    float centroidMin[3], centroidMax[3];
+    emptyBox(node.min, node.max);
+    emptyBox(centroidMin, centroidMax);
+    for (uint i = begin; i < end; i++) {
+        const float *b = &bounds[6*m_order[i]];
+        const float *c = centroids[m_order[i]].ptr();
+        growBox(node.min, node.max, b, b + 3);
+        growBox(centroidMin, centroidMax, c, c);
+    }
+    node.offset = begin;
+    node.count = end - begin;
+
+    //split along the axis of the largest centroid extent
+    uint axis = 0;
+    for (uint k = 1; k < 3; k++)
+        if (centroidMax[k] - centroidMin[k] > centroidMax[axis] - centroidMin[axis]) axis = k;
+    float extent = centroidMax[axis] - centroidMin[axis];
+
+    if (node.count <= BVH_LEAF_SIZE || extent <= 0 || depth >= BVH_MAX_DEPTH) {
+        m_nodes[index] = node;
+        return index;
+    }
+
+    //bin the triangles by centroid
+    BinOf binOf;
+    binOf.centroids = &centroids[0];
+    binOf.axis = axis;
+    binOf.min = centroidMin[axis];
+    binOf.scale = BVH_BINS / extent;
+
+    uint binCounts[BVH_BINS] = {0};
+    float binMin[BVH_BINS][3], binMax[BVH_BINS][3];
+    for (uint b = 0; b < BVH_BINS; b++) emptyBox(binMin[b], binMax[b]);
+    for (uint i = begin; i < end; i++) {
+        uint bin = binOf(m_order[i]);
+        const float *b = &bounds[6*m_order[i]];
+        binCounts[bin]++;
+        growBox(binMin[bin], binMax[bin], b, b + 3);
+    }
+
+    //sweep from the right to get the cost of the right side of every split
+    float rightCost[BVH_BINS];
+    float min[3], max[3];
+    uint count = 0;
+    emptyBox(min, max);
+    for (uint b = BVH_BINS - 1; b > 0; b--) {
+        growBox(min, max, binMin[b], binMax[b]);
+        count += binCounts[b];
+        rightCost[b] = count ? count * halfArea(min, max) : 0;
+    }
+
+    //sweep from the left to find the cheapest split, left of bin split and right of it
+    uint split = 0;
+    float bestCost = FLT_MAX;
+    count = 0;
+    emptyBox(min, max);
+    for (uint b = 1; b < BVH_BINS; b++) {
+        growBox(min, max, binMin[b-1], binMax[b-1]);
+        count += binCounts[b-1];
+        if (count == 0 || count == node.count) continue;
+
+        float cost = count * halfArea(min, max) + rightCost[b];
+        if (cost < bestCost) {
+            bestCost = cost;
+            split = b;
+        }
+    }
+
+    //keep the node as a leaf if intersecting all of its triangles is cheaper than splitting
+    float area = halfArea(node.min, node.max);
+    float leafCost = node.count * area;
+    bestCost += BVH_TRAVERSAL_COST * area;
+    if (split == 0 || (bestCost >= leafCost && node.count <= BVH_MAX_LEAF_SIZE)) {
+        m_nodes[index] = node;
+        return index;
+    }
+
+    LeftOfSplit leftOfSplit;
+    leftOfSplit.binOf = binOf;
+    leftOfSplit.split = split;
+    uint middle = partition(m_order.begin() + begin, m_order.begin() + end, leftOfSplit) - m_order.begin();
+
+    //the left child directly follows its parent
+    buildNode(begin, middle, depth + 1, centroids, bounds);
+    node.offset = buildNode(middle, end, depth + 1, centroids, bounds);
+    node.count = 0;
+    m_nodes[index] = node;
+    return index;
+}
+
+void Bvh::refit(const Vector3f *positions) {
+    //children are stored after their parent, so walking backwards visits them first
+    for (int i = (int)m_nodes.size() - 1; i >= 0; i--) {
+        Node &node = m_nodes[i];
+        emptyBox(node.min, node.max);
+
+        if (node.count > 0) {
+            for (uint j = 3*node.offset; j < 3*(node.offset + node.count); j++) {
+                const float *p = positions[m_triangles[j]].ptr();
+                growBox(node.min, node.max, p, p);
+            }
+        } else {
+            const Node &left = m_nodes[i + 1], &right = m_nodes[node.offset];
+            growBox(node.min, node.max, left.min, left.max);
+            growBox(node.min, node.max, right.min, right.max);
+        }
+    }
+}
+
+//returns the distance at which a ray enters a box, or FLT_MAX if it misses it before maxT
+static float enterBox(const float *min, const float *max, const float *origin, const float *invDir, float maxT) {
+    float tNear = 0, tFar = maxT;
+    for (uint k = 0; k < 3; k++) {
+        float t0 = (min[k] - origin[k]) * invDir[k];
+        float t1 = (max[k] - origin[k]) * invDir[k];
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 > tNear) tNear = t0;
+        if (t1 < tFar) tFar = t1;
+        if (tNear > tFar) return FLT_MAX;
+    }
+    return tNear;
+}
+
+bool Bvh::intersect(const Vector3f *positions, const Vector3f &origin, const Vector3f &direction,
+                    float maxT, float &t, uint &triangle) const {
+    if (m_nodes.empty()) return false;
+
+    float invDir[3];
+    for (uint k = 0; k < 3; k++) invDir[k] = 1.0f / direction[k];
+
+    bool hit = false;
+    float closest = maxT;
+
+    //nodes to visit and the distance at which the ray enters them
+    uint stack[BVH_STACK_SIZE];
+    float stackT[BVH_STACK_SIZE];
+    uint size = 0;
+    stackT[size] = enterBox(m_nodes[0].min, m_nodes[0].max, origin.ptr(), invDir, closest);
+    stack[size++] = 0;
+
+    while (size > 0) {
+        size--;
+        //skip nodes entered beyond a closer hit found since they were pushed
+        if (stackT[size] >= closest) continue;
+        const Node &node = m_nodes[stack[size]];
+
+        if (node.count > 0) {
+            //intersect the triangles of the leaf by the Moller-Trumbore test
+            for (uint i = node.offset; i < node.offset + node.count; i++) {
+                const Vector3f &a = positions[m_triangles[3*i]];
+                Vector3f e1 = positions[m_triangles[3*i + 1]] - a;
+                Vector3f e2 = positions[m_triangles[3*i + 2]] - a;
+
+                Vector3f p = direction.cross(e2);
+                float det = e1.dot(p);
+                if (fabs(det) < 1E-12f) continue;
+                float invDet = 1.0f / det;
+
+                Vector3f s = origin - a;
+                float u = s.dot(p) * invDet;
+                if (u < 0 || u > 1) continue;
+
+                Vector3f q = s.cross(e1);
+                float v = direction.dot(q) * invDet;
+                if (v < 0 || u + v > 1) continue;
+
+                float d = e2.dot(q) * invDet;
+                if (d > 0 && d < closest) {
+                    closest = d;
+                    triangle = m_order[i];
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        //visit the nearer child first by pushing it last
+        uint left = &node - &m_nodes[0] + 1, right = node.offset;
+        float tLeft = enterBox(m_nodes[left].min, m_nodes[left].max, origin.ptr(), invDir, closest);
+        float tRight = enterBox(m_nodes[right].min, m_nodes[right].max, origin.ptr(), invDir, closest);
+        if (tLeft > tRight) {
+            std::swap(left, right);
+            std::swap(tLeft, tRight);
+        }
+        if (tRight != FLT_MAX) {
+            stackT[size] = tRight;
+            stack[size++] = right;
+        }
+        if (tLeft != FLT_MAX) {
+            stackT[size] = tLeft;
+            stack[size++] = left;
+        }
+    }
+
+    if (hit) t = closest;
+    return hit;
+}
+
+bool Bvh::isEmpty() const { return m_nodes.empty(); }
+uint Bvh::getNumNodes() const { return m_nodes.size(); }
+
+size_t Bvh::memoryUsage() const {
+    return m_nodes.capacity() * sizeof(Node) + (m_triangles.capacity() + m_order.capacity()) * sizeof(uint);
+}
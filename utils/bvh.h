@@ -0,0 +1,53 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+
+#include "vector.h"
+
+using namespace std;
+
+/* Bounding volume hierarchy over triangles for ray queries. It is built top
+   down, splitting each node where the surface area heuristic on binned
+   triangle centroids is lowest. Nodes are stored depth first, so the left
+   child of a node directly follows it. The hierarchy does not keep the vertex
+   positions; they are passed to every query, and the bounds can be refit to
+   moved positions without rebuilding.*/
+class Bvh {
+public:
+    Bvh();
+
+    //builds the hierarchy over triangles of 3 vertex indices each
+    void build(const Vector3f *positions, const uint *triangles, uint numTriangles);
+
+    //recomputes the bounds of the nodes for moved positions, keeping the tree
+    void refit(const Vector3f *positions);
+
+    //finds the closest triangle hit by the ray origin + t*direction with 0 < t < maxT
+    //returns false on a miss, otherwise sets t and the index of the triangle in the build input
+    bool intersect(const Vector3f *positions, const Vector3f &origin, const Vector3f &direction,
+                   float maxT, float &t, uint &triangle) const;
+
+    bool isEmpty() const;
+    uint getNumNodes() const;
+
+    //returns the bytes used by the nodes and triangles
+    size_t memoryUsage() const;
+
+private:
+    struct Node {
+        float min[3];
+        float max[3];
+        uint offset;    //right child of an inner node, first triangle of a leaf
+        uint count;     //triangles of a leaf, 0 for inner nodes
+    };
+
+    //builds the node of triangles [begin, end) of m_order, returns its index
+    uint buildNode(uint begin, uint end, uint depth, const vector<Vector3f> &centroids, const vector<float> &bounds);
+
+    vector<Node> m_nodes;
+    vector<uint> m_triangles;  //vertex indices of the triangles in leaf order
+    vector<uint> m_order;      //build input index of each triangle in leaf order
+};
+
+#endif // BVH_H
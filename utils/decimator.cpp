@@ -0,0 +1,508 @@
+#include "decimator.h"
+
+#include <QThread>
+#include <QtConcurrentRun>
+#include <QFuture>
+
+#include <algorithm>
+#include <math.h>
+#include <queue>
+
+#include "trace.h"
+
+#define DECIMATE_CHUNK_TRIANGLES 16384  //fewest triangles worth a slab of their own
+#define DECIMATE_MIN_TURN_COS 0.2f      //triangles may turn by up to about 78 degrees in a collapse
+#define DECIMATE_SINGULAR 1E-12         //determinant below which the planes of a quadric meet in no single point
+#define DECIMATE_MAX_REACH 2.0f         //optimal points further than this many edge lengths are not trusted
+
+//slabs stop at this many times their share of the target, so the final pass has cheap collapses left around
+//the seams; a slab reduced all the way runs out of them and distorts its inside instead
+#define DECIMATE_SLAB_HEADROOM 2
+
+//stronger reductions are made in one pass, the locked seams would hold too much of the target in slabs
+#define DECIMATE_MAX_SLAB_REDUCTION 8
+
+//sum of the squared distances to a set of planes, as the symmetric matrix of their outer products
+struct Quadric {
+    double q[10];   //xx xy xz xw yy yz yw zz zw ww
+    double planes;
+
+    Quadric() : planes(0) {
+        for (uint i = 0; i < 10; i++) q[i] = 0;
+    }
+
+    //adds the plane ax + by + cz + d = 0 of unit normal (a, b, c)
+    void addPlane(double a, double b, double c, double d) {
+        q[0] += a*a; q[1] += a*b; q[2] += a*c; q[3] += a*d;
+        q[4] += b*b; q[5] += b*c; q[6] += b*d;
+        q[7] += c*c; q[8] += c*d;
+        q[9] += d*d;
+        planes++;
+    }
+
+    Quadric &operator+=(const Quadric &quadric) {
+        for (uint i = 0; i < 10; i++) q[i] += quadric.q[i];
+        planes += quadric.planes;
+        return *this;
+    }
+
+    //returns the sum of the squared distances of p to the planes
+    double evaluate(const Vector3f &p) const {
+        double x = p[0], y = p[1], z = p[2];
+        return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+             + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+             + q[7]*z*z + 2*q[8]*z + q[9];
+    }
+
+    //finds the point of least error, returns false if the planes do not meet in a single point
+    bool minimum(Vector3f &p) const {
+        //invert the upper 3x3 block by its cofactors, it is symmetric
+        double c00 = q[4]*q[7] - q[5]*q[5];
+        double c01 = q[2]*q[5] - q[1]*q[7];
+        double c02 = q[1]*q[5] - q[2]*q[4];
+        double det = q[0]*c00 + q[1]*c01 + q[2]*c02;
+        if (fabs(det) < DECIMATE_SINGULAR) return false;
+
+        double c11 = q[0]*q[7] - q[2]*q[2];
+        double c12 = q[1]*q[2] - q[0]*q[5];
+        double c22 = q[0]*q[4] - q[1]*q[1];
+        p[0] = -(c00*q[3] + c01*q[6] + c02*q[8]) / det;
+        p[1] = -(c01*q[3] + c11*q[6] + c12*q[8]) / det;
+        p[2] = -(c02*q[3] + c12*q[6] + c22*q[8]) / det;
+        return true;
+    }
+};
+
+//a collapse of vertex u into vertex v at a target position
+//it is stale once either vertex changed after the collapse was queued
+struct Collapse {
+    double cost;
+    double meanCost;    //cost per plane, the mean squared distance to the planes
+    uint u, v;
+    uint versionU, versionV;
+    Vector3f target;
+
+    //the queue pops the greatest element, which is the cheapest collapse
+    bool operator<(const Collapse &c) const { return cost > c.cost; }
+};
+
+//triangles reduced by one thread, in the vertex indices of the whole mesh
+//vertices of the patch that are not locked belong to no other patch, so they are written in place
+struct Patch {
+    vector<uint> triangles;
+    const char *locked;
+    Vector3f *positions;
+    Quadric *quadrics;
+    uint target;
+    double meanCost;    //largest mean squared distance to the planes of a collapse made
+};
+
+//edge collapses over the triangles of a patch, in vertex indices local to the patch
+class EdgeCollapse {
+public:
+    EdgeCollapse(Patch *patch);
+
+    //collapses edges until the target is reached or no edge can collapse, then writes the patch back
+    void run();
+
+private:
+    //queues the collapse of an edge, unless both of its vertices are locked
+    void push(uint a, uint b);
+
+    //returns the vertices sharing a live triangle with v, and drops the removed triangles of v
+    void neighbours(uint v, vector<uint> &result);
+
+    //returns false if the collapse would make the surface non-manifold or turn a triangle over
+    bool canCollapse(const Collapse &c);
+
+    //returns false if moving vertex from of a triangle to p turns it over
+    //triangles that also have vertex other are removed by the collapse, so they pass
+    bool keepsOrientation(uint triangle, uint from, uint other, const Vector3f &p) const;
+
+    void collapse(const Collapse &c);
+
+    Patch *m_patch;
+    vector<uint> m_globals;     //index in the whole mesh of each local vertex
+    vector<uint> m_triangles;
+    vector<char> m_removed;
+    vector<Vector3f> m_positions;
+    vector<Quadric> m_quadrics;
+    vector<char> m_locked;
+    vector<uint> m_versions;
+    vector<vector<uint> > m_faces;  //triangles of each vertex, including removed ones until they are dropped
+    priority_queue<Collapse> m_queue;
+    uint m_live;
+
+    //scratch lists of neighbours
+    vector<uint> m_first;
+    vector<uint> m_second;
+};
+
+EdgeCollapse::EdgeCollapse(Patch *patch) : m_patch(patch) {
+    //number the vertices of the patch locally
+    m_globals = patch->triangles;
+    sort(m_globals.begin(), m_globals.end());
+    m_globals.erase(unique(m_globals.begin(), m_globals.end()), m_globals.end());
+
+    uint n = m_globals.size();
+    m_positions.resize(n);
+    m_quadrics.resize(n);
+    m_locked.resize(n);
+    m_versions.assign(n, 0);
+    m_faces.resize(n);
+    for (uint i = 0; i < n; i++) {
+        m_positions[i] = patch->positions[m_globals[i]];
+        m_quadrics[i] = patch->quadrics[m_globals[i]];
+        m_locked[i] = patch->locked[m_globals[i]];
+    }
+
+    uint numTriangles = patch->triangles.size() / 3;
+    m_triangles.resize(3 * numTriangles);
+    m_removed.assign(numTriangles, 0);
+    m_live = numTriangles;
+    for (uint i = 0; i < 3 * numTriangles; i++) {
+        m_triangles[i] = lower_bound(m_globals.begin(), m_globals.end(), patch->triangles[i]) - m_globals.begin();
+        m_faces[m_triangles[i]].push_back(i / 3);
+    }
+}
+
+void EdgeCollapse::run() {
+    //find the edges of the patch, edges with other than two triangles lock their vertices
+    vector<unsigned long long> edges;
+    edges.reserve(m_triangles.size());
+    for (uint i = 0; i < m_triangles.size(); i += 3) {
+        for (uint j = 0; j < 3; j++) {
+            unsigned long long a = m_triangles[i + j], b = m_triangles[i + (j+1) % 3];
+            edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+        }
+    }
+    sort(edges.begin(), edges.end());
+
+    vector<unsigned long long> interior;
+    for (uint i = 0; i < edges.size();) {
+        uint j = i + 1;
+        while (j < edges.size() && edges[j] == edges[i]) j++;
+        if (j - i == 2) {
+            interior.push_back(edges[i]);
+        } else {
+            m_locked[edges[i] >> 32] = 1;
+            m_locked[edges[i] & 0xFFFFFFFF] = 1;
+        }
+        i = j;
+    }
+    for (uint i = 0; i < interior.size(); i++)
+        push(interior[i] >> 32, interior[i] & 0xFFFFFFFF);
+
+    m_patch->meanCost = 0;
+    while (m_live > m_patch->target && !m_queue.empty()) {
+        Collapse c = m_queue.top();
+        m_queue.pop();
+        if (c.versionU != m_versions[c.u] || c.versionV != m_versions[c.v]) continue;
+        if (!canCollapse(c)) continue;
+
+        collapse(c);
+        m_patch->meanCost = max(m_patch->meanCost, c.meanCost);
+
+        //the edges around the moved vertex have new costs
+        neighbours(c.v, m_first);
+        for (uint i = 0; i < m_first.size(); i++)
+            push(c.v, m_first[i]);
+    }
+
+    //write back the moved vertices and their quadrics, and the triangles that are left
+    for (uint i = 0; i < m_globals.size(); i++) {
+        if (m_patch->locked[m_globals[i]]) continue;
+        m_patch->positions[m_globals[i]] = m_positions[i];
+        m_patch->quadrics[m_globals[i]] = m_quadrics[i];
+    }
+
+    m_patch->triangles.clear();
+    for (uint i = 0; i < m_removed.size(); i++) {
+        if (m_removed[i]) continue;
+        for (uint j = 0; j < 3; j++)
+            m_patch->triangles.push_back(m_globals[m_triangles[3*i + j]]);
+    }
+}
+
+void EdgeCollapse::push(uint a, uint b) {
+    if (m_locked[a] && m_locked[b]) return;
+
+    //a locked vertex stays where it is, so the other one collapses into it
+    Collapse c;
+    c.u = m_locked[a] ? b : a;
+    c.v = m_locked[a] ? a : b;
+    c.versionU = m_versions[c.u];
+    c.versionV = m_versions[c.v];
+
+    Quadric quadric = m_quadrics[c.u];
+    quadric += m_quadrics[c.v];
+    const Vector3f &pu = m_positions[c.u];
+    const Vector3f &pv = m_positions[c.v];
+
+    if (m_locked[c.v]) {
+        c.target = pv;
+        c.cost = quadric.evaluate(pv);
+    } else {
+        //nearly parallel planes put the optimum far off, the endpoints and midpoint are safer then
+        Vector3f mid = (pu + pv) * 0.5f;
+        float reach = DECIMATE_MAX_REACH * (pu - pv).magnitude();
+        Vector3f optimum;
+        if (quadric.minimum(optimum) && (optimum - mid).magnitude() <= reach) {
+            c.target = optimum;
+            c.cost = quadric.evaluate(optimum);
+        } else {
+            Vector3f candidates[3] = {mid, pu, pv};
+            c.cost = -1;
+            for (uint i = 0; i < 3; i++) {
+                double cost = quadric.evaluate(candidates[i]);
+                if (c.cost < 0 || cost < c.cost) {
+                    c.cost = cost;
+                    c.target = candidates[i];
+                }
+            }
+        }
+    }
+
+    //rounding can make the cost slightly negative
+    c.cost = max(c.cost, 0.0);
+    c.meanCost = quadric.planes > 0 ? c.cost / quadric.planes : 0;
+    m_queue.push(c);
+}
+
+void EdgeCollapse::neighbours(uint v, vector<uint> &result) {
+    result.clear();
+    vector<uint> &faces = m_faces[v];
+    uint kept = 0;
+    for (uint i = 0; i < faces.size(); i++) {
+        if (m_removed[faces[i]]) continue;
+        faces[kept++] = faces[i];
+
+        const uint *t = &m_triangles[3 * faces[i]];
+        for (uint j = 0; j < 3; j++)
+            if (t[j] != v) result.push_back(t[j]);
+    }
+    faces.resize(kept);
+
+    sort(result.begin(), result.end());
+    result.erase(unique(result.begin(), result.end()), result.end());
+}
+
+bool EdgeCollapse::canCollapse(const Collapse &c) {
+    //the edge must be shared by exactly two triangles
+    uint shared = 0;
+    neighbours(c.u, m_first);
+    const vector<uint> &faces = m_faces[c.u];
+    for (uint i = 0; i < faces.size(); i++) {
+        const uint *t = &m_triangles[3 * faces[i]];
+        if (t[0] == c.v || t[1] == c.v || t[2] == c.v) shared++;
+    }
+    if (shared != 2) return false;
+
+    //the link condition: the vertices only share the two vertices opposite the edge
+    neighbours(c.v, m_second);
+    uint common = 0;
+    for (uint i = 0, j = 0; i < m_first.size() && j < m_second.size();) {
+        if (m_first[i] < m_second[j]) {
+            i++;
+        } else if (m_second[j] < m_first[i]) {
+            j++;
+        } else {
+            common++;
+            i++;
+            j++;
+        }
+    }
+    if (common != 2) return false;
+
+    //two vertices of three neighbours each are the last of a tetrahedron, which would fold flat
+    if (m_first.size() <= 3 && m_second.size() <= 3) return false;
+
+    //the triangles that stay must not turn over
+    for (uint i = 0; i < faces.size(); i++)
+        if (!keepsOrientation(faces[i], c.u, c.v, c.target)) return false;
+    if (!m_locked[c.v]) {
+        const vector<uint> &others = m_faces[c.v];
+        for (uint i = 0; i < others.size(); i++)
+            if (!keepsOrientation(others[i], c.v, c.u, c.target)) return false;
+    }
+    return true;
+}
+
+bool EdgeCollapse::keepsOrientation(uint triangle, uint from, uint other, const Vector3f &p) const {
+    const uint *t = &m_triangles[3 * triangle];
+    if (t[0] == other || t[1] == other || t[2] == other) return true;
+
+    Vector3f before[3], after[3];
+    for (uint j = 0; j < 3; j++) {
+        before[j] = m_positions[t[j]];
+        after[j] = t[j] == from ? p : before[j];
+    }
+
+    //triangles that were degenerate already cannot turn over
+    Vector3f n0 = (before[1] - before[0]).cross(before[2] - before[0]);
+    Vector3f n1 = (after[1] - after[0]).cross(after[2] - after[0]);
+    double m0 = n0.magnitude(), m1 = n1.magnitude();
+    if (m0 == 0) return true;
+
+    return m1 > 0 && n0.dot(n1) >= DECIMATE_MIN_TURN_COS * m0 * m1;
+}
+
+void EdgeCollapse::collapse(const Collapse &c) {
+    vector<uint> &faces = m_faces[c.u];
+    for (uint i = 0; i < faces.size(); i++) {
+        uint *t = &m_triangles[3 * faces[i]];
+        if (t[0] == c.v || t[1] == c.v || t[2] == c.v) {
+            m_removed[faces[i]] = 1;
+            m_live--;
+            continue;
+        }
+        for (uint j = 0; j < 3; j++)
+            if (t[j] == c.u) t[j] = c.v;
+        m_faces[c.v].push_back(faces[i]);
+    }
+    faces.clear();
+
+    m_positions[c.v] = c.target;
+    m_quadrics[c.v] += m_quadrics[c.u];
+    m_versions[c.u]++;
+    m_versions[c.v]++;
+}
+
+static void reducePatch(Patch *patch) {
+    EdgeCollapse(patch).run();
+}
+
+Decimator::Decimator() : m_error(0), m_numPartitions(0), m_numThreads(0) {
+}
+
+void Decimator::setNumThreads(int threads) {
+    m_numThreads = threads;
+}
+
+void Decimator::decimate(const Vector3f *positions, uint numPositions, const uint *triangles, uint numTriangles,
+                         uint targetTriangles)
+{
+    TRACE_SCOPE("Decimator::decimate");
+
+    vector<Vector3f> moved(positions, positions + numPositions);
+    vector<Quadric> quadrics(numPositions);
+    m_error = 0;
+    m_numPartitions = 0;
+
+    //every vertex starts with the planes of its triangles
+    for (uint i = 0; i < numTriangles; i++) {
+        const uint *t = triangles + 3*i;
+        Vector3f n = (positions[t[1]] - positions[t[0]]).cross(positions[t[2]] - positions[t[0]]);
+        double m = n.magnitude();
+        if (m == 0) continue;
+        double a = n[0] / m, b = n[1] / m, c = n[2] / m;
+        double d = -(a * positions[t[0]][0] + b * positions[t[0]][1] + c * positions[t[0]][2]);
+        for (uint j = 0; j < 3; j++)
+            quadrics[t[j]].addPlane(a, b, c, d);
+    }
+
+    //split into slabs of about equal counts along the longest axis of the centroids
+    int threads = m_numThreads > 0 ? m_numThreads : QThread::idealThreadCount();
+    uint chunks = max(1u, min((uint)max(threads, 1), numTriangles / DECIMATE_CHUNK_TRIANGLES));
+    if ((double)targetTriangles * DECIMATE_MAX_SLAB_REDUCTION < numTriangles) chunks = 1;
+    vector<Patch> patches(chunks);
+    vector<char> locked(numPositions, 0);
+    if (chunks > 1) {
+        Vector3f minPos = positions[triangles[0]], maxPos = minPos;
+        for (uint i = 0; i < 3 * numTriangles; i++) {
+            const Vector3f &p = positions[triangles[i]];
+            for (uint k = 0; k < 3; k++) {
+                minPos[k] = min(minPos[k], p[k]);
+                maxPos[k] = max(maxPos[k], p[k]);
+            }
+        }
+        uint axis = 0;
+        for (uint k = 1; k < 3; k++)
+            if (maxPos[k] - minPos[k] > maxPos[axis] - minPos[axis]) axis = k;
+
+        vector<pair<float, uint> > order(numTriangles);
+        for (uint i = 0; i < numTriangles; i++) {
+            const uint *t = triangles + 3*i;
+            order[i] = make_pair(positions[t[0]][axis] + positions[t[1]][axis] + positions[t[2]][axis], i);
+        }
+        sort(order.begin(), order.end());
+
+        //vertices used by more than one slab are locked in all of them
+        const uint NO_SLAB = 0xFFFFFFFF;
+        vector<uint> slabOf(numPositions, NO_SLAB);
+        uint chunkSize = (numTriangles + chunks - 1) / chunks;
+        for (uint c = 0; c < chunks; c++) {
+            uint begin = c * chunkSize, end = min(numTriangles, begin + chunkSize);
+            Patch &patch = patches[c];
+            patch.triangles.reserve(3 * (end - begin));
+            for (uint i = begin; i < end; i++) {
+                const uint *t = triangles + 3 * order[i].second;
+                for (uint j = 0; j < 3; j++) {
+                    patch.triangles.push_back(t[j]);
+                    if (slabOf[t[j]] == NO_SLAB) slabOf[t[j]] = c;
+                    else if (slabOf[t[j]] != c) locked[t[j]] = 1;
+                }
+            }
+            patch.target = (uint)((double)DECIMATE_SLAB_HEADROOM * targetTriangles * (end - begin) / numTriangles);
+        }
+
+        vector<QFuture<void> > futures;
+        for (uint c = 0; c < chunks; c++) {
+            Patch &patch = patches[c];
+            patch.locked = &locked[0];
+            patch.positions = &moved[0];
+            patch.quadrics = &quadrics[0];
+            if (c + 1 < chunks)
+                futures.push_back(QtConcurrent::run(reducePatch, &patch));
+            else
+                reducePatch(&patch);
+        }
+        for (uint i = 0; i < futures.size(); i++) futures[i].waitForFinished();
+        m_numPartitions = chunks;
+    }
+
+    //reduce the seams with the rest, or everything if there were no slabs
+    Patch whole;
+    if (chunks > 1) {
+        double meanCost = 0;
+        for (uint c = 0; c < chunks; c++) {
+            whole.triangles.insert(whole.triangles.end(), patches[c].triangles.begin(), patches[c].triangles.end());
+            meanCost = max(meanCost, patches[c].meanCost);
+            vector<uint>().swap(patches[c].triangles);
+        }
+        m_error = sqrt(meanCost);
+    } else {
+        whole.triangles.assign(triangles, triangles + 3 * numTriangles);
+    }
+    locked.assign(numPositions, 0);
+    whole.locked = numPositions > 0 ? &locked[0] : 0;
+    whole.positions = numPositions > 0 ? &moved[0] : 0;
+    whole.quadrics = numPositions > 0 ? &quadrics[0] : 0;
+    whole.target = targetTriangles;
+    whole.meanCost = 0;
+    if (whole.triangles.size() / 3 > targetTriangles)
+        reducePatch(&whole);
+    m_error = max(m_error, (float)sqrt(whole.meanCost));
+
+    //keep the vertices that are still used, in their original order
+    const uint UNUSED = 0xFFFFFFFF;
+    vector<uint> index(numPositions, UNUSED);
+    for (uint i = 0; i < whole.triangles.size(); i++)
+        index[whole.triangles[i]] = 0;
+    m_positions.clear();
+    for (uint i = 0; i < numPositions; i++) {
+        if (index[i] == UNUSED) continue;
+        index[i] = m_positions.size();
+        m_positions.push_back(moved[i]);
+    }
+
+    m_triangles.resize(whole.triangles.size());
+    for (uint i = 0; i < whole.triangles.size(); i++)
+        m_triangles[i] = index[whole.triangles[i]];
+}
+
+const vector<Vector3f> &Decimator::getPositions() const { return m_positions; }
+const vector<uint> &Decimator::getTriangles() const { return m_triangles; }
+uint Decimator::getNumTriangles() const { return m_triangles.size() / 3; }
+float Decimator::getError() const { return m_error; }
+uint Decimator::getNumPartitions() const { return m_numPartitions; }
@@ -0,0 +1,53 @@
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <vector>
+
+#include "vector.h"
+
+using namespace std;
+
+/* Reduces a triangle mesh by collapsing edges in the order of their quadric
+   error. Every vertex keeps the sum of the squared distances to the planes of
+   the input triangles around it, and an edge collapses to the point closest
+   to the planes of both of its vertices. Collapses that would make the
+   surface non-manifold or turn a triangle over are skipped, and vertices on
+   open boundaries never move.
+
+   The triangles are split into slabs along the longest axis of their bounds,
+   which are reduced in parallel with the vertices they share locked. The
+   seams are reduced with the rest in a final pass over the whole mesh, which
+   continues from the quadrics of the slabs. Reductions by large factors are
+   made in the final pass alone, since the seams would hold most of what is
+   left; chains of levels are best built by reducing each from the last.*/
+class Decimator {
+public:
+    Decimator();
+
+    //sets the number of threads, 0 uses one per core
+    void setNumThreads(int threads);
+
+    //reduces triangles of 3 vertex indices each to at most targetTriangles, or as few as the surface allows
+    void decimate(const Vector3f *positions, uint numPositions, const uint *triangles, uint numTriangles,
+                  uint targetTriangles);
+
+    //returns the positions of the vertices that are left and the triangles indexing them
+    const vector<Vector3f> &getPositions() const;
+    const vector<uint> &getTriangles() const;
+    uint getNumTriangles() const;
+
+    //returns the largest root mean square distance of a vertex left from the planes of the input triangles it replaced
+    float getError() const;
+
+    //returns the number of slabs reduced in parallel by the last decimation
+    uint getNumPartitions() const;
+
+private:
+    vector<Vector3f> m_positions;
+    vector<uint> m_triangles;
+    float m_error;
+    uint m_numPartitions;
+    int m_numThreads;
+};
+
+#endif // DECIMATOR_H
@@ -0,0 +1,411 @@
+#include "delaunay.h"
+
+#include <QThread>
+#include <QtConcurrentRun>
+#include <QFuture>
+
+#include <algorithm>
+
+#include "trace.h"
+
+#define NO_TRIANGLE 0xFFFFFFFF
+#define HILBERT_ORDER 16        //bits per coordinate of the Hilbert curve grid
+#define SUPER_TRIANGLE_SCALE 1E4f
+
+//sort key of a point, the insertion round in the high bits and the Hilbert index in the low bits
+struct PointKey {
+    EdgeKey key;
+    uint index;
+
+    bool operator<(const PointKey &k) const { return key < k.key; }
+};
+
+//returns the distance along the Hilbert curve of cell (x,y) in a 2^HILBERT_ORDER grid
+static uint hilbertIndex(uint x, uint y) {
+    uint d = 0;
+    for (uint s = 1 << (HILBERT_ORDER - 1); s > 0; s >>= 1) {
+        uint rx = (x & s) > 0;
+        uint ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        //rotate the quadrant
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            uint t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+//returns a pseudo-random number for point i, so the rounds do not depend on the thread count
+static uint randomOf(uint i) {
+    i ^= i >> 16;
+    i *= 0x7feb352d;
+    i ^= i >> 15;
+    i *= 0x846ca68b;
+    i ^= i >> 16;
+    return i;
+}
+
+//a chunk of points whose sort keys are computed by one thread
+struct KeyChunk {
+    const Vector2f *points;
+    PointKey *keys;
+    uint begin, end;
+    uint numPoints;
+    Vector2f minPos;
+    float scale;    //from distance to Hilbert grid cells
+};
+
+//computes the sort keys of points [begin, end) of a chunk
+static void computeKeys(KeyChunk chunk) {
+    const Vector2f *points = chunk.points;
+    PointKey *keys = chunk.keys;
+    uint numPoints = chunk.numPoints;
+    const Vector2f &minPos = chunk.minPos;
+    float scale = chunk.scale;
+
+    for (uint i = chunk.begin; i < chunk.end; i++) {
+        //biased randomized insertion order: each point ends up in the last round
+        //with probability 1/2, the one before with 1/4, and so on
+        uint round = 0;
+        uint r = randomOf(i);
+        while ((r & 1) == 0 && (2u << round) < numPoints && round < 31) {
+            round++;
+            r >>= 1;
+        }
+
+        uint x = (uint)((points[i][0] - minPos[0]) * scale);
+        uint y = (uint)((points[i][1] - minPos[1]) * scale);
+        keys[i].key = ((EdgeKey)(31 - round) << 32) | hilbertIndex(x, y);
+        keys[i].index = i;
+    }
+}
+
+static void sortKeys(PointKey *begin, PointKey *end) {
+    sort(begin, end);
+}
+
+Delaunay::Delaunay()
+    : m_numInput(0), m_last(0), m_stamp(0), m_numDuplicates(0), m_numThreads(0)
+{
+}
+
+void Delaunay::setNumThreads(int threads) {
+    m_numThreads = threads;
+}
+
+void Delaunay::sortPoints(const vector<Vector2f> &points, const Vector2f &minPos, const Vector2f &maxPos,
+                          vector<uint> &order) const
+{
+    TRACE_SCOPE("Delaunay::sortPoints");
+
+    uint n = points.size();
+    float size = max(maxPos[0] - minPos[0], maxPos[1] - minPos[1]);
+    float scale = size > 0 ? ((1 << HILBERT_ORDER) - 1) / size : 0;
+
+    //split the points into one chunk per thread, unless there are too few to be worth it
+    int threads = m_numThreads > 0 ? m_numThreads : QThread::idealThreadCount();
+    uint chunks = max(1u, min((uint)max(threads, 1), n / 65536));
+    uint chunkSize = (n + chunks - 1) / chunks;
+
+    //compute the keys and sort each chunk in parallel
+    vector<PointKey> keys(n);
+    vector<QFuture<void> > futures;
+    for (uint c = 0; c < chunks; c++) {
+        KeyChunk chunk;
+        chunk.points = &points[0];
+        chunk.keys = &keys[0];
+        chunk.begin = c * chunkSize;
+        chunk.end = min(n, chunk.begin + chunkSize);
+        chunk.numPoints = n;
+        chunk.minPos = minPos;
+        chunk.scale = scale;
+
+        if (c + 1 < chunks)
+            futures.push_back(QtConcurrent::run(computeKeys, chunk));
+        else
+            computeKeys(chunk);
+    }
+    for (uint i = 0; i < futures.size(); i++) futures[i].waitForFinished();
+
+    futures.clear();
+    for (uint c = 0; c < chunks; c++) {
+        PointKey *begin = &keys[0] + c * chunkSize;
+        PointKey *end = &keys[0] + min(n, (c + 1) * chunkSize);
+        if (c + 1 < chunks)
+            futures.push_back(QtConcurrent::run(sortKeys, begin, end));
+        else
+            sortKeys(begin, end);
+    }
+    for (uint i = 0; i < futures.size(); i++) futures[i].waitForFinished();
+
+    //merge the sorted chunks pairwise
+    for (uint width = chunkSize; width < n; width *= 2) {
+        for (uint begin = 0; begin + width < n; begin += 2 * width) {
+            PointKey *first = &keys[0] + begin;
+            inplace_merge(first, first + width, first + min(2 * width, n - begin));
+        }
+    }
+
+    order.resize(n);
+    for (uint i = 0; i < n; i++) order[i] = keys[i].index;
+}
+
+bool Delaunay::triangulate(const vector<Vector2f> &points) {
+    TRACE_SCOPE("Delaunay::triangulate");
+
+    m_numInput = points.size();
+    m_points.clear();
+    m_order.clear();
+    m_triangles.clear();
+    m_freeTriangles.clear();
+    m_visited.clear();
+    m_result.clear();
+    m_numDuplicates = 0;
+    m_stamp = 0;
+    if (m_numInput < 3) return false;
+
+    Vector2f minPos = points[0], maxPos = points[0];
+    for (uint i = 1; i < m_numInput; i++) {
+        for (uint j = 0; j < 2; j++) {
+            minPos[j] = min(minPos[j], points[i][j]);
+            maxPos[j] = max(maxPos[j], points[i][j]);
+        }
+    }
+
+    //store the points in insertion order, so the points of neighbouring triangles are close in memory
+    sortPoints(points, minPos, maxPos, m_order);
+    m_points.resize(m_numInput);
+    for (uint i = 0; i < m_numInput; i++)
+        m_points[i] = points[m_order[i]];
+
+    //enclose all points in a super triangle much larger than their bounding box
+    Vector2f center = (minPos + maxPos) / 2.0f;
+    float size = max(max(maxPos[0] - minPos[0], maxPos[1] - minPos[1]), 1.0f) * SUPER_TRIANGLE_SCALE;
+
+    uint s = m_numInput;
+    m_points.push_back(Vector2f(center[0] - size, center[1] - size));
+    m_points.push_back(Vector2f(center[0] + size, center[1] - size));
+    m_points.push_back(Vector2f(center[0], center[1] + size));
+
+    m_triangles.reserve(2 * m_numInput + 1);
+    m_visited.reserve(2 * m_numInput + 1);
+    m_last = newTriangle(s, s + 1, s + 2);
+    for (uint i = 0; i < 3; i++) m_triangles[m_last].n[i] = NO_TRIANGLE;
+
+    {
+        TRACE_SCOPE("Delaunay::insert");
+        for (uint i = 0; i < m_numInput; i++) {
+            if (!insert(i))
+                m_numDuplicates++;
+        }
+    }
+
+    collectTriangles();
+    TRACE_COUNTER("delaunay triangles", getNumTriangles());
+    return !m_result.empty();
+}
+
+uint Delaunay::newTriangle(uint a, uint b, uint c) {
+    uint t;
+    if (!m_freeTriangles.empty()) {
+        t = m_freeTriangles.back();
+        m_freeTriangles.pop_back();
+    } else {
+        t = m_triangles.size();
+        m_triangles.push_back(Triangle());
+        m_visited.push_back(0);
+    }
+
+    Triangle &T = m_triangles[t];
+    T.v[0] = a;
+    T.v[1] = b;
+    T.v[2] = c;
+    return t;
+}
+
+uint Delaunay::locate(uint p) const {
+    const Vector2f &P = m_points[p];
+    uint t = m_last;
+
+    //step across any edge that has p on its outer side; this walk
+    //always terminates in a Delaunay triangulation
+    for (;;) {
+        const Triangle &T = m_triangles[t];
+        uint next = NO_TRIANGLE;
+        for (uint i = 0; i < 3; i++) {
+            const Vector2f &a = m_points[T.v[(i + 1) % 3]];
+            const Vector2f &b = m_points[T.v[(i + 2) % 3]];
+            if (orient2d(a, b, P) < 0) {
+                next = T.n[i];
+                break;
+            }
+        }
+
+        if (next == NO_TRIANGLE) return t;
+        t = next;
+    }
+}
+
+bool Delaunay::insert(uint p) {
+    const Vector2f &P = m_points[p];
+    uint start = locate(p);
+    m_stamp++;
+
+    //the triangle containing p is in the cavity unless p is one of its vertices
+    const Triangle &S = m_triangles[start];
+    if (incircle(m_points[S.v[0]], m_points[S.v[1]], m_points[S.v[2]], P) <= 0)
+        return false;
+
+    //find the cavity of all triangles whose circumcircle contains p by searching from the start
+    m_cavity.clear();
+    m_boundary.clear();
+    m_stack.clear();
+    m_stack.push_back(start);
+    m_visited[start] = m_stamp;
+
+    while (!m_stack.empty()) {
+        uint t = m_stack.back();
+        m_stack.pop_back();
+        m_cavity.push_back(t);
+
+        const Triangle &T = m_triangles[t];
+        for (uint i = 0; i < 3; i++) {
+            uint n = T.n[i];
+            bool inside = false;
+            if (n != NO_TRIANGLE) {
+                if (m_visited[n] == m_stamp) continue;
+
+                const Triangle &N = m_triangles[n];
+                inside = incircle(m_points[N.v[0]], m_points[N.v[1]], m_points[N.v[2]], P) > 0;
+                if (inside) {
+                    m_visited[n] = m_stamp;
+                    m_stack.push_back(n);
+                }
+            }
+
+            //edges to triangles outside the cavity are its boundary
+            if (!inside) {
+                Triangle edge;
+                edge.v[0] = T.v[(i + 1) % 3];
+                edge.v[1] = T.v[(i + 2) % 3];
+                edge.n[0] = n;
+                m_boundary.push_back(edge);
+            }
+        }
+    }
+
+    //replace the cavity by a fan of triangles from p to each boundary edge
+    for (uint i = 0; i < m_cavity.size(); i++)
+        m_freeTriangles.push_back(m_cavity[i]);
+
+    m_created.resize(m_boundary.size());
+    for (uint i = 0; i < m_boundary.size(); i++) {
+        const Triangle &edge = m_boundary[i];
+        uint t = newTriangle(edge.v[0], edge.v[1], p);
+        m_created[i] = t;
+
+        //link the outer neighbour across the boundary edge
+        uint n = edge.n[0];
+        m_triangles[t].n[2] = n;
+        if (n != NO_TRIANGLE) {
+            Triangle &N = m_triangles[n];
+            for (uint j = 0; j < 3; j++) {
+                if (N.v[j] != edge.v[0] && N.v[j] != edge.v[1]) {
+                    N.n[j] = t;
+                    break;
+                }
+            }
+        }
+    }
+
+    //link the fan triangles to each other: the boundary is a closed loop, so the
+    //triangle on edge (a,b) neighbours the one starting at b and the one ending at a
+    for (uint i = 0; i < m_created.size(); i++) {
+        Triangle &T = m_triangles[m_created[i]];
+        for (uint j = 0; j < m_created.size(); j++) {
+            const Triangle &U = m_triangles[m_created[j]];
+            if (U.v[0] == T.v[1]) T.n[0] = m_created[j];
+            if (U.v[1] == T.v[0]) T.n[1] = m_created[j];
+        }
+    }
+
+    m_last = m_created[0];
+    return true;
+}
+
+void Delaunay::collectTriangles() {
+    //mark the deleted triangles
+    vector<bool> deleted(m_triangles.size(), false);
+    for (uint i = 0; i < m_freeTriangles.size(); i++)
+        deleted[m_freeTriangles[i]] = true;
+
+    m_result.clear();
+    for (uint t = 0; t < m_triangles.size(); t++) {
+        const Triangle &T = m_triangles[t];
+        if (deleted[t] || T.v[0] >= m_numInput || T.v[1] >= m_numInput || T.v[2] >= m_numInput)
+            continue;
+
+        for (uint i = 0; i < 3; i++)
+            m_result.push_back(m_order[T.v[i]]);
+    }
+}
+
+const vector<uint> &Delaunay::getTriangles() const {
+    return m_result;
+}
+
+uint Delaunay::getNumTriangles() const {
+    return m_result.size() / 3;
+}
+
+uint Delaunay::getNumDuplicates() const {
+    return m_numDuplicates;
+}
+
+vector<EdgeKey> Delaunay::getEdges() const {
+    vector<EdgeKey> edges;
+    edges.reserve(m_result.size());
+    for (uint i = 0; i < m_result.size(); i += 3)
+        for (uint j = 0; j < 3; j++)
+            edges.push_back(::hash(m_result[i + j], m_result[i + (j + 1) % 3]));
+
+    //interior edges are shared by two triangles
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    return edges;
+}
+
+bool Delaunay::isDelaunay() const {
+    vector<bool> deleted(m_triangles.size(), false);
+    for (uint i = 0; i < m_freeTriangles.size(); i++)
+        deleted[m_freeTriangles[i]] = true;
+
+    for (uint t = 0; t < m_triangles.size(); t++) {
+        if (deleted[t]) continue;
+        const Triangle &T = m_triangles[t];
+
+        //every triangle must be counter-clockwise and not contain the opposite vertex of any neighbour
+        const Vector2f &a = m_points[T.v[0]], &b = m_points[T.v[1]], &c = m_points[T.v[2]];
+        if (orient2d(a, b, c) <= 0) return false;
+
+        for (uint i = 0; i < 3; i++) {
+            uint n = T.n[i];
+            if (n == NO_TRIANGLE) continue;
+
+            const Triangle &N = m_triangles[n];
+            for (uint j = 0; j < 3; j++) {
+                if (N.n[j] != t) continue;
+                if (incircle(a, b, c, m_points[N.v[j]]) > 0) return false;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,85 @@
+#ifndef DELAUNAY_H
+#define DELAUNAY_H
+
+#include <vector>
+
+#include "pointutils.h"
+
+using namespace std;
+
+/* Delaunay triangulation of a set of points in the plane by Bowyer-Watson
+   insertion. Points are inserted in biased randomized rounds, each sorted
+   along a Hilbert curve, so every point is found by a short walk from the last
+   one. Sorting is split across threads. All orientation and circle tests use
+   the robust predicates, so the result does not depend on rounding.
+
+   The points are enclosed in a large super triangle that is removed at the end;
+   triangles of hull points that are almost colinear with their hull neighbours
+   can be lost with it, so the hull of the result may be slightly non-convex.*/
+class Delaunay {
+public:
+    Delaunay();
+
+    //sets the number of threads used to sort the points, 0 uses one per core
+    void setNumThreads(int threads);
+
+    //triangulates the points, returns false if they do not span a triangle
+    //duplicate points are skipped
+    bool triangulate(const vector<Vector2f> &points);
+
+    //returns the indices of the counter-clockwise triangles, 3 per triangle
+    const vector<uint> &getTriangles() const;
+    uint getNumTriangles() const;
+
+    //returns the key of each edge of the triangulation once
+    vector<EdgeKey> getEdges() const;
+
+    //returns the number of points that were skipped as duplicates
+    uint getNumDuplicates() const;
+
+    //returns true if no triangle has a vertex of a neighbour inside its circumcircle
+    bool isDelaunay() const;
+
+private:
+    struct Triangle {
+        uint v[3];  //counter-clockwise vertices
+        uint n[3];  //neighbour opposite of each vertex
+    };
+
+    //orders the points within their bounding box for insertion
+    void sortPoints(const vector<Vector2f> &points, const Vector2f &minPos, const Vector2f &maxPos,
+                    vector<uint> &order) const;
+
+    //inserts point p, returns false if it is a duplicate
+    bool insert(uint p);
+
+    //returns a triangle containing point p by walking from the last created triangle
+    uint locate(uint p) const;
+
+    //returns the index of a new or reused triangle
+    uint newTriangle(uint a, uint b, uint c);
+
+    //copies the triangles without super triangle vertices into m_result
+    void collectTriangles();
+
+    vector<Vector2f> m_points;      //points in insertion order followed by the super triangle
+    vector<uint> m_order;           //input index of each point
+    vector<Triangle> m_triangles;
+    vector<uint> m_freeTriangles;   //indices of deleted triangles that can be reused
+    vector<uint> m_visited;         //insertion number of the last visit to each triangle
+    vector<uint> m_result;
+
+    uint m_numInput;
+    uint m_last;
+    uint m_stamp;
+    uint m_numDuplicates;
+    int m_numThreads;
+
+    //scratch lists of the cavity of the point being inserted
+    vector<uint> m_cavity;
+    vector<uint> m_stack;
+    vector<Triangle> m_boundary;
+    vector<uint> m_created;
+};
+
+#endif // DELAUNAY_H
@@ -1,8 +1,98 @@
 #include "glutils.h"
 #include "vector.h"
+#include <string.h>
 
 #define PARAMETER_STEP 1E-2
 
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+typedef void (APIENTRY *DrawArraysInstancedProc)(GLenum mode, GLint first, GLsizei count, GLsizei instances);
+typedef void (APIENTRY *DrawElementsInstancedProc)(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances);
+typedef void (APIENTRY *VertexAttribDivisorProc)(GLuint index, GLuint divisor);
+typedef void (APIENTRY *VertexAttribPointerProc)(GLuint index, GLint size, GLenum type, GLboolean normalized,
+                                                 GLsizei stride, const void *pointer);
+typedef void (APIENTRY *AttribArrayProc)(GLuint index);
+
+//instanced drawing and attribute array entry points resolved by glInitInstancing
+static DrawArraysInstancedProc drawArraysInstanced = 0;
+static DrawElementsInstancedProc drawElementsInstanced = 0;
+static VertexAttribDivisorProc vertexAttribDivisor = 0;
+static VertexAttribPointerProc vertexAttribPointer = 0;
+static AttribArrayProc enableVertexAttribArray = 0;
+static AttribArrayProc disableVertexAttribArray = 0;
+
+#define MAP_WRITE_BIT 0x0002
+#define MAP_INVALIDATE_RANGE_BIT 0x0004
+#define MAP_INVALIDATE_BUFFER_BIT 0x0008
+#define MAP_UNSYNCHRONIZED_BIT 0x0020
+#define COPY_READ_BUFFER 0x8F36
+#define COPY_WRITE_BUFFER 0x8F37
+#define WRITE_ONLY 0x88B9
+
+#define TEXTURE0 0x84C0
+
+typedef void (APIENTRY *ActiveTextureProc)(GLenum texture);
+
+//texture unit entry point resolved by glInitFloatTextures
+static ActiveTextureProc activeTexture = 0;
+
+#define PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define PROGRAM_BINARY_LENGTH 0x8741
+#define NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define LINK_STATUS 0x8B82
+
+typedef void (APIENTRY *GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *format, void *binary);
+typedef void (APIENTRY *ProgramBinaryProc)(GLuint program, GLenum format, const void *binary, GLsizei length);
+typedef void (APIENTRY *ProgramParameteriProc)(GLuint program, GLenum name, GLint value);
+typedef void (APIENTRY *GetProgramivProc)(GLuint program, GLenum name, GLint *value);
+
+//program binary entry points resolved by glInitProgramBinaries, they have no ARB suffix
+static GetProgramBinaryProc getProgramBinary = 0;
+static ProgramBinaryProc programBinary = 0;
+static ProgramParameteriProc programParameteri = 0;
+static GetProgramivProc getProgramiv = 0;
+
+//fences of ARB_sync are opaque pointers
+#define SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define ALREADY_SIGNALED 0x911A
+#define CONDITION_SATISFIED 0x911C
+#define WAIT_FAILED 0x911D
+#define SYNC_FLUSH_COMMANDS_BIT 0x0001
+
+typedef void (APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+typedef void *(APIENTRY *MapBufferRangeProc)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef void *(APIENTRY *MapBufferProc)(GLenum target, GLenum access);
+typedef GLboolean (APIENTRY *UnmapBufferProc)(GLenum target);
+typedef void (APIENTRY *CopyBufferSubDataProc)(GLenum readTarget, GLenum writeTarget, GLintptr readOffset,
+                                               GLintptr writeOffset, GLsizeiptr size);
+typedef void *(APIENTRY *FenceSyncProc)(GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRY *ClientWaitSyncProc)(void *sync, GLbitfield flags, unsigned long long timeout);
+typedef void (APIENTRY *DeleteSyncProc)(void *sync);
+
+//buffer object and fence entry points resolved by glInitBufferObjects
+static BindBufferProc bindBuffer = 0;
+static MapBufferRangeProc mapBufferRange = 0;
+static MapBufferProc mapBuffer = 0;
+static UnmapBufferProc unmapBuffer = 0;
+static CopyBufferSubDataProc copyBufferSubData = 0;
+static FenceSyncProc fenceSync = 0;
+static ClientWaitSyncProc clientWaitSync = 0;
+static DeleteSyncProc deleteSync = 0;
+
+#define FRAMEBUFFER 0x8D40
+#define READ_FRAMEBUFFER 0x8CA8
+#define DRAW_FRAMEBUFFER_BINDING 0x8CA6
+
+typedef void (APIENTRY *BindFramebufferProc)(GLenum target, GLuint framebuffer);
+typedef void (APIENTRY *BlitFramebufferProc)(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0,
+                                             GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter);
+
+//framebuffer entry points resolved by glInitFramebufferBlit
+static BindFramebufferProc bindFramebuffer = 0;
+static BlitFramebufferProc blitFramebuffer = 0;
+
 static void drawCircle(float x, float y, float r, GLuint glMode) {
     //translate to x,y
     glPushMatrix();
@@ -58,3 +148,222 @@ GLuint glCircleList(float r) {
 
     return listIndex;
 }
+
+void glLoadMatrix(const Matrix4f &m) {
+    //OpenGL expects the elements in column-major order
+    glLoadMatrixf(m.transpose().ptr());
+}
+
+//returns the address of the core function, or of its ARB extension if the core one is missing
+static void *resolve(const QGLContext *context, const char *name) {
+    void *proc = context->getProcAddress(name);
+    if (!proc) proc = context->getProcAddress(QString(name) + "ARB");
+    return proc;
+}
+
+bool glInitInstancing() {
+    const QGLContext *context = QGLContext::currentContext();
+    if (!context) return false;
+
+    drawArraysInstanced = (DrawArraysInstancedProc)resolve(context, "glDrawArraysInstanced");
+    drawElementsInstanced = (DrawElementsInstancedProc)resolve(context, "glDrawElementsInstanced");
+    vertexAttribDivisor = (VertexAttribDivisorProc)resolve(context, "glVertexAttribDivisor");
+    vertexAttribPointer = (VertexAttribPointerProc)resolve(context, "glVertexAttribPointer");
+    enableVertexAttribArray = (AttribArrayProc)resolve(context, "glEnableVertexAttribArray");
+    disableVertexAttribArray = (AttribArrayProc)resolve(context, "glDisableVertexAttribArray");
+    return drawArraysInstanced && drawElementsInstanced && vertexAttribDivisor
+           && vertexAttribPointer && enableVertexAttribArray && disableVertexAttribArray;
+}
+
+void glDrawInstances(GLenum mode, GLint first, GLsizei count, GLsizei instances) {
+    drawArraysInstanced(mode, first, count, instances);
+}
+
+void glDrawIndexedInstances(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances) {
+    drawElementsInstanced(mode, count, type, indices, instances);
+}
+
+void glAttribDivisor(GLuint index, GLuint divisor) {
+    vertexAttribDivisor(index, divisor);
+}
+
+void glAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer) {
+    vertexAttribPointer(index, size, type, normalized, stride, pointer);
+}
+
+void glEnableAttribArray(GLuint index) {
+    enableVertexAttribArray(index);
+}
+
+void glDisableAttribArray(GLuint index) {
+    disableVertexAttribArray(index);
+}
+
+bool glInitBufferObjects() {
+    const QGLContext *context = QGLContext::currentContext();
+    if (!context) return false;
+
+    bindBuffer = (BindBufferProc)resolve(context, "glBindBuffer");
+    mapBufferRange = (MapBufferRangeProc)context->getProcAddress("glMapBufferRange");
+    mapBuffer = (MapBufferProc)resolve(context, "glMapBuffer");
+    unmapBuffer = (UnmapBufferProc)resolve(context, "glUnmapBuffer");
+    copyBufferSubData = (CopyBufferSubDataProc)context->getProcAddress("glCopyBufferSubData");
+
+    //fences have no ARB suffix, ARB_sync was promoted to core unchanged
+    fenceSync = (FenceSyncProc)context->getProcAddress("glFenceSync");
+    clientWaitSync = (ClientWaitSyncProc)context->getProcAddress("glClientWaitSync");
+    deleteSync = (DeleteSyncProc)context->getProcAddress("glDeleteSync");
+    return bindBuffer != 0;
+}
+
+bool glHasFences() {
+    return fenceSync && clientWaitSync && deleteSync;
+}
+
+void glBindArrayBuffer(GLuint buffer) {
+    bindBuffer(GL_ARRAY_BUFFER, buffer);
+}
+
+void glBindElementBuffer(GLuint buffer) {
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+}
+
+void *glMapWriteBuffer(GLenum target, GLsizeiptr size) {
+    //a range mapped with invalidation never waits for the GPU to finish with the old contents
+    if (mapBufferRange && unmapBuffer)
+        return mapBufferRange(target, 0, size, MAP_WRITE_BIT | MAP_INVALIDATE_BUFFER_BIT);
+    if (mapBuffer && unmapBuffer)
+        return mapBuffer(target, WRITE_ONLY);
+    return 0;
+}
+
+bool glUnmapWriteBuffer(GLenum target) {
+    return unmapBuffer(target) == GL_TRUE;
+}
+
+bool glHasBufferCopies() {
+    //ARB_copy_buffer has no suffix either
+    return copyBufferSubData && mapBufferRange && unmapBuffer;
+}
+
+void *glMapUnsynchronizedBuffer(GLenum target, GLintptr offset, GLsizeiptr size) {
+    return mapBufferRange(target, offset, size, MAP_WRITE_BIT | MAP_INVALIDATE_RANGE_BIT | MAP_UNSYNCHRONIZED_BIT);
+}
+
+void glCopyBufferData(GLuint source, GLintptr sourceOffset, GLuint target, GLintptr targetOffset, GLsizeiptr size) {
+    //the copy targets leave the array and element array bindings alone
+    bindBuffer(COPY_READ_BUFFER, source);
+    bindBuffer(COPY_WRITE_BUFFER, target);
+    copyBufferSubData(COPY_READ_BUFFER, COPY_WRITE_BUFFER, sourceOffset, targetOffset, size);
+    bindBuffer(COPY_READ_BUFFER, 0);
+    bindBuffer(COPY_WRITE_BUFFER, 0);
+}
+
+bool glInitFloatTextures() {
+    const QGLContext *context = QGLContext::currentContext();
+    if (!context) return false;
+
+    activeTexture = (ActiveTextureProc)resolve(context, "glActiveTexture");
+    if (!activeTexture) return false;
+
+    //float textures are core since OpenGL 3.0
+    const char *version = (const char*)glGetString(GL_VERSION);
+    const char *extensions = (const char*)glGetString(GL_EXTENSIONS);
+    return (version && version[0] >= '3') || (extensions && strstr(extensions, "GL_ARB_texture_float"));
+}
+
+void glSelectTextureUnit(GLuint unit) {
+    activeTexture(TEXTURE0 + unit);
+}
+
+bool glInitProgramBinaries() {
+    const QGLContext *context = QGLContext::currentContext();
+    if (!context) return false;
+
+    getProgramBinary = (GetProgramBinaryProc)context->getProcAddress("glGetProgramBinary");
+    programBinary = (ProgramBinaryProc)context->getProcAddress("glProgramBinary");
+    programParameteri = (ProgramParameteriProc)context->getProcAddress("glProgramParameteri");
+    getProgramiv = (GetProgramivProc)context->getProcAddress("glGetProgramiv");
+    if (!getProgramBinary || !programBinary || !programParameteri || !getProgramiv) return false;
+
+    //some drivers expose the entry points but cannot save any binary
+    GLint formats = 0;
+    glGetIntegerv(NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+void glRetrievableProgram(GLuint program) {
+    programParameteri(program, PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool glGetProgramBinaryData(GLuint program, QByteArray &binary, GLenum &format) {
+    GLint length = 0;
+    getProgramiv(program, PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return false;
+
+    binary.resize(length);
+    GLsizei written = 0;
+    getProgramBinary(program, length, &written, &format, binary.data());
+    binary.resize(written);
+    return written > 0;
+}
+
+bool glLoadProgramBinary(GLuint program, const QByteArray &binary, GLenum format) {
+    programBinary(program, format, binary.constData(), binary.size());
+    GLint linked = 0;
+    getProgramiv(program, LINK_STATUS, &linked);
+    return linked != 0;
+}
+
+bool glInitFramebufferBlit() {
+    const QGLContext *context = QGLContext::currentContext();
+    if (!context) return false;
+
+    //the entry points of the extension only differ by their suffix
+    bindFramebuffer = (BindFramebufferProc)context->getProcAddress("glBindFramebuffer");
+    blitFramebuffer = (BlitFramebufferProc)context->getProcAddress("glBlitFramebuffer");
+    if (!bindFramebuffer || !blitFramebuffer) {
+        bindFramebuffer = (BindFramebufferProc)context->getProcAddress("glBindFramebufferEXT");
+        blitFramebuffer = (BlitFramebufferProc)context->getProcAddress("glBlitFramebufferEXT");
+    }
+    return bindFramebuffer && blitFramebuffer;
+}
+
+GLuint glDrawFramebuffer() {
+    GLint framebuffer = 0;
+    glGetIntegerv(DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    return framebuffer;
+}
+
+void glBindDrawFramebuffer(GLuint framebuffer) {
+    bindFramebuffer(FRAMEBUFFER, framebuffer);
+}
+
+void glBlitScaled(GLuint source, GLsizei sourceWidth, GLsizei sourceHeight, GLsizei width, GLsizei height) {
+    GLuint target = glDrawFramebuffer();
+    bindFramebuffer(READ_FRAMEBUFFER, source);
+    blitFramebuffer(0, 0, sourceWidth, sourceHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    bindFramebuffer(READ_FRAMEBUFFER, target);
+}
+
+void *glInsertFence() {
+    if (!glHasFences()) return 0;
+    return fenceSync(SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool glFenceSignaled(void *fence) {
+    GLenum result = clientWaitSync(fence, 0, 0);
+    return result == ALREADY_SIGNALED || result == CONDITION_SATISFIED;
+}
+
+void glWaitFence(void *fence) {
+    //the flush makes sure the fence is submitted, a timeout just waits again
+    GLenum result;
+    do {
+        result = clientWaitSync(fence, SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    } while (result != ALREADY_SIGNALED && result != CONDITION_SATISFIED && result != WAIT_FAILED);
+}
+
+void glDeleteFence(void *fence) {
+    deleteSync(fence);
+}
@@ -3,6 +3,7 @@
 
 #include <QGLWidget>
 #include "vector.h"
+#include "matrix.h"
 
 using namespace std;
 
@@ -22,5 +23,94 @@ void glDrawDottedCircle(float x, float y, float r);
 //creates and returns a display list of a circle with radius r
 GLuint glCircleList(float r);
 
+//replaces the current OpenGL matrix with m
+void glLoadMatrix(const Matrix4f &m);
+
+//resolves the instanced drawing and generic attribute array entry points of the current context
+//returns false if it supports neither ARB_instanced_arrays nor OpenGL 3.3
+bool glInitInstancing();
+
+//draws instances of the enabled arrays, attributes with a divisor advance once per instance
+//only valid after glInitInstancing returned true
+void glDrawInstances(GLenum mode, GLint first, GLsizei count, GLsizei instances);
+void glDrawIndexedInstances(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances);
+void glAttribDivisor(GLuint index, GLuint divisor);
+
+//points a generic attribute of the shaders to an array, only valid after glInitInstancing returned true
+void glAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer);
+void glEnableAttribArray(GLuint index);
+void glDisableAttribArray(GLuint index);
+
+//resolves the buffer object and fence entry points of the current context
+//returns false if it does not support buffer objects, fences are optional
+bool glInitBufferObjects();
+bool glHasFences();
+
+//binds a buffer object to the vertex array or element array target, 0 goes back to client memory
+void glBindArrayBuffer(GLuint buffer);
+void glBindElementBuffer(GLuint buffer);
+
+//maps the first bytes of the buffer bound to a target for writing, discarding its contents
+//returns 0 if mapping is not supported, glUnmapWriteBuffer returns false if the contents were lost
+void *glMapWriteBuffer(GLenum target, GLsizeiptr size);
+bool glUnmapWriteBuffer(GLenum target);
+
+//returns true if buffer objects can be copied into each other and mapped by ranges, OpenGL 3.1 or ARB_copy_buffer
+bool glHasBufferCopies();
+
+//maps a range of the buffer bound to a target for writing, without waiting for commands that use the buffer
+//the caller makes sure none of them reads the range, only valid if glHasBufferCopies returned true
+void *glMapUnsynchronizedBuffer(GLenum target, GLintptr offset, GLsizeiptr size);
+
+//copies bytes between buffer objects on the GPU, only valid if glHasBufferCopies returned true
+void glCopyBufferData(GLuint source, GLintptr sourceOffset, GLuint target, GLintptr targetOffset, GLsizeiptr size);
+
+//float texture formats of ARB_texture_float
+#define GL_RGBA32F_FORMAT 0x8814
+#define GL_LUMINANCE32F_FORMAT 0x8818
+#define GL_LUMINANCE_ALPHA32F_FORMAT 0x8819
+
+//resolves the texture unit entry point and checks the current context for float textures
+//returns false if it supports neither ARB_texture_float nor OpenGL 3.0
+bool glInitFloatTextures();
+
+//selects the texture unit that texture calls apply to, only valid after glInitFloatTextures returned true
+void glSelectTextureUnit(GLuint unit);
+
+//resolves the program binary entry points of ARB_get_program_binary or OpenGL 4.1
+//returns false if the context has none or supports no binary format
+bool glInitProgramBinaries();
+
+//lets the binary of a program be read back after it is linked, call before linking
+void glRetrievableProgram(GLuint program);
+
+//reads back the binary of a linked program, returns false if there is none
+bool glGetProgramBinaryData(GLuint program, QByteArray &binary, GLenum &format);
+
+//replaces a program with a binary read back before, returns false if the driver rejected it
+bool glLoadProgramBinary(GLuint program, const QByteArray &binary, GLenum format);
+
+//resolves the framebuffer binding and blit entry points of OpenGL 3.0, ARB_framebuffer_object or EXT_framebuffer_blit
+//returns false if the context cannot blit between framebuffers
+bool glInitFramebufferBlit();
+
+//returns the framebuffer bound for drawing, 0 for the window, and binds one for drawing and reading
+GLuint glDrawFramebuffer();
+void glBindDrawFramebuffer(GLuint framebuffer);
+
+//stretches the color of the lower left corner of a framebuffer over the lower left corner of the bound one
+//with linear filtering, only valid after glInitFramebufferBlit returned true
+void glBlitScaled(GLuint source, GLsizei sourceWidth, GLsizei sourceHeight, GLsizei width, GLsizei height);
+
+//inserts a fence after the commands issued so far, returns 0 if fences are not supported
+void *glInsertFence();
+
+//returns true once the commands before a fence have completed, without waiting for them
+bool glFenceSignaled(void *fence);
+void glDeleteFence(void *fence);
+
+//blocks until the commands before a fence have completed
+void glWaitFence(void *fence);
+
 
 #endif // GLUTILS_H
@@ -0,0 +1,381 @@
+#include "kernels.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define KERNELS_X86
+#include <immintrin.h>
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+//the kernels available for one instruction set
+struct KernelTable {
+    const char *name;
+    void (*bounds)(const Vector3f *p, uint n, Vector3f &minPos, Vector3f &maxPos);
+    void (*translateScale)(Vector3f *p, uint n, const Vector3f &offset, float scale);
+    void (*normalize)(Vector3f *v, uint n);
+    void (*gatherSum)(Vector3f *out, const Vector3f *src, const uint *indices, const uint *offsets,
+                      uint n, const float *weights);
+    void (*transform)(Vector3f *out, const Vector3f *p, uint n, const Matrix4f &m);
+    void (*planeDistances)(const Vector3f *p, uint n, const Vector4f &plane, float *out);
+};
+
+/* scalar kernels, also used for the elements left over by the SIMD kernels */
+
+static void boundsScalar(const Vector3f *p, uint n, Vector3f &minPos, Vector3f &maxPos) {
+    for (uint i = 0; i < n; i++) {
+        for (uint j = 0; j < 3; j++) {
+            if (p[i][j] < minPos[j]) minPos[j] = p[i][j];
+            if (p[i][j] > maxPos[j]) maxPos[j] = p[i][j];
+        }
+    }
+}
+
+static void translateScaleScalar(Vector3f *p, uint n, const Vector3f &offset, float scale) {
+    for (uint i = 0; i < n; i++)
+        for (uint j = 0; j < 3; j++)
+            p[i][j] = (p[i][j] + offset[j]) * scale;
+}
+
+static void normalizeScalar(Vector3f *v, uint n) {
+    for (uint i = 0; i < n; i++) {
+        float length = sqrtf(v[i][0]*v[i][0] + v[i][1]*v[i][1] + v[i][2]*v[i][2]);
+        if (length > 0)
+            for (uint j = 0; j < 3; j++)
+                v[i][j] /= length;
+    }
+}
+
+static void gatherSumScalar(Vector3f *out, const Vector3f *src, const uint *indices, const uint *offsets,
+                            uint n, const float *weights)
+{
+    for (uint i = 0; i < n; i++) {
+        float sum[3] = {0, 0, 0};
+        for (uint j = offsets[i]; j < offsets[i+1]; j++) {
+            const Vector3f &s = src[indices[j]];
+            sum[0] += s[0];
+            sum[1] += s[1];
+            sum[2] += s[2];
+        }
+
+        float w = weights ? weights[i] : 1;
+        for (uint k = 0; k < 3; k++)
+            out[i][k] += sum[k] * w;
+    }
+}
+
+static void transformScalar(Vector3f *out, const Vector3f *p, uint n, const Matrix4f &m) {
+    const float *M = m.ptr();
+    for (uint i = 0; i < n; i++) {
+        float x = p[i][0], y = p[i][1], z = p[i][2];
+        for (uint j = 0; j < 3; j++)
+            out[i][j] = M[j*4]*x + M[j*4+1]*y + M[j*4+2]*z + M[j*4+3];
+    }
+}
+
+static void planeDistancesScalar(const Vector3f *p, uint n, const Vector4f &plane, float *out) {
+    for (uint i = 0; i < n; i++)
+        out[i] = plane[0]*p[i][0] + plane[1]*p[i][1] + plane[2]*p[i][2] + plane[3];
+}
+
+static const KernelTable s_scalarKernels = {
+    "scalar", boundsScalar, translateScaleScalar, normalizeScalar, gatherSumScalar, transformScalar,
+    planeDistancesScalar
+};
+
+#ifdef KERNELS_X86
+
+/* SSE kernels. Arrays of Vector3f are processed 4 vectors (12 floats, 3 registers)
+   at a time, so lane k of register r holds component (4r + k) % 3.*/
+
+//loads a Vector3f into the first three lanes without reading past it
+KERNEL_TARGET("sse2") static inline __m128 load3(const float *p) {
+    return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)p), _mm_load_ss(p + 2));
+}
+
+//stores the first three lanes into a Vector3f
+KERNEL_TARGET("sse2") static inline void store3(float *p, __m128 v) {
+    _mm_storel_pi((__m64*)p, v);
+    _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+}
+
+//converts 4 vectors x0y0z0x1 y1z1x2y2 z2x3y3z3 to x0x1x2x3 y0y1y2y3 z0z1z2z3
+KERNEL_TARGET("sse2") static inline void transposeSoA(__m128 a, __m128 b, __m128 c, __m128 &x, __m128 &y, __m128 &z) {
+    __m128 t0 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,1,3,2)); //x2 y2 x3 y3
+    __m128 t1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1,0,2,1)); //y0 z0 y1 z1
+    x = _mm_shuffle_ps(a, t0, _MM_SHUFFLE(2,0,3,0));
+    y = _mm_shuffle_ps(t1, t0, _MM_SHUFFLE(3,1,2,0));
+    z = _mm_shuffle_ps(t1, c, _MM_SHUFFLE(3,0,3,1));
+}
+
+//converts x0x1x2x3 y0y1y2y3 z0z1z2z3 back to 4 vectors x0y0z0x1 y1z1x2y2 z2x3y3z3
+KERNEL_TARGET("sse2") static inline void transposeAoS(__m128 x, __m128 y, __m128 z, __m128 &a, __m128 &b, __m128 &c) {
+    a = _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0,0,0,0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,2,0));
+    b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1,1,1,1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2,2,2,2)), _MM_SHUFFLE(2,0,2,0));
+    c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3,3,2,2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0));
+}
+
+KERNEL_TARGET("sse2") static void boundsSSE(const Vector3f *p, uint n, Vector3f &minPos, Vector3f &maxPos) {
+    const float *f = p[0].ptr();
+    uint blocks = n / 4;
+
+    if (blocks > 0) {
+        __m128 lo[3], hi[3];
+        for (uint r = 0; r < 3; r++)
+            lo[r] = hi[r] = _mm_loadu_ps(f + r*4);
+
+        for (uint i = 1; i < blocks; i++) {
+            for (uint r = 0; r < 3; r++) {
+                __m128 v = _mm_loadu_ps(f + i*12 + r*4);
+                lo[r] = _mm_min_ps(lo[r], v);
+                hi[r] = _mm_max_ps(hi[r], v);
+            }
+        }
+
+        //reduce the lanes of each register into the component they hold
+        float L[12], H[12];
+        for (uint r = 0; r < 3; r++) {
+            _mm_storeu_ps(L + r*4, lo[r]);
+            _mm_storeu_ps(H + r*4, hi[r]);
+        }
+        for (uint k = 0; k < 12; k++) {
+            if (L[k] < minPos[k % 3]) minPos[k % 3] = L[k];
+            if (H[k] > maxPos[k % 3]) maxPos[k % 3] = H[k];
+        }
+    }
+
+    boundsScalar(p + blocks*4, n - blocks*4, minPos, maxPos);
+}
+
+KERNEL_TARGET("sse2") static void translateScaleSSE(Vector3f *p, uint n, const Vector3f &offset, float scale) {
+    float *f = p[0].ptr();
+    uint blocks = n / 4;
+
+    //offsets repeating with the period of the components
+    __m128 o[3];
+    for (uint r = 0; r < 3; r++)
+        o[r] = _mm_setr_ps(offset[(r*4) % 3], offset[(r*4+1) % 3], offset[(r*4+2) % 3], offset[(r*4+3) % 3]);
+    __m128 s = _mm_set1_ps(scale);
+
+    for (uint i = 0; i < blocks; i++) {
+        for (uint r = 0; r < 3; r++) {
+            float *q = f + i*12 + r*4;
+            _mm_storeu_ps(q, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(q), o[r]), s));
+        }
+    }
+
+    translateScaleScalar(p + blocks*4, n - blocks*4, offset, scale);
+}
+
+KERNEL_TARGET("sse2") static void normalizeSSE(Vector3f *v, uint n) {
+    float *f = v[0].ptr();
+    uint blocks = n / 4;
+    __m128 zero = _mm_setzero_ps();
+
+    for (uint i = 0; i < blocks; i++) {
+        float *q = f + i*12;
+        __m128 x, y, z;
+        transposeSoA(_mm_loadu_ps(q), _mm_loadu_ps(q + 4), _mm_loadu_ps(q + 8), x, y, z);
+
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+        __m128 mask = _mm_cmpgt_ps(length, zero);
+        x = _mm_or_ps(_mm_and_ps(mask, _mm_div_ps(x, length)), _mm_andnot_ps(mask, x));
+        y = _mm_or_ps(_mm_and_ps(mask, _mm_div_ps(y, length)), _mm_andnot_ps(mask, y));
+        z = _mm_or_ps(_mm_and_ps(mask, _mm_div_ps(z, length)), _mm_andnot_ps(mask, z));
+
+        __m128 a, b, c;
+        transposeAoS(x, y, z, a, b, c);
+        _mm_storeu_ps(q, a);
+        _mm_storeu_ps(q + 4, b);
+        _mm_storeu_ps(q + 8, c);
+    }
+
+    normalizeScalar(v + blocks*4, n - blocks*4);
+}
+
+KERNEL_TARGET("sse2") static void gatherSumSSE(Vector3f *out, const Vector3f *src, const uint *indices, const uint *offsets,
+                                               uint n, const float *weights)
+{
+    for (uint i = 0; i < n; i++) {
+        __m128 sum = _mm_setzero_ps();
+        for (uint j = offsets[i]; j < offsets[i+1]; j++)
+            sum = _mm_add_ps(sum, load3(src[indices[j]].ptr()));
+
+        if (weights)
+            sum = _mm_mul_ps(sum, _mm_set1_ps(weights[i]));
+        store3(out[i].ptr(), _mm_add_ps(load3(out[i].ptr()), sum));
+    }
+}
+
+KERNEL_TARGET("sse2") static void transformSSE(Vector3f *out, const Vector3f *p, uint n, const Matrix4f &m) {
+    //the columns of the matrix, which is stored by rows
+    const float *M = m.ptr();
+    __m128 c0 = _mm_loadu_ps(M), c1 = _mm_loadu_ps(M + 4), c2 = _mm_loadu_ps(M + 8), c3 = _mm_loadu_ps(M + 12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+    for (uint i = 0; i < n; i++) {
+        const float *q = p[i].ptr();
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(q[0])), _mm_mul_ps(c1, _mm_set1_ps(q[1]))),
+                              _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(q[2])), c3));
+        store3(out[i].ptr(), r);
+    }
+}
+
+KERNEL_TARGET("sse2") static void planeDistancesSSE(const Vector3f *p, uint n, const Vector4f &plane, float *out) {
+    const float *f = p[0].ptr();
+    uint blocks = n / 4;
+    __m128 a = _mm_set1_ps(plane[0]), b = _mm_set1_ps(plane[1]), c = _mm_set1_ps(plane[2]), d = _mm_set1_ps(plane[3]);
+
+    for (uint i = 0; i < blocks; i++) {
+        const float *q = f + i*12;
+        __m128 x, y, z;
+        transposeSoA(_mm_loadu_ps(q), _mm_loadu_ps(q + 4), _mm_loadu_ps(q + 8), x, y, z);
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)), _mm_add_ps(_mm_mul_ps(c, z), d));
+        _mm_storeu_ps(out + i*4, distance);
+    }
+
+    planeDistancesScalar(p + blocks*4, n - blocks*4, plane, out + blocks*4);
+}
+
+static const KernelTable s_sseKernels = {
+    "sse", boundsSSE, translateScaleSSE, normalizeSSE, gatherSumSSE, transformSSE, planeDistancesSSE
+};
+
+/* AVX2 kernels for the streaming operations, which process 8 vectors (24 floats,
+   3 registers) at a time so lane k of register r holds component (8r + k) % 3.
+   The gather and per-vector kernels gain nothing from the wider registers and
+   use the SSE implementations.*/
+
+KERNEL_TARGET("avx2") static void boundsAVX2(const Vector3f *p, uint n, Vector3f &minPos, Vector3f &maxPos) {
+    const float *f = p[0].ptr();
+    uint blocks = n / 8;
+
+    if (blocks > 0) {
+        __m256 lo[3], hi[3];
+        for (uint r = 0; r < 3; r++)
+            lo[r] = hi[r] = _mm256_loadu_ps(f + r*8);
+
+        for (uint i = 1; i < blocks; i++) {
+            for (uint r = 0; r < 3; r++) {
+                __m256 v = _mm256_loadu_ps(f + i*24 + r*8);
+                lo[r] = _mm256_min_ps(lo[r], v);
+                hi[r] = _mm256_max_ps(hi[r], v);
+            }
+        }
+
+        float L[24], H[24];
+        for (uint r = 0; r < 3; r++) {
+            _mm256_storeu_ps(L + r*8, lo[r]);
+            _mm256_storeu_ps(H + r*8, hi[r]);
+        }
+        for (uint k = 0; k < 24; k++) {
+            if (L[k] < minPos[k % 3]) minPos[k % 3] = L[k];
+            if (H[k] > maxPos[k % 3]) maxPos[k % 3] = H[k];
+        }
+    }
+
+    boundsScalar(p + blocks*8, n - blocks*8, minPos, maxPos);
+}
+
+KERNEL_TARGET("avx2") static void translateScaleAVX2(Vector3f *p, uint n, const Vector3f &offset, float scale) {
+    float *f = p[0].ptr();
+    uint blocks = n / 8;
+
+    __m256 o[3];
+    for (uint r = 0; r < 3; r++) {
+        float pattern[8];
+        for (uint k = 0; k < 8; k++)
+            pattern[k] = offset[(r*8 + k) % 3];
+        o[r] = _mm256_loadu_ps(pattern);
+    }
+    __m256 s = _mm256_set1_ps(scale);
+
+    for (uint i = 0; i < blocks; i++) {
+        for (uint r = 0; r < 3; r++) {
+            float *q = f + i*24 + r*8;
+            _mm256_storeu_ps(q, _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(q), o[r]), s));
+        }
+    }
+
+    translateScaleScalar(p + blocks*8, n - blocks*8, offset, scale);
+}
+
+static const KernelTable s_avx2Kernels = {
+    "avx2", boundsAVX2, translateScaleAVX2, normalizeSSE, gatherSumSSE, transformSSE, planeDistancesSSE
+};
+
+#endif // KERNELS_X86
+
+//returns the kernels of an instruction set if the CPU supports it
+static const KernelTable *findKernels(const char *name) {
+    if (strcmp(name, "scalar") == 0)
+        return &s_scalarKernels;
+
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "sse") == 0 && __builtin_cpu_supports("sse2"))
+        return &s_sseKernels;
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+        return &s_avx2Kernels;
+#endif
+
+    return 0;
+}
+
+//returns the kernels of the best instruction set the CPU supports
+static const KernelTable *bestKernels() {
+    const char *names[] = {"avx2", "sse"};
+    for (uint i = 0; i < 2; i++) {
+        const KernelTable *kernels = findKernels(names[i]);
+        if (kernels) return kernels;
+    }
+
+    return &s_scalarKernels;
+}
+
+static const KernelTable *s_kernels = bestKernels();
+
+void batchBounds(const Vector3f *p, uint n, Vector3f &minPos, Vector3f &maxPos) {
+    if (n == 0) {
+        minPos.zero();
+        maxPos.zero();
+        return;
+    }
+
+    minPos = maxPos = p[0];
+    s_kernels->bounds(p, n, minPos, maxPos);
+}
+
+void batchTranslateScale(Vector3f *p, uint n, const Vector3f &offset, float scale) {
+    if (n > 0) s_kernels->translateScale(p, n, offset, scale);
+}
+
+void batchNormalize(Vector3f *v, uint n) {
+    if (n > 0) s_kernels->normalize(v, n);
+}
+
+void batchGatherSum(Vector3f *out, const Vector3f *src, const uint *indices, const uint *offsets,
+                    uint n, const float *weights)
+{
+    if (n > 0) s_kernels->gatherSum(out, src, indices, offsets, n, weights);
+}
+
+void batchTransform(Vector3f *out, const Vector3f *p, uint n, const Matrix4f &m) {
+    if (n > 0) s_kernels->transform(out, p, n, m);
+}
+
+void batchPlaneDistances(const Vector3f *p, uint n, const Vector4f &plane, float *out) {
+    if (n > 0) s_kernels->planeDistances(p, n, plane, out);
+}
+
+const char *kernelInstructionSet() {
+    return s_kernels->name;
+}
+
+bool setKernelInstructionSet(const char *name) {
+    const KernelTable *kernels = findKernels(name);
+    if (!kernels) return false;
+
+    s_kernels = kernels;
+    return true;
+}
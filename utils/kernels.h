@@ -0,0 +1,38 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "vector.h"
+#include "matrix.h"
+
+/* Batch operations over contiguous arrays of 3D vectors. Each kernel has a
+   scalar implementation and, on x86, SSE and AVX2 implementations that are
+   selected at runtime according to what the CPU supports.*/
+
+//finds the axis aligned bounding box of n points, which is empty (all 0) if n is 0
+void batchBounds(const Vector3f *p, uint n, Vector3f &minPos, Vector3f &maxPos);
+
+//replaces each point p with (p + offset) * scale
+void batchTranslateScale(Vector3f *p, uint n, const Vector3f &offset, float scale);
+
+//scales each vector to unit length, vectors of length 0 are left unchanged
+void batchNormalize(Vector3f *v, uint n);
+
+//for each i < n, adds weights[i] times the sum of src[indices[j]] for j in
+//[offsets[i], offsets[i+1]) to out[i], the weight is 1 if weights is null
+void batchGatherSum(Vector3f *out, const Vector3f *src, const uint *indices, const uint *offsets,
+                    uint n, const float *weights = 0);
+
+//transforms n points by the affine matrix m, out may be the same array as p
+void batchTransform(Vector3f *out, const Vector3f *p, uint n, const Matrix4f &m);
+
+//sets out[i] to the signed distance dot(plane.xyz, p[i]) + plane.w of each point to a plane with unit normal
+void batchPlaneDistances(const Vector3f *p, uint n, const Vector4f &plane, float *out);
+
+//returns the name of the instruction set used by the kernels ("scalar", "sse" or "avx2")
+const char *kernelInstructionSet();
+
+//selects the kernels of an instruction set by name
+//returns false, leaving the selection unchanged, if the CPU does not support it
+bool setKernelInstructionSet(const char *name);
+
+#endif // KERNELS_H
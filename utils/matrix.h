@@ -2,7 +2,6 @@
 #define MATRIX_H
 
 #include "vector.h"
-#include <QDebug>
 
 //A row vector of MxN matrix which handles assignment operations
 //This is different than the column vector class <Vector>
@@ -31,7 +30,50 @@ protected:
     T *data;
 };
 
+template <typename T, uint M, uint N> class Matrix;
+
+//determinant of a matrix by cofactor expansion, specialized below in closed form for small sizes
+template <typename T, uint M, uint N>
+struct MatrixDeterminant {
+    static double det(const Matrix<T,M,N> &m);
+};
+
+//product of an MxN and NxP matrix stored in row-major arrays, specialized below for 4x4 matrices
+template <typename T, uint M, uint N, uint P>
+struct MatrixProduct {
+    static void multiply(T *r, const T *a, const T *b) {
+        for (uint i = 0; i < M; i++) {
+            for (uint j = 0; j < P; j++) {
+                T sum = 0;
+                for (uint k = 0; k < N; k++)
+                    sum += a[i*N + k] * b[k*P + j];
+                r[i*P + j] = sum;
+            }
+        }
+    }
+};
+
+//each row of the result is a combination of the 4 rows of b, written out so the
+//compiler can keep the rows of b in vector registers
+template <typename T>
+struct MatrixProduct<T,4,4,4> {
+    static void multiply(T *r, const T *a, const T *b) {
+        for (uint i = 0; i < 4; i++) {
+            T a0 = a[i*4], a1 = a[i*4+1], a2 = a[i*4+2], a3 = a[i*4+3];
+            r[i*4]   = a0*b[0] + a1*b[4] + a2*b[8]  + a3*b[12];
+            r[i*4+1] = a0*b[1] + a1*b[5] + a2*b[9]  + a3*b[13];
+            r[i*4+2] = a0*b[2] + a1*b[6] + a2*b[10] + a3*b[14];
+            r[i*4+3] = a0*b[3] + a1*b[7] + a2*b[11] + a3*b[15];
+        }
+    }
+};
+
+//inverse of a matrix, only defined for the sizes specialized below
+template <typename T, uint M, uint N>
+struct MatrixInverse;
+
 //represents an MxN matrix of type T
+//the elements are stored contiguously in row-major order
 template <typename T, uint M, uint N>
 class Matrix {
 public:
@@ -39,8 +81,12 @@ public:
         this->zero();
     }
 
-    Matrix(const Matrix<T,M,N>& mat) {
-        this->operator=(mat);
+    //returns the identity matrix
+    static Matrix<T,M,N> identity() {
+        Matrix<T,M,N> I;
+        for (uint i = 0; i < M && i < N; i++)
+            I.data[i][i] = 1;
+        return I;
     }
 
     //clears all elements to 0
@@ -52,22 +98,26 @@ public:
 
     //returns the determinant of the matrix
     //returns 0 if the matrix is not square
-    double det() {
-        if (M != N) return 0;
-        if (N == 1) return data[0][0];
-        if (N == 2) return data[0][0]*data[1][1] - data[0][1]*data[1][0];
-
-        double result = 0;
-        for (uint j = 0; j < N; j++) {
-            int sign = j % 2 == 0 ? 1 : -1;
-            result += sign * data[0][j] * cofactor(0,j).det();
-        }
+    double det() const {
+        return MatrixDeterminant<T,M,N>::det(*this);
+    }
+
+    //returns the inverse of the matrix, or the zero matrix if it is singular
+    Matrix<T,M,N> inverse() const {
+        return MatrixInverse<T,M,N>::inverse(*this);
+    }
 
+    //returns the transpose of the matrix
+    Matrix<T,N,M> transpose() const {
+        Matrix<T,N,M> result;
+        for (uint i = 0; i < M; i++)
+            for (uint j = 0; j < N; j++)
+                result[j][i] = data[i][j];
         return result;
     }
 
     //returns the cofactor matrix, which is used in determinant calculation
-    Matrix<T,M-1,N-1> cofactor(uint row, uint column) {
+    Matrix<T,M-1,N-1> cofactor(uint row, uint column) const {
         Matrix<T,M-1,N-1> C;
 
         uint ii = 0;
@@ -91,27 +141,42 @@ public:
         Matrix<T,M,N> result = mat;
         for (uint i = 0; i < M; i++)
             for (uint j = 0; j < N; j++)
-                result.data[i][j] = this->data[i][j];
+                result.data[i][j] += this->data[i][j];
         return result;
     }
 
-    //matrix assignment
-    Matrix<T,N,M>& operator=(const Matrix<T,M,N>& mat) {
-        if (this != &mat) {
-            for (uint i = 0; i < M; i++)
-                for (uint j = 0; j < N; j++)
-                    this->data[i][j] = mat.data[i][j];
-        }
+    //matrix multiplication
+    template <uint P>
+    Matrix<T,M,P> operator*(const Matrix<T,N,P>& mat) const {
+        Matrix<T,M,P> result;
+        MatrixProduct<T,M,N,P>::multiply(result.ptr(), &data[0][0], mat.ptr());
+        return result;
+    }
 
-        return *this;
+    //matrix vector multiplication
+    Vector<T,M> operator*(const Vector<T,N>& v) const {
+        Vector<T,M> result;
+        for (uint i = 0; i < M; i++)
+            for (uint j = 0; j < N; j++)
+                result[i] += data[i][j] * v[j];
+        return result;
     }
 
     //returns the ith row vector of the matrix
     RowVector<T,N> operator[](uint i) {
-        RowVector<T,N> rowVector((T*)data + i*M);
+        RowVector<T,N> rowVector((T*)data + i*N);
         return rowVector;
     }
 
+    //returns the elements of the ith row
+    const T *operator[](uint i) const {
+        return data[i];
+    }
+
+    //returns the elements in row-major order
+    T *ptr() { return &data[0][0]; }
+    const T *ptr() const { return &data[0][0]; }
+
 protected:
     T data[M][N];
 };
@@ -120,10 +185,111 @@ protected:
 template <typename T>
 class Matrix <T,0,0> {
 public:
-    double det() { return 0; }
+    double det() const { return 0; }
     RowVector<T,0> operator[](uint) { return RowVector<T,0>(); }
 };
 
+template <typename T, uint M, uint N>
+double MatrixDeterminant<T,M,N>::det(const Matrix<T,M,N> &m) {
+    if (M != N) return 0;
+    if (N == 1) return m[0][0];
+
+    double result = 0;
+    for (uint j = 0; j < N; j++) {
+        int sign = j % 2 == 0 ? 1 : -1;
+        result += sign * m[0][j] * m.cofactor(0,j).det();
+    }
+
+    return result;
+}
+
+template <typename T>
+struct MatrixDeterminant<T,2,2> {
+    static double det(const Matrix<T,2,2> &m) {
+        return (double)m[0][0]*m[1][1] - (double)m[0][1]*m[1][0];
+    }
+};
+
+template <typename T>
+struct MatrixDeterminant<T,3,3> {
+    static double det(const Matrix<T,3,3> &m) {
+        return m[0][0] * ((double)m[1][1]*m[2][2] - (double)m[1][2]*m[2][1])
+             - m[0][1] * ((double)m[1][0]*m[2][2] - (double)m[1][2]*m[2][0])
+             + m[0][2] * ((double)m[1][0]*m[2][1] - (double)m[1][1]*m[2][0]);
+    }
+};
+
+//the 2x2 minors of the top two and bottom two rows of a 4x4 matrix,
+//which the closed form determinant and inverse are built from
+struct Minors4 {
+    double s[6];
+    double c[6];
+
+    template <typename T>
+    Minors4(const Matrix<T,4,4> &m) {
+        s[0] = (double)m[0][0]*m[1][1] - (double)m[1][0]*m[0][1];
+        s[1] = (double)m[0][0]*m[1][2] - (double)m[1][0]*m[0][2];
+        s[2] = (double)m[0][0]*m[1][3] - (double)m[1][0]*m[0][3];
+        s[3] = (double)m[0][1]*m[1][2] - (double)m[1][1]*m[0][2];
+        s[4] = (double)m[0][1]*m[1][3] - (double)m[1][1]*m[0][3];
+        s[5] = (double)m[0][2]*m[1][3] - (double)m[1][2]*m[0][3];
+
+        c[5] = (double)m[2][2]*m[3][3] - (double)m[3][2]*m[2][3];
+        c[4] = (double)m[2][1]*m[3][3] - (double)m[3][1]*m[2][3];
+        c[3] = (double)m[2][1]*m[3][2] - (double)m[3][1]*m[2][2];
+        c[2] = (double)m[2][0]*m[3][3] - (double)m[3][0]*m[2][3];
+        c[1] = (double)m[2][0]*m[3][2] - (double)m[3][0]*m[2][2];
+        c[0] = (double)m[2][0]*m[3][1] - (double)m[3][0]*m[2][1];
+    }
+
+    double det() const {
+        return s[0]*c[5] - s[1]*c[4] + s[2]*c[3] + s[3]*c[2] - s[4]*c[1] + s[5]*c[0];
+    }
+};
+
+template <typename T>
+struct MatrixDeterminant<T,4,4> {
+    static double det(const Matrix<T,4,4> &m) {
+        return Minors4(m).det();
+    }
+};
+
+template <typename T>
+struct MatrixInverse<T,4,4> {
+    static Matrix<T,4,4> inverse(const Matrix<T,4,4> &m) {
+        Minors4 minors(m);
+        const double *s = minors.s;
+        const double *c = minors.c;
+
+        Matrix<T,4,4> b;
+        double det = minors.det();
+        if (det == 0) return b;
+        double k = 1.0 / det;
+
+        b[0][0] = ( m[1][1]*c[5] - m[1][2]*c[4] + m[1][3]*c[3]) * k;
+        b[0][1] = (-m[0][1]*c[5] + m[0][2]*c[4] - m[0][3]*c[3]) * k;
+        b[0][2] = ( m[3][1]*s[5] - m[3][2]*s[4] + m[3][3]*s[3]) * k;
+        b[0][3] = (-m[2][1]*s[5] + m[2][2]*s[4] - m[2][3]*s[3]) * k;
+
+        b[1][0] = (-m[1][0]*c[5] + m[1][2]*c[2] - m[1][3]*c[1]) * k;
+        b[1][1] = ( m[0][0]*c[5] - m[0][2]*c[2] + m[0][3]*c[1]) * k;
+        b[1][2] = (-m[3][0]*s[5] + m[3][2]*s[2] - m[3][3]*s[1]) * k;
+        b[1][3] = ( m[2][0]*s[5] - m[2][2]*s[2] + m[2][3]*s[1]) * k;
+
+        b[2][0] = ( m[1][0]*c[4] - m[1][1]*c[2] + m[1][3]*c[0]) * k;
+        b[2][1] = (-m[0][0]*c[4] + m[0][1]*c[2] - m[0][3]*c[0]) * k;
+        b[2][2] = ( m[3][0]*s[4] - m[3][1]*s[2] + m[3][3]*s[0]) * k;
+        b[2][3] = (-m[2][0]*s[4] + m[2][1]*s[2] - m[2][3]*s[0]) * k;
+
+        b[3][0] = (-m[1][0]*c[3] + m[1][1]*c[1] - m[1][2]*c[0]) * k;
+        b[3][1] = ( m[0][0]*c[3] - m[0][1]*c[1] + m[0][2]*c[0]) * k;
+        b[3][2] = (-m[3][0]*s[3] + m[3][1]*s[1] - m[3][2]*s[0]) * k;
+        b[3][3] = ( m[2][0]*s[3] - m[2][1]*s[1] + m[2][2]*s[0]) * k;
+
+        return b;
+    }
+};
+
 //typedefs for convenience
 typedef Matrix<int, 3, 3> Matrix3i;
 typedef Matrix<float, 3, 3> Matrix3f;
@@ -133,4 +299,39 @@ typedef Matrix<int, 4, 4> Matrix4i;
 typedef Matrix<float, 4, 4> Matrix4f;
 typedef Matrix<double, 4, 4> Matrix4d;
 
+//compile time check that matrices hold nothing besides their elements
+typedef char Matrix4fSizeCheck[sizeof(Matrix4f) == 16*sizeof(float) ? 1 : -1];
+
+//returns the perspective projection matrix of glFrustum
+inline Matrix4f frustumMatrix(float left, float right, float bottom, float top, float zNear, float zFar) {
+    Matrix4f P;
+    P[0][0] = 2*zNear / (right - left);
+    P[0][2] = (right + left) / (right - left);
+    P[1][1] = 2*zNear / (top - bottom);
+    P[1][2] = (top + bottom) / (top - bottom);
+    P[2][2] = -(zFar + zNear) / (zFar - zNear);
+    P[2][3] = -2*zFar*zNear / (zFar - zNear);
+    P[3][2] = -1;
+    return P;
+}
+
+//returns the viewing matrix of gluLookAt
+inline Matrix4f lookAtMatrix(const Vector3f &eye, const Vector3f &center, const Vector3f &up) {
+    Vector3f f = (center - eye).unit();
+    Vector3f s = f.cross(up).unit();
+    Vector3f u = s.cross(f);
+
+    Matrix4f V;
+    for (uint j = 0; j < 3; j++) {
+        V[0][j] = s[j];
+        V[1][j] = u[j];
+        V[2][j] = -f[j];
+    }
+    V[0][3] = -s.dot(eye);
+    V[1][3] = -u.dot(eye);
+    V[2][3] = f.dot(eye);
+    V[3][3] = 1;
+    return V;
+}
+
 #endif // MATRIX_H
@@ -1,18 +1,21 @@
 #include "pointutils.h"
 
+#include <math.h>
+#include <vector>
+
+using namespace std;
+
 
 //tests a point p and line ab using cross product test
 //returns 1 if p is clockwise to ab
 //returns -1 if p is counter-clockwise to ab
 //returns 0 if p is colinear
 int pointLineTest (Vector2f a, Vector2f b, Vector2f p) {
-    Vector2f v1 = b - a;
-    Vector2f v2 = p - a;
-    Vector2f c = v1.cross(v2);
+    double o = orient2d(a, b, p);
 
-    if (c[0] < 0)
+    if (o > 0)
         return -1;
-    else if (c[0] > 0)
+    else if (o < 0)
         return 1;
     else
         return 0;
@@ -20,15 +23,7 @@ int pointLineTest (Vector2f a, Vector2f b, Vector2f p) {
 
 //returns true if vertex d is in the circumcircle of triangle abc
 bool inCircle(Vector2f a, Vector2f b, Vector2f c, Vector2f d) {
-    Matrix4f M;
-
-    Vector2f *vectors[4] = {&a, &b, &c, &d};
-    for (uint i = 0; i < 4; i++) {
-        Vector2f &v = *vectors[i];
-        M[i] = Vector4f(v[0], v[1], v[0]*v[0] + v[1]*v[1], 1);
-    }
-
-    return M.det() > 0;
+    return incircle(a, b, c, d) > 0;
 }
 
 //returns true if vertex d is in triangle abc
@@ -39,18 +34,234 @@ bool inTriangle(Vector2f a, Vector2f b, Vector2f c, Vector2f d) {
 }
 
 //hashes two vertex indices for map lookup
-uint hash(uint i, uint j) {
+EdgeKey hash(uint i, uint j) {
     if (i > j) {
         uint tmp = i;
         i = j;
         j= tmp;
     }
-    return (i << 16) | j;
+    return ((EdgeKey)i << 32) | j;
 }
 
 //unhash a hash to two vertex indices
-void unhash(uint h, uint &u, uint &v) {
-    u = h >> 16;
-    v = (h << 16) >> 16;
+void unhash(EdgeKey h, uint &u, uint &v) {
+    u = (uint)(h >> 32);
+    v = (uint)h;
+}
+
+void triangulatePolygon(const Vector2f *points, uint n, vector<uint> &triangles) {
+    if (n < 3) return;
+
+    //the sign pointLineTest gives for a convex vertex depends on the winding
+    double area = 0;
+    for (uint i = 0; i < n; i++) {
+        const Vector2f &a = points[i], &b = points[(i+1) % n];
+        area += (double)a[0]*b[1] - (double)b[0]*a[1];
+    }
+    int convex = area >= 0 ? -1 : 1;
+
+    //a quad is split along the diagonal from its reflex vertex, if it has one
+    if (n == 4) {
+        bool reflex = pointLineTest(points[0], points[1], points[2]) != convex
+                      || pointLineTest(points[2], points[3], points[0]) != convex;
+        uint d = reflex ? 1 : 0;
+        uint quad[6] = {d, d+1, d+2, d+2, (d+3) % 4, d};
+        triangles.insert(triangles.end(), quad, quad + 6);
+        return;
+    }
+
+    //remaining vertices as a circular linked list
+    vector<uint> prev(n), next(n);
+    for (uint i = 0; i < n; i++) {
+        prev[i] = (i + n - 1) % n;
+        next[i] = (i + 1) % n;
+    }
+
+    uint i = 0, remaining = n, tried = 0;
+    while (remaining > 3) {
+        uint p = prev[i], q = next[i];
+
+        //an ear is a convex vertex whose triangle contains no other vertex
+        bool ear = pointLineTest(points[p], points[i], points[q]) == convex;
+        for (uint j = next[q]; ear && j != p; j = next[j])
+            ear = !inTriangle(points[p], points[i], points[q], points[j]);
+
+        //a degenerate polygon may have no ear left, then clip any vertex to still cover it
+        if (ear || tried > remaining) {
+            triangles.push_back(p);
+            triangles.push_back(i);
+            triangles.push_back(q);
+
+            next[p] = q;
+            prev[q] = p;
+            remaining--;
+            tried = 0;
+            i = p;
+        } else {
+            tried++;
+            i = q;
+        }
+    }
+
+    triangles.push_back(prev[i]);
+    triangles.push_back(i);
+    triangles.push_back(next[i]);
+}
+
+/* Exact arithmetic on expansions, sums of doubles that do not overlap, stored
+   in order of increasing magnitude. The sign of an expansion is the sign of its
+   last component. See Shewchuk, "Adaptive Precision Floating-Point Arithmetic
+   and Fast Robust Geometric Predicates".*/
+
+typedef vector<double> Expansion;
+
+//x + y = a + b exactly
+static inline void twoSum(double a, double b, double &x, double &y) {
+    x = a + b;
+    double bv = x - a;
+    double av = x - bv;
+    y = (a - av) + (b - bv);
+}
+
+//x + y = a - b exactly
+static inline void twoDiff(double a, double b, double &x, double &y) {
+    x = a - b;
+    double bv = a - x;
+    double av = x + bv;
+    y = (a - av) + (bv - b);
+}
+
+//splits a into two halves of 26 bits, so their products are exact
+static inline void split(double a, double &hi, double &lo) {
+    double c = 134217729.0 * a;     //2^27 + 1
+    hi = c - (c - a);
+    lo = a - hi;
+}
+
+//x + y = a * b exactly
+static inline void twoProduct(double a, double b, double &x, double &y) {
+    x = a * b;
+    double ahi, alo, bhi, blo;
+    split(a, ahi, alo);
+    split(b, bhi, blo);
+    y = alo*blo - (((x - ahi*bhi) - alo*bhi) - ahi*blo);
+}
+
+//returns a - b
+static Expansion difference(double a, double b) {
+    double x, y;
+    twoDiff(a, b, x, y);
+
+    Expansion e;
+    if (y != 0) e.push_back(y);
+    e.push_back(x);
+    return e;
+}
+
+//returns e + f
+static Expansion sum(const Expansion &e, const Expansion &f) {
+    Expansion h = e;
+    for (uint j = 0; j < f.size(); j++) {
+        //grows h by one component, eliminating zero components
+        Expansion g;
+        double q = f[j];
+        for (uint i = 0; i < h.size(); i++) {
+            double hh;
+            twoSum(q, h[i], q, hh);
+            if (hh != 0) g.push_back(hh);
+        }
+        if (q != 0 || g.empty()) g.push_back(q);
+        h.swap(g);
+    }
+    return h;
+}
+
+//returns e * b
+static Expansion scale(const Expansion &e, double b) {
+    Expansion h;
+    double q, hh;
+    twoProduct(e[0], b, q, hh);
+    if (hh != 0) h.push_back(hh);
+
+    for (uint i = 1; i < e.size(); i++) {
+        double p1, p0, s;
+        twoProduct(e[i], b, p1, p0);
+        twoSum(q, p0, s, hh);
+        if (hh != 0) h.push_back(hh);
+        twoSum(p1, s, q, hh);
+        if (hh != 0) h.push_back(hh);
+    }
+
+    if (q != 0 || h.empty()) h.push_back(q);
+    return h;
+}
+
+//returns e * f
+static Expansion product(const Expansion &e, const Expansion &f) {
+    Expansion h = scale(e, f[0]);
+    for (uint j = 1; j < f.size(); j++)
+        h = sum(h, scale(e, f[j]));
+    return h;
 }
 
+//returns -e
+static Expansion negated(const Expansion &e) {
+    Expansion h = e;
+    for (uint i = 0; i < h.size(); i++) h[i] = -h[i];
+    return h;
+}
+
+//relative error bounds of the floating point determinants, from Shewchuk
+static const double s_epsilon = 1.1102230246251565e-16;     //2^-53
+static const double s_orientBound = (3.0 + 16.0*s_epsilon) * s_epsilon;
+static const double s_incircleBound = (10.0 + 96.0*s_epsilon) * s_epsilon;
+
+double orient2d(const Vector2f &a, const Vector2f &b, const Vector2f &c) {
+    double detLeft = ((double)a[0] - c[0]) * ((double)b[1] - c[1]);
+    double detRight = ((double)a[1] - c[1]) * ((double)b[0] - c[0]);
+    double det = detLeft - detRight;
+
+    //the sign is certain if the terms have different signs or the determinant is large enough
+    if ((detLeft > 0 && detRight <= 0) || (detLeft < 0 && detRight >= 0) || detLeft == 0)
+        return det;
+    if (fabs(det) >= s_orientBound * fabs(detLeft + detRight))
+        return det;
+
+    Expansion left = product(difference(a[0], c[0]), difference(b[1], c[1]));
+    Expansion right = product(difference(a[1], c[1]), difference(b[0], c[0]));
+    return sum(left, negated(right)).back();
+}
+
+double incircle(const Vector2f &a, const Vector2f &b, const Vector2f &c, const Vector2f &d) {
+    double adx = (double)a[0] - d[0], ady = (double)a[1] - d[1];
+    double bdx = (double)b[0] - d[0], bdy = (double)b[1] - d[1];
+    double cdx = (double)c[0] - d[0], cdy = (double)c[1] - d[1];
+
+    double bdxcdy = bdx*cdy, cdxbdy = cdx*bdy;
+    double cdxady = cdx*ady, adxcdy = adx*cdy;
+    double adxbdy = adx*bdy, bdxady = bdx*ady;
+    double alift = adx*adx + ady*ady;
+    double blift = bdx*bdx + bdy*bdy;
+    double clift = cdx*cdx + cdy*cdy;
+
+    double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+    double permanent = (fabs(bdxcdy) + fabs(cdxbdy)) * alift
+                     + (fabs(cdxady) + fabs(adxcdy)) * blift
+                     + (fabs(adxbdy) + fabs(bdxady)) * clift;
+    if (fabs(det) > s_incircleBound * permanent)
+        return det;
+
+    Expansion ex = difference(a[0], d[0]), ey = difference(a[1], d[1]);
+    Expansion fx = difference(b[0], d[0]), fy = difference(b[1], d[1]);
+    Expansion gx = difference(c[0], d[0]), gy = difference(c[1], d[1]);
+
+    Expansion aLift = sum(product(ex, ex), product(ey, ey));
+    Expansion bLift = sum(product(fx, fx), product(fy, fy));
+    Expansion cLift = sum(product(gx, gx), product(gy, gy));
+
+    Expansion bc = sum(product(fx, gy), negated(product(gx, fy)));
+    Expansion ca = sum(product(gx, ey), negated(product(ex, gy)));
+    Expansion ab = sum(product(ex, fy), negated(product(fx, ey)));
+
+    return sum(sum(product(aLift, bc), product(bLift, ca)), product(cLift, ab)).back();
+}
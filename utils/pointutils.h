@@ -1,14 +1,33 @@
 #ifndef POINTSUTIL_H
 #define POINTSUTIL_H
 
+#include <vector>
+
 #include "matrix.h"
 #include "vector.h"
 
+//key of an edge between two vertex indices
+typedef unsigned long long EdgeKey;
+
 //utility functions for points
-uint hash(uint i, uint j);
-void unhash(uint h, uint &u, uint &v);
+EdgeKey hash(uint i, uint j);
+void unhash(EdgeKey h, uint &u, uint &v);
 bool inCircle(Vector2f a, Vector2f b, Vector2f c, Vector2f d);
 bool inTriangle(Vector2f a, Vector2f b, Vector2f c, Vector2f d);
 int pointLineTest (Vector2f a, Vector2f b, Vector2f p);
 
+//triangulates a simple polygon of n points by ear clipping, in either winding
+//appends n-2 triangles of indices into points to triangles, in the winding of the polygon
+void triangulatePolygon(const Vector2f *points, uint n, std::vector<uint> &triangles);
+
+//robust predicates, which evaluate the determinant in floating point and fall back
+//to exact arithmetic when the result is too close to 0 to trust its sign
+
+//returns a positive value if abc are in counter-clockwise order, negative if clockwise and 0 if colinear
+double orient2d(const Vector2f &a, const Vector2f &b, const Vector2f &c);
+
+//returns a positive value if d is inside the circumcircle of the counter-clockwise triangle abc,
+//negative if it is outside and 0 if it is on the circle
+double incircle(const Vector2f &a, const Vector2f &b, const Vector2f &c, const Vector2f &d);
+
 #endif // POINTSUTIL_H
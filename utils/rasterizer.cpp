@@ -0,0 +1,764 @@
+#include "rasterizer.h"
+
+#include <QAtomicInt>
+#include <QFuture>
+#include <QThread>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "timer.h"
+#include "trace.h"
+
+#if defined(__SSE2__)
+#define RASTER_SSE2
+#include <emmintrin.h>
+#endif
+
+#define RASTER_SUBPIXELS 16.0f          //vertices are snapped to this fraction of a pixel
+#define RASTER_GUARD_BAND 4.0f          //triangles are clipped to this many times the view around its center
+#define RASTER_CHUNK_TRIANGLES 4096     //triangles set up by one task
+#define RASTER_NO_TRIANGLE 0xFFFFFFFFu
+
+//a triangle is named by its chunk in the high bits and its place in the chunk in the low bits
+//a chunk sets up at most 7 triangles for each it is given, from a triangle clipped by all 6 planes
+#define RASTER_ID_BITS 16
+#define RASTER_MAX_CHUNKS 0xFFFF
+
+//a triangle clipped by the 6 planes has up to 3 + 6 vertices
+#define RASTER_MAX_CLIPPED 9
+
+//pixels the edges reach into each triangle, as far as the wire shader blends them fully
+#define RASTER_WIRE_WIDTH 1.0f
+#define RASTER_WIRE_COLOR 0.1f
+
+//the default material of the fixed-function pipeline, and the ambient light of its light model times it
+#define RASTER_DEFAULT_AMBIENT 0.2f
+#define RASTER_DEFAULT_DIFFUSE 0.8f
+#define RASTER_SCENE_COLOR 0.04f
+
+//the Phong shaders take half the ambient light, and a white specular color with a shininess of 32
+#define RASTER_PHONG_AMBIENT 0.5f
+
+#define TILE_PIXELS (RASTER_TILE_SIZE * RASTER_TILE_SIZE)
+#define TILE_BLOCKS (RASTER_TILE_SIZE / RASTER_BLOCK_SIZE)
+#define TILE_QUADS (RASTER_TILE_SIZE / 2)
+
+//returns a float with every bit set if set is true, a lane of a mask
+static inline float laneMask(bool set) {
+    uint bits = set ? 0xFFFFFFFFu : 0;
+    float mask;
+    memcpy(&mask, &bits, sizeof(mask));
+    return mask;
+}
+
+/* four floats, one for each pixel of a 2x2 quad, in an SSE register where there is one
+   comparisons give masks with every bit set in the lanes where they hold*/
+#ifdef RASTER_SSE2
+struct Float4 {
+    __m128 v;
+
+    Float4() {}
+    Float4(__m128 v) : v(v) {}
+    Float4(float f) : v(_mm_set1_ps(f)) {}
+    Float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+
+    static Float4 load(const float *p) { return _mm_loadu_ps(p); }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+};
+
+static inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+static inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+static inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+static inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+static inline Float4 min4(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+static inline Float4 max4(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+static inline Float4 sqrt4(Float4 a) { return _mm_sqrt_ps(a.v); }
+
+static inline Float4 operator<(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+static inline Float4 operator<=(Float4 a, Float4 b) { return _mm_cmple_ps(a.v, b.v); }
+static inline Float4 operator>(Float4 a, Float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+static inline Float4 operator==(Float4 a, Float4 b) { return _mm_cmpeq_ps(a.v, b.v); }
+static inline Float4 operator&(Float4 a, Float4 b) { return _mm_and_ps(a.v, b.v); }
+static inline Float4 operator|(Float4 a, Float4 b) { return _mm_or_ps(a.v, b.v); }
+
+//takes a in the lanes of the mask and b in the others
+static inline Float4 select(Float4 mask, Float4 a, Float4 b) {
+    return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+
+//returns bit i set for each lane i of the mask
+static inline int laneBits(Float4 mask) { return _mm_movemask_ps(mask.v); }
+
+static inline Float4 clamp01(Float4 a) { return min4(max4(a, 0.0f), 1.0f); }
+
+//writes colors in [0, 1] as opaque RGBA pixels
+static inline void storePixels(Float4 r, Float4 g, Float4 b, uint *out) {
+    __m128i ri = _mm_cvtps_epi32(_mm_mul_ps(clamp01(r).v, _mm_set1_ps(255)));
+    __m128i gi = _mm_cvtps_epi32(_mm_mul_ps(clamp01(g).v, _mm_set1_ps(255)));
+    __m128i bi = _mm_cvtps_epi32(_mm_mul_ps(clamp01(b).v, _mm_set1_ps(255)));
+    __m128i rg = _mm_or_si128(ri, _mm_slli_epi32(gi, 8));
+    __m128i ba = _mm_or_si128(_mm_slli_epi32(bi, 16), _mm_set1_epi32((int)0xFF000000));
+    _mm_storeu_si128((__m128i*)out, _mm_or_si128(rg, ba));
+}
+#else
+struct Float4 {
+    float v[4];
+
+    Float4() {}
+    Float4(float f) { v[0] = v[1] = v[2] = v[3] = f; }
+    Float4(float a, float b, float c, float d) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+
+    static Float4 load(const float *p) { return Float4(p[0], p[1], p[2], p[3]); }
+    void store(float *p) const { for (int i = 0; i < 4; i++) p[i] = v[i]; }
+};
+
+static inline uint bitsOf(float f) {
+    uint bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static inline float fromBits(uint bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+#define FLOAT4_LANES(expression) Float4 r; for (int i = 0; i < 4; i++) r.v[i] = (expression); return r
+
+static inline Float4 operator+(Float4 a, Float4 b) { FLOAT4_LANES(a.v[i] + b.v[i]); }
+static inline Float4 operator-(Float4 a, Float4 b) { FLOAT4_LANES(a.v[i] - b.v[i]); }
+static inline Float4 operator*(Float4 a, Float4 b) { FLOAT4_LANES(a.v[i] * b.v[i]); }
+static inline Float4 operator/(Float4 a, Float4 b) { FLOAT4_LANES(a.v[i] / b.v[i]); }
+static inline Float4 min4(Float4 a, Float4 b) { FLOAT4_LANES(a.v[i] < b.v[i] ? a.v[i] : b.v[i]); }
+static inline Float4 max4(Float4 a, Float4 b) { FLOAT4_LANES(a.v[i] > b.v[i] ? a.v[i] : b.v[i]); }
+static inline Float4 sqrt4(Float4 a) { FLOAT4_LANES(sqrtf(a.v[i])); }
+
+static inline Float4 operator<(Float4 a, Float4 b) { FLOAT4_LANES(laneMask(a.v[i] < b.v[i])); }
+static inline Float4 operator<=(Float4 a, Float4 b) { FLOAT4_LANES(laneMask(a.v[i] <= b.v[i])); }
+static inline Float4 operator>(Float4 a, Float4 b) { FLOAT4_LANES(laneMask(a.v[i] > b.v[i])); }
+static inline Float4 operator==(Float4 a, Float4 b) { FLOAT4_LANES(laneMask(a.v[i] == b.v[i])); }
+static inline Float4 operator&(Float4 a, Float4 b) { FLOAT4_LANES(fromBits(bitsOf(a.v[i]) & bitsOf(b.v[i]))); }
+static inline Float4 operator|(Float4 a, Float4 b) { FLOAT4_LANES(fromBits(bitsOf(a.v[i]) | bitsOf(b.v[i]))); }
+
+//takes a in the lanes of the mask and b in the others
+static inline Float4 select(Float4 mask, Float4 a, Float4 b) { FLOAT4_LANES(bitsOf(mask.v[i]) ? a.v[i] : b.v[i]); }
+
+//returns bit i set for each lane i of the mask
+static inline int laneBits(Float4 mask) {
+    int bits = 0;
+    for (int i = 0; i < 4; i++)
+        if (bitsOf(mask.v[i])) bits |= 1 << i;
+    return bits;
+}
+
+static inline Float4 clamp01(Float4 a) { return min4(max4(a, 0.0f), 1.0f); }
+
+//writes colors in [0, 1] as opaque RGBA pixels
+static inline void storePixels(Float4 r, Float4 g, Float4 b, uint *out) {
+    Float4 channels[3] = {clamp01(r), clamp01(g), clamp01(b)};
+    unsigned char *bytes = (unsigned char*)out;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 3; j++)
+            bytes[4*i + j] = (unsigned char)(channels[j].v[i] * 255 + 0.5f);
+        bytes[4*i + 3] = 255;
+    }
+}
+#endif
+
+//lanes of the pixels of a quad: bottom left, bottom right, top left, top right
+static inline Float4 laneX() { return Float4(0, 1, 0, 1); }
+static inline Float4 laneY() { return Float4(0, 0, 1, 1); }
+
+//returns the lanes inside an edge, and those on it if the triangle owns it
+static inline Float4 covered(Float4 e, Float4 owns) {
+    return (e > 0.0f) | ((e == 0.0f) & owns);
+}
+
+//gather an attribute of the triangles of the 4 lanes of a quad
+static inline Float4 gather(const RasterTriangle *const *t, float RasterTriangle::*member) {
+    return Float4(t[0]->*member, t[1]->*member, t[2]->*member, t[3]->*member);
+}
+
+static inline Float4 gather(const RasterTriangle *const *t, float (RasterTriangle::*member)[3], uint i) {
+    return Float4((t[0]->*member)[i], (t[1]->*member)[i], (t[2]->*member)[i], (t[3]->*member)[i]);
+}
+
+static inline Float4 gather(const RasterTriangle *const *t, Vector3f (RasterTriangle::*member)[3], uint i, uint axis) {
+    return Float4((t[0]->*member)[i][axis], (t[1]->*member)[i][axis], (t[2]->*member)[i][axis], (t[3]->*member)[i][axis]);
+}
+
+//a vertex of a triangle being clipped, edge marks the edge to the next vertex as a face edge
+struct ClipVertex {
+    float clip[4];
+    Vector3f position;
+    Vector3f normal;
+    bool edge;
+};
+
+//returns the distance of a clip space point inside plane i, negative outside
+//the planes are the near and far planes and the sides of the guard band
+static inline float planeDistance(const float *clip, uint plane) {
+    switch (plane) {
+    case 0: return clip[3] + clip[2];
+    case 1: return clip[3] - clip[2];
+    case 2: return RASTER_GUARD_BAND * clip[3] + clip[0];
+    case 3: return RASTER_GUARD_BAND * clip[3] - clip[0];
+    case 4: return RASTER_GUARD_BAND * clip[3] + clip[1];
+    default: return RASTER_GUARD_BAND * clip[3] - clip[1];
+    }
+}
+
+//returns bit i set for each plane i the point is outside of
+static inline uint outcode(const float *clip) {
+    uint code = 0;
+    for (uint i = 0; i < 6; i++)
+        if (planeDistance(clip, i) < 0) code |= 1 << i;
+    return code;
+}
+
+//clips a polygon to a plane, returns the number of vertices left
+static uint clipPolygon(const ClipVertex *in, uint n, uint plane, ClipVertex *out) {
+    uint m = 0;
+    for (uint k = 0; k < n; k++) {
+        const ClipVertex &a = in[k];
+        const ClipVertex &b = in[(k + 1) % n];
+        float da = planeDistance(a.clip, plane);
+        float db = planeDistance(b.clip, plane);
+        if (da >= 0) out[m++] = a;
+        if ((da >= 0) == (db >= 0)) continue;
+
+        //interpolate from the inside end, so the triangles sharing the edge get the same point
+        const ClipVertex &inside = da >= 0 ? a : b;
+        const ClipVertex &outside = da >= 0 ? b : a;
+        float s = qMax(da, db) / (qMax(da, db) - qMin(da, db));
+        ClipVertex &c = out[m++];
+        for (uint i = 0; i < 4; i++)
+            c.clip[i] = inside.clip[i] + s * (outside.clip[i] - inside.clip[i]);
+        c.position = inside.position + (outside.position - inside.position) * s;
+        c.normal = inside.normal + (outside.normal - inside.normal) * s;
+
+        //leaving, the next edge runs along the plane; entering, it is the rest of the edge cut
+        c.edge = da >= 0 ? false : a.edge;
+    }
+    return m;
+}
+
+//sets up a triangle of clipped vertices for a view of width x height pixels, returns false if it covers no pixel center
+static bool setupProjected(const ClipVertex *const *v, uint faceEdges, int width, int height, RasterTriangle &t) {
+    //window coordinates with y up, snapped so edge functions of them are exact in double
+    float x[3], y[3];
+    for (uint i = 0; i < 3; i++) {
+        const float *clip = v[i]->clip;
+        float invW = 1 / clip[3];
+        x[i] = floorf((clip[0] * invW + 1) * 0.5f * width * RASTER_SUBPIXELS + 0.5f) / RASTER_SUBPIXELS;
+        y[i] = floorf((clip[1] * invW + 1) * 0.5f * height * RASTER_SUBPIXELS + 0.5f) / RASTER_SUBPIXELS;
+        t.z[i] = (clip[2] * invW + 1) * 0.5f;
+        t.invW[i] = invW;
+        t.position[i] = v[i]->position;
+        t.normal[i] = v[i]->normal;
+    }
+
+    //twice the signed area, positive for counter-clockwise triangles
+    double area = ((double)x[1] - x[0]) * ((double)y[2] - y[0]) - ((double)x[2] - x[0]) * ((double)y[1] - y[0]);
+    if (area == 0) return false;
+    float sign = area > 0 ? 1 : -1;
+
+    //pixels whose centers lie within the bounds
+    float minX = qMin(x[0], qMin(x[1], x[2])), maxX = qMax(x[0], qMax(x[1], x[2]));
+    float minY = qMin(y[0], qMin(y[1], y[2])), maxY = qMax(y[0], qMax(y[1], y[2]));
+    t.minX = qMax((int)ceilf(minX - 0.5f), 0);
+    t.maxX = qMin((int)floorf(maxX - 0.5f), width - 1);
+    t.minY = qMax((int)ceilf(minY - 0.5f), 0);
+    t.maxY = qMin((int)floorf(maxY - 0.5f), height - 1);
+    if (t.minX > t.maxX || t.minY > t.maxY) return false;
+
+    t.owns = 0;
+    for (uint i = 0; i < 3; i++) {
+        //the edge from vertex j to vertex k, turned to be positive towards vertex i
+        uint j = (i + 1) % 3, k = (i + 2) % 3;
+        t.a[i] = sign * (y[j] - y[k]);
+        t.b[i] = sign * (x[k] - x[j]);
+
+        bool lower = x[k] < x[j] || (x[k] == x[j] && y[k] < y[j]);
+        t.x0[i] = lower ? x[k] : x[j];
+        t.y0[i] = lower ? y[k] : y[j];
+        t.invLength[i] = 1 / sqrtf(t.a[i]*t.a[i] + t.b[i]*t.b[i]);
+
+        //the two triangles along an edge face it from opposite sides, so exactly one owns it
+        if (t.a[i] > 0 || (t.a[i] == 0 && t.b[i] < 0)) t.owns |= 1 << i;
+    }
+
+    t.invArea = 1 / fabs(area);
+    t.zMin = qMin(t.z[0], qMin(t.z[1], t.z[2]));
+    t.zMax = qMax(t.z[0], qMax(t.z[1], t.z[2]));
+    t.faceEdges = faceEdges;
+    return true;
+}
+
+struct Rasterizer::TileBuffers {
+    //pixels are stored by quads, the 4 of each together in the order of the lanes
+    float depth[TILE_PIXELS];
+    uint ids[TILE_PIXELS];
+
+    //the farthest depth of each block and of the whole tile, which is worked out again when stale
+    float blockZMax[TILE_BLOCKS * TILE_BLOCKS];
+    float zMax;
+    bool zMaxStale;
+};
+
+Rasterizer::Rasterizer()
+    : m_width(0), m_height(0), m_tilesX(0), m_tilesY(0), m_numThreads(0), m_projection(Matrix4f::identity()),
+      m_shading(RASTER_DIFFUSE), m_numChunks(0), m_numTriangles(0), m_setupMs(0), m_tileMs(0)
+{
+}
+
+void Rasterizer::setNumThreads(int threads) { m_numThreads = threads; }
+
+uint Rasterizer::getNumThreads() const {
+    return m_numThreads > 0 ? m_numThreads : qMax(QThread::idealThreadCount(), 1);
+}
+
+void Rasterizer::resize(int width, int height) {
+    m_width = qMax(width, 0);
+    m_height = qMax(height, 0);
+    m_tilesX = (m_width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    m_tilesY = (m_height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    m_pixels.assign((size_t)m_width * m_height, 0);
+}
+
+int Rasterizer::getWidth() const { return m_width; }
+int Rasterizer::getHeight() const { return m_height; }
+
+void Rasterizer::setProjection(const Matrix4f &projection) { m_projection = projection; }
+
+void Rasterizer::setLights(const vector<RasterLight> &lights) {
+    m_lights.assign(lights.begin(), lights.begin() + qMin((int)lights.size(), RASTER_MAX_LIGHTS));
+}
+
+void Rasterizer::setShading(RasterShading shading) { m_shading = shading; }
+
+void Rasterizer::begin() {
+    m_draws.clear();
+    m_modelViews.clear();
+}
+
+void Rasterizer::addTriangles(const Vector3f *positions, const Vector3f *normals, const unsigned char *edgeFlags,
+                              uint stride, uint numVertices, const Matrix4f *modelViews, uint copies)
+{
+    if (numVertices < 3 || copies == 0) return;
+
+    RasterDraw draw;
+    draw.positions = (const char*)positions;
+    draw.normals = (const char*)normals;
+    draw.edgeFlags = (const char*)edgeFlags;
+    draw.stride = stride;
+    draw.numTriangles = numVertices / 3;
+    draw.firstModelView = m_modelViews.size();
+    draw.copies = copies;
+    m_draws.push_back(draw);
+    m_modelViews.insert(m_modelViews.end(), modelViews, modelViews + copies);
+}
+
+void Rasterizer::end() {
+    TRACE_SCOPE("Rasterizer::end");
+    Timer timer;
+
+    //split the triangles of every copy of every draw into chunks, few enough for the ids
+    uint total = 0;
+    for (uint i = 0; i < m_draws.size(); i++)
+        total += m_draws[i].numTriangles * m_draws[i].copies;
+    uint chunkTriangles = qMax((uint)RASTER_CHUNK_TRIANGLES, total / RASTER_MAX_CHUNKS + 1);
+    m_numChunks = (total + chunkTriangles - 1) / chunkTriangles;
+    if (m_chunks.size() < m_numChunks) m_chunks.resize(m_numChunks);
+    for (uint i = 0; i < m_numChunks; i++) {
+        m_chunks[i].first = i * chunkTriangles;
+        m_chunks[i].count = qMin(chunkTriangles, total - m_chunks[i].first);
+    }
+
+    //the calling thread works along with the others
+    uint threads = getNumThreads();
+    vector<QFuture<void> > futures;
+    QAtomicInt nextChunk(0);
+    for (uint i = 1; i < qMin(threads, m_numChunks); i++)
+        futures.push_back(QtConcurrent::run(this, &Rasterizer::setupChunks, &nextChunk));
+    setupChunks(&nextChunk);
+    for (uint i = 0; i < futures.size(); i++) futures[i].waitForFinished();
+    futures.clear();
+
+    m_numTriangles = 0;
+    for (uint i = 0; i < m_numChunks; i++)
+        m_numTriangles += m_chunks[i].triangles.size();
+    m_setupMs = timer.elapsed();
+
+    timer.start();
+    uint tiles = m_tilesX * m_tilesY;
+    QAtomicInt nextTile(0);
+    for (uint i = 1; i < qMin(threads, tiles); i++)
+        futures.push_back(QtConcurrent::run(this, &Rasterizer::renderTiles, &nextTile));
+    renderTiles(&nextTile);
+    for (uint i = 0; i < futures.size(); i++) futures[i].waitForFinished();
+    m_tileMs = timer.elapsed();
+}
+
+void Rasterizer::setupChunks(QAtomicInt *next) {
+    TRACE_SCOPE("Rasterizer::setupChunks");
+    uint numTiles = m_tilesX * m_tilesY;
+    vector<uint> fill;
+
+    for (uint c = next->fetchAndAddOrdered(1); c < m_numChunks; c = next->fetchAndAddOrdered(1)) {
+        RasterChunk &chunk = m_chunks[c];
+        chunk.triangles.clear();
+
+        //find the draw the chunk starts in, then walk its triangles copy by copy
+        uint d = 0;
+        uint offset = chunk.first;
+        while (offset >= m_draws[d].numTriangles * m_draws[d].copies) {
+            offset -= m_draws[d].numTriangles * m_draws[d].copies;
+            d++;
+        }
+        for (uint i = 0; i < chunk.count; i++) {
+            const RasterDraw &draw = m_draws[d];
+            setupTriangle(draw, offset / draw.numTriangles, offset % draw.numTriangles, chunk.triangles);
+            if (++offset == draw.numTriangles * draw.copies) {
+                offset = 0;
+                d++;
+            }
+        }
+
+        //count the triangles of each tile first, then place them in order
+        chunk.tileStarts.assign(numTiles + 1, 0);
+        for (uint i = 0; i < chunk.triangles.size(); i++) {
+            const RasterTriangle &t = chunk.triangles[i];
+            for (int y = t.minY / RASTER_TILE_SIZE; y <= t.maxY / RASTER_TILE_SIZE; y++)
+                for (int x = t.minX / RASTER_TILE_SIZE; x <= t.maxX / RASTER_TILE_SIZE; x++)
+                    chunk.tileStarts[y * m_tilesX + x + 1]++;
+        }
+        for (uint i = 0; i < numTiles; i++)
+            chunk.tileStarts[i + 1] += chunk.tileStarts[i];
+
+        fill.assign(chunk.tileStarts.begin(), chunk.tileStarts.end() - 1);
+        chunk.tileTriangles.resize(chunk.tileStarts[numTiles]);
+        for (uint i = 0; i < chunk.triangles.size(); i++) {
+            const RasterTriangle &t = chunk.triangles[i];
+            for (int y = t.minY / RASTER_TILE_SIZE; y <= t.maxY / RASTER_TILE_SIZE; y++)
+                for (int x = t.minX / RASTER_TILE_SIZE; x <= t.maxX / RASTER_TILE_SIZE; x++)
+                    chunk.tileTriangles[fill[y * m_tilesX + x]++] = i;
+        }
+    }
+}
+
+void Rasterizer::setupTriangle(const RasterDraw &draw, uint copy, uint i, vector<RasterTriangle> &out) const {
+    const Matrix4f &modelView = m_modelViews[draw.firstModelView + copy];
+    const Matrix4f &p = m_projection;
+
+    ClipVertex polygon[RASTER_MAX_CLIPPED];
+    uint any = 0, all = ~0u;
+    for (uint j = 0; j < 3; j++) {
+        uint offset = (3*i + j) * draw.stride;
+        const Vector3f &position = *(const Vector3f*)(draw.positions + offset);
+        const Vector3f &normal = *(const Vector3f*)(draw.normals + offset);
+
+        //the model-view matrices are affine, normals only turn with them
+        ClipVertex &v = polygon[j];
+        for (uint k = 0; k < 3; k++) {
+            const float *m = modelView[k];
+            v.position[k] = m[0]*position[0] + m[1]*position[1] + m[2]*position[2] + m[3];
+            v.normal[k] = m[0]*normal[0] + m[1]*normal[1] + m[2]*normal[2];
+        }
+        for (uint k = 0; k < 4; k++)
+            v.clip[k] = p[k][0]*v.position[0] + p[k][1]*v.position[1] + p[k][2]*v.position[2] + p[k][3];
+        v.edge = draw.edgeFlags[offset] != 0;
+
+        uint code = outcode(v.clip);
+        any |= code;
+        all &= code;
+    }
+
+    //outside one plane with all vertices, or clipped by each plane some are outside of
+    if (all) return;
+    uint n = 3;
+    for (uint plane = 0; plane < 6 && n >= 3; plane++) {
+        if (!(any & (1 << plane))) continue;
+        ClipVertex clipped[RASTER_MAX_CLIPPED];
+        n = clipPolygon(polygon, n, plane, clipped);
+        for (uint j = 0; j < n; j++) polygon[j] = clipped[j];
+    }
+
+    //fan out the polygon, only its own edges can be face edges
+    //edge i of a triangle is opposite vertex i, so the edge from vertex 0 to 1 is edge 2
+    for (uint j = 1; j + 1 < n; j++) {
+        const ClipVertex *v[3] = {&polygon[0], &polygon[j], &polygon[j + 1]};
+        uint faceEdges = 0;
+        if (j == 1 && polygon[0].edge) faceEdges |= 4;
+        if (polygon[j].edge) faceEdges |= 1;
+        if (j + 2 == n && polygon[j + 1].edge) faceEdges |= 2;
+
+        out.resize(out.size() + 1);
+        if (!setupProjected(v, faceEdges, m_width, m_height, out.back()))
+            out.pop_back();
+    }
+}
+
+const RasterTriangle &Rasterizer::getTriangle(uint id) const {
+    return m_chunks[id >> RASTER_ID_BITS].triangles[id & ((1 << RASTER_ID_BITS) - 1)];
+}
+
+void Rasterizer::renderTiles(QAtomicInt *next) {
+    TRACE_SCOPE("Rasterizer::renderTiles");
+    TileBuffers *tile = new TileBuffers;
+    uint numTiles = m_tilesX * m_tilesY;
+
+    for (uint i = next->fetchAndAddOrdered(1); i < numTiles; i = next->fetchAndAddOrdered(1)) {
+        int tileX = i % m_tilesX * RASTER_TILE_SIZE;
+        int tileY = i / m_tilesX * RASTER_TILE_SIZE;
+
+        std::fill(tile->depth, tile->depth + TILE_PIXELS, 1.0f);
+        std::fill(tile->ids, tile->ids + TILE_PIXELS, RASTER_NO_TRIANGLE);
+        std::fill(tile->blockZMax, tile->blockZMax + TILE_BLOCKS * TILE_BLOCKS, 1.0f);
+        tile->zMax = 1;
+        tile->zMaxStale = false;
+
+        //the chunks hold the triangles in the order they were added, which decides ties in depth
+        for (uint c = 0; c < m_numChunks; c++) {
+            const RasterChunk &chunk = m_chunks[c];
+            for (uint k = chunk.tileStarts[i]; k < chunk.tileStarts[i + 1]; k++) {
+                uint index = chunk.tileTriangles[k];
+                const RasterTriangle &t = chunk.triangles[index];
+
+                if (tile->zMaxStale) {
+                    tile->zMax = *std::max_element(tile->blockZMax, tile->blockZMax + TILE_BLOCKS * TILE_BLOCKS);
+                    tile->zMaxStale = false;
+                }
+                if (t.zMin >= tile->zMax) continue;
+
+                rasterizeTriangle(t, c << RASTER_ID_BITS | index, tileX, tileY, *tile);
+            }
+        }
+
+        shadeTile(tileX, tileY, *tile);
+    }
+
+    delete tile;
+}
+
+void Rasterizer::rasterizeTriangle(const RasterTriangle &t, uint id, int tileX, int tileY, TileBuffers &tile) const {
+    int x0 = qMax(t.minX - tileX, 0), x1 = qMin(t.maxX - tileX, RASTER_TILE_SIZE - 1);
+    int y0 = qMax(t.minY - tileY, 0), y1 = qMin(t.maxY - tileY, RASTER_TILE_SIZE - 1);
+    if (x0 > x1 || y0 > y1) return;
+
+    //edges alone keep only the pixels near a face edge
+    bool edges = m_shading == RASTER_EDGES;
+    const Float4 all = laneMask(true);
+    const Float4 none = laneMask(false);
+
+    //the edge functions at the center of the first pixel of the tile, in double so they are exact
+    //before rounding, which then comes out the same for both triangles along an edge
+    float e[3];
+    Float4 a[3], b[3], owns[3], face[3], invLength[3];
+    for (uint i = 0; i < 3; i++) {
+        e[i] = (float)(t.a[i] * (tileX + 0.5 - t.x0[i]) + t.b[i] * (tileY + 0.5 - t.y0[i]));
+        a[i] = t.a[i];
+        b[i] = t.b[i];
+        owns[i] = t.owns & (1 << i) ? all : none;
+        face[i] = t.faceEdges & (1 << i) ? all : none;
+        invLength[i] = t.invLength[i];
+    }
+    Float4 z0(t.z[0]), z1(t.z[1]), z2(t.z[2]);
+    Float4 invArea(t.invArea);
+
+    for (int by = y0 / RASTER_BLOCK_SIZE; by <= y1 / RASTER_BLOCK_SIZE; by++) {
+        for (int bx = x0 / RASTER_BLOCK_SIZE; bx <= x1 / RASTER_BLOCK_SIZE; bx++) {
+            float &blockZMax = tile.blockZMax[by * TILE_BLOCKS + bx];
+            if (t.zMin >= blockZMax) continue;
+            int px = bx * RASTER_BLOCK_SIZE, py = by * RASTER_BLOCK_SIZE;
+
+            //the edge functions are linear, so their extremes over the block are at its corners
+            //the margin keeps rounding from deciding what the quads would decide otherwise
+            bool outside = false, inside = !edges;
+            for (uint i = 0; i < 3; i++) {
+                float corner = e[i] + t.a[i] * px + t.b[i] * py;
+                float dx = t.a[i] * (RASTER_BLOCK_SIZE - 1), dy = t.b[i] * (RASTER_BLOCK_SIZE - 1);
+                float margin = (fabsf(corner) + fabsf(dx) + fabsf(dy)) * 1E-5f;
+                if (corner + qMax(dx, 0.0f) + qMax(dy, 0.0f) < -margin) outside = true;
+                if (corner + qMin(dx, 0.0f) + qMin(dy, 0.0f) <= margin) inside = false;
+            }
+            if (outside) continue;
+
+            bool written = false;
+            for (int qy = py; qy < py + RASTER_BLOCK_SIZE; qy += 2) {
+                for (int qx = px; qx < px + RASTER_BLOCK_SIZE; qx += 2) {
+                    Float4 fx = Float4((float)qx) + laneX();
+                    Float4 fy = Float4((float)qy) + laneY();
+                    Float4 e0 = Float4(e[0]) + a[0] * fx + b[0] * fy;
+                    Float4 e1 = Float4(e[1]) + a[1] * fx + b[1] * fy;
+                    Float4 e2 = Float4(e[2]) + a[2] * fx + b[2] * fy;
+
+                    Float4 mask = inside ? all : covered(e0, owns[0]) & covered(e1, owns[1]) & covered(e2, owns[2]);
+                    if (edges) {
+                        Float4 wire(RASTER_WIRE_WIDTH);
+                        mask = mask & (((e0 * invLength[0] <= wire) & face[0]) | ((e1 * invLength[1] <= wire) & face[1])
+                                       | ((e2 * invLength[2] <= wire) & face[2]));
+                    }
+                    if (!laneBits(mask)) continue;
+
+                    //depth is linear in the window, so it interpolates without perspective
+                    uint quad = (qy / 2) * TILE_QUADS + qx / 2;
+                    float *depth = &tile.depth[4 * quad];
+                    Float4 z = (e0 * z0 + e1 * z1 + e2 * z2) * invArea;
+                    Float4 d = Float4::load(depth);
+                    Float4 pass = mask & (z < d);
+                    int bits = laneBits(pass);
+                    if (!bits) continue;
+
+                    select(pass, z, d).store(depth);
+                    for (uint lane = 0; lane < 4; lane++)
+                        if (bits & (1 << lane)) tile.ids[4 * quad + lane] = id;
+                    written = true;
+                }
+            }
+
+            //a block the triangle covers holds nothing farther than it any more
+            if (inside && written) {
+                Float4 farthest(0.0f);
+                for (int qy = py; qy < py + RASTER_BLOCK_SIZE; qy += 2)
+                    for (int qx = px; qx < px + RASTER_BLOCK_SIZE; qx += 2)
+                        farthest = max4(farthest, Float4::load(&tile.depth[4 * ((qy / 2) * TILE_QUADS + qx / 2)]));
+                float lanes[4];
+                farthest.store(lanes);
+                blockZMax = qMax(qMax(lanes[0], lanes[1]), qMax(lanes[2], lanes[3]));
+                tile.zMaxStale = true;
+            }
+        }
+    }
+}
+
+void Rasterizer::shadeTile(int tileX, int tileY, const TileBuffers &tile) {
+    bool lit = m_shading != RASTER_EDGES;
+    bool specular = m_shading == RASTER_PHONG;
+    bool wire = m_shading == RASTER_DIFFUSE_EDGES;
+    float ambientScale = specular ? RASTER_PHONG_AMBIENT : RASTER_DEFAULT_AMBIENT;
+    float diffuseScale = specular ? 1 : RASTER_DEFAULT_DIFFUSE;
+
+    int width = qMin(RASTER_TILE_SIZE, m_width - tileX);
+    int height = qMin(RASTER_TILE_SIZE, m_height - tileY);
+    for (int qy = 0; qy < height; qy += 2) {
+        for (int qx = 0; qx < width; qx += 2) {
+            uint quad = (qy / 2) * TILE_QUADS + qx / 2;
+            const uint *ids = &tile.ids[4 * quad];
+
+            //lanes without a triangle are shaded with one of the others and left out
+            const RasterTriangle *t[4] = {0, 0, 0, 0};
+            const RasterTriangle *first = 0;
+            int valid = 0;
+            for (uint lane = 0; lane < 4; lane++) {
+                if (ids[lane] == RASTER_NO_TRIANGLE) continue;
+                t[lane] = &getTriangle(ids[lane]);
+                if (!first) first = t[lane];
+                valid |= 1 << lane;
+            }
+
+            uint pixels[4] = {0, 0, 0, 0};
+            if (valid) {
+                for (uint lane = 0; lane < 4; lane++)
+                    if (!t[lane]) t[lane] = first;
+
+                //barycentric coordinates from the edge functions at the pixel centers, with perspective
+                Float4 x = Float4((float)(tileX + qx) + 0.5f) + laneX();
+                Float4 y = Float4((float)(tileY + qy) + 0.5f) + laneY();
+                Float4 weight[3];
+                Float4 sum(0.0f);
+                Float4 nearest(FLT_MAX);
+                for (uint i = 0; i < 3; i++) {
+                    Float4 e = gather(t, &RasterTriangle::a, i) * (x - gather(t, &RasterTriangle::x0, i))
+                               + gather(t, &RasterTriangle::b, i) * (y - gather(t, &RasterTriangle::y0, i));
+                    if (wire) {
+                        Float4 face(laneMask(t[0]->faceEdges & (1 << i)), laneMask(t[1]->faceEdges & (1 << i)),
+                                    laneMask(t[2]->faceEdges & (1 << i)), laneMask(t[3]->faceEdges & (1 << i)));
+                        nearest = min4(nearest, select(face, e * gather(t, &RasterTriangle::invLength, i), FLT_MAX));
+                    }
+                    weight[i] = e * gather(t, &RasterTriangle::invArea) * gather(t, &RasterTriangle::invW, i);
+                    sum = sum + weight[i];
+                }
+                Float4 invSum = Float4(1.0f) / sum;
+                for (uint i = 0; i < 3; i++) weight[i] = weight[i] * invSum;
+
+                Float4 r(1.0f), g(1.0f), b(1.0f);
+                if (lit) {
+                    Float4 p[3], n[3];
+                    for (uint k = 0; k < 3; k++) {
+                        p[k] = weight[0] * gather(t, &RasterTriangle::position, 0, k)
+                               + weight[1] * gather(t, &RasterTriangle::position, 1, k)
+                               + weight[2] * gather(t, &RasterTriangle::position, 2, k);
+                        n[k] = weight[0] * gather(t, &RasterTriangle::normal, 0, k)
+                               + weight[1] * gather(t, &RasterTriangle::normal, 1, k)
+                               + weight[2] * gather(t, &RasterTriangle::normal, 2, k);
+                    }
+                    Float4 invN = Float4(1.0f) / max4(sqrt4(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]), 1E-20f);
+                    for (uint k = 0; k < 3; k++) n[k] = n[k] * invN;
+
+                    //the eye is at the origin of eye space
+                    Float4 v[3];
+                    if (specular) {
+                        Float4 invV = Float4(-1.0f) / max4(sqrt4(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]), 1E-20f);
+                        for (uint k = 0; k < 3; k++) v[k] = p[k] * invV;
+                    }
+
+                    r = g = b = RASTER_SCENE_COLOR;
+                    for (uint i = 0; i < m_lights.size(); i++) {
+                        const RasterLight &light = m_lights[i];
+                        Float4 l[3];
+                        for (uint k = 0; k < 3; k++)
+                            l[k] = Float4(light.position[k]) - Float4(light.position[3]) * p[k];
+                        Float4 invL = Float4(1.0f) / max4(sqrt4(l[0]*l[0] + l[1]*l[1] + l[2]*l[2]), 1E-20f);
+                        for (uint k = 0; k < 3; k++) l[k] = l[k] * invL;
+
+                        Float4 nDotL = n[0]*l[0] + n[1]*l[1] + n[2]*l[2];
+                        Float4 diffuse = max4(nDotL, 0.0f);
+                        r = r + Float4(ambientScale * light.ambient[0]) + Float4(diffuseScale * light.diffuse[0]) * diffuse;
+                        g = g + Float4(ambientScale * light.ambient[1]) + Float4(diffuseScale * light.diffuse[1]) * diffuse;
+                        b = b + Float4(ambientScale * light.ambient[2]) + Float4(diffuseScale * light.diffuse[2]) * diffuse;
+
+                        //the light reflected about the normal, to the power of 32 by squaring 5 times
+                        if (specular) {
+                            Float4 twice = nDotL * 2.0f;
+                            Float4 rDotV = (n[0]*twice - l[0]) * v[0] + (n[1]*twice - l[1]) * v[1]
+                                           + (n[2]*twice - l[2]) * v[2];
+                            Float4 s = max4(rDotV, 0.0f);
+                            for (uint k = 0; k < 5; k++) s = s * s;
+                            r = r + Float4(light.specular[0]) * s;
+                            g = g + Float4(light.specular[1]) * s;
+                            b = b + Float4(light.specular[2]) * s;
+                        }
+                    }
+                }
+
+                //blend the edges over the faces as the wire shader does, with a pixel of falloff
+                if (wire) {
+                    Float4 coverage = Float4(1.0f) - clamp01(nearest - 0.5f * RASTER_WIRE_WIDTH);
+                    Float4 color(RASTER_WIRE_COLOR);
+                    r = r + (color - r) * coverage;
+                    g = g + (color - g) * coverage;
+                    b = b + (color - b) * coverage;
+                }
+
+                storePixels(r, g, b, pixels);
+            }
+
+            for (uint lane = 0; lane < 4; lane++) {
+                int x = tileX + qx + (lane & 1), y = tileY + qy + (lane >> 1);
+                if (x < m_width && y < m_height)
+                    m_pixels[(size_t)y * m_width + x] = valid & (1 << lane) ? pixels[lane] : 0;
+            }
+        }
+    }
+}
+
+const uint *Rasterizer::getPixels() const { return m_pixels.empty() ? 0 : &m_pixels[0]; }
+uint Rasterizer::getNumTriangles() const { return m_numTriangles; }
+double Rasterizer::getSetupMs() const { return m_setupMs; }
+double Rasterizer::getTileMs() const { return m_tileMs; }
@@ -0,0 +1,166 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include <vector>
+
+#include "matrix.h"
+#include "vector.h"
+
+using namespace std;
+
+class QAtomicInt;
+
+//pixels on a side of the tiles the screen is split into, and of the blocks within them that keep depth bounds
+#define RASTER_TILE_SIZE 64
+#define RASTER_BLOCK_SIZE 8
+
+#define RASTER_MAX_LIGHTS 8
+
+//a light in eye space, the w of the position is 0 for directional lights
+struct RasterLight {
+    Vector4f position;
+    Vector3f ambient;
+    Vector3f diffuse;
+    Vector3f specular;
+};
+
+//how the covered pixels are colored
+enum RasterShading {
+    RASTER_DIFFUSE,         //ambient and diffuse light of the default material
+    RASTER_PHONG,           //the lighting of the Phong shaders, with specular highlights
+    RASTER_EDGES,           //the edges of the faces in white, nothing of their insides
+    RASTER_DIFFUSE_EDGES    //diffuse shading with the edges of the faces blended over it
+};
+
+//a triangle after clipping and projection, with what the tiles need to rasterize and shade it
+//edge i is opposite vertex i, a (x - x0) + b (y - y0) is positive inside it and 0 on it
+struct RasterTriangle {
+    float a[3], b[3];
+    float x0[3], y0[3];     //the same end of an edge for both triangles sharing it, so they compute it alike
+    float invLength[3];     //1 / |(a, b)|, turns the edge functions into distances in pixels
+    float invArea;          //1 / twice the area, the barycentric coordinate of vertex i is its edge function times this
+    float z[3];             //window depth of the vertices, 0 at the near plane and 1 at the far plane
+    float invW[3];          //for attributes interpolated with perspective
+    float zMin, zMax;
+    int minX, minY, maxX, maxY;     //pixel bounds, inclusive and within the view
+    uint owns;              //bit i is set if pixel centers on edge i belong to this triangle, by the top-left rule
+    uint faceEdges;         //bit i is set if edge i is an edge of a face rather than of the triangulation
+    Vector3f position[3];   //eye space
+    Vector3f normal[3];
+};
+
+//triangles added by one call, whose vertex arrays are read when the frame ends
+struct RasterDraw {
+    const char *positions;
+    const char *normals;
+    const char *edgeFlags;
+    uint stride;
+    uint numTriangles;
+    uint firstModelView;
+    uint copies;
+};
+
+//triangles set up by one task, binned by the tiles they overlap in the order they were added
+struct RasterChunk {
+    uint first;     //of the triangles of all draws and copies in order
+    uint count;
+    vector<RasterTriangle> triangles;
+    vector<uint> tileStarts;        //tileTriangles[tileStarts[i]] to tileTriangles[tileStarts[i+1]] overlap tile i
+    vector<uint> tileTriangles;
+};
+
+/* Multithreaded tile-based software rasterizer. Triangles are transformed,
+   clipped and set up in chunks on every core, and each chunk bins its
+   triangles by the screen tiles they overlap. The tiles are then claimed by
+   the threads one at a time from a shared counter. A tile rasterizes the
+   triangles of the chunks in order with edge functions evaluated for 2x2
+   pixel quads at once, keeping a depth and triangle for every pixel; blocks
+   of 8x8 pixels keep the farthest depth in them, so triangles behind what a
+   block already holds are rejected without testing their pixels. Once every
+   triangle is in, the visible pixels are shaded a quad at a time with
+   attributes interpolated with perspective.
+
+   Vertices are snapped to sixteenths of a pixel and the edge functions are
+   set up in double precision for each tile, so the pixels along an edge
+   shared by two triangles belong to exactly one of them. Triangles are
+   clipped to the near and far planes and to a guard band around the view,
+   and are drawn whichever way they face.*/
+class Rasterizer {
+public:
+    Rasterizer();
+
+    //sets the number of threads, 0 uses one per core
+    void setNumThreads(int threads);
+    uint getNumThreads() const;
+
+    void resize(int width, int height);
+    int getWidth() const;
+    int getHeight() const;
+
+    //set how the following frames are projected and lit
+    void setProjection(const Matrix4f &projection);
+    void setLights(const vector<RasterLight> &lights);
+    void setShading(RasterShading shading);
+
+    //starts a frame, dropping the triangles of the last one
+    void begin();
+
+    //adds a copy of triangles of 3 consecutive vertices for each model-view matrix
+    //the edge flag of a vertex marks the edge to the next vertex of the triangle as a face edge, as glEdgeFlagPointer
+    //the arrays are read when the frame ends and must stay valid until then
+    void addTriangles(const Vector3f *positions, const Vector3f *normals, const unsigned char *edgeFlags, uint stride,
+                      uint numVertices, const Matrix4f *modelViews, uint copies);
+
+    //sets up, bins, rasterizes and shades the triangles added since the frame began
+    void end();
+
+    //returns the pixels of the last frame as RGBA bytes, rows from the bottom up as glDrawPixels takes them
+    const uint *getPixels() const;
+
+    //returns the triangles left after clipping and culling in the last frame
+    uint getNumTriangles() const;
+
+    //returns the milliseconds the setup and the tiles of the last frame took
+    double getSetupMs() const;
+    double getTileMs() const;
+
+private:
+    struct TileBuffers;
+
+    //set up chunks, then rasterize and shade tiles, claimed from the counter until none are left
+    void setupChunks(QAtomicInt *next);
+    void renderTiles(QAtomicInt *next);
+
+    //transforms, clips and sets up triangle i of a draw for one of its copies
+    void setupTriangle(const RasterDraw &draw, uint copy, uint i, vector<RasterTriangle> &out) const;
+
+    void rasterizeTriangle(const RasterTriangle &t, uint id, int tileX, int tileY, TileBuffers &tile) const;
+    void shadeTile(int tileX, int tileY, const TileBuffers &tile);
+
+    const RasterTriangle &getTriangle(uint id) const;
+
+    int m_width;
+    int m_height;
+    int m_tilesX;
+    int m_tilesY;
+    int m_numThreads;
+
+    Matrix4f m_projection;
+    vector<RasterLight> m_lights;
+    RasterShading m_shading;
+
+    vector<RasterDraw> m_draws;
+    vector<Matrix4f> m_modelViews;
+
+    //chunks keep their arrays between frames, only the first m_numChunks are used
+    vector<RasterChunk> m_chunks;
+    uint m_numChunks;
+
+    vector<uint> m_pixels;
+
+    uint m_numTriangles;
+    double m_setupMs;
+    double m_tileMs;
+};
+
+#endif // RASTERIZER_H
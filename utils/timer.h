@@ -0,0 +1,34 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <time.h>
+
+//a monotonic wall clock timer with sub-millisecond resolution
+class Timer {
+public:
+    Timer() {
+        start();
+    }
+
+    //restarts the timer
+    void start() {
+        m_start = now();
+    }
+
+    //returns the time elapsed since the timer was started in milliseconds
+    double elapsed() const {
+        return (now() - m_start) * 1000.0;
+    }
+
+    //returns the current time of the monotonic clock in seconds
+    static double now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1E-9;
+    }
+
+protected:
+    double m_start;
+};
+
+#endif // TIMER_H
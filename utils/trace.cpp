@@ -0,0 +1,184 @@
+#include "trace.h"
+
+#ifdef VIEWER_TRACING
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThreadStorage>
+
+#include <vector>
+
+#include "timer.h"
+
+#define TRACE_CHUNK_SIZE 4096
+
+struct TraceEvent {
+    const char *name;
+    char phase;         //'X' for zones, 'C' for counters
+    double timestamp;   //start of the event in microseconds
+    double value;       //duration of a zone or value of a counter
+};
+
+//a block of events that is only written by the thread owning it
+//events are published to readers by incrementing count
+struct TraceChunk {
+    TraceChunk() : count(0), next(0) {}
+
+    TraceEvent events[TRACE_CHUNK_SIZE];
+    QAtomicInt count;
+    QAtomicPointer<TraceChunk> next;
+};
+
+//the chain of event chunks of one thread
+//the chunks are recorded since clear was called generation times, older ones are freed by the owning thread
+struct TraceBuffer {
+    uint threadId;
+    int generation;
+    TraceChunk *head;
+    TraceChunk *tail;   //only accessed by the owning thread
+};
+
+//thread local handle to a buffer, the buffer itself is kept after the thread
+//exits so its events can still be saved
+struct TraceThread {
+    TraceBuffer *buffer;
+};
+
+volatile bool Trace::s_enabled = false;
+
+static const double s_startTime = Timer::now();
+static QAtomicInt s_generation(0);
+
+static QThreadStorage<TraceThread*> s_threads;
+static QMutex s_buffersMutex;
+static std::vector<TraceBuffer*> s_buffers;
+
+//returns the buffer of the calling thread, registering it on first use
+static TraceBuffer *threadBuffer() {
+    if (!s_threads.hasLocalData()) {
+        TraceBuffer *buffer = new TraceBuffer;
+        buffer->head = buffer->tail = new TraceChunk;
+
+        QMutexLocker locker(&s_buffersMutex);
+        buffer->generation = s_generation.fetchAndAddAcquire(0);
+        buffer->threadId = s_buffers.size() + 1;
+        s_buffers.push_back(buffer);
+
+        TraceThread *thread = new TraceThread;
+        thread->buffer = buffer;
+        s_threads.setLocalData(thread);
+    }
+
+    return s_threads.localData()->buffer;
+}
+
+//frees the chunks of the calling thread recorded before the last clear
+//saving reads the chunks of every thread under the lock, so they are only freed while holding it
+static void resetBuffer(TraceBuffer *buffer) {
+    QMutexLocker locker(&s_buffersMutex);
+    for (TraceChunk *chunk = buffer->head; chunk;) {
+        TraceChunk *next = chunk->next.fetchAndAddAcquire(0);
+        delete chunk;
+        chunk = next;
+    }
+    buffer->head = buffer->tail = new TraceChunk;
+    buffer->generation = s_generation.fetchAndAddAcquire(0);
+}
+
+//appends an event to the buffer of the calling thread
+static void record(const char *name, char phase, double timestamp, double value) {
+    TraceBuffer *buffer = threadBuffer();
+    if (buffer->generation != s_generation.fetchAndAddAcquire(0))
+        resetBuffer(buffer);
+    TraceChunk *chunk = buffer->tail;
+    int n = chunk->count.fetchAndAddAcquire(0);
+
+    //start a new chunk when the current one is full
+    if (n == TRACE_CHUNK_SIZE) {
+        TraceChunk *next = new TraceChunk;
+        chunk->next.fetchAndStoreRelease(next);
+        buffer->tail = chunk = next;
+        n = 0;
+    }
+
+    TraceEvent &e = chunk->events[n];
+    e.name = name;
+    e.phase = phase;
+    e.timestamp = timestamp;
+    e.value = value;
+    chunk->count.fetchAndStoreRelease(n + 1);
+}
+
+//escapes a string for use in JSON
+static QString escape(const char *name) {
+    QString s(name);
+    s.replace("\\", "\\\\");
+    s.replace("\"", "\\\"");
+    return s;
+}
+
+void Trace::setEnabled(bool enabled) {
+    s_enabled = enabled;
+}
+
+void Trace::zone(const char *name, double start, double duration) {
+    record(name, 'X', start, duration);
+}
+
+void Trace::counter(const char *name, double value) {
+    record(name, 'C', now(), value);
+}
+
+double Trace::now() {
+    return (Timer::now() - s_startTime) * 1E6;
+}
+
+void Trace::clear() {
+    //threads may be writing their chunks, so each frees its own when it next records
+    //until then, saving skips them
+    s_generation.fetchAndAddOrdered(1);
+}
+
+bool Trace::save(QString filename) {
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate))
+        return false;
+
+    QTextStream out(&file);
+    out << "{\"traceEvents\":[\n";
+
+    QMutexLocker locker(&s_buffersMutex);
+    bool first = true;
+    for (uint i = 0; i < s_buffers.size(); i++) {
+        TraceBuffer *buffer = s_buffers[i];
+        if (buffer->generation != s_generation.fetchAndAddAcquire(0)) continue;
+
+        for (TraceChunk *chunk = buffer->head; chunk; chunk = chunk->next.fetchAndAddAcquire(0)) {
+            int count = chunk->count.fetchAndAddAcquire(0);
+
+            for (int j = 0; j < count; j++) {
+                const TraceEvent &e = chunk->events[j];
+                if (!first) out << ",\n";
+                first = false;
+
+                out << "{\"name\":\"" << escape(e.name) << "\",\"ph\":\"" << e.phase << "\""
+                    << ",\"pid\":1,\"tid\":" << buffer->threadId
+                    << ",\"ts\":" << QString::number(e.timestamp, 'f', 3);
+
+                if (e.phase == 'X')
+                    out << ",\"dur\":" << QString::number(e.value, 'f', 3) << "}";
+                else
+                    out << ",\"args\":{\"value\":" << QString::number(e.value, 'f', 3) << "}}";
+            }
+        }
+    }
+
+    out << "\n]}\n";
+    return true;
+}
+
+#endif // VIEWER_TRACING
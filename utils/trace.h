@@ -0,0 +1,72 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Lightweight scoped tracing. Zones and counters are recorded into per-thread
+   buffers without locking and can be saved as Chrome trace JSON (load the file
+   in chrome://tracing). Tracing is compiled in with DEFINES += VIEWER_TRACING
+   (qmake CONFIG+=tracing) and is switched off at runtime until enabled.
+   When compiled out, the macros expand to nothing.*/
+
+#ifdef VIEWER_TRACING
+
+#include <QString>
+
+#define TRACE_CONCAT_(a,b) a##b
+#define TRACE_CONCAT(a,b) TRACE_CONCAT_(a,b)
+
+//records a zone named name from this line until the end of the enclosing scope
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+//records the value of a counter named name
+#define TRACE_COUNTER(name, value) \
+    do { if (Trace::isEnabled()) Trace::counter(name, (double)(value)); } while (0)
+
+class Trace {
+public:
+    //switches recording on or off
+    static void setEnabled(bool enabled);
+    static bool isEnabled() { return s_enabled; }
+
+    //records a complete zone, start and duration are in microseconds
+    static void zone(const char *name, double start, double duration);
+
+    //records a counter value
+    static void counter(const char *name, double value);
+
+    //returns the time since tracing started in microseconds
+    static double now();
+
+    //writes all recorded events to a Chrome trace JSON file, returns false on failure
+    static bool save(QString filename);
+
+    //discards all recorded events, each thread frees the memory of its events the next time it records one
+    static void clear();
+
+private:
+    static volatile bool s_enabled;
+};
+
+//records a zone for the lifetime of the object
+class TraceScope {
+public:
+    TraceScope(const char *name) : m_name(Trace::isEnabled() ? name : 0), m_start(0) {
+        if (m_name) m_start = Trace::now();
+    }
+
+    ~TraceScope() {
+        if (m_name) Trace::zone(m_name, m_start, Trace::now() - m_start);
+    }
+
+private:
+    const char *m_name;
+    double m_start;
+};
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_COUNTER(name, value) do {} while (0)
+
+#endif // VIEWER_TRACING
+
+#endif // TRACE_H
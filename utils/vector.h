@@ -5,50 +5,25 @@
 
 typedef unsigned int uint;
 
+//4 element float and int vectors are aligned to 16 bytes so they can be loaded as one SIMD register
+#ifdef __GNUC__
+#define VECTOR_ALIGN(T,N) __attribute__((aligned(N == 4 && sizeof(T) == 4 ? 16 : __alignof__(T))))
+#else
+#define VECTOR_ALIGN(T,N)
+#endif
+
 //represents a vector of size N consisting of elements of type T
+//the elements are stored contiguously with nothing else, so vectors can be copied
+//with memcpy and arrays of them passed directly to OpenGL
 template <typename T, uint N>
 class Vector {
 public:
-    /*Vector() {
-        this->zero();
-        init(0,0,0,0);
-    }*/
-
-    Vector(const Vector<T,N> &v)
-        : x(N >= 1 ? data[0] : voidRef), y(N >= 1 ? data[1] : voidRef),
-          z(N >= 1 ? data[2] : voidRef), w(N >= 1 ? data[3] : voidRef)
-    {
-        init(v.x, v.y, v.z, v.w);
-        for (uint i = 4; i < N; i++)
-            this->data[i] = v.data[i];
-
-    }
-/*
-    Vector(T x, T y)
-        : x(data[0]), y(data[0]), z(voidRef), w(voidRef)
-    {
-        this->zero();
-        Vector(x,y,0,0);
-        init(x,y,0,0);
-    }
-
-    Vector(T x, T y, T z)
-        : x(data[0]), y(data[0]), z(data[2])
-    {
-        this->zero();
-        init(x,y,z,0);
-    }
-*/
-    Vector(T x=0, T y=0, T z=0, T w=0)
-        : x(N >= 1 ? data[0] : voidRef), y(N >= 1 ? data[1] : voidRef),
-          z(N >= 1 ? data[2] : voidRef), w(N >= 1 ? data[3] : voidRef)
-    {
-        this->zero();
+    Vector(T x=0, T y=0, T z=0, T w=0) {
+        zero();
         init(x,y,z,w);
     }
 
     void init(T x, T y, T z, T w) {
-        voidRef = 0;
         if (N >= 1) data[0] = x;
         if (N >= 2) data[1] = y;
         if (N >= 3) data[2] = z;
@@ -72,11 +47,11 @@ public:
     }
 
     //returns the unit vector of this vector
-    Vector<T,N> unit() {
+    Vector<T,N> unit() const {
         Vector<T,N> result;
         double mag = magnitude();
         for (uint i = 0; i < N; i++) {
-            result[i] = data[i] / mag;
+            result.data[i] = data[i] / mag;
         }
         return result;
     }
@@ -94,21 +69,21 @@ public:
     //returns the cross product with another vector
     Vector<T,N> cross(const Vector<T,N> &v) const {
         Vector<T,N> c;
-        const T (&a)[N] = data;
-        const T (&b)[N] = v.data;
+        const T *a = data;
+        const T *b = v.data;
 
         switch(N) {
         case 1:
-            c[0] = a[0]*b[0];
+            c.data[0] = a[0]*b[0];
             break;
         case 2:
-            c[0] = a[1]*b[0] - a[0]*b[1];
-            c[1] = a[0]*b[0] - a[0]*b[0];
+            c.data[0] = a[1]*b[0] - a[0]*b[1];
             break;
         case 3:
-            c[0] = a[1]*b[2] - a[2]*b[1];
-            c[1] = a[2]*b[0] - a[0]*b[2];
-            c[2] = a[0]*b[1] - a[1]*b[0];
+            c.data[0] = a[1]*b[2] - a[2]*b[1];
+            c.data[1] = a[2]*b[0] - a[0]*b[2];
+            c.data[2] = a[0]*b[1] - a[1]*b[0];
+            break;
         default:
             //TODO: implement general cross product function
             break;
@@ -124,6 +99,17 @@ public:
         return 0;
     }
 
+    //named accessors of the 1st, 2nd, 3rd, 4th elements respectively
+    T& x() { return data[0]; }
+    T& y() { return data[N >= 2 ? 1 : 0]; }
+    T& z() { return data[N >= 3 ? 2 : 0]; }
+    T& w() { return data[N >= 4 ? 3 : 0]; }
+
+    T x() const { return get(0); }
+    T y() const { return get(1); }
+    T z() const { return get(2); }
+    T w() const { return get(3); }
+
     //vector subtraction
     Vector<T,N> operator-(const Vector<T,N> &v) const {
         Vector<T,N> result;
@@ -141,7 +127,7 @@ public:
     }
 
     //vector scalar multiplication
-    Vector<T,N> operator*(T scalar) {
+    Vector<T,N> operator*(T scalar) const {
         Vector<T,N> result;
         for (uint i = 0; i < N; i++)
             result.data[i] = data[i] * scalar;
@@ -149,22 +135,13 @@ public:
     }
 
     //vector scalar division
-    Vector<T,N> operator/(T scalar) {
+    Vector<T,N> operator/(T scalar) const {
         Vector<T,N> result;
         for (uint i = 0; i < N; i++)
             result.data[i] = data[i] / scalar;
         return result;
     }
 
-    //vector assignment
-    Vector<T,N>& operator=(const Vector<T,N> &v) {
-        if (this != &v) {
-            for (uint i = 0; i < N; i++)
-                data[i] = v.data[i];
-        }
-        return *this;
-    }
-
     //vector element-wise comparison
     bool operator==(const Vector<T,N> &v) const {
         for (uint i = 0; i < N; i++)
@@ -192,16 +169,16 @@ public:
         return this->data[i];
     }
 
-public:
-    //convenience references to the 1st, 2nd, 3rd, 4th elements respetively
-    T &x;
-    T &y;
-    T &z;
-    T &w;
+    const T& operator[](uint i) const {
+        return this->data[i];
+    }
+
+    //returns the elements as an array, e.g. for glVertex3fv
+    T *ptr() { return data; }
+    const T *ptr() const { return data; }
 
 protected:
-    T data[N];
-    T voidRef; //referenced by x,y,z, or w if N is less than 4
+    T data[N] VECTOR_ALIGN(T,N);
 };
 
 //typedefs for convenience
@@ -217,4 +194,8 @@ typedef Vector<int, 4> Vector4i;
 typedef Vector<float, 4> Vector4f;
 typedef Vector<double, 4> Vector4d;
 
+//compile time checks that vectors hold nothing besides their elements
+typedef char Vector3fSizeCheck[sizeof(Vector3f) == 3*sizeof(float) ? 1 : -1];
+typedef char Vector4fSizeCheck[sizeof(Vector4f) == 4*sizeof(float) ? 1 : -1];
+
 #endif // VECTOR_H
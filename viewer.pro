@@ -13,27 +13,72 @@ SOURCES += main.cpp \
     lightdialog.cpp \
     light.cpp \
     openglrenderer.cpp \
+    clusteredrenderer.cpp \
+    softwarerenderer.cpp \
+    shadermanager.cpp \
     scene.cpp \
     cameradialog.cpp \
-    mesh.cpp
+    mesh.cpp \
+    meshloader.cpp \
+    bufferuploader.cpp \
+    stagingbuffer.cpp \
+    benchmark.cpp \
+    mathbenchmark.cpp \
+    utils/trace.cpp \
+    utils/arena.cpp \
+    utils/kernels.cpp \
+    utils/delaunay.cpp \
+    utils/bvh.cpp \
+    utils/decimator.cpp \
+    utils/rasterizer.cpp
 HEADERS += mainwindow.h \
     glwidget.h \
     utils/matrix.h \
     utils/vector.h \
     utils/glutils.h \
     utils/pointutils.h \
+    utils/timer.h \
+    utils/trace.h \
+    utils/arena.h \
+    utils/kernels.h \
+    utils/delaunay.h \
+    utils/bvh.h \
+    utils/decimator.h \
+    utils/rasterizer.h \
     camera.h \
     lightdialog.h \
     light.h \
     types.h \
     openglrenderer.h \
+    clusteredrenderer.h \
+    softwarerenderer.h \
+    shadermanager.h \
     renderer.h \
     scene.h \
     cameradialog.h \
-    mesh.h
+    mesh.h \
+    meshloader.h \
+    bufferuploader.h \
+    stagingbuffer.h \
+    benchmark.h \
+    mathbenchmark.h
+
+# qmake CONFIG+=tracing compiles in the scoped tracing instrumentation
+tracing {
+    DEFINES += VIEWER_TRACING
+}
+
 FORMS += lightdialog.ui \
     cameradialog.ui
 
+# the shaders are built into the executable
+RESOURCES += shaders.qrc
+
 OTHER_FILES += \
     phong.vsh \
-    phong.fsh
+    phong.fsh \
+    phong_instanced.vsh \
+    instanced.vsh \
+    instanced.fsh \
+    wire.fsh \
+    clustered.fsh